@@ -22,6 +22,7 @@
 #include "util/common-utils.h"
 #include "hmm/transition-model.h"
 #include "nnet3/nnet-chain-example.h"
+#include "nnet3/nnet-example-compact.h"
 
 
 int main(int argc, char *argv[]) {
@@ -34,7 +35,8 @@ int main(int argc, char *argv[]) {
     const char *usage =
         "This copies nnet3+chain training examples from input to output, merging them\n"
         "into composite examples.  The --minibatch-size option controls how many egs\n"
-        "are merged into a single output eg.\n"
+        "are merged into a single output eg.  The input may also be a compact egs\n"
+        "file (see nnet3-compact-egs --chain) given as compact:<rxfilename>.\n"
         "\n"
         "Usage:  nnet3-chain-merge-egs [options] <egs-rspecifier> <egs-wspecifier>\n"
         "e.g.\n"
@@ -57,7 +59,7 @@ int main(int argc, char *argv[]) {
     std::string examples_rspecifier = po.GetArg(1),
         examples_wspecifier = po.GetArg(2);
 
-    SequentialNnetChainExampleReader example_reader(examples_rspecifier);
+    SequentialNnetChainEgsReader example_reader(examples_rspecifier);
     NnetChainExampleWriter example_writer(examples_wspecifier);
 
     merging_config.ComputeDerived();
@@ -20,6 +20,7 @@
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "nnet3/nnet-chain-training.h"
+#include "nnet3/nnet-example-pipeline.h"
 #include "cudamatrix/cu-allocator.h"
 
 
@@ -34,8 +35,10 @@ int main(int argc, char *argv[]) {
     const char *usage =
         "Train nnet3+chain neural network parameters with backprop and stochastic\n"
         "gradient descent.  Minibatches are to be created by nnet3-chain-merge-egs in\n"
-        "the input pipeline.  This training program is single-threaded (best to\n"
-        "use it with a GPU).\n"
+        "the input pipeline, or by this program if --merge-egs=true (see also\n"
+        "--shuffle-buffer-size).  This training program is single-threaded (best to\n"
+        "use it with a GPU).  The examples may also be read from a compact egs file\n"
+        "(see nnet3-compact-egs --chain) given as compact:<rxfilename>.\n"
         "\n"
         "Usage:  nnet3-chain-train [options] <raw-nnet-in> <denominator-fst-in> <chain-training-examples-in> <raw-nnet-out>\n"
         "\n"
@@ -45,6 +48,7 @@ int main(int argc, char *argv[]) {
     bool binary_write = true;
     std::string use_gpu = "yes";
     NnetChainTrainingOptions opts;
+    ExamplePipelineOptions pipeline_opts("64");  // 64 is default minibatch size.
 
     ParseOptions po(usage);
     po.Register("srand", &srand_seed, "Seed for random number generator ");
@@ -53,6 +57,7 @@ int main(int argc, char *argv[]) {
                 "yes|no|optional|wait, only has effect if compiled with CUDA");
 
     opts.Register(&po);
+    pipeline_opts.Register(&po);
     RegisterCuAllocatorOptions(&po);
 
     po.Read(argc, argv);
@@ -84,7 +89,7 @@ int main(int argc, char *argv[]) {
 
       NnetChainTrainer trainer(opts, den_fst, &nnet);
 
-      SequentialNnetChainExampleReader example_reader(examples_rspecifier);
+      NnetChainExamplePipeline example_reader(pipeline_opts, examples_rspecifier);
 
       for (; !example_reader.Done(); example_reader.Next())
         trainer.Train(example_reader.Value());
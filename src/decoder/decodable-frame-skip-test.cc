@@ -0,0 +1,209 @@
+// decoder/decodable-frame-skip-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/decodable-frame-skip.h"
+#include "decoder/decodable-matrix.h"
+#include "hmm/hmm-test-utils.h"
+#include "tree/context-dep.h"
+
+namespace kaldi {
+
+// Returns a monophone transition model with the default 3-state topology, in
+// which all states have self-loops.
+static TransitionModel *GetToyTransitionModel() {
+  std::vector<int32> phones;
+  phones.push_back(1);
+  phones.push_back(2);
+  std::vector<int32> phone2num_pdf_classes(3, 3);
+  ContextDependency *ctx_dep = MonophoneContextDependency(
+      phones, phone2num_pdf_classes);
+  TransitionModel *trans_model =
+      new TransitionModel(*ctx_dep, GetDefaultTopology(phones));
+  delete ctx_dep;
+  return trans_model;
+}
+
+void UnitTestAllStatesHaveSelfLoops() {
+  TransitionModel *trans_model = GetToyTransitionModel();
+  KALDI_ASSERT(AllStatesHaveSelfLoops(*trans_model));
+  delete trans_model;
+
+  // The first state of this topology has no self-loop.
+  std::string topo_string = "<Topology>\n"
+      "<TopologyEntry>\n"
+      "<ForPhones> 1 </ForPhones>\n"
+      "<State> 0 <PdfClass> 0 <Transition> 1 1.0 </State>\n"
+      "<State> 1 <PdfClass> 1 <Transition> 1 0.5 <Transition> 2 0.5 "
+      "</State>\n"
+      "<State> 2 </State>\n"
+      "</TopologyEntry>\n"
+      "</Topology>\n";
+  HmmTopology topo;
+  std::istringstream is(topo_string);
+  topo.Read(is, false);
+  std::vector<int32> phones(1, 1), phone2num_pdf_classes(2, 2);
+  ContextDependency *ctx_dep = MonophoneContextDependency(
+      phones, phone2num_pdf_classes);
+  TransitionModel no_loop_trans_model(*ctx_dep, topo);
+  KALDI_ASSERT(!AllStatesHaveSelfLoops(no_loop_trans_model));
+  delete ctx_dep;
+}
+
+void UnitTestSelfLoopPdfsMatch() {
+  TransitionModel *trans_model = GetToyTransitionModel();
+  KALDI_ASSERT(SelfLoopPdfsMatch(*trans_model));
+  delete trans_model;
+
+  // The 'chain' topology, whose self-loop has a different pdf-class.
+  std::string topo_string = "<Topology>\n"
+      "<TopologyEntry>\n"
+      "<ForPhones> 1 </ForPhones>\n"
+      "<State> 0 <ForwardPdfClass> 0 <SelfLoopPdfClass> 1 "
+      "<Transition> 0 0.5 <Transition> 1 0.5 </State>\n"
+      "<State> 1 </State>\n"
+      "</TopologyEntry>\n"
+      "</Topology>\n";
+  HmmTopology topo;
+  std::istringstream is(topo_string);
+  topo.Read(is, false);
+  std::vector<int32> phones(1, 1), phone2num_pdf_classes(2, 2);
+  ContextDependency *ctx_dep = MonophoneContextDependency(
+      phones, phone2num_pdf_classes);
+  TransitionModel chain_trans_model(*ctx_dep, topo);
+  KALDI_ASSERT(AllStatesHaveSelfLoops(chain_trans_model) &&
+               !SelfLoopPdfsMatch(chain_trans_model));
+  delete ctx_dep;
+}
+
+void UnitTestDecodableFrameSkip() {
+  TransitionModel *trans_model = GetToyTransitionModel();
+  for (int32 n = 0; n < 10; n++) {
+    FrameSkipOptions opts;
+    opts.max_merged_frames = RandInt(1, 4);
+    opts.merged_frame_scale = RandUniform();
+    opts.self_loop_scale = (RandInt(0, 1) == 0 ? 0.1 : 1.0);
+    opts.reorder = (n % 2 == 0);
+    int32 num_frames = RandInt(1, 20);
+    Matrix<BaseFloat> loglikes(num_frames, trans_model->NumPdfs());
+    loglikes.SetRandn();
+    DecodableMatrixScaledMapped decodable(*trans_model, loglikes, 1.0);
+    // Merging is on a fixed schedule, as merge_threshold < 0.
+    DecodableFrameSkip skip_decodable(opts, &decodable);
+
+    int32 num_merged_frames = skip_decodable.NumFramesReady();
+    KALDI_ASSERT(num_merged_frames ==
+                 (num_frames + opts.max_merged_frames - 1) /
+                 opts.max_merged_frames);
+    KALDI_ASSERT(skip_decodable.IsLastFrame(num_merged_frames - 1));
+
+    // A linear lattice with a random transition-id on each merged frame,
+    // followed by a word.
+    Lattice lat;
+    LatticeArc::StateId cur_state = lat.AddState();
+    lat.SetStart(cur_state);
+    std::vector<int32> tids;
+    double tot_graph_cost = 0.0, tot_acoustic_cost = 0.0;
+    int32 frame = 0;
+    for (int32 m = 0; m < num_merged_frames; m++) {
+      int32 tid = RandInt(1, trans_model->NumTransitionIds()),
+          num_merged = skip_decodable.NumMergedFrames(m);
+      BaseFloat loglike = skip_decodable.LogLikelihood(m, tid),
+          expected_loglike = decodable.LogLikelihood(frame, tid);
+      for (int32 j = 1; j < num_merged; j++)
+        expected_loglike += opts.merged_frame_scale *
+            decodable.LogLikelihood(frame + j, tid);
+      KALDI_ASSERT(ApproxEqual(loglike, expected_loglike));
+      frame += num_merged;
+
+      BaseFloat graph_cost = RandUniform();
+      LatticeArc::StateId next_state = lat.AddState();
+      lat.AddArc(cur_state, LatticeArc(tid, 0,
+                                       LatticeWeight(graph_cost, -loglike),
+                                       next_state));
+      cur_state = next_state;
+      tids.push_back(tid);
+      tot_graph_cost += graph_cost;
+      tot_acoustic_cost += -loglike;
+      // The graph costs of the self-loops that ExpandLattice() should add.
+      int32 self_loop = trans_model->SelfLoopOf(
+          trans_model->TransitionIdToTransitionState(tid));
+      tot_graph_cost += -(num_merged - 1) * opts.self_loop_scale *
+          trans_model->GetTransitionLogProb(self_loop);
+    }
+    KALDI_ASSERT(frame == num_frames);
+    LatticeArc::StateId final_state = lat.AddState();
+    lat.AddArc(cur_state, LatticeArc(0, 1, LatticeWeight::One(),
+                                     final_state));
+    lat.SetFinal(final_state, LatticeWeight::One());
+
+    skip_decodable.ExpandLattice(*trans_model, &lat);
+
+    // Walk the expanded lattice, which should still be linear.
+    std::vector<int32> alignment;
+    int32 num_words = 0;
+    double graph_cost = 0.0, acoustic_cost = 0.0;
+    LatticeArc::StateId s = lat.Start();
+    while (lat.NumArcs(s) != 0) {
+      KALDI_ASSERT(lat.NumArcs(s) == 1);
+      fst::ArcIterator<Lattice> aiter(lat, s);
+      const LatticeArc &arc = aiter.Value();
+      KALDI_ASSERT(arc.nextstate > s);  // it's topologically sorted.
+      if (arc.ilabel != 0)
+        alignment.push_back(arc.ilabel);
+      if (arc.olabel != 0)
+        num_words++;
+      graph_cost += arc.weight.Value1();
+      acoustic_cost += arc.weight.Value2();
+      s = arc.nextstate;
+    }
+    KALDI_ASSERT(lat.Final(s) == LatticeWeight::One());
+    KALDI_ASSERT(num_words == 1 &&
+                 static_cast<int32>(alignment.size()) == num_frames);
+    KALDI_ASSERT(ApproxEqual(graph_cost, tot_graph_cost) &&
+                 ApproxEqual(acoustic_cost, tot_acoustic_cost));
+
+    // Each merged frame becomes its transition-id and the self-loop of the
+    // HMM state of that transition-id, which comes after the transition-id
+    // if opts.reorder is true and before it otherwise.
+    frame = 0;
+    for (int32 m = 0; m < num_merged_frames; m++) {
+      int32 num_merged = skip_decodable.NumMergedFrames(m),
+          self_loop = trans_model->SelfLoopOf(
+              trans_model->TransitionIdToTransitionState(tids[m])),
+          tid_frame = (opts.reorder ? frame : frame + num_merged - 1);
+      for (int32 j = 0; j < num_merged; j++) {
+        if (frame + j == tid_frame)
+          KALDI_ASSERT(alignment[frame + j] == tids[m]);
+        else
+          KALDI_ASSERT(alignment[frame + j] == self_loop);
+      }
+      frame += num_merged;
+    }
+  }
+  delete trans_model;
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  UnitTestAllStatesHaveSelfLoops();
+  UnitTestSelfLoopPdfsMatch();
+  UnitTestDecodableFrameSkip();
+  KALDI_LOG << "Tests succeeded.";
+  return 0;
+}
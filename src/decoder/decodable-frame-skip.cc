@@ -0,0 +1,234 @@
+// decoder/decodable-frame-skip.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <limits>
+
+#include "decoder/decodable-frame-skip.h"
+#include "lat/lattice-functions.h"
+
+namespace kaldi {
+
+DecodableFrameSkip::DecodableFrameSkip(const FrameSkipOptions &opts,
+                                       DecodableInterface *decodable):
+    opts_(opts), decodable_(decodable), loglikes_offset_(0),
+    pending_num_frames_(0) {
+  opts_.Check();
+  KALDI_ASSERT(decodable != NULL);
+  frame_begin_.push_back(0);
+}
+
+void DecodableFrameSkip::GetFrameLoglikes(int32 frame,
+                                          Vector<BaseFloat> *loglikes) const {
+  int32 num_indices = decodable_->NumIndices();
+  loglikes->Resize(num_indices + 1, kUndefined);
+  (*loglikes)(0) = 0.0;
+  for (int32 i = 1; i <= num_indices; i++)
+    (*loglikes)(i) = decodable_->LogLikelihood(frame, i);
+}
+
+void DecodableFrameSkip::FinishPendingFrame() const {
+  KALDI_ASSERT(pending_num_frames_ > 0);
+  loglikes_.push_back(Vector<BaseFloat>());
+  loglikes_.back().Swap(&pending_loglikes_);
+  frame_begin_.push_back(frame_begin_.back() + pending_num_frames_);
+  pending_num_frames_ = 0;
+}
+
+bool DecodableFrameSkip::DecideNextFrame() const {
+  Vector<BaseFloat> loglikes, posteriors;
+  while (true) {
+    if (pending_num_frames_ == opts_.max_merged_frames) {
+      FinishPendingFrame();
+      return true;
+    }
+    int32 frame = frame_begin_.back() + pending_num_frames_;
+    if (frame >= decodable_->NumFramesReady()) {
+      if (pending_num_frames_ > 0 && decodable_->IsLastFrame(frame - 1)) {
+        FinishPendingFrame();
+        return true;
+      }
+      // We can't tell yet whether the next frame will be merged.
+      return false;
+    }
+    GetFrameLoglikes(frame, &loglikes);
+    if (opts_.merge_threshold >= 0.0) {
+      // the element for index 0 is not used.
+      posteriors = loglikes;
+      posteriors(0) = -std::numeric_limits<BaseFloat>::infinity();
+      posteriors.ApplySoftMax();
+    }
+    if (pending_num_frames_ == 0) {
+      pending_loglikes_.Swap(&loglikes);
+      pending_posteriors_.Swap(&posteriors);
+      pending_num_frames_ = 1;
+      continue;
+    }
+    if (opts_.merge_threshold >= 0.0) {
+      Vector<BaseFloat> diff(posteriors);
+      diff.AddVec(-1.0, pending_posteriors_);
+      // total variation distance, between 0 and 1.
+      BaseFloat distance = 0.5 * diff.Norm(1.0);
+      if (distance > opts_.merge_threshold) {
+        // This frame starts the next merged frame.
+        FinishPendingFrame();
+        pending_loglikes_.Swap(&loglikes);
+        pending_posteriors_.Swap(&posteriors);
+        pending_num_frames_ = 1;
+        return true;
+      }
+    }
+    pending_loglikes_.AddVec(opts_.merged_frame_scale, loglikes);
+    pending_num_frames_++;
+  }
+}
+
+int32 DecodableFrameSkip::NumFramesReady() const {
+  while (DecideNextFrame());
+  return static_cast<int32>(frame_begin_.size()) - 1;
+}
+
+bool DecodableFrameSkip::IsLastFrame(int32 frame) const {
+  int32 num_frames_ready = NumFramesReady();
+  // NumFramesReady() finishes the last merged frame if the underlying
+  // decodable has no more frames.
+  return frame == num_frames_ready - 1 && pending_num_frames_ == 0 &&
+      decodable_->NumFramesReady() == frame_begin_.back() &&
+      decodable_->IsLastFrame(frame_begin_.back() - 1);
+}
+
+BaseFloat DecodableFrameSkip::LogLikelihood(int32 frame, int32 index) {
+  KALDI_ASSERT(frame >= loglikes_offset_ &&
+               "Frames must be accessed in order.");
+  while (frame >= static_cast<int32>(frame_begin_.size()) - 1) {
+    if (!DecideNextFrame())
+      KALDI_ERR << "Attempt to access frame past the end of the available "
+                << "input";
+  }
+  // The decoder won't ask for the frames before 'frame' again.
+  while (frame > loglikes_offset_) {
+    loglikes_.pop_front();
+    loglikes_offset_++;
+  }
+  return loglikes_.front()(index);
+}
+
+int32 DecodableFrameSkip::NumMergedFrames(int32 frame) const {
+  KALDI_ASSERT(frame >= 0 &&
+               frame + 1 < static_cast<int32>(frame_begin_.size()));
+  return frame_begin_[frame + 1] - frame_begin_[frame];
+}
+
+void DecodableFrameSkip::ExpandLattice(const TransitionModel &trans_model,
+                                       Lattice *lat) const {
+  typedef LatticeArc::StateId StateId;
+  if (lat->Start() == fst::kNoStateId)
+    return;
+  if (lat->Properties(fst::kTopSorted, true) == 0 && !fst::TopSort(lat))
+    KALDI_ERR << "Cannot expand a lattice with cycles.";
+  std::vector<int32> times;
+  LatticeStateTimes(*lat, &times);
+  StateId num_states = lat->NumStates();
+  std::vector<LatticeArc> arcs;
+  for (StateId s = 0; s < num_states; s++) {
+    arcs.clear();
+    bool has_emitting_arc = false;
+    for (fst::ArcIterator<Lattice> aiter(*lat, s); !aiter.Done();
+         aiter.Next()) {
+      arcs.push_back(aiter.Value());
+      if (aiter.Value().ilabel != 0)
+        has_emitting_arc = true;
+    }
+    if (!has_emitting_arc)
+      continue;
+    int32 num_merged = NumMergedFrames(times[s]);
+    if (num_merged == 1)
+      continue;
+    lat->DeleteArcs(s);
+    for (size_t i = 0; i < arcs.size(); i++) {
+      const LatticeArc &arc = arcs[i];
+      if (arc.ilabel == 0) {
+        lat->AddArc(s, arc);
+        continue;
+      }
+      // For the other frames, the HMM stays in the same state.
+      int32 trans_state = trans_model.TransitionIdToTransitionState(
+          arc.ilabel),
+          loop_id = trans_model.SelfLoopOf(trans_state);
+      if (loop_id == 0)
+        KALDI_ERR << "Transition-id " << arc.ilabel << " is on a merged "
+                  << "frame but its HMM state has no self-loop; frames can "
+                  << "only be merged with topologies where all states have "
+                  << "self-loops.";
+      if (trans_model.TransitionIdToPdf(loop_id) !=
+          trans_model.TransitionIdToPdf(arc.ilabel))
+        KALDI_ERR << "Transition-id " << arc.ilabel << " is on a merged "
+                  << "frame but the self-loop of its HMM state has a "
+                  << "different pdf; frames cannot be merged with topologies "
+                  << "like that of 'chain' models.";
+      LatticeWeight loop_weight(
+          -opts_.self_loop_scale * trans_model.GetTransitionLogProb(loop_id),
+          0.0);
+      StateId cur_state = s;
+      if (opts_.reorder) {
+        // In reordered graphs the self-loop follows the transition out of
+        // the state.
+        StateId next_state = lat->AddState();
+        lat->AddArc(cur_state, LatticeArc(arc.ilabel, arc.olabel, arc.weight,
+                                          next_state));
+        cur_state = next_state;
+      }
+      for (int32 j = 1; j < num_merged; j++) {
+        StateId next_state = (opts_.reorder && j + 1 == num_merged ?
+                              arc.nextstate : lat->AddState());
+        lat->AddArc(cur_state, LatticeArc(loop_id, 0, loop_weight,
+                                          next_state));
+        cur_state = next_state;
+      }
+      if (!opts_.reorder)
+        lat->AddArc(cur_state, LatticeArc(arc.ilabel, arc.olabel, arc.weight,
+                                          arc.nextstate));
+    }
+  }
+  // the states we added come after the ones they lead to.
+  fst::TopSort(lat);
+}
+
+bool AllStatesHaveSelfLoops(const TransitionModel &trans_model) {
+  for (int32 trans_state = 1;
+       trans_state <= trans_model.NumTransitionStates(); trans_state++)
+    if (trans_model.SelfLoopOf(trans_state) == 0)
+      return false;
+  return true;
+}
+
+bool SelfLoopPdfsMatch(const TransitionModel &trans_model) {
+  for (int32 trans_state = 1;
+       trans_state <= trans_model.NumTransitionStates(); trans_state++)
+    if (trans_model.TransitionStateToSelfLoopPdf(trans_state) !=
+        trans_model.TransitionStateToForwardPdf(trans_state))
+      return false;
+  return true;
+}
+
+DecodableFrameSkip::~DecodableFrameSkip() {
+  int32 num_frames = static_cast<int32>(frame_begin_.size()) - 1;
+  if (num_frames > 0)
+    KALDI_VLOG(2) << "Merged " << frame_begin_.back() << " frames into "
+                  << num_frames << " frames for decoding.";
+}
+
+}  // namespace kaldi
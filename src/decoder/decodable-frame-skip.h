@@ -0,0 +1,200 @@
+// decoder/decodable-frame-skip.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_DECODABLE_FRAME_SKIP_H_
+#define KALDI_DECODER_DECODABLE_FRAME_SKIP_H_
+
+#include <deque>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "itf/decodable-itf.h"
+#include "itf/options-itf.h"
+#include "hmm/transition-model.h"
+#include "lat/kaldi-lattice.h"
+#include "matrix/kaldi-vector.h"
+
+namespace kaldi {
+
+struct FrameSkipOptions {
+  int32 max_merged_frames;
+  BaseFloat merge_threshold;
+  BaseFloat merged_frame_scale;
+  BaseFloat self_loop_scale;
+  bool reorder;
+
+  FrameSkipOptions(): max_merged_frames(1), merge_threshold(-1.0),
+                      merged_frame_scale(1.0), self_loop_scale(0.1),
+                      reorder(true) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("max-merged-frames", &max_merged_frames, "If >1, up to "
+                   "this many consecutive frames are merged into one frame "
+                   "for the decoder, which then only does the search for the "
+                   "first of them (see also --merge-threshold).  The lattice "
+                   "is expanded back to the original frames afterwards.");
+    opts->Register("merge-threshold", &merge_threshold, "If >= 0, a frame is "
+                   "only merged into the previous one(s) if the total "
+                   "variation distance between its posteriors and those of "
+                   "the first merged frame (a number between 0 and 1) is at "
+                   "most this.  If < 0, frames are merged on a fixed "
+                   "schedule, --max-merged-frames at a time.");
+    opts->Register("merged-frame-scale", &merged_frame_scale, "Scale on the "
+                   "log-likelihoods of the frames after the first in a "
+                   "merged frame.  1.0 keeps the total acoustic score; values "
+                   "less than 1.0 make the score differences in merged frames "
+                   "(which are pruned as one frame) closer to those of a "
+                   "normal frame, compensating for the beam being "
+                   "effectively tighter there.");
+    opts->Register("self-loop-scale", &self_loop_scale, "Scale on the "
+                   "self-loop transition log-probs that are added to the "
+                   "lattice when the merged frames are expanded back; should "
+                   "match the --self-loop-scale that the graph was built with "
+                   "(normally 0.1).");
+    opts->Register("reorder", &reorder, "If true, the self-loops that are "
+                   "added to the lattice when the merged frames are expanded "
+                   "back come after the transition out of the HMM state, as "
+                   "in graphs built with add-self-loops --reorder=true (the "
+                   "default in mkgraph.sh); if false, they come before it. "
+                   "Should match the graph.");
+  }
+
+  void Check() const {
+    KALDI_ASSERT(max_merged_frames >= 1 && merge_threshold <= 1.0 &&
+                 merged_frame_scale >= 0.0 && self_loop_scale >= 0.0);
+  }
+};
+
+
+/**
+   DecodableFrameSkip wraps another decodable object and merges runs of
+   consecutive frames into single frames for the decoder, so that the decoder
+   (whose time is mostly spent expanding arcs, once per frame) has fewer frames
+   to process.  This is most useful where consecutive frames are very similar,
+   e.g. in steady parts of the speech; a frame is merged into the preceding one
+   if the posteriors (the softmax of the log-likelihoods over the indexes) have
+   not changed much, or on a fixed schedule (see FrameSkipOptions).  The
+   log-likelihood of a merged frame is the log-likelihood of its first frame,
+   plus --merged-frame-scale times those of the other frames.
+
+   Since the decoder sees fewer frames, the lattices and alignments it
+   produces have to be expanded back to the original frames with
+   ExpandLattice() before they are used; DecodeUtteranceLatticeFaster() does
+   this automatically if it's given a DecodableFrameSkip.
+
+   This works with online decodables too; a merged frame is ready once we
+   know where it ends.  Frames of the underlying decodable are accessed in
+   increasing order, as the decodables in nnet3 require.
+ */
+class DecodableFrameSkip: public DecodableInterface {
+ public:
+  /// Does not take ownership of 'decodable'.
+  DecodableFrameSkip(const FrameSkipOptions &opts,
+                     DecodableInterface *decodable);
+
+  /// 'frame' is a frame of the decoder, i.e. after merging.
+  virtual BaseFloat LogLikelihood(int32 frame, int32 index);
+
+  virtual int32 NumFramesReady() const;
+
+  virtual bool IsLastFrame(int32 frame) const;
+
+  virtual int32 NumIndices() const { return decodable_->NumIndices(); }
+
+  /// Returns the number of frames of the underlying decodable that frame
+  /// 'frame' of the decoder corresponds to.  Requires frame <
+  /// NumFramesReady().
+  int32 NumMergedFrames(int32 frame) const;
+
+  /// Replaces each arc of 'lat' with a transition-id on a merged frame with
+  /// a sequence of arcs, one per original frame: the original arc and, for
+  /// the other frames, the self-loop of the HMM state.  If opts.reorder is
+  /// true the self-loops come after the original arc, as in reordered graphs
+  /// (the self-loop of a state follows the transition out of it), otherwise
+  /// before it.  The arcs for the self-loops have a graph cost of
+  /// -self_loop_scale times the log-prob of the self-loop (see
+  /// FrameSkipOptions), and no acoustic cost, since that of the whole merged
+  /// frame is on the original arc.  Crashes if the HMM state has no self-loop
+  /// (see AllStatesHaveSelfLoops()), or if its self-loop has a different pdf
+  /// from the original arc (see SelfLoopPdfsMatch()), since the merged frame
+  /// was only scored with the pdf of the original arc.  The lattice must be
+  /// one that was decoded with this object, e.g. from
+  /// LatticeFasterDecoder::GetRawLattice() or GetBestPath(); it is
+  /// topologically sorted if it wasn't.
+  void ExpandLattice(const TransitionModel &trans_model, Lattice *lat) const;
+
+  ~DecodableFrameSkip();
+
+ private:
+  // Tries to decide where the next merged frame ends, using the frames of the
+  // underlying decodable that are ready.  Returns true if it decided on a new
+  // merged frame.
+  bool DecideNextFrame() const;
+
+  // Sets 'loglikes' (indexed by index, i.e. with an unused element 0) to the
+  // log-likelihoods of frame 'frame' of the underlying decodable.
+  void GetFrameLoglikes(int32 frame, Vector<BaseFloat> *loglikes) const;
+
+  // Adds the merged frame in pending_loglikes_, of pending_num_frames_
+  // frames, to loglikes_ and frame_begin_.
+  void FinishPendingFrame() const;
+
+  const FrameSkipOptions opts_;
+  DecodableInterface *decodable_;
+
+  // The members below are mutable because we decide on the merging in
+  // NumFramesReady(), which is const.
+
+  // frame_begin_[i] is the first frame of the underlying decodable of merged
+  // frame i; it has one more element than the number of merged frames we have
+  // decided on.
+  mutable std::vector<int32> frame_begin_;
+  // The log-likelihoods of merged frames loglikes_offset_,
+  // loglikes_offset_ + 1, ..., for the ones that the decoder may still ask
+  // for.
+  mutable std::deque<Vector<BaseFloat> > loglikes_;
+  mutable int32 loglikes_offset_;
+
+  // The merged frame we are working on, which starts at frame_begin_.back():
+  // the number of frames in it so far, their log-likelihoods (combined as
+  // described above) and the posteriors of its first frame.
+  mutable int32 pending_num_frames_;
+  mutable Vector<BaseFloat> pending_loglikes_;
+  mutable Vector<BaseFloat> pending_posteriors_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableFrameSkip);
+};
+
+
+/// Returns true if all the HMM states in 'trans_model' have a self-loop.
+/// This is required for decoding with DecodableFrameSkip with
+/// --max-merged-frames > 1, because the frames of a merged frame are all in
+/// one HMM state (see DecodableFrameSkip::ExpandLattice()).
+bool AllStatesHaveSelfLoops(const TransitionModel &trans_model);
+
+/// Returns true if, for all the HMM states in 'trans_model', the self-loop
+/// has the same pdf as the transitions out of the state.  This is also
+/// required for decoding with DecodableFrameSkip with --max-merged-frames >
+/// 1, because a merged frame is only scored with the pdf of its first frame.
+/// It's false for topologies with a different <SelfLoopPdfClass>, such as
+/// that of 'chain' models.
+bool SelfLoopPdfsMatch(const TransitionModel &trans_model);
+
+
+}  // namespace kaldi
+
+#endif  // KALDI_DECODER_DECODABLE_FRAME_SKIP_H_
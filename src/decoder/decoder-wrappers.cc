@@ -18,6 +18,7 @@
 // limitations under the License.
 
 #include "decoder/decoder-wrappers.h"
+#include "decoder/decodable-frame-skip.h"
 #include "decoder/faster-decoder.h"
 #include "decoder/lattice-faster-decoder.h"
 #include "decoder/grammar-fst.h"
@@ -91,6 +92,11 @@ void DecodeUtteranceLatticeFasterClass::operator () () {
   if (lat_->NumStates() == 0)
     KALDI_ERR << "Unexpected problem getting lattice for utterance " << utt_;
   fst::Connect(lat_);
+  // If frames were merged for decoding, go back to the original frames.
+  const DecodableFrameSkip *skip_decodable =
+      dynamic_cast<const DecodableFrameSkip*>(decodable_);
+  if (skip_decodable != NULL)
+    skip_decodable->ExpandLattice(*trans_model_, lat_);
   if (determinize_) {
     clat_ = new CompactLattice;
     if (!DeterminizeLatticePhonePrunedWrapper(
@@ -134,6 +140,10 @@ DecodeUtteranceLatticeFasterClass::~DecodeUtteranceLatticeFasterClass() {
         // Shouldn't really reach this point as already checked success.
         KALDI_ERR << "Failed to get traceback for utterance " << utt_;
       }
+      const DecodableFrameSkip *skip_decodable =
+          dynamic_cast<const DecodableFrameSkip*>(decodable_);
+      if (skip_decodable != NULL)
+        skip_decodable->ExpandLattice(*trans_model_, &decoded);
       std::vector<int32> alignment;
       std::vector<int32> words;
       GetLinearSymbolSequence(decoded, &alignment, &words, &weight);
@@ -230,6 +240,11 @@ bool DecodeUtteranceLatticeFaster(
     }
   }
 
+  // If frames were merged for decoding, the lattices have to be expanded back
+  // to the original frames.
+  const DecodableFrameSkip *skip_decodable =
+      dynamic_cast<const DecodableFrameSkip*>(&decodable);
+
   double likelihood;
   LatticeWeight weight;
   int32 num_frames;
@@ -238,6 +253,8 @@ bool DecodeUtteranceLatticeFaster(
     if (!decoder.GetBestPath(&decoded))
       // Shouldn't really reach this point as already checked success.
       KALDI_ERR << "Failed to get traceback for utterance " << utt;
+    if (skip_decodable != NULL)
+      skip_decodable->ExpandLattice(trans_model, &decoded);
 
     std::vector<int32> alignment;
     std::vector<int32> words;
@@ -266,6 +283,8 @@ bool DecodeUtteranceLatticeFaster(
   if (lat.NumStates() == 0)
     KALDI_ERR << "Unexpected problem getting lattice for utterance " << utt;
   fst::Connect(&lat);
+  if (skip_decodable != NULL)
+    skip_decodable->ExpandLattice(trans_model, &lat);
   if (determinize) {
     CompactLattice clat;
     if (!DeterminizeLatticePhonePrunedWrapper(
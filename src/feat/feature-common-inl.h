@@ -31,13 +31,52 @@ void OfflineFeatureTpl<F>::ComputeFeatures(
     BaseFloat sample_freq,
     BaseFloat vtln_warp,
     Matrix<BaseFloat> *output) {
+  ComputeFeaturesInternal(wave, sample_freq, vtln_warp, &computer_, output);
+}
+
+template <class F>
+void OfflineFeatureTpl<F>::ComputeFeatures(
+    const VectorBase<BaseFloat> &wave,
+    BaseFloat sample_freq,
+    BaseFloat vtln_warp,
+    Matrix<BaseFloat> *output) const {
+  F computer(computer_);
+  ComputeFeaturesInternal(wave, sample_freq, vtln_warp, &computer, output);
+}
+
+template <class F>
+void OfflineFeatureTpl<F>::Compute(
+    const VectorBase<BaseFloat> &wave,
+    BaseFloat vtln_warp,
+    Matrix<BaseFloat> *output) {
+  ComputeInternal(wave, vtln_warp, &computer_, output);
+}
+
+template <class F>
+void OfflineFeatureTpl<F>::Compute(
+    const VectorBase<BaseFloat> &wave,
+    BaseFloat vtln_warp,
+    Matrix<BaseFloat> *output) const {
+  // Work on a temporary copy of the feature computer; the window function is
+  // only read, so it doesn't need to be copied.
+  F computer(computer_);
+  ComputeInternal(wave, vtln_warp, &computer, output);
+}
+
+template <class F>
+void OfflineFeatureTpl<F>::ComputeFeaturesInternal(
+    const VectorBase<BaseFloat> &wave,
+    BaseFloat sample_freq,
+    BaseFloat vtln_warp,
+    F *computer,
+    Matrix<BaseFloat> *output) const {
   KALDI_ASSERT(output != NULL);
-  BaseFloat new_sample_freq = computer_.GetFrameOptions().samp_freq;
+  BaseFloat new_sample_freq = computer->GetFrameOptions().samp_freq;
   if (sample_freq == new_sample_freq)
-    Compute(wave, vtln_warp, output);
+    ComputeInternal(wave, vtln_warp, computer, output);
   else {
     if (new_sample_freq < sample_freq) {
-      if (! computer_.GetFrameOptions().allow_downsample)
+      if (! computer->GetFrameOptions().allow_downsample)
         KALDI_ERR << "Waveform and config sample Frequency mismatch: "
                   << sample_freq << " .vs " << new_sample_freq
                   << " ( use --allow_downsample=true option to allow "
@@ -47,7 +86,7 @@ void OfflineFeatureTpl<F>::ComputeFeatures(
       Vector<BaseFloat> downsampled_wave(wave);
       DownsampleWaveForm(sample_freq, wave,
                          new_sample_freq, &downsampled_wave);
-      Compute(downsampled_wave, vtln_warp, output);
+      ComputeInternal(downsampled_wave, vtln_warp, computer, output);
     } else
       KALDI_ERR << "The waveform is allowed to get downsampled."
                 << "New sample Frequency " << new_sample_freq
@@ -58,55 +97,97 @@ void OfflineFeatureTpl<F>::ComputeFeatures(
 }
 
 template <class F>
-void OfflineFeatureTpl<F>::ComputeFeatures(
+void OfflineFeatureTpl<F>::ComputeInternal(
     const VectorBase<BaseFloat> &wave,
-    BaseFloat sample_freq,
     BaseFloat vtln_warp,
+    F *computer,
     Matrix<BaseFloat> *output) const {
-  OfflineFeatureTpl<F> temp(*this);
-  // This const version of ComputeFeatures() is a wrapper that
-  // calls the non-const ComputeFeatures() on a temporary object
-  // that is a copy of *this.  It is not as efficient because of the
-  // overhead of copying *this.
-  temp.ComputeFeatures(wave, vtln_warp, output);
-}
-
-template <class F>
-void OfflineFeatureTpl<F>::Compute(
-    const VectorBase<BaseFloat> &wave,
-    BaseFloat vtln_warp,
-    Matrix<BaseFloat> *output) {
   KALDI_ASSERT(output != NULL);
-  int32 rows_out = NumFrames(wave.Dim(), computer_.GetFrameOptions()),
-      cols_out = computer_.Dim();
+  int32 rows_out = NumFrames(wave.Dim(), computer->GetFrameOptions()),
+      cols_out = computer->Dim();
   if (rows_out == 0) {
     output->Resize(0, 0);
     return;
   }
   output->Resize(rows_out, cols_out);
   Vector<BaseFloat> window;  // windowed waveform.
-  bool use_raw_log_energy = computer_.NeedRawLogEnergy();
+  bool use_raw_log_energy = computer->NeedRawLogEnergy();
   for (int32 r = 0; r < rows_out; r++) {  // r is frame index.
     BaseFloat raw_log_energy = 0.0;
-    ExtractWindow(0, wave, r, computer_.GetFrameOptions(),
+    ExtractWindow(0, wave, r, computer->GetFrameOptions(),
                   feature_window_function_, &window,
                   (use_raw_log_energy ? &raw_log_energy : NULL));
 
     SubVector<BaseFloat> output_row(*output, r);
-    computer_.Compute(raw_log_energy, vtln_warp, &window, &output_row);
+    computer->Compute(raw_log_energy, vtln_warp, &window, &output_row);
   }
 }
 
 template <class F>
-void OfflineFeatureTpl<F>::Compute(
-    const VectorBase<BaseFloat> &wave,
-    BaseFloat vtln_warp,
-    Matrix<BaseFloat> *output) const {
-  OfflineFeatureTpl<F> temp(*this);
-  // call the non-const version of Compute() on a temporary copy of this object.
-  // This is a workaround for const-ness that may sometimes be useful in
-  // multi-threaded code, although it's not optimally efficient.
-  temp.Compute(wave, vtln_warp, output);
+OfflineFeatureTpl<F> *OfflineFeatureTplPool<F>::Get() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!free_extractors_.empty()) {
+      OfflineFeatureTpl<F> *ans = free_extractors_.back();
+      free_extractors_.pop_back();
+      return ans;
+    }
+  }
+  OfflineFeatureTpl<F> *ans = new OfflineFeatureTpl<F>(extractor_);
+  std::lock_guard<std::mutex> lock(mutex_);
+  extractors_.push_back(ans);
+  return ans;
+}
+
+template <class F>
+void OfflineFeatureTplPool<F>::Release(OfflineFeatureTpl<F> *extractor) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  free_extractors_.push_back(extractor);
+}
+
+template <class F>
+void OfflineFeatureComputeTask<F>::operator () () {
+  OfflineFeatureTpl<F> *extractor = pool_->Get();
+  try {
+    extractor->ComputeFeatures(waveform_, samp_freq_, vtln_warp_, &features_);
+  } catch (...) {
+    pool_->Release(extractor);
+    failed_ = true;
+    return;
+  }
+  pool_->Release(extractor);
+  if (subtract_mean_) {
+    Vector<BaseFloat> mean(features_.NumCols());
+    mean.AddRowSumMat(1.0, features_);
+    mean.Scale(1.0 / features_.NumRows());
+    for (int32 i = 0; i < features_.NumRows(); i++)
+      features_.Row(i).AddVec(-1.0, mean);
+  }
+}
+
+template <class F>
+OfflineFeatureComputeTask<F>::~OfflineFeatureComputeTask() {
+  if (failed_) {
+    KALDI_WARN << "Failed to compute features for utterance " << utt_;
+    return;
+  }
+  if (kaldi_writer_ != NULL) {
+    kaldi_writer_->Write(utt_, features_);
+  } else {
+    std::pair<Matrix<BaseFloat>, HtkHeader> p;
+    p.first.Resize(features_.NumRows(), features_.NumCols());
+    p.first.CopyFromMat(features_);
+    HtkHeader header = {
+      features_.NumRows(),
+      100000,  // 10ms shift
+      static_cast<int16>(sizeof(float) * features_.NumCols()),
+      htk_param_kind_
+    };
+    p.second = header;
+    htk_writer_->Write(utt_, p);
+  }
+  KALDI_VLOG(2) << "Processed features for key " << utt_;
+  (*num_success_)++;
 }
 
 } // end namespace kaldi
@@ -21,7 +21,10 @@
 #define KALDI_FEAT_FEATURE_COMMON_H_
 
 #include <map>
+#include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
 #include "feat/feature-window.h"
 
 namespace kaldi {
@@ -126,9 +129,11 @@ class OfflineFeatureTpl {
                BaseFloat vtln_warp,
                Matrix<BaseFloat> *output);
 
-  // This const version of Compute() is a wrapper that
-  // calls the non-const version on a temporary object.
-  // It's less efficient than the non-const version.
+  // This const version of Compute() is a wrapper that calls the non-const
+  // version on a temporary copy of the feature computer.  The copy shares
+  // read-only data such as the mel banks with the original, and the window
+  // function is not copied, so this is fairly cheap; it may be called from
+  // multiple threads at once, as long as no non-const function is.
   void Compute(const VectorBase<BaseFloat> &wave,
                BaseFloat vtln_warp,
                Matrix<BaseFloat> *output) const;
@@ -153,10 +158,9 @@ class OfflineFeatureTpl {
                        BaseFloat vtln_warp,
                        Matrix<BaseFloat> *output);
   /**
-     This const version of ComputeFeatures() is a wrapper that
-     calls the non-const ComputeFeatures() on a temporary object
-     that is a copy of *this.  It is not as efficient because of the
-     overhead of copying *this.
+     This const version of ComputeFeatures() works on a temporary copy of the
+     feature computer, like the const version of Compute(), and may be called
+     from multiple threads at once.
   */
   void ComputeFeatures(const VectorBase<BaseFloat> &wave,
                        BaseFloat sample_freq,
@@ -173,10 +177,97 @@ class OfflineFeatureTpl {
   // Disallow assignment.
   OfflineFeatureTpl<F> &operator =(const OfflineFeatureTpl<F> &other);
 
+  // These do the work of ComputeFeatures() and Compute(), using 'computer',
+  // which is either computer_ or a copy of it.
+  void ComputeFeaturesInternal(const VectorBase<BaseFloat> &wave,
+                               BaseFloat sample_freq,
+                               BaseFloat vtln_warp,
+                               F *computer,
+                               Matrix<BaseFloat> *output) const;
+  void ComputeInternal(const VectorBase<BaseFloat> &wave,
+                       BaseFloat vtln_warp,
+                       F *computer,
+                       Matrix<BaseFloat> *output) const;
+
   F computer_;
   FeatureWindowFunction feature_window_function_;
 };
 
+
+/// This class holds copies of an OfflineFeatureTpl object for use by worker
+/// threads, so that the features of several utterances can be computed in
+/// parallel.  A copy is only created when no free one is available, so there
+/// are at most as many copies as threads computing features at once, and each
+/// copy (with its FFT workspace) is reused for many utterances.
+template <class F>
+class OfflineFeatureTplPool {
+ public:
+  /// Does not take ownership of 'extractor', which is copied as needed and
+  /// must not be modified while this object exists.
+  explicit OfflineFeatureTplPool(const OfflineFeatureTpl<F> &extractor):
+      extractor_(extractor) { }
+
+  /// Returns a copy of the extractor that no other thread is using.
+  OfflineFeatureTpl<F> *Get();
+
+  /// Makes 'extractor', which must have been returned by Get(), available to
+  /// other threads.
+  void Release(OfflineFeatureTpl<F> *extractor);
+
+  ~OfflineFeatureTplPool() { DeletePointers(&extractors_); }
+
+ private:
+  const OfflineFeatureTpl<F> &extractor_;
+  std::mutex mutex_;
+  std::vector<OfflineFeatureTpl<F>*> extractors_;
+  std::vector<OfflineFeatureTpl<F>*> free_extractors_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(OfflineFeatureTplPool);
+};
+
+
+/// This class computes the features for one utterance in the
+/// feature-extraction binaries such as compute-mfcc-feats.  It is run by
+/// class TaskSequencer, which calls operator () in a worker thread and runs
+/// the destructors in the original order; the destructor writes the output.
+template <class F>
+class OfflineFeatureComputeTask {
+ public:
+  /// Does not take ownership of the pointers; exactly one of 'kaldi_writer'
+  /// and 'htk_writer' should be non-NULL.  'htk_param_kind' is the parameter
+  /// kind written in the HTK header (e.g. 006 | 020000 for MFCC with C0); it
+  /// is only used if 'htk_writer' is non-NULL.
+  OfflineFeatureComputeTask(OfflineFeatureTplPool<F> *pool,
+                            const std::string &utt,
+                            const VectorBase<BaseFloat> &waveform,
+                            BaseFloat samp_freq, BaseFloat vtln_warp,
+                            bool subtract_mean, uint16 htk_param_kind,
+                            BaseFloatMatrixWriter *kaldi_writer,
+                            TableWriter<HtkMatrixHolder> *htk_writer,
+                            int32 *num_success):
+      pool_(pool), utt_(utt), waveform_(waveform), samp_freq_(samp_freq),
+      vtln_warp_(vtln_warp), subtract_mean_(subtract_mean),
+      htk_param_kind_(htk_param_kind), kaldi_writer_(kaldi_writer),
+      htk_writer_(htk_writer), num_success_(num_success), failed_(false) { }
+
+  void operator () ();
+
+  ~OfflineFeatureComputeTask();
+
+ private:
+  OfflineFeatureTplPool<F> *pool_;
+  std::string utt_;
+  Vector<BaseFloat> waveform_;
+  BaseFloat samp_freq_;
+  BaseFloat vtln_warp_;
+  bool subtract_mean_;
+  uint16 htk_param_kind_;
+  BaseFloatMatrixWriter *kaldi_writer_;
+  TableWriter<HtkMatrixHolder> *htk_writer_;
+  int32 *num_success_;
+  bool failed_;
+  Matrix<BaseFloat> features_;
+};
+
 /// @} End of "addtogroup feat"
 }  // namespace kaldi
 
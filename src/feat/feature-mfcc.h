@@ -22,6 +22,7 @@
 #define KALDI_FEAT_FEATURE_MFCC_H_
 
 #include <map>
+#include <memory>
 #include <string>
 
 #include "feat/feature-common.h"
@@ -135,7 +136,9 @@ class MfccComputer {
   Vector<BaseFloat> lifter_coeffs_;
   Matrix<BaseFloat> dct_matrix_;  // matrix we left-multiply by to perform DCT.
   BaseFloat log_energy_floor_;
-  std::map<BaseFloat, MelBanks*> mel_banks_;  // BaseFloat is VTLN coefficient.
+  // BaseFloat is VTLN coefficient.  The MelBanks objects are never modified
+  // once created, so copies of this object share them.
+  std::map<BaseFloat, std::shared_ptr<const MelBanks> > mel_banks_;
   SplitRadixRealFft<BaseFloat> *srfft_;
 
   // note: mel_energies_ is specific to the frame we're processing, it's
@@ -0,0 +1,238 @@
+// feat/online-feature-speed-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "feat/online-feature.h"
+#include "feat/pitch-functions.h"
+#include "base/timer.h"
+
+namespace kaldi {
+
+static void CsvResult(std::string test, int dim, BaseFloat measure,
+                      std::string units) {
+  std::cout << test << "," << dim << "," << measure << "," << units << "\n";
+}
+
+// This reproduces the order in which DecodableNnetSimpleLooped requests input
+// frames: the first chunk needs frames_per_chunk plus the left and right
+// context (with frames before the start clamped to frame zero), and after that
+// each chunk requests just the next frames_per_chunk frames, since the
+// recurrent state carries the context.
+static void GetFramesLooped(int32 frames_per_chunk,
+                            int32 left_context, int32 right_context,
+                            OnlineFeatureInterface *feat) {
+  int32 num_frames = feat->NumFramesReady();
+  Vector<BaseFloat> frame(feat->Dim());
+  int32 begin_input_frame = -left_context,
+      end_input_frame = frames_per_chunk + right_context;
+  while (begin_input_frame < num_frames) {
+    for (int32 t = begin_input_frame; t < end_input_frame; t++) {
+      int32 t_limited = std::min<int32>(std::max<int32>(t, 0),
+                                        num_frames - 1);
+      feat->GetFrame(t_limited, &frame);
+    }
+    begin_input_frame = end_input_frame;
+    end_input_frame += frames_per_chunk;
+  }
+}
+
+// Requests frames in a random order.
+static void GetFramesRandom(int32 num_requests, OnlineFeatureInterface *feat) {
+  int32 num_frames = feat->NumFramesReady();
+  Vector<BaseFloat> frame(feat->Dim());
+  for (int32 i = 0; i < num_requests; i++)
+    feat->GetFrame(RandInt(0, num_frames - 1), &frame);
+}
+
+static void UnitTestOnlineCmvnSpeed() {
+  Timer t;
+  int32 dim = 40, num_frames = 30000;  // 5 minutes of 40-dim features.
+  Matrix<BaseFloat> feats(num_frames, dim);
+  feats.SetRandn();
+  Matrix<double> global_stats(2, dim + 1);
+  global_stats(0, dim) = 1.0;
+  global_stats.Row(1).Range(0, dim).Set(1.0);
+  OnlineCmvnState cmvn_state(global_stats);
+
+  std::vector<int32> cmn_windows;
+  cmn_windows.push_back(100);
+  cmn_windows.push_back(600);
+  cmn_windows.push_back(3000);
+  cmn_windows.push_back(10000);
+  for (size_t i = 0; i < cmn_windows.size(); i++) {
+    OnlineCmvnOptions opts;
+    opts.cmn_window = cmn_windows[i];
+    opts.speaker_frames = std::min(opts.speaker_frames, opts.cmn_window);
+    opts.global_frames = std::min(opts.global_frames, opts.speaker_frames);
+    {
+      OnlineMatrixFeature matrix_feats(feats);
+      OnlineCmvn cmvn(opts, cmvn_state, &matrix_feats);
+      Timer t1;
+      GetFramesLooped(50, 40, 10, &cmvn);
+      CsvResult("OnlineCmvn looped access, cmn-window", opts.cmn_window,
+                1.0e+06 * t1.Elapsed() / num_frames, "microseconds/frame");
+    }
+    {
+      OnlineMatrixFeature matrix_feats(feats);
+      OnlineCmvn cmvn(opts, cmvn_state, &matrix_feats);
+      int32 num_requests = num_frames / 10;
+      Timer t1;
+      GetFramesRandom(num_requests, &cmvn);
+      CsvResult("OnlineCmvn random access, cmn-window", opts.cmn_window,
+                1.0e+06 * t1.Elapsed() / num_requests, "microseconds/frame");
+    }
+  }
+  CsvResult(__func__, dim, t.Elapsed(), "seconds");
+}
+
+static void UnitTestOnlineSpliceTransformSpeed() {
+  Timer t;
+  // A typical GMM setup: 13-dim MFCC with online CMN, spliced +-3 frames,
+  // then LDA to 40.
+  int32 dim = 13, num_frames = 30000, lda_dim = 40;
+  OnlineSpliceOptions opts;
+  opts.left_context = 3;
+  opts.right_context = 3;
+  Matrix<BaseFloat> feats(num_frames, dim);
+  feats.SetRandn();
+  Matrix<BaseFloat> lda(lda_dim,
+                        dim * (1 + opts.left_context + opts.right_context) + 1);
+  lda.SetRandn();
+  Matrix<double> global_stats(2, dim + 1);
+  global_stats(0, dim) = 1.0;
+  OnlineCmvnState cmvn_state(global_stats);
+  OnlineCmvnOptions cmvn_opts;
+  Vector<BaseFloat> frame(lda_dim);
+  {
+    OnlineMatrixFeature matrix_feats(feats);
+    OnlineCmvn cmvn(cmvn_opts, cmvn_state, &matrix_feats);
+    OnlineSpliceFrames splice(opts, &cmvn);
+    OnlineTransform transform(lda, &splice);
+    Timer t1;
+    for (int32 t = 0; t < num_frames; t++)
+      transform.GetFrame(t, &frame);
+    CsvResult("OnlineSpliceFrames+OnlineTransform", lda_dim,
+              1.0e+06 * t1.Elapsed() / num_frames, "microseconds/frame");
+  }
+  std::vector<int32> block_sizes;
+  block_sizes.push_back(1);
+  block_sizes.push_back(4);
+  block_sizes.push_back(16);
+  block_sizes.push_back(64);
+  for (size_t i = 0; i < block_sizes.size(); i++) {
+    OnlineMatrixFeature matrix_feats(feats);
+    OnlineCmvn cmvn(cmvn_opts, cmvn_state, &matrix_feats);
+    OnlineSpliceTransform transform(opts, lda, &cmvn, block_sizes[i]);
+    Timer t1;
+    for (int32 t = 0; t < num_frames; t++)
+      transform.GetFrame(t, &frame);
+    CsvResult("OnlineSpliceTransform, block-size", block_sizes[i],
+              1.0e+06 * t1.Elapsed() / num_frames, "microseconds/frame");
+  }
+  CsvResult(__func__, dim, t.Elapsed(), "seconds");
+}
+
+// Like GetFramesLooped(), but gets each chunk with one call to GetFrames(), as
+// DecodableNnetLoopedOnline does.
+static void GetFramesLoopedBatch(int32 frames_per_chunk,
+                                 int32 left_context, int32 right_context,
+                                 OnlineFeatureInterface *feat) {
+  int32 num_frames = feat->NumFramesReady();
+  int32 begin_input_frame = -left_context,
+      end_input_frame = frames_per_chunk + right_context;
+  while (begin_input_frame < num_frames) {
+    std::vector<int32> frames;
+    for (int32 t = begin_input_frame; t < end_input_frame; t++)
+      frames.push_back(std::min<int32>(std::max<int32>(t, 0), num_frames - 1));
+    Matrix<BaseFloat> chunk(frames.size(), feat->Dim(), kUndefined);
+    feat->GetFrames(frames, &chunk);
+    begin_input_frame = end_input_frame;
+    end_input_frame += frames_per_chunk;
+  }
+}
+
+static void UnitTestOnlinePipelineSpeed() {
+  Timer t;
+  // One minute of noise at 16kHz; we compute all the features before timing,
+  // so that only the cost of getting the frames through the pipeline is timed.
+  BaseFloat samp_freq = 16000.0;
+  Vector<BaseFloat> waveform(60 * 16000);
+  waveform.SetRandn();
+  waveform.Scale(1000.0);
+
+  MfccOptions mfcc_opts;
+  mfcc_opts.num_ceps = 40;
+  mfcc_opts.mel_opts.num_bins = 40;
+  OnlineMfcc mfcc(mfcc_opts);
+  mfcc.AcceptWaveform(samp_freq, waveform);
+  mfcc.InputFinished();
+  PitchExtractionOptions pitch_opts;
+  OnlinePitchFeature pitch(pitch_opts);
+  pitch.AcceptWaveform(samp_freq, waveform);
+  pitch.InputFinished();
+  int32 num_frames = mfcc.NumFramesReady();
+
+  for (int32 batch = 0; batch <= 1; batch++) {
+    // This is the input to the network in the online2 nnet3 setup, as in
+    // OnlineNnet2FeaturePipeline with --add-pitch=true.
+    ProcessPitchOptions process_opts;
+    OnlineProcessPitch process_pitch(process_opts, &pitch);
+    OnlineAppendFeature mfcc_plus_pitch(&mfcc, &process_pitch);
+    OnlineCacheFeature cache(&mfcc_plus_pitch);
+    Timer t1;
+    if (batch)
+      GetFramesLoopedBatch(20, 40, 10, &cache);
+    else
+      GetFramesLooped(20, 40, 10, &cache);
+    CsvResult(std::string("MFCC+pitch pipeline, looped access, ") +
+              (batch ? "GetFrames()" : "GetFrame()"), cache.Dim(),
+              1.0e+06 * t1.Elapsed() / num_frames, "microseconds/frame");
+  }
+  for (int32 batch = 0; batch <= 1; batch++) {
+    // This is a deeper pipeline, with online CMN, deltas and a transform.
+    int32 dim = mfcc.Dim();
+    Matrix<double> global_stats(2, dim + 1);
+    global_stats(0, dim) = 1.0;
+    OnlineCmvnOptions cmvn_opts;
+    OnlineCmvn cmvn(cmvn_opts, OnlineCmvnState(global_stats), &mfcc);
+    DeltaFeaturesOptions delta_opts;
+    OnlineDeltaFeature delta(delta_opts, &cmvn);
+    Matrix<BaseFloat> transform(dim, delta.Dim());
+    transform.SetRandn();
+    OnlineTransform online_transform(transform, &delta);
+    Timer t1;
+    if (batch)
+      GetFramesLoopedBatch(20, 40, 10, &online_transform);
+    else
+      GetFramesLooped(20, 40, 10, &online_transform);
+    CsvResult(std::string("MFCC+CMN+deltas+transform, looped access, ") +
+              (batch ? "GetFrames()" : "GetFrame()"), dim,
+              1.0e+06 * t1.Elapsed() / num_frames, "microseconds/frame");
+  }
+  CsvResult(__func__, num_frames, t.Elapsed(), "seconds");
+}
+
+}  // end namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  Timer t;
+  UnitTestOnlineCmvnSpeed();
+  UnitTestOnlineSpliceTransformSpeed();
+  UnitTestOnlinePipelineSpeed();
+  KALDI_LOG << "Tests succeeded, total duration " << t.Elapsed()
+            << " seconds.";
+}
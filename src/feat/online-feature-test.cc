@@ -20,9 +20,11 @@
 // limitations under the License.
 
 #include "feat/online-feature.h"
+#include "feat/pitch-functions.h"
 #include "feat/wave-reader.h"
 #include "matrix/kaldi-matrix.h"
 #include "transform/transform-common.h"
+#include "transform/cmvn.h"
 
 namespace kaldi {
 
@@ -143,6 +145,200 @@ void TestOnlineSpliceFrames() {
   KALDI_ASSERT(output_feats1.ApproxEqual(output_feats2));
 }
 
+void TestOnlineSpliceTransform() {
+  int32 dim = 2 + rand() % 5;  // dimension of features.
+  int32 num_frames = 1 + rand() % 100;
+  OnlineSpliceOptions opts;
+  opts.left_context  = rand() % 5;
+  opts.right_context = rand() % 5;
+  int32 block_size = 1 + rand() % 20;
+
+  int32 spliced_dim = dim * (1 + opts.left_context + opts.right_context),
+      output_dim = 1 + rand() % 10;
+
+  Matrix<BaseFloat> input_feats(num_frames, dim);
+  input_feats.SetRandn();
+  Matrix<BaseFloat> transform(output_dim, spliced_dim + (rand() % 2));
+  transform.SetRandn();
+
+  OnlineMatrixFeature matrix_feats(input_feats);
+  OnlineSpliceFrames splice_frames(opts, &matrix_feats);
+  OnlineTransform splice_transform1(transform, &splice_frames);
+  OnlineSpliceTransform splice_transform2(opts, transform, &matrix_feats,
+                                          block_size);
+
+  Matrix<BaseFloat> output_feats1;
+  GetOutput(&splice_transform1, &output_feats1);
+  Matrix<BaseFloat> output_feats2;
+  GetOutput(&splice_transform2, &output_feats2);
+  KALDI_ASSERT(output_feats1.ApproxEqual(output_feats2));
+
+  // Check random access.
+  Vector<BaseFloat> feat(output_dim);
+  for (int32 i = 0; i < 10; i++) {
+    int32 t = rand() % num_frames;
+    splice_transform2.GetFrame(t, &feat);
+    KALDI_ASSERT(feat.ApproxEqual(output_feats1.Row(t)));
+  }
+}
+
+void TestOnlineCmvn() {
+  int32 dim = 2 + rand() % 5;  // dimension of features.
+  int32 num_frames = 100 + rand() % 500;
+  OnlineCmvnOptions opts;
+  opts.cmn_window = 10 + rand() % 200;
+  opts.speaker_frames = std::min(opts.speaker_frames, opts.cmn_window);
+  opts.global_frames = std::min(opts.global_frames, opts.speaker_frames);
+  opts.normalize_variance = (rand() % 2 == 0);
+  opts.modulus = 1 + rand() % 20;
+  opts.ring_buffer_size = 2 + rand() % 5;
+
+  Matrix<BaseFloat> input_feats(num_frames, dim);
+  input_feats.SetRandn();
+  input_feats.Add(2.0);
+  Matrix<double> global_stats(2, dim + 1);
+  AccCmvnStats(input_feats, NULL, &global_stats);
+
+  // Compute the expected output directly, from the definition.
+  Matrix<BaseFloat> expected_feats(num_frames, dim);
+  for (int32 t = 0; t < num_frames; t++) {
+    int32 begin = std::max<int32>(0, t + 1 - opts.cmn_window);
+    Matrix<double> stats(2, dim + 1);
+    AccCmvnStats(input_feats.RowRange(begin, t + 1 - begin), NULL, &stats);
+    double count = stats(0, dim);
+    if (count < opts.cmn_window) {
+      double count_from_global = std::min<double>(opts.cmn_window - count,
+                                                  opts.global_frames);
+      stats.AddMat(count_from_global / global_stats(0, dim), global_stats);
+    }
+    SubMatrix<BaseFloat> expected_row(expected_feats, t, 1, 0, dim);
+    expected_row.CopyFromMat(input_feats.RowRange(t, 1));
+    ApplyCmvn(stats, opts.normalize_variance, &expected_row);
+  }
+
+  OnlineMatrixFeature matrix_feats(input_feats);
+  OnlineCmvnState cmvn_state(global_stats);
+  OnlineCmvn cmvn(opts, cmvn_state, &matrix_feats);
+
+  // Access the frames in a randomized order, in the way a looped decodable
+  // would: chunks mostly moving forward, with some frames revisited.
+  Matrix<BaseFloat> output_feats(num_frames, dim);
+  Vector<BaseFloat> feat(dim);
+  int32 t = 0;
+  while (t < num_frames) {
+    int32 chunk_size = 1 + rand() % 30,
+        begin = std::max<int32>(0, t - rand() % 40),
+        end = std::min<int32>(num_frames, t + chunk_size);
+    for (int32 t2 = begin; t2 < end; t2++) {
+      cmvn.GetFrame(t2, &feat);
+      output_feats.Row(t2).CopyFromVec(feat);
+    }
+    if (rand() % 10 == 0) {
+      int32 t2 = rand() % end;
+      cmvn.GetFrame(t2, &feat);
+      KALDI_ASSERT(feat.ApproxEqual(output_feats.Row(t2), 0.001));
+    }
+    t = end;
+  }
+  AssertEqual(expected_feats, output_feats, 0.001);
+
+  // Check that the speaker stats output by GetState() are the stats of the
+  // frames seen so far.
+  int32 cur_frame = rand() % num_frames;
+  OnlineCmvnState state_out;
+  cmvn.GetState(cur_frame, &state_out);
+  Matrix<double> speaker_stats(2, dim + 1);
+  AccCmvnStats(input_feats.RowRange(0, cur_frame + 1), NULL, &speaker_stats);
+  AssertEqual(speaker_stats, state_out.speaker_cmvn_stats, 0.001);
+}
+
+// Checks that a->GetFrames() gives the same output as a->GetFrame(), for a
+// random list of frames that includes repeats.
+void CheckGetFrames(OnlineFeatureInterface *a) {
+  int32 num_frames = a->NumFramesReady(), dim = a->Dim();
+  KALDI_ASSERT(num_frames > 0);
+  std::vector<int32> frames;
+  int32 begin = rand() % num_frames,
+      end = std::min(num_frames, begin + 1 + rand() % 50);
+  for (int32 t = begin; t < end; t++) {
+    frames.push_back(t);
+    if (rand() % 5 == 0)
+      frames.push_back(rand() % num_frames);
+  }
+  Matrix<BaseFloat> feats1(frames.size(), dim),
+      feats2(frames.size(), dim);
+  for (size_t i = 0; i < frames.size(); i++) {
+    SubVector<BaseFloat> feat(feats1, i);
+    a->GetFrame(frames[i], &feat);
+  }
+  a->GetFrames(frames, &feats2);
+  KALDI_ASSERT(feats1.ApproxEqual(feats2, 0.0001));
+}
+
+void TestOnlineGetFrames() {
+  int32 dim = 2 + rand() % 5;  // dimension of features.
+  int32 num_frames = 100 + rand() % 100;
+  Matrix<BaseFloat> input_feats(num_frames, dim);
+  input_feats.SetRandn();
+  OnlineMatrixFeature matrix_feats(input_feats);
+  CheckGetFrames(&matrix_feats);
+
+  Matrix<double> global_stats(2, dim + 1);
+  AccCmvnStats(input_feats, NULL, &global_stats);
+  OnlineCmvnOptions cmvn_opts;
+  cmvn_opts.cmn_window = 10 + rand() % 100;
+  cmvn_opts.speaker_frames = std::min(cmvn_opts.speaker_frames,
+                                      cmvn_opts.cmn_window);
+  cmvn_opts.global_frames = std::min(cmvn_opts.global_frames,
+                                     cmvn_opts.speaker_frames);
+  OnlineCmvn cmvn(cmvn_opts, OnlineCmvnState(global_stats), &matrix_feats);
+  CheckGetFrames(&cmvn);
+
+  DeltaFeaturesOptions delta_opts;
+  delta_opts.order = rand() % 3;
+  delta_opts.window = 1 + rand() % 3;
+  OnlineDeltaFeature delta_feats(delta_opts, &cmvn);
+  CheckGetFrames(&delta_feats);
+
+  OnlineSpliceOptions splice_opts;
+  splice_opts.left_context = rand() % 4;
+  splice_opts.right_context = rand() % 4;
+  OnlineSpliceFrames splice_frames(splice_opts, &cmvn);
+  CheckGetFrames(&splice_frames);
+
+  Matrix<BaseFloat> transform(1 + rand() % 10, splice_frames.Dim() + 1);
+  transform.SetRandn();
+  OnlineTransform online_transform(transform, &splice_frames);
+  CheckGetFrames(&online_transform);
+  OnlineSpliceTransform splice_transform(splice_opts, transform, &cmvn);
+  CheckGetFrames(&splice_transform);
+
+  OnlineCacheFeature cache(&delta_feats);
+  CheckGetFrames(&cache);
+  CheckGetFrames(&cache);  // now some frames are cached.
+
+  OnlineAppendFeature append(&cache, &online_transform);
+  CheckGetFrames(&append);
+
+  // Check the pitch features, which need real speech.
+  std::ifstream is("../feat/test_data/test.wav", std::ios_base::binary);
+  WaveData wave;
+  wave.Read(is);
+  KALDI_ASSERT(wave.Data().NumRows() == 1);
+  SubVector<BaseFloat> waveform(wave.Data(), 0);
+  PitchExtractionOptions pitch_opts;
+  pitch_opts.samp_freq = wave.SampFreq();
+  OnlinePitchFeature pitch(pitch_opts);
+  pitch.AcceptWaveform(wave.SampFreq(), waveform);
+  if (rand() % 2 == 0)
+    pitch.InputFinished();
+  CheckGetFrames(&pitch);
+  ProcessPitchOptions process_opts;
+  process_opts.add_raw_log_pitch = true;
+  OnlineProcessPitch process_pitch(process_opts, &pitch);
+  CheckGetFrames(&process_pitch);
+}
+
 void TestOnlineMfcc() {
   std::ifstream is("../feat/test_data/test.wav", std::ios_base::binary);
   WaveData wave;
@@ -383,6 +579,9 @@ int main() {
     TestOnlineMatrixCacheFeature();
     TestOnlineDeltaFeature();
     TestOnlineSpliceFrames();
+    TestOnlineSpliceTransform();
+    TestOnlineCmvn();
+    TestOnlineGetFrames();
     TestOnlineMfcc();
     TestOnlinePlp();
     TestOnlineTransform();
@@ -24,6 +24,17 @@
 
 namespace kaldi {
 
+// Returns the position of "frame" in "unique_frames", which must be sorted and
+// contain "frame".  This is used in GetFrames() implementations that get all
+// the input frames they need with a single call to their source's GetFrames().
+static inline int32 FramePosition(const std::vector<int32> &unique_frames,
+                                  int32 frame) {
+  std::vector<int32>::const_iterator iter =
+      std::lower_bound(unique_frames.begin(), unique_frames.end(), frame);
+  KALDI_ASSERT(iter != unique_frames.end() && *iter == frame);
+  return iter - unique_frames.begin();
+}
+
 template<class C>
 void OnlineGenericBaseFeature<C>::GetFrame(int32 frame,
                                            VectorBase<BaseFloat> *feat) {
@@ -31,6 +42,14 @@ void OnlineGenericBaseFeature<C>::GetFrame(int32 frame,
   feat->CopyFromVec(*(features_.at(frame)));
 };
 
+template<class C>
+void OnlineGenericBaseFeature<C>::GetFrames(const std::vector<int32> &frames,
+                                            MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(static_cast<int32>(frames.size()) == feats->NumRows());
+  for (size_t i = 0; i < frames.size(); i++)
+    feats->Row(i).CopyFromVec(*(features_.at(frames[i])));
+}
+
 template<class C>
 OnlineGenericBaseFeature<C>::OnlineGenericBaseFeature(
     const typename C::Options &opts):
@@ -143,7 +162,7 @@ void OnlineCmvnState::Read(std::istream &is, bool binary) {
 OnlineCmvn::OnlineCmvn(const OnlineCmvnOptions &opts,
                        const OnlineCmvnState &cmvn_state,
                        OnlineFeatureInterface *src):
-    opts_(opts), src_(src) {
+    opts_(opts), num_frames_accumulated_(0), cache_time_(0), src_(src) {
   SetState(cmvn_state);
   if (!SplitStringToIntegers(opts.skip_dims, ":", false, &skip_dims_))
     KALDI_ERR << "Bad --skip-dims option (should be colon-separated list of "
@@ -151,81 +170,126 @@ OnlineCmvn::OnlineCmvn(const OnlineCmvnOptions &opts,
 }
 
 OnlineCmvn::OnlineCmvn(const OnlineCmvnOptions &opts,
-                       OnlineFeatureInterface *src): opts_(opts), src_(src) {
+                       OnlineFeatureInterface *src):
+    opts_(opts), num_frames_accumulated_(0), cache_time_(0), src_(src) {
   if (!SplitStringToIntegers(opts.skip_dims, ":", false, &skip_dims_))
     KALDI_ERR << "Bad --skip-dims option (should be colon-separated list of "
               <<  "integers)";
 }
 
 
-void OnlineCmvn::GetMostRecentCachedFrame(int32 frame,
-                                          int32 *cached_frame,
-                                          Matrix<double> *stats) {
-  KALDI_ASSERT(frame >= 0);
-  InitRingBufferIfNeeded();
-  // look for a cached frame on a previous frame as close as possible in time
-  // to "frame".  Return if we get one.
-  for (int32 t = frame; t >= 0 && t >= frame - opts_.ring_buffer_size; t--) {
-    if (t % opts_.modulus == 0) {
-      // if this frame should be cached in cached_stats_modulo_, then
-      // we'll look there, and we won't go back any further in time.
-      break;
-    }
-    int32 index = t % opts_.ring_buffer_size;
-    if (cached_stats_ring_[index].first == t) {
-      *cached_frame = t;
-      *stats = cached_stats_ring_[index].second;
-      return;
+void OnlineCmvn::InitCacheIfNeeded() {
+  if (!cached_stats_modulo_.empty())
+    return;
+  KALDI_ASSERT(opts_.modulus > 0 && opts_.ring_buffer_size >= 2);
+  int32 dim = this->Dim(), num_slots = opts_.ring_buffer_size;
+  cur_stats_.Resize(2, dim + 1);
+  cached_stats_modulo_.push_back(new Matrix<double>(cur_stats_));
+  cached_stats_.Resize(2 * num_slots * opts_.modulus, dim + 1, kUndefined);
+  cached_block_index_.resize(num_slots, -1);
+  cached_block_size_.resize(num_slots, 0);
+  cached_block_time_.resize(num_slots, 0);
+  // Block zero starts out containing the (zero) stats for n == 0.
+  cached_stats_.RowRange(0, 2).SetZero();
+  cached_block_index_[0] = 0;
+  cached_block_size_[0] = 1;
+}
+
+void OnlineCmvn::AccumulateUntil(int32 n) {
+  InitCacheIfNeeded();
+  int32 dim = this->Dim(), modulus = opts_.modulus;
+  Vector<BaseFloat> feat(dim);
+  Vector<double> feat_dbl(dim);
+  // The slot where the newest block is cached, or -1 if it is not cached.
+  int32 slot = -1, block = num_frames_accumulated_ / modulus;
+  for (int32 s = 0; s < opts_.ring_buffer_size; s++)
+    if (cached_block_index_[s] == block &&
+        cached_block_size_[s] == num_frames_accumulated_ % modulus + 1)
+      slot = s;
+
+  while (num_frames_accumulated_ < n) {
+    src_->GetFrame(num_frames_accumulated_, &feat);
+    feat_dbl.CopyFromVec(feat);
+    cur_stats_.Row(0).Range(0, dim).AddVec(1.0, feat_dbl);
+    cur_stats_.Row(1).Range(0, dim).AddVec2(1.0, feat_dbl);
+    cur_stats_(0, dim) += 1.0;
+    num_frames_accumulated_++;
+    int32 offset = num_frames_accumulated_ % modulus;
+    if (offset == 0) {
+      // We are starting a new block: store a checkpoint, and start caching
+      // the new block in the least recently used slot.
+      KALDI_ASSERT(cached_stats_modulo_.size() ==
+                   num_frames_accumulated_ / modulus);
+      cached_stats_modulo_.push_back(new Matrix<double>(cur_stats_));
+      block = num_frames_accumulated_ / modulus;
+      slot = 0;
+      for (int32 s = 1; s < opts_.ring_buffer_size; s++)
+        if (cached_block_time_[s] < cached_block_time_[slot])
+          slot = s;
+      cached_block_index_[slot] = block;
+      cached_block_size_[slot] = 0;
     }
-  }
-  int32 n = frame / opts_.modulus;
-  if (n >= cached_stats_modulo_.size()) {
-    if (cached_stats_modulo_.size() == 0) {
-      *cached_frame = -1;
-      stats->Resize(2, this->Dim() + 1);
-      return;
-    } else {
-      n = static_cast<int32>(cached_stats_modulo_.size() - 1);
+    if (slot >= 0) {
+      cached_stats_.RowRange(2 * (slot * modulus + offset), 2).CopyFromMat(
+          cur_stats_);
+      cached_block_size_[slot] = offset + 1;
+      cached_block_time_[slot] = ++cache_time_;
     }
   }
-  *cached_frame = n * opts_.modulus;
-  KALDI_ASSERT(cached_stats_modulo_[n] != NULL);
-  *stats = *(cached_stats_modulo_[n]);
 }
 
-// Initialize ring buffer for caching stats.
-void OnlineCmvn::InitRingBufferIfNeeded() {
-  if (cached_stats_ring_.empty() && opts_.ring_buffer_size > 0) {
-    Matrix<double> temp(2, this->Dim() + 1);
-    cached_stats_ring_.resize(opts_.ring_buffer_size,
-                              std::pair<int32, Matrix<double> >(-1, temp));
+int32 OnlineCmvn::GetCachedBlock(int32 block, int32 offset) {
+  int32 modulus = opts_.modulus, num_slots = opts_.ring_buffer_size,
+      slot = -1, lru_slot = 0;
+  for (int32 s = 0; s < num_slots; s++) {
+    if (cached_block_index_[s] == block)
+      slot = s;
+    if (cached_block_time_[s] < cached_block_time_[lru_slot])
+      lru_slot = s;
   }
+  if (slot == -1) {
+    // The block is not cached: start it from its checkpoint, in the least
+    // recently used slot.
+    KALDI_ASSERT(block < static_cast<int32>(cached_stats_modulo_.size()));
+    slot = lru_slot;
+    cached_stats_.RowRange(2 * slot * modulus, 2).CopyFromMat(
+        *(cached_stats_modulo_[block]));
+    cached_block_index_[slot] = block;
+    cached_block_size_[slot] = 1;
+  }
+  // Fill in the block as far as "offset", if needed.
+  KALDI_ASSERT(block * modulus + offset <= num_frames_accumulated_);
+  int32 dim = this->Dim();
+  Vector<BaseFloat> feat(dim);
+  Vector<double> feat_dbl(dim);
+  for (int32 i = cached_block_size_[slot]; i <= offset; i++) {
+    src_->GetFrame(block * modulus + i - 1, &feat);
+    feat_dbl.CopyFromVec(feat);
+    int32 row = 2 * (slot * modulus + i);
+    SubMatrix<double> stats(cached_stats_, row, 2, 0, dim + 1);
+    stats.CopyFromMat(cached_stats_.RowRange(row - 2, 2));
+    stats.Row(0).Range(0, dim).AddVec(1.0, feat_dbl);
+    stats.Row(1).Range(0, dim).AddVec2(1.0, feat_dbl);
+    stats(0, dim) += 1.0;
+  }
+  cached_block_size_[slot] = std::max(cached_block_size_[slot], offset + 1);
+  cached_block_time_[slot] = ++cache_time_;
+  return slot;
 }
 
-void OnlineCmvn::CacheFrame(int32 frame, const Matrix<double> &stats) {
-  KALDI_ASSERT(frame >= 0);
-  if (frame % opts_.modulus == 0) {  // store in cached_stats_modulo_.
-    int32 n = frame / opts_.modulus;
-    if (n >= cached_stats_modulo_.size()) {
-      // The following assert is a limitation on in what order you can call
-      // CacheFrame.  Fortunately the calling code always calls it in sequence,
-      // which it has to because you need a previous frame to compute the
-      // current one.
-      KALDI_ASSERT(n == cached_stats_modulo_.size());
-      cached_stats_modulo_.push_back(new Matrix<double>(stats));
-    } else {
-      KALDI_WARN << "Did not expect to reach this part of code.";
-      // do what seems right, but we shouldn't get here.
-      cached_stats_modulo_[n]->CopyFromMat(stats);
-    }
-  } else {  // store in the ring buffer.
-    InitRingBufferIfNeeded();
-    if (!cached_stats_ring_.empty()) {
-      int32 index = frame % cached_stats_ring_.size();
-      cached_stats_ring_[index].first = frame;
-      cached_stats_ring_[index].second.CopyFromMat(stats);
-    }
+void OnlineCmvn::GetCumulativeStats(int32 n, MatrixBase<double> *stats) {
+  KALDI_ASSERT(n >= 0);
+  if (n > num_frames_accumulated_)
+    AccumulateUntil(n);
+  InitCacheIfNeeded();
+  if (n == num_frames_accumulated_) {
+    stats->CopyFromMat(cur_stats_);
+    return;
   }
+  int32 block = n / opts_.modulus, offset = n % opts_.modulus,
+      slot = GetCachedBlock(block, offset);
+  stats->CopyFromMat(cached_stats_.RowRange(
+      2 * (slot * opts_.modulus + offset), 2));
 }
 
 OnlineCmvn::~OnlineCmvn() {
@@ -237,34 +301,14 @@ OnlineCmvn::~OnlineCmvn() {
 void OnlineCmvn::ComputeStatsForFrame(int32 frame,
                                       MatrixBase<double> *stats_out) {
   KALDI_ASSERT(frame >= 0 && frame < src_->NumFramesReady());
-
-  int32 dim = this->Dim(), cur_frame;
-  Matrix<double> stats(2, dim + 1);
-  GetMostRecentCachedFrame(frame, &cur_frame, &stats);
-
-  Vector<BaseFloat> feats(dim);
-  Vector<double> feats_dbl(dim);
-  while (cur_frame < frame) {
-    cur_frame++;
-    src_->GetFrame(cur_frame, &feats);
-    feats_dbl.CopyFromVec(feats);
-    stats.Row(0).Range(0, dim).AddVec(1.0, feats_dbl);
-    stats.Row(1).Range(0, dim).AddVec2(1.0, feats_dbl);
-    stats(0, dim) += 1.0;
-    // it's a sliding buffer; a frame at the back may be
-    // leaving the buffer so we have to subtract that.
-    int32 prev_frame = cur_frame - opts_.cmn_window;
-    if (prev_frame >= 0) {
-      // we need to subtract frame prev_f from the stats.
-      src_->GetFrame(prev_frame, &feats);
-      feats_dbl.CopyFromVec(feats);
-      stats.Row(0).Range(0, dim).AddVec(-1.0, feats_dbl);
-      stats.Row(1).Range(0, dim).AddVec2(-1.0, feats_dbl);
-      stats(0, dim) -= 1.0;
-    }
-    CacheFrame(cur_frame, stats);
+  // The window is frames std::max(0, frame + 1 - cmn_window) through frame.
+  int32 window_begin = std::max<int32>(0, frame + 1 - opts_.cmn_window);
+  GetCumulativeStats(frame + 1, stats_out);
+  if (window_begin > 0) {
+    Matrix<double> begin_stats(2, this->Dim() + 1, kUndefined);
+    GetCumulativeStats(window_begin, &begin_stats);
+    stats_out->AddMat(-1.0, begin_stats);
   }
-  stats_out->CopyFromMat(stats);
 }
 
 
@@ -306,37 +350,60 @@ void OnlineCmvn::SmoothOnlineCmvnStats(const MatrixBase<double> &speaker_stats,
   }
 }
 
-void OnlineCmvn::GetFrame(int32 frame,
-                          VectorBase<BaseFloat> *feat) {
-  src_->GetFrame(frame, feat);
-  KALDI_ASSERT(feat->Dim() == this->Dim());
-  int32 dim = feat->Dim();
-  Matrix<double> stats(2, dim + 1);
+void OnlineCmvn::GetStatsForFrame(int32 frame, MatrixBase<double> *stats) {
   if (frozen_state_.NumRows() != 0) {  // the CMVN state has been frozen.
-    stats.CopyFromMat(frozen_state_);
+    stats->CopyFromMat(frozen_state_);
   } else {
     // first get the raw CMVN stats (this involves caching..)
-    this->ComputeStatsForFrame(frame, &stats);
+    this->ComputeStatsForFrame(frame, stats);
     // now smooth them.
     SmoothOnlineCmvnStats(orig_state_.speaker_cmvn_stats,
                           orig_state_.global_cmvn_stats,
                           opts_,
-                          &stats);
+                          stats);
   }
-
   if (!skip_dims_.empty())
-    FakeStatsForSomeDims(skip_dims_, &stats);
+    FakeStatsForSomeDims(skip_dims_, stats);
+}
+
+void OnlineCmvn::GetFrame(int32 frame,
+                          VectorBase<BaseFloat> *feat) {
+  src_->GetFrame(frame, feat);
+  KALDI_ASSERT(feat->Dim() == this->Dim());
+  int32 dim = feat->Dim();
+  Matrix<double> stats(2, dim + 1);
+  GetStatsForFrame(frame, &stats);
 
   // call the function ApplyCmvn declared in ../transform/cmvn.h, which
-  // requires a matrix.
-  Matrix<BaseFloat> feat_mat(1, dim);
-  feat_mat.Row(0).CopyFromVec(*feat);
-  // the function ApplyCmvn takes a matrix, so form a one-row matrix to give it.
+  // requires a matrix, so form a one-row matrix that views "feat".
+  SubMatrix<BaseFloat> feat_mat(feat->Data(), 1, dim, dim);
   if (opts_.normalize_mean)
     ApplyCmvn(stats, opts_.normalize_variance, &feat_mat);
   else
     KALDI_ASSERT(!opts_.normalize_variance);
-  feat->CopyFromVec(feat_mat.Row(0));
+}
+
+void OnlineCmvn::GetFrames(const std::vector<int32> &frames,
+                           MatrixBase<BaseFloat> *feats) {
+  src_->GetFrames(frames, feats);
+  KALDI_ASSERT(feats->NumCols() == this->Dim());
+  if (!opts_.normalize_mean) {
+    KALDI_ASSERT(!opts_.normalize_variance);
+    return;
+  }
+  int32 dim = feats->NumCols();
+  Matrix<double> stats(2, dim + 1);
+  if (frozen_state_.NumRows() != 0) {
+    // All frames are normalized with the same stats.
+    GetStatsForFrame(0, &stats);
+    ApplyCmvn(stats, opts_.normalize_variance, feats);
+    return;
+  }
+  for (size_t i = 0; i < frames.size(); i++) {
+    GetStatsForFrame(frames[i], &stats);
+    SubMatrix<BaseFloat> feat_mat(*feats, i, 1, 0, dim);
+    ApplyCmvn(stats, opts_.normalize_variance, &feat_mat);
+  }
 }
 
 void OnlineCmvn::Freeze(int32 cur_frame) {
@@ -359,14 +426,10 @@ void OnlineCmvn::GetState(int32 cur_frame,
     int32 dim = this->Dim();
     if (state_out->speaker_cmvn_stats.NumRows() == 0)
       state_out->speaker_cmvn_stats.Resize(2, dim + 1);
-    Vector<BaseFloat> feat(dim);
-    Vector<double> feat_dbl(dim);
-    for (int32 t = 0; t <= cur_frame; t++) {
-      src_->GetFrame(t, &feat);
-      feat_dbl.CopyFromVec(feat);
-      state_out->speaker_cmvn_stats(0, dim) += 1.0;
-      state_out->speaker_cmvn_stats.Row(0).Range(0, dim).AddVec(1.0, feat_dbl);
-      state_out->speaker_cmvn_stats.Row(1).Range(0, dim).AddVec2(1.0, feat_dbl);
+    if (cur_frame >= 0) {
+      Matrix<double> utt_stats(2, dim + 1, kUndefined);
+      GetCumulativeStats(cur_frame + 1, &utt_stats);
+      state_out->speaker_cmvn_stats.AddMat(1.0, utt_stats);
     }
   }
   // Store any frozen state (the effect of the user possibly
@@ -406,6 +469,38 @@ void OnlineSpliceFrames::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
   }
 }
 
+void OnlineSpliceFrames::GetFrames(const std::vector<int32> &frames,
+                                   MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(static_cast<int32>(frames.size()) == feats->NumRows());
+  KALDI_ASSERT(left_context_ >= 0 && right_context_ >= 0);
+  int32 dim_in = src_->Dim(), context = left_context_ + 1 + right_context_,
+      T = src_->NumFramesReady();
+  KALDI_ASSERT(feats->NumCols() == dim_in * context);
+  // input_frames[i * context + n] is the input frame that goes in the n'th
+  // position of the spliced output for frames[i].
+  std::vector<int32> input_frames(frames.size() * context);
+  for (size_t i = 0; i < frames.size(); i++) {
+    KALDI_ASSERT(frames[i] >= 0 && frames[i] < NumFramesReady());
+    for (int32 n = 0; n < context; n++) {
+      int32 t2_limited = frames[i] - left_context_ + n;
+      if (t2_limited < 0) t2_limited = 0;
+      if (t2_limited >= T) t2_limited = T - 1;
+      input_frames[i * context + n] = t2_limited;
+    }
+  }
+  std::vector<int32> unique_frames(input_frames);
+  SortAndUniq(&unique_frames);
+  Matrix<BaseFloat> input(unique_frames.size(), dim_in, kUndefined);
+  src_->GetFrames(unique_frames, &input);
+  for (size_t i = 0; i < frames.size(); i++) {
+    for (int32 n = 0; n < context; n++) {
+      SubVector<BaseFloat> part(feats->Row(i), n * dim_in, dim_in);
+      part.CopyFromVec(input.Row(FramePosition(unique_frames,
+                                               input_frames[i * context + n])));
+    }
+  }
+}
+
 OnlineTransform::OnlineTransform(const MatrixBase<BaseFloat> &transform,
                                  OnlineFeatureInterface *src):
     src_(src) {
@@ -430,6 +525,128 @@ void OnlineTransform::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
   feat->AddMatVec(1.0, linear_term_, kNoTrans, input_feat, 1.0);
 }
 
+void OnlineTransform::GetFrames(const std::vector<int32> &frames,
+                                MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(static_cast<int32>(frames.size()) == feats->NumRows());
+  Matrix<BaseFloat> input_feats(frames.size(), linear_term_.NumCols(),
+                                kUndefined);
+  src_->GetFrames(frames, &input_feats);
+  feats->CopyRowsFromVec(offset_);
+  feats->AddMatMat(1.0, input_feats, kNoTrans, linear_term_, kTrans, 1.0);
+}
+
+
+OnlineSpliceTransform::OnlineSpliceTransform(
+    const OnlineSpliceOptions &opts,
+    const MatrixBase<BaseFloat> &transform,
+    OnlineFeatureInterface *src,
+    int32 block_size):
+    left_context_(opts.left_context), right_context_(opts.right_context),
+    block_size_(block_size), src_(src), block_begin_(0),
+    block_num_frames_(0) {
+  KALDI_ASSERT(left_context_ >= 0 && right_context_ >= 0 && block_size_ > 0);
+  int32 input_dim = src_->Dim() * (1 + left_context_ + right_context_);
+  if (transform.NumCols() == input_dim) {  // Linear transform
+    linear_term_ = transform;
+    offset_.Resize(transform.NumRows());  // Resize() will zero it.
+  } else if (transform.NumCols() == input_dim + 1) {  // Affine transform
+    linear_term_ = transform.Range(0, transform.NumRows(), 0, input_dim);
+    offset_.Resize(transform.NumRows());
+    offset_.CopyColFromMat(transform, input_dim);
+  } else {
+    KALDI_ERR << "Dimension mismatch: spliced features have dimension "
+              << input_dim << " and LDA #cols is " << transform.NumCols();
+  }
+}
+
+int32 OnlineSpliceTransform::NumFramesReady() const {
+  int32 num_frames = src_->NumFramesReady();
+  if (num_frames > 0 && src_->IsLastFrame(num_frames-1))
+    return num_frames;
+  else
+    return std::max<int32>(0, num_frames - right_context_);
+}
+
+void OnlineSpliceTransform::ComputeBlock(int32 frame) {
+  int32 num_frames_ready = NumFramesReady(),
+      num_frames = std::min(block_size_, num_frames_ready - frame),
+      context = left_context_ + 1 + right_context_,
+      dim_in = src_->Dim(),
+      T = src_->NumFramesReady();
+  KALDI_ASSERT(frame >= 0 && num_frames > 0);
+  if (block_input_.NumRows() != num_frames + context - 1)
+    block_input_.Resize(num_frames + context - 1, dim_in, kUndefined);
+  // Get each input frame once, repeating the first and last frames where the
+  // context extends past the edges.
+  int32 prev_t_limited = -1;
+  for (int32 i = 0; i < block_input_.NumRows(); i++) {
+    int32 t_limited = frame - left_context_ + i;
+    if (t_limited < 0) t_limited = 0;
+    if (t_limited >= T) t_limited = T - 1;
+    SubVector<BaseFloat> row(block_input_, i);
+    if (t_limited == prev_t_limited)
+      row.CopyFromVec(block_input_.Row(i - 1));
+    else
+      src_->GetFrame(t_limited, &row);
+    prev_t_limited = t_limited;
+  }
+  // The spliced input of output frame "frame + i" is rows i through
+  // i + context - 1 of block_input_, concatenated, so the output for the whole
+  // block is the sum over context offsets n of the rows of block_input_
+  // starting at n times the corresponding columns of the transform.
+  if (block_output_.NumRows() != num_frames)
+    block_output_.Resize(num_frames, Dim(), kUndefined);
+  block_output_.CopyRowsFromVec(offset_);
+  for (int32 n = 0; n < context; n++)
+    block_output_.AddMatMat(1.0, block_input_.RowRange(n, num_frames), kNoTrans,
+                            linear_term_.ColRange(n * dim_in, dim_in), kTrans,
+                            1.0);
+  block_begin_ = frame;
+  block_num_frames_ = num_frames;
+}
+
+void OnlineSpliceTransform::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
+  KALDI_ASSERT(feat->Dim() == Dim());
+  if (frame < block_begin_ || frame >= block_begin_ + block_num_frames_)
+    ComputeBlock(frame);
+  feat->CopyFromVec(block_output_.Row(frame - block_begin_));
+}
+
+void OnlineSpliceTransform::GetFrames(const std::vector<int32> &frames,
+                                      MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(static_cast<int32>(frames.size()) == feats->NumRows() &&
+               feats->NumCols() == Dim());
+  int32 num_frames = frames.size(), dim_in = src_->Dim(),
+      context = left_context_ + 1 + right_context_,
+      T = src_->NumFramesReady();
+  // input_frames[n * num_frames + i] is the input frame that goes in the n'th
+  // position of the spliced input for frames[i].
+  std::vector<int32> input_frames(num_frames * context);
+  for (int32 i = 0; i < num_frames; i++) {
+    KALDI_ASSERT(frames[i] >= 0 && frames[i] < NumFramesReady());
+    for (int32 n = 0; n < context; n++) {
+      int32 t2_limited = frames[i] - left_context_ + n;
+      if (t2_limited < 0) t2_limited = 0;
+      if (t2_limited >= T) t2_limited = T - 1;
+      input_frames[n * num_frames + i] = t2_limited;
+    }
+  }
+  std::vector<int32> unique_frames(input_frames);
+  SortAndUniq(&unique_frames);
+  Matrix<BaseFloat> input(unique_frames.size(), dim_in, kUndefined);
+  src_->GetFrames(unique_frames, &input);
+  for (size_t j = 0; j < input_frames.size(); j++)
+    input_frames[j] = FramePosition(unique_frames, input_frames[j]);
+
+  feats->CopyRowsFromVec(offset_);
+  Matrix<BaseFloat> context_input(num_frames, dim_in, kUndefined);
+  for (int32 n = 0; n < context; n++) {
+    context_input.CopyRows(input, &(input_frames[n * num_frames]));
+    feats->AddMatMat(1.0, context_input, kNoTrans,
+                     linear_term_.ColRange(n * dim_in, dim_in), kTrans, 1.0);
+  }
+}
+
 
 int32 OnlineDeltaFeature::Dim() const {
   int32 src_dim = src_->Dim();
@@ -474,6 +691,40 @@ void OnlineDeltaFeature::GetFrame(int32 frame,
 }
 
 
+void OnlineDeltaFeature::GetFrames(const std::vector<int32> &frames,
+                                   MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(static_cast<int32>(frames.size()) == feats->NumRows() &&
+               feats->NumCols() == Dim());
+  int32 context = opts_.order * opts_.window,
+      src_frames_ready = src_->NumFramesReady();
+  // Get all the input frames we need in one batch.
+  std::vector<int32> input_frames;
+  for (size_t i = 0; i < frames.size(); i++) {
+    KALDI_ASSERT(frames[i] >= 0 && frames[i] < NumFramesReady());
+    int32 left_frame = std::max<int32>(0, frames[i] - context),
+        right_frame = std::min<int32>(src_frames_ready - 1,
+                                      frames[i] + context);
+    for (int32 t = left_frame; t <= right_frame; t++)
+      input_frames.push_back(t);
+  }
+  std::vector<int32> unique_frames(input_frames);
+  SortAndUniq(&unique_frames);
+  Matrix<BaseFloat> input(unique_frames.size(), src_->Dim(), kUndefined);
+  src_->GetFrames(unique_frames, &input);
+  for (size_t i = 0; i < frames.size(); i++) {
+    int32 left_frame = std::max<int32>(0, frames[i] - context),
+        right_frame = std::min<int32>(src_frames_ready - 1,
+                                      frames[i] + context);
+    // All frames from left_frame to right_frame are in unique_frames, so they
+    // are in consecutive rows of "input".
+    SubMatrix<BaseFloat> temp_src(input.RowRange(
+        FramePosition(unique_frames, left_frame),
+        right_frame + 1 - left_frame));
+    SubVector<BaseFloat> feat(*feats, i);
+    delta_features_.Process(temp_src, frames[i] - left_frame, &feat);
+  }
+}
+
 OnlineDeltaFeature::OnlineDeltaFeature(const DeltaFeaturesOptions &opts,
                                        OnlineFeatureInterface *src):
     src_(src), opts_(opts), delta_features_(opts) { }
@@ -493,6 +744,32 @@ void OnlineCacheFeature::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
   }
 }
 
+void OnlineCacheFeature::GetFrames(const std::vector<int32> &frames,
+                                   MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(static_cast<int32>(frames.size()) == feats->NumRows());
+  // Get any frames that are not cached in a single batch.
+  std::vector<int32> frames_to_compute;
+  for (size_t i = 0; i < frames.size(); i++) {
+    int32 frame = frames[i];
+    KALDI_ASSERT(frame >= 0);
+    if (static_cast<size_t>(frame) >= cache_.size() || cache_[frame] == NULL)
+      frames_to_compute.push_back(frame);
+  }
+  if (!frames_to_compute.empty()) {
+    SortAndUniq(&frames_to_compute);
+    int32 dim = this->Dim();
+    Matrix<BaseFloat> computed(frames_to_compute.size(), dim, kUndefined);
+    // The following call will crash if some frame is not ready.
+    src_->GetFrames(frames_to_compute, &computed);
+    if (static_cast<size_t>(frames_to_compute.back()) >= cache_.size())
+      cache_.resize(frames_to_compute.back() + 1, NULL);
+    for (size_t i = 0; i < frames_to_compute.size(); i++)
+      cache_[frames_to_compute[i]] = new Vector<BaseFloat>(computed.Row(i));
+  }
+  for (size_t i = 0; i < frames.size(); i++)
+    feats->Row(i).CopyFromVec(*(cache_[frames[i]]));
+}
+
 void OnlineCacheFeature::ClearCache() {
   for (size_t i = 0; i < cache_.size(); i++)
     delete cache_[i];
@@ -510,5 +787,15 @@ void OnlineAppendFeature::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
   src2_->GetFrame(frame, &feat2);
 };
 
+void OnlineAppendFeature::GetFrames(const std::vector<int32> &frames,
+                                    MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(static_cast<int32>(frames.size()) == feats->NumRows() &&
+               feats->NumCols() == Dim());
+  SubMatrix<BaseFloat> feats1(feats->ColRange(0, src1_->Dim())),
+      feats2(feats->ColRange(src1_->Dim(), src2_->Dim()));
+  src1_->GetFrames(frames, &feats1);
+  src2_->GetFrames(frames, &feats2);
+}
+
 
 }  // namespace kaldi
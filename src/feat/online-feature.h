@@ -65,6 +65,9 @@ class OnlineGenericBaseFeature: public OnlineBaseFeature {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
+
   // Next, functions that are not in the interface.
 
 
@@ -153,6 +156,13 @@ class OnlineMatrixFeature: public OnlineFeatureInterface {
     feat->CopyFromVec(mat_.Row(frame));
   }
 
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats) {
+    KALDI_ASSERT(static_cast<int32>(frames.size()) == feats->NumRows());
+    if (!frames.empty())
+      feats->CopyRows(mat_, &(frames[0]));
+  }
+
   virtual bool IsLastFrame(int32 frame) const {
     return (frame + 1 == mat_.NumRows());
   }
@@ -179,10 +189,15 @@ struct OnlineCmvnOptions {
   bool normalize_variance;
 
   int32 modulus;  // not configurable from command line, relates to how the
-                  // class computes the cmvn internally.  smaller->more
-                  // time-efficient but less memory-efficient.  Must be >= 1.
-  int32 ring_buffer_size;  // not configurable from command line; size of ring
-                           // buffer used for caching CMVN stats.
+                  // class computes the cmvn internally: it stores checkpoints
+                  // of the cumulative stats every "modulus" frames, and caches
+                  // blocks of "modulus" frames of cumulative stats.
+                  // smaller->more time-efficient for random access but less
+                  // memory-efficient.  Must be >= 1.
+  int32 ring_buffer_size;  // not configurable from command line; number of
+                           // blocks of cumulative stats that we cache.  Must
+                           // be >= 2, so the front and back of the sliding
+                           // window can both be cached.
   std::string skip_dims; // Colon-separated list of dimensions to skip normalization
                          // of, e.g. 13:14:15.
 
@@ -198,7 +213,7 @@ struct OnlineCmvnOptions {
 
   void Check() {
     KALDI_ASSERT(speaker_frames <= cmn_window && global_frames <= speaker_frames
-                 && modulus > 0);
+                 && modulus > 0 && ring_buffer_size >= 2);
   }
 
   void Register(ParseOptions *po) {
@@ -308,6 +323,9 @@ class OnlineCmvn: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
+
   //
   // Next, functions that are not in the interface.
   //
@@ -367,21 +385,34 @@ class OnlineCmvn: public OnlineFeatureInterface {
                                     const OnlineCmvnOptions &opts,
                                     MatrixBase<double> *stats);
 
-  /// Get the most recent cached frame of CMVN stats.  [If no frames
-  /// were cached, sets up empty stats for frame zero and returns that].
-  void GetMostRecentCachedFrame(int32 frame,
-                                int32 *cached_frame,
-                                Matrix<double> *stats);
-
-  /// Cache this frame of stats.
-  void CacheFrame(int32 frame, const Matrix<double> &stats);
-
-  /// Initialize ring buffer for caching stats.
-  inline void InitRingBufferIfNeeded();
-
-  /// Computes the raw CMVN stats for this frame, making use of (and updating if
-  /// necessary) the cached statistics in raw_stats_.  This means the (x,
-  /// x^2, count) stats for the last up to opts_.cmn_window frames.
+  /// Initialize the cache of cumulative stats, if not already done.
+  inline void InitCacheIfNeeded();
+
+  /// Outputs the cumulative raw (x, x^2, count) stats of frames 0 through n-1
+  /// (so n == 0 gives zero stats), in the usual 2 x (dim+1) format.  The cost
+  /// is O(1) if n is in a cached block, and otherwise at most opts_.modulus
+  /// frames of accumulation starting from a checkpoint, so the amortized cost
+  /// per frame is O(1) for any access pattern.
+  void GetCumulativeStats(int32 n, MatrixBase<double> *stats);
+
+  /// Accumulates cumulative stats for frames num_frames_accumulated_ through
+  /// n - 1, storing checkpoints and caching the newest block as we go.
+  void AccumulateUntil(int32 n);
+
+  /// Returns the slot in cached_stats_ of block "block", filled in at least
+  /// as far as offset "offset".  If the block is not cached it is started from
+  /// its checkpoint in cached_stats_modulo_, evicting the least recently used
+  /// block.
+  int32 GetCachedBlock(int32 block, int32 offset);
+
+  /// Gets the CMVN stats that we normalize this frame with: the frozen state
+  /// if Freeze() was called, else the smoothed stats for this frame's window;
+  /// any skipped dimensions are given fake stats.
+  void GetStatsForFrame(int32 frame, MatrixBase<double> *stats);
+
+  /// Computes the raw CMVN stats for this frame, i.e. the (x, x^2, count)
+  /// stats for the last up to opts_.cmn_window frames, as the difference of
+  /// two cumulative stats.
   void ComputeStatsForFrame(int32 frame,
                             MatrixBase<double> *stats);
 
@@ -394,14 +425,29 @@ class OnlineCmvn: public OnlineFeatureInterface {
                                  // will reflect the CMVN state that we froze
                                  // at.
 
-  // The variable below reflects the raw (count, x, x^2) statistics of the
-  // input, computed every opts_.modulus frames.  raw_stats_[n / opts_.modulus]
-  // contains the (count, x, x^2) statistics for the frames from
-  // std::max(0, n - opts_.cmn_window) through n.
+  // cached_stats_modulo_[n] contains the cumulative raw (x, x^2, count)
+  // statistics of frames 0 through n * opts_.modulus - 1 (so
+  // cached_stats_modulo_[0] is zero); these checkpoints cover the whole
+  // utterance so far.
   std::vector<Matrix<double>*> cached_stats_modulo_;
-  // the variable below is a ring-buffer of cached stats.  the int32 is the
-  // frame index.
-  std::vector<std::pair<int32, Matrix<double> > > cached_stats_ring_;
+
+  // The number of frames accumulated into the cumulative stats so far, and the
+  // cumulative stats of frames 0 through num_frames_accumulated_ - 1.
+  int32 num_frames_accumulated_;
+  Matrix<double> cur_stats_;
+
+  // cached_stats_ caches opts_.ring_buffer_size blocks of cumulative stats,
+  // each covering opts_.modulus consecutive values of n.  The cumulative stats
+  // for n == block * opts_.modulus + offset, if cached in slot s, are in rows
+  // 2 * (s * opts_.modulus + offset) and 2 * (s * opts_.modulus + offset) + 1.
+  Matrix<double> cached_stats_;
+  // for each slot: the block index cached there, or -1.
+  std::vector<int32> cached_block_index_;
+  // for each slot: the number of offsets in the block that are filled in.
+  std::vector<int32> cached_block_size_;
+  // for each slot: a timestamp used to evict the least recently used block.
+  std::vector<int64> cached_block_time_;
+  int64 cache_time_;
 
   OnlineFeatureInterface *src_;  // Not owned here
 };
@@ -439,6 +485,9 @@ class OnlineSpliceFrames: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
+
   //
   // Next, functions that are not in the interface.
   //
@@ -472,6 +521,9 @@ class OnlineTransform: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
+
   //
   // Next, functions that are not in the interface.
   //
@@ -488,6 +540,72 @@ class OnlineTransform: public OnlineFeatureInterface {
   Vector<BaseFloat> offset_;
 };
 
+/// This online-feature class does the same as OnlineSpliceFrames followed by
+/// OnlineTransform (e.g. splicing followed by LDA), but it computes blocks of
+/// frames at a time: each input frame is fetched just once per block rather
+/// than once per output frame it appears in, and the transform is applied to
+/// the whole block as one matrix multiplication per context offset, instead of
+/// one matrix-vector product per frame.  The most recently computed block is
+/// cached, so it is efficient when frames are accessed in order.
+class OnlineSpliceTransform: public OnlineFeatureInterface {
+ public:
+  //
+  // First, functions that are present in the interface:
+  //
+  virtual int32 Dim() const { return offset_.Dim(); }
+
+  virtual bool IsLastFrame(int32 frame) const {
+    return src_->IsLastFrame(frame);
+  }
+  virtual BaseFloat FrameShiftInSeconds() const {
+    return src_->FrameShiftInSeconds();
+  }
+
+  virtual int32 NumFramesReady() const;
+
+  virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
+
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
+
+  //
+  // Next, functions that are not in the interface.
+  //
+
+  /// The transform can be a linear transform, or an affine transform
+  /// where the last column is the offset; its input dimension must equal
+  /// src->Dim() * (1 + opts.left_context + opts.right_context).
+  /// "block_size" is the number of frames we compute at a time.
+  OnlineSpliceTransform(const OnlineSpliceOptions &opts,
+                        const MatrixBase<BaseFloat> &transform,
+                        OnlineFeatureInterface *src,
+                        int32 block_size = 16);
+
+  /// This should be called if the input features may have changed, e.g. if
+  /// the CMVN was frozen.
+  void ClearCache() { block_num_frames_ = 0; }
+
+ private:
+  // Computes the block of output frames starting at "frame".
+  void ComputeBlock(int32 frame);
+
+  int32 left_context_;
+  int32 right_context_;
+  int32 block_size_;
+  OnlineFeatureInterface *src_;  // Not owned here
+  Matrix<BaseFloat> linear_term_;
+  Vector<BaseFloat> offset_;
+
+  // The input frames block_begin_ - left_context_ through
+  // block_begin_ + block_num_frames_ + right_context_ - 1 (limited to the
+  // range of frames that exist), one per row.
+  Matrix<BaseFloat> block_input_;
+  // Output frames block_begin_ through block_begin_ + block_num_frames_ - 1.
+  Matrix<BaseFloat> block_output_;
+  int32 block_begin_;
+  int32 block_num_frames_;
+};
+
 class OnlineDeltaFeature: public OnlineFeatureInterface {
  public:
   //
@@ -506,6 +624,9 @@ class OnlineDeltaFeature: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
+
   //
   // Next, functions that are not in the interface.
   //
@@ -537,6 +658,9 @@ class OnlineCacheFeature: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
+
   virtual ~OnlineCacheFeature() { ClearCache(); }
 
   // Things that are not in the shared interface:
@@ -574,6 +698,9 @@ class OnlineAppendFeature: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
+
   virtual ~OnlineAppendFeature() {  }
 
   OnlineAppendFeature(OnlineFeatureInterface *src1,
@@ -1220,6 +1220,15 @@ void OnlinePitchFeature::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
   impl_->GetFrame(frame, feat);
 }
 
+void OnlinePitchFeature::GetFrames(const std::vector<int32> &frames,
+                                   MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(static_cast<int32>(frames.size()) == feats->NumRows());
+  for (size_t i = 0; i < frames.size(); i++) {
+    SubVector<BaseFloat> feat(*feats, i);
+    impl_->GetFrame(frames[i], &feat);
+  }
+}
+
 void OnlinePitchFeature::AcceptWaveform(
     BaseFloat sampling_rate,
     const VectorBase<BaseFloat> &waveform) {
@@ -1428,6 +1437,82 @@ void OnlineProcessPitch::GetFrame(int32 frame,
   KALDI_ASSERT(index == dim_);
 }
 
+void OnlineProcessPitch::GetFrames(const std::vector<int32> &frames,
+                                   MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(static_cast<int32>(frames.size()) == feats->NumRows() &&
+               feats->NumCols() == dim_);
+  if (frames.empty())
+    return;
+  int32 num_frames_ready = NumFramesReady(),
+      src_frames_ready = src_->NumFramesReady(),
+      context = opts_.delta_window;
+  std::vector<int32> frames_delayed(frames.size());
+  int32 min_frame = src_frames_ready, max_frame = -1;
+  for (size_t i = 0; i < frames.size(); i++) {
+    int32 frame_delayed = frames[i] < opts_.delay ? 0 :
+        frames[i] - opts_.delay;
+    KALDI_ASSERT(frame_delayed < num_frames_ready);
+    frames_delayed[i] = frame_delayed;
+    min_frame = std::min(min_frame, frame_delayed);
+    max_frame = std::max(max_frame, frame_delayed);
+  }
+  // [begin_frame, end_frame) is the range of source frames we need, including
+  // the context for the delta-pitch features.
+  int32 begin_frame = std::max(0, min_frame - context),
+      end_frame = std::min(max_frame + context + 1, src_frames_ready),
+      num_src_frames = end_frame - begin_frame;
+  if (num_src_frames > 2 * (static_cast<int32>(frames.size()) + 2 * context)) {
+    // The frames are too spread out for this to be efficient.
+    OnlineFeatureInterface::GetFrames(frames, feats);
+    return;
+  }
+  std::vector<int32> src_frames(num_src_frames);
+  for (int32 t = begin_frame; t < end_frame; t++)
+    src_frames[t - begin_frame] = t;
+  Matrix<BaseFloat> raw_feats(num_src_frames, kRawFeatureDim, kUndefined);
+  src_->GetFrames(src_frames, &raw_feats);  // (NCCF, pitch) from pitch extractor
+
+  Matrix<BaseFloat> log_pitch(num_src_frames, 1, kUndefined), delta_log_pitch;
+  for (int32 t = 0; t < num_src_frames; t++) {
+    KALDI_ASSERT(raw_feats(t, 1) > 0);
+    log_pitch(t, 0) = Log(raw_feats(t, 1));
+  }
+  if (opts_.add_delta_pitch) {
+    // Because the range of frames includes the delta context of each frame
+    // we need (or else goes to the edge of the file), the deltas are the same
+    // as those that GetDeltaPitchFeature() would compute.
+    DeltaFeaturesOptions delta_opts;
+    delta_opts.order = 1;
+    delta_opts.window = opts_.delta_window;
+    ComputeDeltas(delta_opts, log_pitch, &delta_log_pitch);
+    while (delta_feature_noise_.size() <= static_cast<size_t>(max_frame)) {
+      delta_feature_noise_.push_back(RandGauss() *
+                                     opts_.delta_pitch_noise_stddev);
+    }
+  }
+
+  for (size_t i = 0; i < frames.size(); i++) {
+    int32 frame = frames_delayed[i], t = frame - begin_frame, index = 0;
+    if (opts_.add_pov_feature)
+      (*feats)(i, index++) = opts_.pov_scale *
+          NccfToPovFeature(raw_feats(t, 0)) + opts_.pov_offset;
+    if (opts_.add_normalized_log_pitch) {
+      UpdateNormalizationStats(frame);
+      BaseFloat avg_log_pitch = normalization_stats_[frame].sum_log_pitch_pov /
+          normalization_stats_[frame].sum_pov;
+      (*feats)(i, index++) = (log_pitch(t, 0) - avg_log_pitch) *
+          opts_.pitch_scale;
+    }
+    if (opts_.add_delta_pitch)
+      (*feats)(i, index++) = (delta_log_pitch(t, 1) +
+                              delta_feature_noise_[frame]) *
+          opts_.delta_pitch_scale;
+    if (opts_.add_raw_log_pitch)
+      (*feats)(i, index++) = log_pitch(t, 0);
+    KALDI_ASSERT(index == dim_);
+  }
+}
+
 BaseFloat OnlineProcessPitch::GetPovFeature(int32 frame) const {
   Vector<BaseFloat> tmp(kRawFeatureDim);
   src_->GetFrame(frame, &tmp);  // (NCCF, pitch) from pitch extractor
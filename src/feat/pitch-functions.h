@@ -313,6 +313,9 @@ class OnlinePitchFeature: public OnlineBaseFeature {
   /// should probably post-process this using class OnlineProcessPitch.
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
+
   virtual void AcceptWaveform(BaseFloat sampling_rate,
                               const VectorBase<BaseFloat> &waveform);
 
@@ -349,6 +352,11 @@ class OnlineProcessPitch: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  /// This gets all the raw pitch frames it needs from the source in one batch,
+  /// and computes the delta-pitch features for all the frames at once.
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
+
   virtual ~OnlineProcessPitch() {  }
 
   // Does not take ownership of "src".
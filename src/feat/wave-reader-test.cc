@@ -17,10 +17,13 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <unistd.h>
+#include <fstream>
 #include <iostream>
 
 #include "base/kaldi-math.h"
 #include "feat/wave-reader.h"
+#include "feat/wave-segment-reader.h"
 #include "matrix/kaldi-matrix.h"
 
 using namespace kaldi;
@@ -198,11 +201,140 @@ static void UnitTestEndless2() {
   AssertEqual(wave.Data(), expected);
 }
 
+// A stream buffer that does not support seeking, like a pipe.
+class UnseekableStringBuf: public std::stringbuf {
+ public:
+  explicit UnseekableStringBuf(const std::string &s):
+      std::stringbuf(s, std::ios::in | std::ios::binary) { }
+ protected:
+  virtual pos_type seekoff(off_type, std::ios_base::seekdir,
+                           std::ios_base::openmode) { return pos_type(-1); }
+  virtual pos_type seekpos(pos_type, std::ios_base::openmode) {
+    return pos_type(-1);
+  }
+};
+
+static WaveData RandomWaveData() {
+  Matrix<BaseFloat> data(RandInt(1, 3), RandInt(1, 5000));
+  for (int32 i = 0; i < data.NumRows(); i++)
+    for (int32 j = 0; j < data.NumCols(); j++)
+      data(i, j) = RandInt(-32768, 32767);
+  return WaveData(RandInt(1, 2) * 8000, data);
+}
+
+static void UnitTestWaveReader() {
+  for (int32 n = 0; n < 10; n++) {
+    WaveData wave = RandomWaveData();
+    const Matrix<BaseFloat> &data = wave.Data();
+    int32 num_samp = data.NumCols();
+    std::ostringstream os(std::ios::out | std::ios::binary);
+    wave.Write(os);
+
+    for (int32 seekable = 0; seekable <= 1; seekable++) {
+      UnseekableStringBuf unseekable_buf(os.str());
+      std::istringstream seekable_is(os.str(),
+                                     std::ios::in | std::ios::binary);
+      std::istream unseekable_is(&unseekable_buf);
+      WaveReader reader(seekable ? seekable_is : unseekable_is);
+      KALDI_ASSERT(reader.IsSeekable() == (seekable != 0));
+      KALDI_ASSERT(reader.NumChannels() == data.NumRows());
+      AssertEqual(reader.SampFreq(), wave.SampFreq(), 0);
+
+      // Read the whole file in chunks.
+      int32 chunk_size = RandInt(1, 1000);
+      Matrix<BaseFloat> chunk;
+      while (reader.Position() < num_samp) {
+        int32 pos = reader.Position(),
+            num_read = reader.Read(chunk_size, &chunk);
+        KALDI_ASSERT(num_read == std::min(chunk_size, num_samp - pos));
+        AssertEqual(chunk, Matrix<BaseFloat>(data.ColRange(pos, num_read)));
+      }
+      KALDI_ASSERT(reader.Read(chunk_size, &chunk) == 0 &&
+                   chunk.NumCols() == 0);
+
+      // Seeking backwards only works on seekable streams.
+      int32 pos = RandInt(0, num_samp - 1);
+      KALDI_ASSERT(reader.Seek(pos) == (seekable != 0));
+      if (seekable) {
+        KALDI_ASSERT(reader.Read(chunk_size, &chunk) ==
+                     std::min(chunk_size, num_samp - pos));
+        AssertEqual(chunk, Matrix<BaseFloat>(
+            data.ColRange(pos, chunk.NumCols())));
+      }
+    }
+    // Seeking forwards works on any stream.
+    UnseekableStringBuf unseekable_buf(os.str());
+    std::istream unseekable_is(&unseekable_buf);
+    WaveReader reader(unseekable_is);
+    int32 pos = RandInt(0, num_samp - 1);
+    Matrix<BaseFloat> chunk;
+    KALDI_ASSERT(reader.Seek(pos));
+    KALDI_ASSERT(reader.Read(num_samp, &chunk) == num_samp - pos);
+    AssertEqual(chunk, Matrix<BaseFloat>(data.ColRange(pos, num_samp - pos)));
+    KALDI_ASSERT(reader.Seek(num_samp + 10) &&
+                 reader.Read(num_samp, &chunk) == 0);
+  }
+}
+
+static void UnitTestWaveSegmentReader() {
+  BaseFloat samp_freq = 8000.0;
+  Matrix<BaseFloat> data(2, 16000);
+  for (int32 i = 0; i < data.NumRows(); i++)
+    for (int32 j = 0; j < data.NumCols(); j++)
+      data(i, j) = RandInt(-32768, 32767);
+  {
+    std::ofstream os("tmp.wav", std::ios::out | std::ios::binary);
+    WaveData(samp_freq, data).Write(os);
+  }
+  {
+    std::ofstream os("tmp.scp");
+    os << "rec1 tmp.wav\n"
+       << "rec2 cat tmp.wav |\n";
+  }
+  {
+    std::ofstream os("tmp.segments");
+    os << "seg1 rec1 0.5 1.0 1\n"
+       << "seg2 rec1 0.1 0.3 0\n"       // before seg1: seeks back.
+       << "seg3 rec1 1.5 -1\n"          // to the end, both channels.
+       << "seg4 rec1 1.8 2.1 0\n"       // overshoots: truncated.
+       << "seg5 rec1 1.0 4.0 0\n"       // overshoots too far: skipped.
+       << "seg6 rec3 0.0 1.0 0\n"       // no such recording: skipped.
+       << "seg7 rec2 0.5 1.0 1\n"
+       << "seg8 rec2 0.1 0.3 0\n"       // before seg7: reopens the pipe.
+       << "seg9 rec2 1.5 -1 1\n"
+       << "seg10 rec2 1.0 1.05 0\n";    // too short: skipped.
+  }
+  const char *keys[] = { "seg1", "seg2", "seg3", "seg4", "seg7", "seg8",
+                         "seg9" };
+  int32 channels[] = { 1, 0, -1, 0, 1, 0, 1 };
+  BaseFloat starts[] = { 0.5, 0.1, 1.5, 1.8, 0.5, 0.1, 1.5 },
+      ends[] = { 1.0, 0.3, 2.0, 2.0, 1.0, 0.3, 2.0 };
+  int32 num_segments = sizeof(channels) / sizeof(channels[0]), i = 0;
+
+  SequentialWaveSegmentReader reader("scp:tmp.scp", "tmp.segments");
+  for (; !reader.Done(); reader.Next(), i++) {
+    KALDI_ASSERT(i < num_segments && reader.Key() == keys[i]);
+    const WaveData &wave = reader.Value();
+    int32 start = starts[i] * samp_freq, end = ends[i] * samp_freq;
+    SubMatrix<BaseFloat> expected =
+        (channels[i] == -1 ? data.ColRange(start, end - start) :
+         data.Range(channels[i], 1, start, end - start));
+    AssertEqual(wave.SampFreq(), samp_freq, 0);
+    AssertEqual(wave.Data(), Matrix<BaseFloat>(expected));
+  }
+  KALDI_ASSERT(i == num_segments && reader.NumLinesRead() == 10);
+  unlink("tmp.wav");
+  unlink("tmp.scp");
+  unlink("tmp.segments");
+}
+
 static void UnitTest() {
   UnitTestStereo8K();
   UnitTestMono22K();
   UnitTestEndless1();
   UnitTestEndless2();
+  UnitTestWaveReader();
+  UnitTestWaveSegmentReader();
 }
 
 int main() {
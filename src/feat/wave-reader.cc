@@ -269,6 +269,24 @@ void WaveInfo::Read(std::istream &is) {
     samp_count_ = data_chunk_size / block_align;
 }
 
+// Converts the 16-bit interleaved samples in 'buffer' to the matrix 'data',
+// which is arranged row per channel, column per sample; 'buffer' must contain
+// data->NumCols() samples.
+static void DecodeSamples(const char *buffer, const WaveInfo &info,
+                          MatrixBase<BaseFloat> *data) {
+  KALDI_ASSERT(data->NumRows() == info.NumChannels());
+  const uint16 *data_ptr = reinterpret_cast<const uint16*>(buffer);
+  bool reverse_bytes = info.ReverseBytes();
+  for (MatrixIndexT i = 0; i < data->NumCols(); ++i) {
+    for (MatrixIndexT j = 0; j < data->NumRows(); ++j) {
+      int16 k = *data_ptr++;
+      if (reverse_bytes)
+        KALDI_SWAP2(k);
+      (*data)(j, i) = k;
+    }
+  }
+}
+
 void WaveData::Read(std::istream &is) {
   const uint32 kBlockSize = 1024 * 1024;
 
@@ -306,19 +324,76 @@ void WaveData::Read(std::istream &is) {
                << "Truncated file?";
   }
 
-  uint16 *data_ptr = reinterpret_cast<uint16*>(&buffer[0]);
-
   // The matrix is arranged row per channel, column per sample.
   data_.Resize(header.NumChannels(),
                buffer.size() / header.BlockAlign());
-  for (uint32 i = 0; i < data_.NumCols(); ++i) {
-    for (uint32 j = 0; j < data_.NumRows(); ++j) {
-      int16 k = *data_ptr++;
-      if (header.ReverseBytes())
-        KALDI_SWAP2(k);
-      data_(j, i) =  k;
+  DecodeSamples(&buffer[0], header, &data_);
+}
+
+
+WaveReader::WaveReader(std::istream &is): is_(is), data_begin_(-1),
+                                          position_(0) {
+  info_.Read(is);
+  // tellg() returns -1 for streams that do not support seeking, e.g. pipes.
+  std::streampos pos = is.tellg();
+  if (pos != std::streampos(-1))
+    data_begin_ = static_cast<int64>(pos);
+}
+
+int32 WaveReader::ReadBuffer(int32 max_samples) {
+  KALDI_ASSERT(max_samples >= 0);
+  int64 num_samples = max_samples;
+  if (!info_.IsStreamed())
+    num_samples = std::min<int64>(
+        num_samples, std::max<int64>(0, info_.SampleCount() - position_));
+  if (num_samples == 0 || !is_.good())
+    return 0;
+  size_t block_align = info_.BlockAlign();
+  buffer_.resize(num_samples * block_align);
+  is_.read(&buffer_[0], buffer_.size());
+  if (is_.bad())
+    KALDI_ERR << "WaveReader: file read error";
+  // Any incomplete sample at the end of the file is discarded.
+  int32 num_read = is_.gcount() / block_align;
+  position_ += num_read;
+  return num_read;
+}
+
+int32 WaveReader::Read(int32 max_samples, Matrix<BaseFloat> *chunk) {
+  int32 num_read = ReadBuffer(max_samples);
+  if (num_read == 0) {
+    chunk->Resize(0, 0);
+  } else {
+    chunk->Resize(info_.NumChannels(), num_read, kUndefined);
+    DecodeSamples(&buffer_[0], info_, chunk);
+  }
+  return num_read;
+}
+
+bool WaveReader::Seek(int64 sample) {
+  KALDI_ASSERT(sample >= 0);
+  if (sample == position_)
+    return true;
+  if (IsSeekable()) {
+    is_.clear();  // we may have hit the end of the file.
+    is_.seekg(data_begin_ + sample * static_cast<int64>(info_.BlockAlign()));
+    if (is_.fail())
+      KALDI_ERR << "WaveReader: failed to seek to sample " << sample;
+    position_ = sample;
+    return true;
+  }
+  if (sample < position_)
+    return false;
+  const int32 kSkipSize = 65536;  // Skip at most this many samples at a time.
+  while (position_ < sample) {
+    int32 num_samples = std::min<int64>(sample - position_, kSkipSize);
+    if (ReadBuffer(num_samples) < num_samples) {
+      // End of data; subsequent reads will return nothing.
+      position_ = sample;
+      break;
     }
   }
+  return true;
 }
 
 
@@ -49,8 +49,10 @@
 #define KALDI_FEAT_WAVE_READER_H_
 
 #include <cstring>
+#include <vector>
 
 #include "base/kaldi-types.h"
+#include "base/kaldi-utils.h"
 #include "matrix/kaldi-vector.h"
 #include "matrix/kaldi-matrix.h"
 
@@ -150,6 +152,60 @@ class WaveData {
 };
 
 
+/// This class reads the samples of a wave file incrementally, a chunk at a
+/// time, so that long recordings can be processed without holding the whole
+/// file in memory.  It works with any stream, including pipes; if the stream
+/// is seekable (e.g. an actual file), Seek() will jump directly to the
+/// requested sample, otherwise it only supports seeking forward, by reading
+/// and discarding the samples in between.
+class WaveReader {
+ public:
+  /// Reads the header from 'is', which should be opened in binary mode and
+  /// must outlive this object.  Throws on error.
+  explicit WaveReader(std::istream &is);
+
+  const WaveInfo &Info() const { return info_; }
+
+  BaseFloat SampFreq() const { return info_.SampFreq(); }
+
+  int32 NumChannels() const { return info_.NumChannels(); }
+
+  /// Returns the index of the next sample that Read() will return.
+  int64 Position() const { return position_; }
+
+  /// Returns true if the underlying stream supports seeking.
+  bool IsSeekable() const { return data_begin_ >= 0; }
+
+  /// Reads up to 'max_samples' samples, starting at Position(), and puts them
+  /// in 'chunk', which is resized to NumChannels() by the number of samples
+  /// read.  Returns the number of samples read, which is less than
+  /// 'max_samples' only at the end of the data (zero if there is no more
+  /// data).
+  int32 Read(int32 max_samples, Matrix<BaseFloat> *chunk);
+
+  /// Repositions the reader so that the next sample read is 'sample'.  Returns
+  /// false if this is not possible, i.e. if the stream is not seekable and
+  /// 'sample' is before Position().  Seeking past the end of the data
+  /// succeeds, but subsequent calls to Read() will return no data.
+  bool Seek(int64 sample);
+
+ private:
+  // Reads up to 'max_samples' samples into buffer_ and returns the number of
+  // whole samples read.
+  int32 ReadBuffer(int32 max_samples);
+
+  std::istream &is_;
+  WaveInfo info_;
+  // Stream position of the first sample, or -1 if the stream is not seekable.
+  int64 data_begin_;
+  // Index of the next sample to be read.
+  int64 position_;
+  std::vector<char> buffer_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(WaveReader);
+};
+
+
 // Holder class for .wav files that enables us to read (but not write) .wav
 // files. c.f. util/kaldi-holder.h we don't use the KaldiObjectHolder template
 // because we don't want to check for the \0B binary header. We could have faked
@@ -0,0 +1,286 @@
+// feat/wave-segment-reader.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <limits>
+#include <vector>
+
+#include "feat/wave-segment-reader.h"
+
+namespace kaldi {
+
+SequentialWaveSegmentReader::SequentialWaveSegmentReader(
+    const std::string &wav_rspecifier,
+    const std::string &segments_rxfilename,
+    const WaveSegmentOptions &opts):
+    opts_(opts), wav_reader_(NULL), permissive_(false), num_lines_(0),
+    recording_reader_(NULL), done_(false) {
+  if (segments_rxfilename.empty()) {
+    wav_reader_ = new SequentialTableReader<WaveHolder>(wav_rspecifier);
+    return;
+  }
+  std::string script_rxfilename;
+  RspecifierOptions rspecifier_opts;
+  if (ClassifyRspecifier(wav_rspecifier, &script_rxfilename,
+                         &rspecifier_opts) != kScriptRspecifier)
+    KALDI_ERR << "Reading segments requires the wave files to be given as a "
+              << "script file (e.g. scp:wav.scp), got " << wav_rspecifier;
+  permissive_ = rspecifier_opts.permissive;
+  std::vector<std::pair<std::string, std::string> > script;
+  if (!ReadScriptFile(script_rxfilename, true, &script))
+    KALDI_ERR << "Error reading script file "
+              << PrintableRxfilename(script_rxfilename);
+  for (size_t i = 0; i < script.size(); i++) {
+    if (!recordings_.insert(script[i]).second)
+      KALDI_WARN << "Duplicate recording-id " << script[i].first
+                 << " in script file "
+                 << PrintableRxfilename(script_rxfilename)
+                 << ", using the first entry.";
+  }
+  if (!segments_input_.Open(segments_rxfilename))
+    KALDI_ERR << "Error opening segments file "
+              << PrintableRxfilename(segments_rxfilename);
+  ReadNextSegment();
+}
+
+SequentialWaveSegmentReader::~SequentialWaveSegmentReader() {
+  delete wav_reader_;
+  delete recording_reader_;
+}
+
+bool SequentialWaveSegmentReader::Done() const {
+  if (wav_reader_ != NULL)
+    return wav_reader_->Done();
+  return done_;
+}
+
+void SequentialWaveSegmentReader::Next() {
+  if (wav_reader_ != NULL) {
+    wav_reader_->Next();
+    return;
+  }
+  KALDI_ASSERT(!done_);
+  ReadNextSegment();
+}
+
+std::string SequentialWaveSegmentReader::Key() const {
+  if (wav_reader_ != NULL)
+    return wav_reader_->Key();
+  KALDI_ASSERT(!done_);
+  return key_;
+}
+
+const WaveData &SequentialWaveSegmentReader::Value() const {
+  if (wav_reader_ != NULL)
+    return wav_reader_->Value();
+  KALDI_ASSERT(!done_);
+  return value_;
+}
+
+void SequentialWaveSegmentReader::ReadNextSegment() {
+  std::string line;
+  while (std::getline(segments_input_.Stream(), line)) {
+    num_lines_++;
+    if (ReadSegment(line))
+      return;
+  }
+  done_ = true;
+  key_.clear();
+  value_.Clear();
+  // We don't need the recording any more.
+  delete recording_reader_;
+  recording_reader_ = NULL;
+  recording_input_.Close();
+}
+
+bool SequentialWaveSegmentReader::ReadSegment(const std::string &line) {
+  std::vector<std::string> split_line;
+  // There must be 4 fields--segment name, recording id, start time, end time;
+  // the 5th field (channel info) is optional.
+  SplitStringToVector(line, " \t\r", true, &split_line);
+  if (split_line.size() != 4 && split_line.size() != 5) {
+    KALDI_WARN << "Invalid line in segments file: " << line;
+    return false;
+  }
+  const std::string &segment = split_line[0],
+      &recording = split_line[1];
+  double start, end;
+  if (!ConvertStringToReal(split_line[2], &start)) {
+    KALDI_WARN << "Invalid line in segments file [bad start]: " << line;
+    return false;
+  }
+  if (!ConvertStringToReal(split_line[3], &end)) {
+    KALDI_WARN << "Invalid line in segments file [bad end]: " << line;
+    return false;
+  }
+  // start time must not be negative; start time must not be greater than
+  // end time, except if end time is -1
+  if (start < 0 || (end != -1.0 && end <= 0) ||
+      ((start >= end) && (end > 0))) {
+    KALDI_WARN << "Invalid line in segments file [empty or invalid segment]: "
+               << line;
+    return false;
+  }
+  int32 channel = -1;  // means channel info is unspecified.
+  if (split_line.size() == 5) {
+    if (!ConvertStringToInteger(split_line[4], &channel) || channel < 0) {
+      KALDI_WARN << "Invalid line in segments file [bad channel]: " << line;
+      return false;
+    }
+  }
+  if (recordings_.count(recording) == 0) {
+    KALDI_WARN << "Could not find recording " << recording
+               << ", skipping segment " << segment;
+    return false;
+  }
+  if (!OpenRecording(recording, -1))
+    return false;
+
+  const WaveInfo &info = recording_reader_->Info();
+  BaseFloat samp_freq = info.SampFreq();
+  int32 num_chan = info.NumChannels();
+  if (channel >= num_chan) {
+    KALDI_WARN << "Invalid channel " << channel << " >= " << num_chan
+               << ", skipping segment " << segment;
+    return false;
+  }
+  int64 start_samp = start * samp_freq,
+      end_samp = (end != -1.0 ? static_cast<int64>(end * samp_freq) : -1);
+  // If the header tells us the length of the recording, we can reject
+  // segments without reading anything.
+  if (!info.IsStreamed() &&
+      !CheckSegmentRange(segment, samp_freq, info.SampleCount(),
+                         start_samp, &end_samp))
+    return false;
+
+  if (!OpenRecording(recording, start_samp))
+    return false;
+  Matrix<BaseFloat> data;
+  if (end_samp != -1) {
+    recording_reader_->Read(end_samp - start_samp, &data);
+  } else {
+    // Read to the end of the recording, one block at a time.
+    const int32 kBlockSize = 1 << 20;
+    std::vector<Matrix<BaseFloat>* > blocks;
+    int64 num_samp_read = 0;
+    while (true) {
+      Matrix<BaseFloat> *block = new Matrix<BaseFloat>();
+      blocks.push_back(block);
+      num_samp_read += recording_reader_->Read(kBlockSize, block);
+      if (block->NumCols() < kBlockSize)
+        break;
+    }
+    if (num_samp_read > 0) {
+      data.Resize(num_chan, num_samp_read, kUndefined);
+      int64 offset = 0;
+      for (size_t i = 0; i < blocks.size(); i++) {
+        if (blocks[i]->NumCols() == 0) continue;
+        data.ColRange(offset, blocks[i]->NumCols()).CopyFromMat(*blocks[i]);
+        offset += blocks[i]->NumCols();
+      }
+    }
+    DeletePointers(&blocks);
+  }
+  // Check the segment against the samples we actually got, which matters if
+  // the header did not give the length or the file was truncated.
+  int64 num_samp_read = data.NumCols(),
+      num_samp = std::numeric_limits<int64>::max();
+  if (end_samp == -1 || start_samp + num_samp_read < end_samp)
+    num_samp = start_samp + num_samp_read;
+  if (!CheckSegmentRange(segment, samp_freq, num_samp, start_samp, &end_samp))
+    return false;
+
+  key_ = segment;
+  if (channel == -1) {
+    WaveData wave(samp_freq, data.ColRange(0, end_samp - start_samp));
+    value_.Swap(&wave);
+  } else {
+    WaveData wave(samp_freq,
+                  data.Range(channel, 1, 0, end_samp - start_samp));
+    value_.Swap(&wave);
+  }
+  return true;
+}
+
+bool SequentialWaveSegmentReader::OpenRecording(const std::string &recording,
+                                                int64 start_samp) {
+  if (recording_reader_ != NULL && recording == recording_ &&
+      (start_samp == -1 || recording_reader_->Seek(start_samp)))
+    return true;
+  // We need to (re)open the recording.
+  if (recording_reader_ != NULL && recording == recording_)
+    KALDI_VLOG(1) << "Reopening recording " << recording << " to read "
+                  << "from sample " << start_samp << "; it is faster if the "
+                  << "segments of each recording are in order.";
+  delete recording_reader_;
+  recording_reader_ = NULL;
+  recording_ = recording;
+  const std::string &rxfilename = recordings_[recording];
+  if (!recording_input_.Open(rxfilename)) {
+    if (permissive_) {
+      KALDI_WARN << "Failed to open recording " << recording << " from "
+                 << PrintableRxfilename(rxfilename);
+      return false;
+    }
+    KALDI_ERR << "Failed to open recording " << recording << " from "
+              << PrintableRxfilename(rxfilename);
+  }
+  try {
+    recording_reader_ = new WaveReader(recording_input_.Stream());
+  } catch (const std::exception &e) {
+    if (!permissive_)
+      throw;
+    KALDI_WARN << "Failed to read wave header of recording " << recording
+               << " from " << PrintableRxfilename(rxfilename);
+    return false;
+  }
+  if (start_samp != -1 && !recording_reader_->Seek(start_samp))
+    KALDI_ERR << "Failed to seek to sample " << start_samp
+              << " of recording " << recording;  // Should not happen.
+  return true;
+}
+
+bool SequentialWaveSegmentReader::CheckSegmentRange(
+    const std::string &segment, BaseFloat samp_freq, int64 num_samp,
+    int64 start_samp, int64 *end_samp) const {
+  // start sample must be less than total number of samples.
+  if (start_samp >= num_samp) {
+    KALDI_WARN << "Start sample out of range " << start_samp << " [length:] "
+               << num_samp << ", skipping segment " << segment;
+    return false;
+  }
+  if (*end_samp == -1) {
+    *end_samp = num_samp;
+  } else if (*end_samp > num_samp) {
+    if (*end_samp >=
+        num_samp + static_cast<int64>(opts_.max_overshoot * samp_freq)) {
+      KALDI_WARN << "End sample too far out of range " << *end_samp
+                 << " [length:] " << num_samp << ", skipping segment "
+                 << segment;
+      return false;
+    }
+    *end_samp = num_samp;  // for small differences, just truncate.
+  }
+  // Skip if segment size is less than minimum segment length.
+  if (*end_samp <=
+      start_samp + static_cast<int64>(opts_.min_segment_length * samp_freq)) {
+    KALDI_WARN << "Segment " << segment << " too short, skipping it.";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace kaldi
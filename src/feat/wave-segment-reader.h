@@ -0,0 +1,141 @@
+// feat/wave-segment-reader.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_FEAT_WAVE_SEGMENT_READER_H_
+#define KALDI_FEAT_WAVE_SEGMENT_READER_H_
+
+#include <string>
+#include <unordered_map>
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "feat/wave-reader.h"
+
+namespace kaldi {
+
+struct WaveSegmentOptions {
+  BaseFloat min_segment_length;  // Minimum segment length in seconds.
+  BaseFloat max_overshoot;  // Max time by which last segment can overshoot.
+
+  WaveSegmentOptions(): min_segment_length(0.1), max_overshoot(0.5) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("min-segment-length", &min_segment_length,
+                   "Minimum segment length in seconds (reject shorter "
+                   "segments)");
+    opts->Register("max-overshoot", &max_overshoot,
+                   "End segments overshooting audio by less than this (in "
+                   "seconds) are truncated, else rejected.");
+  }
+};
+
+
+/// This class iterates over the segments of a set of recordings, as given by a
+/// "segments" file, and has the same interface as
+/// SequentialTableReader<WaveHolder>.  Each line of the segments file is
+///   <segment-id> <recording-id> <start-time> <end-time> [<channel>]
+/// where an <end-time> of -1 means the end of the recording.  Only the samples
+/// of the segment are read from the recording, using class WaveReader, so the
+/// memory used is bounded by the segment length, not by the length of the
+/// recording.  The recording currently being read is kept open; if it is an
+/// actual file we seek to the start of each segment, otherwise (e.g. if it is
+/// a pipe) we read forward to it, and have to reopen the recording if the
+/// segments of a recording are not in order of increasing start time.
+///
+/// If no segments file is given, it just iterates over the recordings in the
+/// wav-rspecifier.
+class SequentialWaveSegmentReader {
+ public:
+  /// If 'segments_rxfilename' is nonempty, 'wav_rspecifier' must be a script
+  /// file, e.g. "scp:wav.scp", mapping recording-id to the rxfilename of the
+  /// wave file; the "p" (permissive) option makes it skip segments of
+  /// recordings that cannot be read instead of dying.  Throws on error.
+  SequentialWaveSegmentReader(
+      const std::string &wav_rspecifier,
+      const std::string &segments_rxfilename,
+      const WaveSegmentOptions &opts = WaveSegmentOptions());
+
+  ~SequentialWaveSegmentReader();
+
+  bool Done() const;
+
+  void Next();
+
+  /// Returns the segment-id (or the recording-id if there is no segments
+  /// file).
+  std::string Key() const;
+
+  /// Returns the wave data of the segment.  If the channel was given in the
+  /// segments file, it has just that channel, otherwise it has all the
+  /// channels of the recording.
+  const WaveData &Value() const;
+
+  /// Returns the number of lines of the segments file read so far.
+  int32 NumLinesRead() const { return num_lines_; }
+
+ private:
+  // Reads lines of the segments file until a segment is successfully read
+  // into key_ and value_, and sets done_ if there are no more segments.
+  void ReadNextSegment();
+
+  // Tries to read the segment on 'line'; returns false (with a warning) if the
+  // line is invalid or the segment is to be skipped.
+  bool ReadSegment(const std::string &line);
+
+  // Makes sure that the recording 'recording' is open and that its next
+  // sample is 'start_samp', reopening the recording if necessary.  If
+  // 'start_samp' is -1 it only makes sure the recording is open.  Returns
+  // false if the recording could not be read in permissive mode, and throws
+  // in non-permissive mode.
+  bool OpenRecording(const std::string &recording, int64 start_samp);
+
+  // Checks the range [start_samp, *end_samp) of a segment against the
+  // length of the recording, 'num_samp', and truncates *end_samp if it
+  // overshoots by less than the max-overshoot.  *end_samp == -1 means the
+  // segment runs to the end of the recording.  Returns false (with a warning)
+  // if the segment should be skipped.
+  bool CheckSegmentRange(const std::string &segment, BaseFloat samp_freq,
+                         int64 num_samp, int64 start_samp,
+                         int64 *end_samp) const;
+
+  WaveSegmentOptions opts_;
+
+  // Used instead of everything below if there is no segments file.
+  SequentialTableReader<WaveHolder> *wav_reader_;
+
+  bool permissive_;
+  // Map from recording-id to rxfilename, read from the script file.
+  std::unordered_map<std::string, std::string> recordings_;
+  Input segments_input_;
+  int32 num_lines_;
+
+  // The recording currently open, if recording_reader_ != NULL.
+  std::string recording_;
+  Input recording_input_;
+  WaveReader *recording_reader_;
+
+  bool done_;
+  std::string key_;
+  WaveData value_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(SequentialWaveSegmentReader);
+};
+
+
+}  // namespace kaldi
+
+#endif  // KALDI_FEAT_WAVE_SEGMENT_READER_H_
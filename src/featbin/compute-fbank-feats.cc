@@ -20,9 +20,10 @@
 
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
+#include "util/kaldi-thread.h"
 #include "feat/feature-fbank.h"
 #include "feat/wave-reader.h"
-
+#include "feat/wave-segment-reader.h"
 
 int main(int argc, char *argv[]) {
   try {
@@ -40,6 +41,8 @@ int main(int argc, char *argv[]) {
     std::string utt2spk_rspecifier;
     int32 channel = -1;
     BaseFloat min_duration = 0.0;
+    std::string segments_rxfilename;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
     // Define defaults for gobal options
     std::string output_format = "kaldi";
 
@@ -53,6 +56,12 @@ int main(int argc, char *argv[]) {
     po.Register("utt2spk", &utt2spk_rspecifier, "Utterance to speaker-id map (if doing VTLN and you have warps per speaker)");
     po.Register("channel", &channel, "Channel to extract (-1 -> expect mono, 0 -> left, 1 -> right)");
     po.Register("min-duration", &min_duration, "Minimum duration of segments to process (in seconds).");
+    po.Register("segments", &segments_rxfilename, "Segments file, with lines "
+                "<segment-id> <recording-id> <start-time> <end-time> "
+                "[<channel>]; if supplied, features are computed for each "
+                "segment, reading just its samples from the recording "
+                "(requires an scp <wav-rspecifier>).");
+    sequencer_config.Register(&po);
 
     // OPTION PARSING ..........................................................
     //
@@ -69,9 +78,13 @@ int main(int argc, char *argv[]) {
 
     std::string output_wspecifier = po.GetArg(2);
 
-    Fbank fbank(fbank_opts);
+    const Fbank fbank(fbank_opts);
+    // Each worker thread gets its own copy of 'fbank' from this pool.
+    OfflineFeatureTplPool<FbankComputer> fbank_pool(fbank);
+    uint16 htk_param_kind = 007 |  // FBANK
+        (fbank_opts.use_energy ? 0100 : 020000);  // energy; otherwise c0
 
-    SequentialTableReader<WaveHolder> reader(wav_rspecifier);
+    SequentialWaveSegmentReader reader(wav_rspecifier, segments_rxfilename);
     BaseFloatMatrixWriter kaldi_writer;  // typedef to TableWriter<something>.
     TableWriter<HtkMatrixHolder> htk_writer;
 
@@ -94,6 +107,8 @@ int main(int argc, char *argv[]) {
     }
 
     int32 num_utts = 0, num_success = 0;
+    TaskSequencer<OfflineFeatureComputeTask<FbankComputer> > sequencer(
+        sequencer_config);
     for (; !reader.Done(); reader.Next()) {
       num_utts++;
       std::string utt = reader.Key();
@@ -134,42 +149,15 @@ int main(int argc, char *argv[]) {
       }
 
       SubVector<BaseFloat> waveform(wave_data.Data(), this_chan);
-      Matrix<BaseFloat> features;
-      try {
-        fbank.ComputeFeatures(waveform, wave_data.SampFreq(), vtln_warp_local, &features);
-      } catch (...) {
-        KALDI_WARN << "Failed to compute features for utterance "
-                   << utt;
-        continue;
-      }
-      if (subtract_mean) {
-        Vector<BaseFloat> mean(features.NumCols());
-        mean.AddRowSumMat(1.0, features);
-        mean.Scale(1.0 / features.NumRows());
-        for (int32 i = 0; i < features.NumRows(); i++)
-          features.Row(i).AddVec(-1.0, mean);
-      }
-      if (output_format == "kaldi") {
-        kaldi_writer.Write(utt, features);
-      } else {
-        std::pair<Matrix<BaseFloat>, HtkHeader> p;
-        p.first.Resize(features.NumRows(), features.NumCols());
-        p.first.CopyFromMat(features);
-        HtkHeader header = {
-          features.NumRows(),
-          100000,  // 10ms shift
-          static_cast<int16>(sizeof(float)*features.NumCols()),
-          static_cast<uint16>(007 | // FBANK
-          (fbank_opts.use_energy ? 0100 : 020000)) // energy; otherwise c0
-        };
-        p.second = header;
-        htk_writer.Write(utt, p);
-      }
+      sequencer.Run(new OfflineFeatureComputeTask<FbankComputer>(
+          &fbank_pool, utt, waveform, wave_data.SampFreq(), vtln_warp_local,
+          subtract_mean, htk_param_kind,
+          (output_format == "kaldi" ? &kaldi_writer : NULL),
+          (output_format == "htk" ? &htk_writer : NULL), &num_success));
       if (num_utts % 10 == 0)
         KALDI_LOG << "Processed " << num_utts << " utterances";
-      KALDI_VLOG(2) << "Processed features for key " << utt;
-      num_success++;
     }
+    sequencer.Wait();
     KALDI_LOG << " Done " << num_success << " out of " << num_utts
               << " utterances.";
     return (num_success != 0 ? 0 : 1);
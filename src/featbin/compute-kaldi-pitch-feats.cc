@@ -22,6 +22,7 @@
 #include "util/common-utils.h"
 #include "feat/pitch-functions.h"
 #include "feat/wave-reader.h"
+#include "feat/wave-segment-reader.h"
 
 
 int main(int argc, char *argv[]) {
@@ -40,12 +41,18 @@ int main(int argc, char *argv[]) {
 
     ParseOptions po(usage);
     PitchExtractionOptions pitch_opts;
+    std::string segments_rxfilename;
     int32 channel = -1; // Note: this isn't configurable because it's not a very
                         // good idea to control it this way: better to extract the
                         // on the command line (in the .scp file) using sox or
                         // similar.
 
     pitch_opts.Register(&po);
+    po.Register("segments", &segments_rxfilename, "Segments file, with lines "
+                "<segment-id> <recording-id> <start-time> <end-time> "
+                "[<channel>]; if supplied, features are computed for each "
+                "segment, reading just its samples from the recording "
+                "(requires an scp <wav-rspecifier>).");
 
     po.Read(argc, argv);
 
@@ -57,7 +64,8 @@ int main(int argc, char *argv[]) {
     std::string wav_rspecifier = po.GetArg(1),
         feat_wspecifier = po.GetArg(2);
 
-    SequentialTableReader<WaveHolder> wav_reader(wav_rspecifier);
+    SequentialWaveSegmentReader wav_reader(wav_rspecifier,
+                                           segments_rxfilename);
     BaseFloatMatrixWriter feat_writer(feat_wspecifier);
 
     int32 num_done = 0, num_err = 0;
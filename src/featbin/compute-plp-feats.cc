@@ -22,6 +22,7 @@
 #include "util/common-utils.h"
 #include "feat/feature-plp.h"
 #include "feat/wave-reader.h"
+#include "feat/wave-segment-reader.h"
 
 
 int main(int argc, char *argv[]) {
@@ -40,6 +41,7 @@ int main(int argc, char *argv[]) {
     std::string utt2spk_rspecifier;
     int32 channel = -1;
     BaseFloat min_duration = 0.0;
+    std::string segments_rxfilename;
     // Define defaults for gobal options
     std::string output_format = "kaldi";
 
@@ -58,6 +60,11 @@ int main(int argc, char *argv[]) {
                 "0 -> left, 1 -> right)");
     po.Register("min-duration", &min_duration, "Minimum duration of segments "
                 "to process (in seconds).");
+    po.Register("segments", &segments_rxfilename, "Segments file, with lines "
+                "<segment-id> <recording-id> <start-time> <end-time> "
+                "[<channel>]; if supplied, features are computed for each "
+                "segment, reading just its samples from the recording "
+                "(requires an scp <wav-rspecifier>).");
 
     plp_opts.Register(&po);
 
@@ -74,7 +81,7 @@ int main(int argc, char *argv[]) {
 
     Plp plp(plp_opts);
 
-    SequentialTableReader<WaveHolder> reader(wav_rspecifier);
+    SequentialWaveSegmentReader reader(wav_rspecifier, segments_rxfilename);
     BaseFloatMatrixWriter kaldi_writer;  // typedef to TableWriter<something>.
     TableWriter<HtkMatrixHolder> htk_writer;
 
@@ -21,6 +21,7 @@
 #include "util/common-utils.h"
 #include "feat/feature-spectrogram.h"
 #include "feat/wave-reader.h"
+#include "feat/wave-segment-reader.h"
 
 
 int main(int argc, char *argv[]) {
@@ -36,6 +37,7 @@ int main(int argc, char *argv[]) {
     bool subtract_mean = false;
     int32 channel = -1;
     BaseFloat min_duration = 0.0;
+    std::string segments_rxfilename;
     // Define defaults for gobal options
     std::string output_format = "kaldi";
 
@@ -46,6 +48,11 @@ int main(int argc, char *argv[]) {
     po.Register("subtract-mean", &subtract_mean, "Subtract mean of each feature file [CMS]; not recommended to do it this way. ");
     po.Register("channel", &channel, "Channel to extract (-1 -> expect mono, 0 -> left, 1 -> right)");
     po.Register("min-duration", &min_duration, "Minimum duration of segments to process (in seconds).");
+    po.Register("segments", &segments_rxfilename, "Segments file, with lines "
+                "<segment-id> <recording-id> <start-time> <end-time> "
+                "[<channel>]; if supplied, features are computed for each "
+                "segment, reading just its samples from the recording "
+                "(requires an scp <wav-rspecifier>).");
 
     // OPTION PARSING ..........................................................
     //
@@ -64,7 +71,7 @@ int main(int argc, char *argv[]) {
 
     Spectrogram spec(spec_opts);
 
-    SequentialTableReader<WaveHolder> reader(wav_rspecifier);
+    SequentialWaveSegmentReader reader(wav_rspecifier, segments_rxfilename);
     BaseFloatMatrixWriter kaldi_writer;  // typedef to TableWriter<something>.
     TableWriter<HtkMatrixHolder> htk_writer;
 
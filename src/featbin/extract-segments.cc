@@ -21,6 +21,7 @@
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "feat/wave-reader.h"
+#include "feat/wave-segment-reader.h"
 
 /*! @brief This is the main program for extracting segments from a wav file
  - usage :
@@ -47,16 +48,19 @@ int main(int argc, char *argv[]) {
         "where <channel> will normally be 0 (left) or 1 (right)\n"
         "e.g. call-861225-A-0050-0065 call-861225 5.0 6.5 1\n"
         "And <end-time> of -1 means the segment runs till the end of the WAV file\n"
+        "With --streaming=true, only the samples of each segment are read, so\n"
+        "long recordings are never held in memory in their entirety; this\n"
+        "requires <wav-rspecifier> to be an scp, and works best if the segments\n"
+        "of each recording are in order of start time.\n"
         "See also: extract-feature-segments, wav-copy, wav-to-duration\n";
 
     ParseOptions po(usage);
-    BaseFloat min_segment_length = 0.1, // Minimum segment length in seconds.
-        max_overshoot = 0.5;  // max time by which last segment can overshoot
-    po.Register("min-segment-length", &min_segment_length,
-                "Minimum segment length in seconds (reject shorter segments)");
-    po.Register("max-overshoot", &max_overshoot,
-                "End segments overshooting audio by less than this (in seconds) "
-                "are truncated, else rejected.");
+    WaveSegmentOptions segment_opts;
+    bool streaming = false;
+    segment_opts.Register(&po);
+    po.Register("streaming", &streaming, "If true, read just the samples of "
+                "each segment from the recordings, seeking where the input "
+                "allows it, instead of reading whole recordings into memory.");
 
     po.Read(argc, argv);
     if (po.NumArgs() != 3) {
@@ -68,12 +72,33 @@ int main(int argc, char *argv[]) {
     std::string segments_rxfilename = po.GetArg(2);
     std::string wav_wspecifier = po.GetArg(3);
 
+    int32 num_lines = 0, num_success = 0;
+
+    if (streaming) {
+      SequentialWaveSegmentReader segment_reader(wav_rspecifier,
+                                                 segments_rxfilename,
+                                                 segment_opts);
+      TableWriter<WaveHolder> writer(wav_wspecifier);
+      for (; !segment_reader.Done(); segment_reader.Next()) {
+        std::string segment = segment_reader.Key();
+        const WaveData &wave = segment_reader.Value();
+        if (wave.Data().NumRows() != 1)
+          KALDI_ERR << "If your data has multiple channels, you must specify "
+              "the channel in the segments file.  Processing segment "
+                    << segment;
+        writer.Write(segment, wave);
+        num_success++;
+      }
+      num_lines = segment_reader.NumLinesRead();
+      KALDI_LOG << "Successfully processed " << num_success << " lines out of "
+                << num_lines << " in the segments file. ";
+      return 0;
+    }
+
     RandomAccessTableReader<WaveHolder> reader(wav_rspecifier);
     TableWriter<WaveHolder> writer(wav_wspecifier);
     Input ki(segments_rxfilename);  // no binary argment: never binary.
 
-    int32 num_lines = 0, num_success = 0;
-
     std::string line;
     /* read each line from segments file */
     while (std::getline(ki.Stream(), line)) {
@@ -150,8 +175,8 @@ int main(int argc, char *argv[]) {
        * otherwise skip the segment
        */
       if (end_samp > num_samp) {
-        if ((end_samp >=
-             num_samp + static_cast<int32>(max_overshoot * samp_freq))) {
+        if ((end_samp >= num_samp + static_cast<int32>(
+                 segment_opts.max_overshoot * samp_freq))) {
           KALDI_WARN << "End sample too far out of range " << end_samp
                      << " [length:] " << num_samp << ", skipping segment "
                      << segment;
@@ -160,8 +185,8 @@ int main(int argc, char *argv[]) {
         end_samp = num_samp;  // for small differences, just truncate.
       }
       // Skip if segment size is less than minimum segment length (default 0.1s)
-      if (end_samp <=
-          start_samp + static_cast<int32>(min_segment_length * samp_freq)) {
+      if (end_samp <= start_samp + static_cast<int32>(
+              segment_opts.min_segment_length * samp_freq)) {
         KALDI_WARN << "Segment " << segment << " too short, skipping it.";
         continue;
       }
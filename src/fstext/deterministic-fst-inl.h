@@ -255,6 +255,118 @@ bool CacheDeterministicOnDemandFst<Arc>::GetArc(StateId s, Label ilabel,
   }
 }
 
+inline InterpolateDeterministicOnDemandFst::InterpolateDeterministicOnDemandFst(
+    const std::vector<DeterministicOnDemandFst<StdArc>*> &fsts,
+    const std::vector<float> &weights, bool log_linear,
+    StateId num_cached_arcs):
+    fsts_(fsts), weights_(weights), log_linear_(log_linear),
+    num_cached_arcs_(num_cached_arcs), cached_arcs_(num_cached_arcs),
+    costs_(fsts.size()) {
+  KALDI_ASSERT(!fsts.empty() && fsts.size() == weights.size() &&
+               num_cached_arcs > 0);
+  for (size_t i = 0; i < weights.size(); i++)
+    KALDI_ASSERT(log_linear || weights[i] >= 0.0);
+  for (StateId i = 0; i < num_cached_arcs; i++)
+    cached_arcs_[i].first = kNoStateId; // Invalidate all elements of the cache.
+  std::vector<StateId> start_tuple(fsts.size());
+  for (size_t i = 0; i < fsts.size(); i++)
+    start_tuple[i] = fsts_[i]->Start();
+  if (std::find(start_tuple.begin(), start_tuple.end(),
+                static_cast<StateId>(kNoStateId)) != start_tuple.end())
+    start_state_ = kNoStateId;
+  else
+    start_state_ = FindOrAddState(start_tuple);
+}
+
+inline float InterpolateDeterministicOnDemandFst::Interpolate(
+    const std::vector<float> &costs) const {
+  const float inf = Weight::Zero().Value();
+  if (log_linear_) {
+    float cost = 0.0;
+    for (size_t i = 0; i < costs.size(); i++) {
+      if (weights_[i] == 0.0) continue;  // avoids 0 * infinity.
+      if (costs[i] == inf) return inf;
+      cost += weights_[i] * costs[i];
+    }
+    return cost;
+  } else {
+    // -log(\sum_i weights[i] exp(-costs[i])), computed relative to the
+    // smallest cost for numerical stability.
+    float min_cost = *std::min_element(costs.begin(), costs.end());
+    if (min_cost == inf) return inf;
+    double prob = 0.0;
+    for (size_t i = 0; i < costs.size(); i++)
+      if (costs[i] != inf)
+        prob += weights_[i] * kaldi::Exp(min_cost - costs[i]);
+    if (prob <= 0.0) return inf;
+    return min_cost - kaldi::Log(prob);
+  }
+}
+
+inline InterpolateDeterministicOnDemandFst::StateId
+InterpolateDeterministicOnDemandFst::FindOrAddState(
+    const std::vector<StateId> &state_tuple) {
+  std::pair<const std::vector<StateId>, StateId> new_value(
+      state_tuple, static_cast<StateId>(state_vec_.size()));
+  std::pair<MapType::iterator, bool> result = state_map_.insert(new_value);
+  if (result.second) {
+    state_vec_.push_back(state_tuple);
+    final_weights_.push_back(Weight::Zero());
+    final_computed_.push_back(false);
+  }
+  return result.first->second;
+}
+
+inline InterpolateDeterministicOnDemandFst::Weight
+InterpolateDeterministicOnDemandFst::Final(StateId s) {
+  KALDI_ASSERT(static_cast<size_t>(s) < state_vec_.size());
+  if (!final_computed_[s]) {
+    const std::vector<StateId> &state_tuple = state_vec_[s];
+    for (size_t i = 0; i < fsts_.size(); i++)
+      costs_[i] = fsts_[i]->Final(state_tuple[i]).Value();
+    final_weights_[s] = Weight(Interpolate(costs_));
+    final_computed_[s] = true;
+  }
+  return final_weights_[s];
+}
+
+inline size_t InterpolateDeterministicOnDemandFst::GetIndex(
+    StateId src_state, Label ilabel) {
+  const StateId p1 = 26597, p2 = 50329;  // as in
+  // CacheDeterministicOnDemandFst.
+  return static_cast<size_t>(src_state * p1 + ilabel * p2) %
+      static_cast<size_t>(num_cached_arcs_);
+}
+
+inline bool InterpolateDeterministicOnDemandFst::GetArc(StateId s,
+                                                        Label ilabel,
+                                                        StdArc *oarc) {
+  KALDI_ASSERT(static_cast<size_t>(s) < state_vec_.size() && ilabel != 0);
+  size_t index = GetIndex(s, ilabel);
+  if (cached_arcs_[index].first == s &&
+      cached_arcs_[index].second.ilabel == ilabel) {
+    *oarc = cached_arcs_[index].second;
+    return true;
+  }
+  // Note: 'next_tuple' can't be a reference into state_vec_, which
+  // FindOrAddState() may reallocate.
+  std::vector<StateId> next_tuple(state_vec_[s]);
+  StdArc arc;
+  for (size_t i = 0; i < fsts_.size(); i++) {
+    if (!fsts_[i]->GetArc(next_tuple[i], ilabel, &arc))
+      return false;
+    costs_[i] = arc.weight.Value();
+    next_tuple[i] = arc.nextstate;
+  }
+  oarc->ilabel = ilabel;
+  oarc->olabel = ilabel;
+  oarc->weight = Weight(Interpolate(costs_));
+  oarc->nextstate = FindOrAddState(next_tuple);
+  cached_arcs_[index].first = s;
+  cached_arcs_[index].second = *oarc;
+  return true;
+}
+
 template<class Arc>
 LmExampleDeterministicOnDemandFst<Arc>::LmExampleDeterministicOnDemandFst(
     void *lm, Label bos_symbol, Label eos_symbol):
@@ -218,6 +218,74 @@ void TestCompose() {
   }
 }
 
+void TestInterpolate() {
+  cout << "Test interpolation of backoff FSTs" << endl;
+  StdVectorFst *nfst = CreateBackoffFst();
+  ArcSort(nfst, StdILabelCompare());
+  BackoffDeterministicOnDemandFst<StdArc> dfst1(*nfst), dfst2a(*nfst);
+  // The second "LM" has different weights on the same states.
+  ScaleDeterministicOnDemandFst dfst2(0.5, &dfst2a);
+
+  for (int log_linear = 0; log_linear < 2; log_linear++) {
+    std::vector<DeterministicOnDemandFst<StdArc>*> fsts;
+    fsts.push_back(&dfst1);
+    fsts.push_back(&dfst2);
+    std::vector<float> weights;
+    weights.push_back(0.3);
+    weights.push_back(log_linear ? 2.0 : 0.7);
+    // A small cache, so that entries get replaced.
+    InterpolateDeterministicOnDemandFst interp_fst(fsts, weights,
+                                                   log_linear != 0, 3);
+
+    // Follows the paths 10 {12,13,14} 15 and checks the weights.
+    Label second_labels[] = { 12, 13, 14 };
+    for (int i = 0; i < 3; i++) {
+      std::vector<Label> labels;
+      labels.push_back(10);
+      labels.push_back(second_labels[i]);
+      labels.push_back(15);
+      StateId s = interp_fst.Start(), s1 = dfst1.Start(), s2 = dfst2.Start();
+      for (size_t j = 0; j <= labels.size(); j++) {
+        float cost1, cost2, cost;
+        if (j < labels.size()) {
+          StdArc arc, arc1, arc2, arc_again;
+          bool b = dfst1.GetArc(s1, labels[j], &arc1) &&
+              dfst2.GetArc(s2, labels[j], &arc2) &&
+              interp_fst.GetArc(s, labels[j], &arc);
+          assert(b);
+          // The second time, it may come from the cache.
+          b = interp_fst.GetArc(s, labels[j], &arc_again);
+          assert(b && arc_again.nextstate == arc.nextstate &&
+                 arc_again.weight == arc.weight);
+          cost1 = arc1.weight.Value();
+          cost2 = arc2.weight.Value();
+          cost = arc.weight.Value();
+          s = arc.nextstate;
+          s1 = arc1.nextstate;
+          s2 = arc2.nextstate;
+        } else {
+          cost1 = dfst1.Final(s1).Value();
+          cost2 = dfst2.Final(s2).Value();
+          cost = interp_fst.Final(s).Value();
+        }
+        float expected_cost = log_linear ?
+            weights[0] * cost1 + weights[1] * cost2 :
+            -kaldi::Log(weights[0] * kaldi::Exp(-cost1) +
+                        weights[1] * kaldi::Exp(-cost2));
+        assert(kaldi::ApproxEqual(cost, expected_cost));
+      }
+    }
+    StdArc arc;
+    // Label 11 is in neither of the FSTs.
+    bool b = interp_fst.GetArc(interp_fst.Start(), 11, &arc);
+    assert(!b);
+    // State 1 is not final, even after backing off.
+    b = interp_fst.GetArc(interp_fst.Start(), 10, &arc);
+    assert(b && interp_fst.Final(arc.nextstate) == Weight::Zero());
+  }
+  delete nfst;
+}
+
 }
 
 
@@ -225,5 +293,6 @@ int main() {
   using namespace fst;
   TestBackoffAndCache();
   TestCompose();
+  TestInterpolate();
 }
   
@@ -253,6 +253,82 @@ class CacheDeterministicOnDemandFst: public DeterministicOnDemandFst<Arc> {
   std::vector<std::pair<StateId, Arc> > cached_arcs_;
 };
 
+/**
+   Class InterpolateDeterministicOnDemandFst interpolates several language
+   models on the fly, each given as a DeterministicOnDemandFst (e.g. a
+   BackoffDeterministicOnDemandFst wrapping a G.fst, or a
+   ConstArpaLmDeterministicFst), so that the interpolation weights can be
+   chosen per utterance without building an interpolated G.fst.  It can be
+   used wherever a single language model of this type is, e.g. in the "lm
+   difference" FST of the biglm decoder, or in lattice rescoring.
+
+   With log_linear == false the probabilities are interpolated linearly,
+   i.e. p(w|h) = \sum_i weights[i] p_i(w|h_i), so the weights should sum to
+   one.  With log_linear == true the costs are interpolated, i.e.
+   -log p(w|h) = \sum_i weights[i] (-log p_i(w|h_i)), which is not
+   normalized.
+
+   The states are tuples of states of the input FSTs.  An arc only exists if
+   it exists in all of the input FSTs, so they should have the same
+   vocabulary (e.g. map out-of-vocabulary words to <unk>).  Recently used
+   arcs are cached in a hash table of num_cached_arcs entries, as in
+   CacheDeterministicOnDemandFst, and final-probs are cached per state, so
+   the cost of repeated lookups does not grow with the number of input FSTs.
+
+   It's specialized for StdArc because there is no generic way to scale
+   weights.
+*/
+class InterpolateDeterministicOnDemandFst:
+      public DeterministicOnDemandFst<StdArc> {
+ public:
+  typedef StdArc::Weight Weight;
+  typedef StdArc::StateId StateId;
+  typedef StdArc::Label Label;
+
+  /// Does not take ownership of the FSTs in 'fsts', which should not be used
+  /// by anything else while this object exists (they aren't thread safe).
+  /// 'weights' must have the same size as 'fsts'.
+  InterpolateDeterministicOnDemandFst(
+      const std::vector<DeterministicOnDemandFst<StdArc>*> &fsts,
+      const std::vector<float> &weights, bool log_linear = false,
+      StateId num_cached_arcs = 100000);
+
+  virtual StateId Start() { return start_state_; }
+
+  virtual Weight Final(StateId s);
+
+  virtual bool GetArc(StateId s, Label ilabel, StdArc *oarc);
+
+ private:
+  // Returns the interpolated cost, given the costs of the input FSTs (which
+  // may be infinite).
+  float Interpolate(const std::vector<float> &costs) const;
+
+  // Returns the state for the tuple of states 'state_tuple', adding it if
+  // it's new.
+  StateId FindOrAddState(const std::vector<StateId> &state_tuple);
+
+  // Get index for cached arc.
+  inline size_t GetIndex(StateId src_state, Label ilabel);
+
+  std::vector<DeterministicOnDemandFst<StdArc>*> fsts_;
+  std::vector<float> weights_;
+  bool log_linear_;
+
+  typedef unordered_map<std::vector<StateId>, StateId,
+                        kaldi::VectorHasher<StateId> > MapType;
+  MapType state_map_;
+  std::vector<std::vector<StateId> > state_vec_;  // maps from StateId to
+                                                  // tuple of states.
+  std::vector<Weight> final_weights_;  // cached final-probs, valid if
+  std::vector<bool> final_computed_;   // final_computed_[s] is true.
+  StateId start_state_;
+
+  StateId num_cached_arcs_;
+  std::vector<std::pair<StateId, StdArc> > cached_arcs_;
+  std::vector<float> costs_;  // temporary storage.
+};
+
 
 /// This class is for didactic purposes, it does not really do anything.
 /// It shows how you would wrap a language model.  Note: you should probably
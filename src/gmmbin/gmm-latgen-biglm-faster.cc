@@ -153,15 +153,21 @@ int main(int argc, char *argv[]) {
     const char *usage =
         "Generate lattices using GMM-based model.\n"
         "User supplies LM used to generate decoding graph, and desired LM;\n"
-        "this decoder applies the difference during decoding\n"
+        "this decoder applies the difference during decoding.  The desired LM may\n"
+        "be an interpolation of several LMs, given as a comma-separated list of\n"
+        "FSTs with their weights in --lm-weights.\n"
         "Usage: gmm-latgen-biglm-faster [options] model-in (fst-in|fsts-rspecifier) "
         "oldlm-fst-in newlm-fst-in features-rspecifier"
-        " lattice-wspecifier [ words-wspecifier [alignments-wspecifier] ]\n";
+        " lattice-wspecifier [ words-wspecifier [alignments-wspecifier] ]\n"
+        "e.g.: gmm-latgen-biglm-faster --lm-weights=0.7,0.3 final.mdl HCLG.fst \\\n"
+        "  G.fst G_general.fst,G_domain.fst ark:feats.ark ark:lat.ark\n";
     ParseOptions po(usage);
     Timer timer;
     bool allow_partial = false;
     BaseFloat acoustic_scale = 0.1;
     LatticeBiglmFasterDecoderConfig config;
+    std::string lm_weights_str;
+    bool log_linear = false;
     
     std::string word_syms_filename;
     config.Register(&po);
@@ -169,6 +175,13 @@ int main(int argc, char *argv[]) {
 
     po.Register("word-symbol-table", &word_syms_filename, "Symbol table for words [for debug output]");
     po.Register("allow-partial", &allow_partial, "If true, produce output even if end state was not reached.");
+    po.Register("lm-weights", &lm_weights_str, "Comma-separated list of "
+                "interpolation weights, one per new LM, if newlm-fst-in is a "
+                "comma-separated list of LM FSTs to be interpolated on the fly, "
+                "e.g. 0.7,0.3");
+    po.Register("log-linear", &log_linear, "If true, the new LMs are "
+                "interpolated log-linearly, i.e. the costs are scaled by "
+                "--lm-weights and added, instead of linearly in probability.");
     
     po.Read(argc, argv);
 
@@ -199,13 +212,39 @@ int main(int argc, char *argv[]) {
         fst::ReadFstKaldiGeneric(old_lm_fst_rxfilename));
     ApplyProbabilityScale(-1.0, old_lm_fst); // Negate old LM probs...
     
-    VectorFst<StdArc> *new_lm_fst = fst::CastOrConvertToVectorFst(
-        fst::ReadFstKaldiGeneric(new_lm_fst_rxfilename));
+    std::vector<std::string> new_lm_rxfilenames;
+    SplitStringToVector(new_lm_fst_rxfilename, ",", true, &new_lm_rxfilenames);
+    std::vector<BaseFloat> lm_weights;
+    if (new_lm_rxfilenames.size() > 1 || !lm_weights_str.empty()) {
+      if (!SplitStringToFloats(lm_weights_str, ",", false, &lm_weights) ||
+          lm_weights.size() != new_lm_rxfilenames.size() ||
+          new_lm_rxfilenames.size() < 2)
+        KALDI_ERR << "Expected --lm-weights to have one weight per new LM ("
+                  << new_lm_rxfilenames.size() << " new LMs given in '"
+                  << new_lm_fst_rxfilename << "'), got '" << lm_weights_str
+                  << "'";
+    }
+
+    std::vector<VectorFst<StdArc>*> new_lm_fsts;
+    std::vector<fst::DeterministicOnDemandFst<StdArc>*> new_lm_dfsts;
+    for (size_t i = 0; i < new_lm_rxfilenames.size(); i++) {
+      new_lm_fsts.push_back(fst::CastOrConvertToVectorFst(
+          fst::ReadFstKaldiGeneric(new_lm_rxfilenames[i])));
+      new_lm_dfsts.push_back(
+          new fst::BackoffDeterministicOnDemandFst<StdArc>(*new_lm_fsts[i]));
+    }
+    fst::DeterministicOnDemandFst<StdArc> *new_lm_dfst = new_lm_dfsts[0];
+    fst::InterpolateDeterministicOnDemandFst *interp_dfst = NULL;
+    if (new_lm_dfsts.size() > 1) {
+      std::vector<float> weights(lm_weights.begin(), lm_weights.end());
+      interp_dfst = new fst::InterpolateDeterministicOnDemandFst(
+          new_lm_dfsts, weights, log_linear);
+      new_lm_dfst = interp_dfst;
+    }
 
     fst::BackoffDeterministicOnDemandFst<StdArc> old_lm_dfst(*old_lm_fst);
-    fst::BackoffDeterministicOnDemandFst<StdArc> new_lm_dfst(*new_lm_fst);
     fst::ComposeDeterministicOnDemandFst<StdArc> compose_dfst(&old_lm_dfst,
-                                                              &new_lm_dfst);
+                                                              new_lm_dfst);
     fst::CacheDeterministicOnDemandFst<StdArc> cache_dfst(&compose_dfst);
 
     bool determinize = config.determinize_lattice;
@@ -310,6 +349,9 @@ int main(int argc, char *argv[]) {
               << frame_count<<" frames.";
 
     delete word_syms;
+    delete interp_dfst;
+    DeletePointers(&new_lm_dfsts);
+    DeletePointers(&new_lm_fsts);
     if (num_success != 0) return 0;
     else return 1;
   } catch(const std::exception &e) {
@@ -74,6 +74,23 @@ class OnlineFeatureInterface {
   /// the class.
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat) = 0;
 
+
+  /// This is like GetFrame() but for a collection of frames: row i of "feats"
+  /// is set to frame frames[i].  The frames need not be sorted or distinct
+  /// (e.g. padding at the edges may repeat frames).  There is a default
+  /// implementation that just gets the frames one by one, but it is overridden
+  /// by child classes that can do things more efficiently in a batch, e.g. by
+  /// getting all the frames they need from their input in a single call; this
+  /// means a whole chunk of frames only passes through the pipeline once.
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats) {
+    KALDI_ASSERT(static_cast<int32>(frames.size()) == feats->NumRows());
+    for (size_t i = 0; i < frames.size(); i++) {
+      SubVector<BaseFloat> feat(*feats, i);
+      GetFrame(frames[i], &feat);
+    }
+  }
+
   // Returns frame shift in seconds.  Helps to estimate duration from frame
   // counts.
   virtual BaseFloat FrameShiftInSeconds() const = 0;
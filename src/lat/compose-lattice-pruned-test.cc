@@ -0,0 +1,154 @@
+// lat/compose-lattice-pruned-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lat/compose-lattice-pruned.h"
+#include "lat/lattice-functions.h"
+#include "fstext/deterministic-fst.h"
+
+namespace kaldi {
+using namespace fst;
+
+// Returns a toy bigram language model over the words 1 ... num_words, in the
+// form expected by BackoffDeterministicOnDemandFst.  State 0 is the start
+// state and the unigram state; state w is the history state for word w, which
+// has arcs for some of the words and backs off to state 0 for the rest.  If
+// 'skip_word' is nonzero that word has no arc at all, so it cannot be
+// traversed.
+static VectorFst<StdArc> *GetToyLm(int32 num_words, int32 skip_word) {
+  VectorFst<StdArc> *lm = new VectorFst<StdArc>();
+  for (int32 s = 0; s <= num_words; s++) {
+    lm->AddState();
+    lm->SetFinal(s, TropicalWeight(RandUniform()));
+  }
+  lm->SetStart(0);
+  for (int32 s = 0; s <= num_words; s++) {
+    if (s != 0)
+      lm->AddArc(s, StdArc(0, 0, TropicalWeight(RandUniform()), 0));
+    for (int32 w = 1; w <= num_words; w++) {
+      if (w == skip_word || (s != 0 && RandInt(0, 1) == 0))
+        continue;
+      lm->AddArc(s, StdArc(w, w, TropicalWeight(5.0 * RandUniform()), w));
+    }
+  }
+  return lm;
+}
+
+// Returns a random acyclic CompactLattice whose words are in the range
+// 1 ... num_words.  There is always a path through the states in order whose
+// words are all less than num_words.
+static CompactLattice *GetToyLattice(int32 num_words) {
+  CompactLattice *clat = new CompactLattice();
+  int32 num_states = RandInt(2, 8);
+  for (int32 s = 0; s < num_states; s++)
+    clat->AddState();
+  clat->SetStart(0);
+  for (int32 s = 0; s + 1 < num_states; s++) {
+    for (int32 n = RandInt(1, 3); n > 0; n--) {
+      int32 next_state = (n == 1 ? s + 1 : RandInt(s + 1, num_states - 1)),
+          word = (n == 1 ? RandInt(1, num_words - 1) : RandInt(1, num_words));
+      std::vector<int32> string(RandInt(0, 2));
+      for (size_t i = 0; i < string.size(); i++)
+        string[i] = RandInt(1, 10);
+      LatticeWeight weight(RandUniform(), 10.0 * RandUniform());
+      clat->AddArc(s, CompactLatticeArc(
+          word, word, CompactLatticeWeight(weight, string), next_state));
+    }
+  }
+  clat->SetFinal(num_states - 1, CompactLatticeWeight::One());
+  return clat;
+}
+
+// Returns the total cost of the best path through 'clat', and its words.
+static double BestPathCost(const CompactLattice &clat,
+                           std::vector<int32> *words) {
+  CompactLattice best_path;
+  CompactLatticeShortestPath(clat, &best_path);
+  words->clear();
+  if (best_path.Start() == kNoStateId)
+    return std::numeric_limits<double>::infinity();
+  double cost = 0.0;
+  CompactLatticeArc::StateId s = best_path.Start();
+  while (best_path.NumArcs(s) != 0) {
+    ArcIterator<CompactLattice> aiter(best_path, s);
+    const CompactLatticeArc &arc = aiter.Value();
+    words->push_back(arc.olabel);
+    cost += arc.weight.Weight().Value1() + arc.weight.Weight().Value2();
+    s = arc.nextstate;
+  }
+  LatticeWeight final_weight = best_path.Final(s).Weight();
+  return cost + final_weight.Value1() + final_weight.Value2();
+}
+
+// Checks that composing with a vector of language models and their scales
+// gives the same result as composing with the ComposeDeterministicOnDemandFst
+// of the ScaleDeterministicOnDemandFsts of the language models.
+void TestComposeCompactLatticePrunedMultiLm() {
+  int32 num_words = RandInt(2, 5);
+  VectorFst<StdArc> *old_lm = GetToyLm(num_words, 0),
+      *new_lm = GetToyLm(num_words, num_words);
+  CompactLattice *clat = GetToyLattice(num_words);
+
+  ComposeLatticePrunedOptions opts;
+  // The toy lattices are small enough to be composed in full.
+  opts.lattice_compose_beam = 1.0e+10;
+
+  BaseFloat old_scale = -1.0, new_scale = 0.5 + RandUniform();
+
+  BackoffDeterministicOnDemandFst<StdArc> old_fst(*old_lm), new_fst(*new_lm);
+  CompactLattice composed_clat;
+  {
+    ScaleDeterministicOnDemandFst old_scale_fst(old_scale, &old_fst),
+        new_scale_fst(new_scale, &new_fst);
+    ComposeDeterministicOnDemandFst<StdArc> combined_fst(&old_scale_fst,
+                                                         &new_scale_fst);
+    ComposeCompactLatticePruned(opts, *clat, &combined_fst, &composed_clat);
+  }
+  CompactLattice composed_clat_multi;
+  {
+    std::vector<DeterministicOnDemandFst<StdArc>*> lms;
+    lms.push_back(&old_fst);
+    lms.push_back(&new_fst);
+    std::vector<BaseFloat> lm_scales;
+    lm_scales.push_back(old_scale);
+    lm_scales.push_back(new_scale);
+    ComposeCompactLatticePruned(opts, *clat, lms, lm_scales,
+                                &composed_clat_multi);
+  }
+
+  KALDI_ASSERT(composed_clat.NumStates() == composed_clat_multi.NumStates());
+  std::vector<int32> words, words_multi;
+  double cost = BestPathCost(composed_clat, &words),
+      cost_multi = BestPathCost(composed_clat_multi, &words_multi);
+  KALDI_LOG << "Best-path cost is " << cost << " (vs. " << cost_multi
+            << " when composing with a vector of LMs)";
+  KALDI_ASSERT(!words.empty() && words == words_multi &&
+               ApproxEqual(cost, cost_multi));
+
+  delete clat;
+  delete old_lm;
+  delete new_lm;
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 20; i++)
+    TestComposeCompactLatticePrunedMultiLm();
+  KALDI_LOG << "Tests succeeded.";
+  return 0;
+}
@@ -944,4 +944,19 @@ void ComposeCompactLatticePruned(
   composer.Compose();
 }
 
+void ComposeCompactLatticePruned(
+    const ComposeLatticePrunedOptions &opts,
+    const CompactLattice &clat,
+    const std::vector<fst::DeterministicOnDemandFst<fst::StdArc>*> &lms,
+    const std::vector<BaseFloat> &lm_scales,
+    CompactLattice* composed_clat) {
+  KALDI_ASSERT(!lms.empty() && lms.size() == lm_scales.size());
+  std::vector<float> scales(lm_scales.begin(), lm_scales.end());
+  // The composition visits at most about opts.max_arcs arcs, so a larger
+  // arc cache would not help.
+  fst::InterpolateDeterministicOnDemandFst lm_stack(
+      lms, scales, true /* log_linear */, std::max<int32>(opts.max_arcs, 1));
+  ComposeCompactLatticePruned(opts, clat, &lm_stack, composed_clat);
+}
+
 } // namespace kaldi
@@ -35,7 +35,9 @@ namespace kaldi {
 /*
    This header implements pruned lattice composition, via the functions
    ComposeCompactLatticePruned (we may later add ComposeLatticePruned if
-   needed).
+   needed).  There is a version that composes with a single
+   DeterministicOnDemandFst, and one that composes with a weighted stack of
+   language models in a single pass.
 
    ComposeCompactLatticePruned does composition of a CompactLattice with a
    DeterministicOnDemandFst<StdArc>, producing a CompactLattice.  It's
@@ -79,6 +81,13 @@ namespace kaldi {
    BackoffDeterministicOnDemandFst wrapped in ScaleDeterministicOnDemandFst)
    with the RNNLM language model (the name of FST TBD, Hainan needs to write
    this).
+
+   If you want to rescore with more than one new language model (e.g. a 4-gram
+   and an RNNLM), you can use the version of ComposeCompactLatticePruned that
+   takes a vector of language models and their scales, instead of rescoring
+   once per language model; this does the pruned composition and the
+   determinization of its output only once.  The result is not exactly the
+   same as that of rescoring in several passes, as the pruning differs.
 */
 
 
@@ -172,6 +181,41 @@ void ComposeCompactLatticePruned(
     CompactLattice* composed_clat);
 
 
+/**
+   This version of ComposeCompactLatticePruned does pruned composition of
+   'clat' with a weighted stack of language models in a single pass, e.g. the
+   LM used to create the original HCLG with scale -1, a 4-gram LM with scale
+   0.5 and an RNNLM with scale 0.5.  The cost of a word is the sum over the
+   language models of lm_scales[i] times the cost from lms[i], and a word
+   can only be traversed if all the language models have an arc for it.
+
+   This gives the same result as composing with the
+   ComposeDeterministicOnDemandFst of the ScaleDeterministicOnDemandFsts of the
+   language models, but the states of the language models are kept as a flat
+   tuple and recently used arcs are cached (see
+   InterpolateDeterministicOnDemandFst with log_linear == true), so that
+   arcs revisited during the best-first search are not looked up in every
+   language model again.
+
+   @param [in] opts Class containing options
+   @param [in] clat   The input lattice; see the other version.
+   @param [in] lms    The language models to compose with.  Must be
+                   nonempty; this function does not take ownership.  They are
+                   non-const because they are on-demand.
+   @param [in] lm_scales  The scales of the language models; must have the
+                   same size as 'lms'.  They may be negative, for language
+                   models whose scores are to be subtracted.
+   @param [out] composed_clat  The output, which is a result of composing
+                   'clat' with the language models.
+ */
+void ComposeCompactLatticePruned(
+    const ComposeLatticePrunedOptions &opts,
+    const CompactLattice &clat,
+    const std::vector<fst::DeterministicOnDemandFst<fst::StdArc>*> &lms,
+    const std::vector<BaseFloat> &lm_scales,
+    CompactLattice* composed_clat);
+
+
 
 
 } // namespace kaldi
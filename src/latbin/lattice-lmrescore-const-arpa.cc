@@ -24,6 +24,85 @@
 #include "lat/lattice-functions.h"
 #include "lm/const-arpa-lm.h"
 #include "util/common-utils.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// Rescores one lattice; the result is written in the destructor, so that
+// the lattices are written in order when run via TaskSequencer.
+class ConstArpaRescoreTask {
+ public:
+  // Takes ownership of "clat".  "const_arpa" is shared between the tasks; it
+  // is only read from.
+  ConstArpaRescoreTask(const ConstArpaLm &const_arpa, BaseFloat lm_scale,
+                       const std::string &key, CompactLattice *clat,
+                       CompactLatticeWriter *compact_lattice_writer,
+                       int32 *num_done, int32 *num_fail):
+      const_arpa_(const_arpa), lm_scale_(lm_scale), key_(key), clat_(clat),
+      compact_lattice_writer_(compact_lattice_writer), num_done_(num_done),
+      num_fail_(num_fail) { }
+
+  void operator () () {
+    if (lm_scale_ == 0.0) {
+      // Zero scale so nothing to do.
+      return;
+    }
+    // Before composing with the LM FST, we scale the lattice weights
+    // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
+    // We do it this way so we can determinize and it will give the
+    // right effect (taking the "best path" through the LM) regardless
+    // of the sign of lm_scale.
+    fst::ScaleLattice(fst::GraphLatticeScale(1.0/lm_scale_), clat_);
+    ArcSort(clat_, fst::OLabelCompare<CompactLatticeArc>());
+
+    // Wraps the ConstArpaLm format language model into FST. We re-create it
+    // for each lattice to prevent memory usage increasing with time; this
+    // also means each thread has its own cache of LM states.
+    ConstArpaLmDeterministicFst const_arpa_fst(const_arpa_);
+
+    // Composes lattice with language model.
+    CompactLattice composed_clat;
+    ComposeCompactLatticeDeterministic(*clat_,
+                                       &const_arpa_fst, &composed_clat);
+    delete clat_;
+    clat_ = NULL;
+
+    // Determinizes the composed lattice.
+    Lattice composed_lat;
+    ConvertLattice(composed_clat, &composed_lat);
+    Invert(&composed_lat);
+    DeterminizeLattice(composed_lat, &determinized_clat_);
+    fst::ScaleLattice(fst::GraphLatticeScale(lm_scale_), &determinized_clat_);
+  }
+
+  ~ConstArpaRescoreTask() {
+    if (clat_ != NULL) {
+      // lm_scale_ was zero.
+      compact_lattice_writer_->Write(key_, *clat_);
+      (*num_done_)++;
+      delete clat_;
+    } else if (determinized_clat_.Start() == fst::kNoStateId) {
+      KALDI_WARN << "Empty lattice for utterance " << key_
+                 << " (incompatible LM?)";
+      (*num_fail_)++;
+    } else {
+      compact_lattice_writer_->Write(key_, determinized_clat_);
+      (*num_done_)++;
+    }
+  }
+
+ private:
+  const ConstArpaLm &const_arpa_;
+  BaseFloat lm_scale_;
+  std::string key_;
+  CompactLattice *clat_;  // The input lattice; owned here.
+  CompactLattice determinized_clat_;  // The output, written in the destructor.
+  CompactLatticeWriter *compact_lattice_writer_;
+  int32 *num_done_;
+  int32 *num_fail_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -36,7 +115,8 @@ int main(int argc, char *argv[]) {
         "will be wrapped into the DeterministicOnDemandFst interface and the\n"
         "rescoring is done by composing with the wrapped LM using a special\n"
         "type of composition algorithm. Determinization will be applied on\n"
-        "the composed lattice.\n"
+        "the composed lattice.  With --num-threads > 1, several lattices are\n"
+        "rescored in parallel with the same LM; the output order is unchanged.\n"
         "\n"
         "Usage: lattice-lmrescore-const-arpa [options] lattice-rspecifier \\\n"
         "                                   const-arpa-in lattice-wspecifier\n"
@@ -45,9 +125,11 @@ int main(int argc, char *argv[]) {
 
     ParseOptions po(usage);
     BaseFloat lm_scale = 1.0;
+    TaskSequencerConfig sequencer_config; // has --num-threads option
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for language model "
                 "costs; frequently 1.0 or -1.0");
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -62,56 +144,25 @@ int main(int argc, char *argv[]) {
 
     // Reads the language model in ConstArpaLm format.
     ConstArpaLm const_arpa;
-    ReadKaldiObject(lm_rxfilename, &const_arpa);
+    ReadConstArpaLm(lm_rxfilename, &const_arpa);
 
     // Reads and writes as compact lattice.
     SequentialCompactLatticeReader compact_lattice_reader(lats_rspecifier);
     CompactLatticeWriter compact_lattice_writer(lats_wspecifier);
 
     int32 n_done = 0, n_fail = 0;
-    for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
-      std::string key = compact_lattice_reader.Key();
-      CompactLattice clat = compact_lattice_reader.Value();
-      compact_lattice_reader.FreeCurrent();
-
-      if (lm_scale != 0.0) {
-        // Before composing with the LM FST, we scale the lattice weights
-        // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
-        // We do it this way so we can determinize and it will give the
-        // right effect (taking the "best path" through the LM) regardless
-        // of the sign of lm_scale.
-        fst::ScaleLattice(fst::GraphLatticeScale(1.0/lm_scale), &clat);
-        ArcSort(&clat, fst::OLabelCompare<CompactLatticeArc>());
-
-        // Wraps the ConstArpaLm format language model into FST. We re-create it
-        // for each lattice to prevent memory usage increasing with time.
-        ConstArpaLmDeterministicFst const_arpa_fst(const_arpa);
-
-        // Composes lattice with language model.
-        CompactLattice composed_clat;
-        ComposeCompactLatticeDeterministic(clat,
-                                           &const_arpa_fst, &composed_clat);
-
-        // Determinizes the composed lattice.
-        Lattice composed_lat;
-        ConvertLattice(composed_clat, &composed_lat);
-        Invert(&composed_lat);
-        CompactLattice determinized_clat;
-        DeterminizeLattice(composed_lat, &determinized_clat);
-        fst::ScaleLattice(fst::GraphLatticeScale(lm_scale), &determinized_clat);
-        if (determinized_clat.Start() == fst::kNoStateId) {
-          KALDI_WARN << "Empty lattice for utterance " << key
-              << " (incompatible LM?)";
-          n_fail++;
-        } else {
-          compact_lattice_writer.Write(key, determinized_clat);
-          n_done++;
-        }
-      } else {
-        // Zero scale so nothing to do.
-        n_done++;
-        compact_lattice_writer.Write(key, clat);
+    {
+      TaskSequencer<ConstArpaRescoreTask> sequencer(sequencer_config);
+      for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
+        std::string key = compact_lattice_reader.Key();
+        CompactLattice *clat = new CompactLattice(
+            compact_lattice_reader.Value());
+        compact_lattice_reader.FreeCurrent();
+        sequencer.Run(new ConstArpaRescoreTask(const_arpa, lm_scale, key, clat,
+                                               &compact_lattice_writer,
+                                               &n_done, &n_fail));
       }
+      sequencer.Wait();
     }
 
     KALDI_LOG << "Done " << n_done << " lattices, failed for " << n_fail;
@@ -19,16 +19,210 @@
 // limitations under the License.
 
 
+#include <mutex>
+
 #include "base/kaldi-common.h"
+#include "base/timer.h"
 #include "fstext/fstext-lib.h"
 #include "rnnlm/rnnlm-lattice-rescoring.h"
 #include "lm/const-arpa-lm.h"
 #include "util/common-utils.h"
+#include "util/kaldi-thread.h"
 #include "nnet3/nnet-utils.h"
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
 #include "lat/compose-lattice-pruned.h"
 
+namespace kaldi {
+
+// A pool of batched RNNLM FSTs, each with its own RnnlmBatchComputer, so that
+// each thread can have one without compiling the batched computation for
+// every lattice.
+class RnnlmBatchedFstPool {
+ public:
+  RnnlmBatchedFstPool(int32 max_ngram_order,
+                      const rnnlm::RnnlmComputeStateInfo &info,
+                      int32 batch_size):
+      max_ngram_order_(max_ngram_order), info_(info),
+      batch_size_(batch_size) { }
+
+  // Returns an FST that no other thread is using, creating it if necessary.
+  rnnlm::KaldiRnnlmBatchedDeterministicFst *Get() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!free_fsts_.empty()) {
+        rnnlm::KaldiRnnlmBatchedDeterministicFst *ans = free_fsts_.back();
+        free_fsts_.pop_back();
+        return ans;
+      }
+    }
+    // Compilation is slow, so we do it without holding the lock.
+    rnnlm::RnnlmBatchComputer *computer =
+        new rnnlm::RnnlmBatchComputer(info_, batch_size_);
+    rnnlm::KaldiRnnlmBatchedDeterministicFst *ans =
+        new rnnlm::KaldiRnnlmBatchedDeterministicFst(max_ngram_order_,
+                                                     computer);
+    std::lock_guard<std::mutex> lock(mutex_);
+    computers_.push_back(computer);
+    fsts_.push_back(ans);
+    return ans;
+  }
+
+  // Clears "fst", which must have been returned by Get(), and makes it
+  // available to other threads.
+  void Release(rnnlm::KaldiRnnlmBatchedDeterministicFst *fst) {
+    fst->Clear();
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_fsts_.push_back(fst);
+  }
+
+  // Prints the statistics of the batched computation (see
+  // RnnlmBatchComputer::PrintStats()) for each thread.
+  void PrintStats() const {
+    for (size_t i = 0; i < computers_.size(); i++)
+      computers_[i]->PrintStats();
+  }
+
+  ~RnnlmBatchedFstPool() {
+    DeletePointers(&fsts_);
+    DeletePointers(&computers_);
+  }
+
+ private:
+  int32 max_ngram_order_;
+  const rnnlm::RnnlmComputeStateInfo &info_;
+  int32 batch_size_;
+  std::mutex mutex_;
+  std::vector<rnnlm::RnnlmBatchComputer*> computers_;
+  std::vector<rnnlm::KaldiRnnlmBatchedDeterministicFst*> fsts_;
+  std::vector<rnnlm::KaldiRnnlmBatchedDeterministicFst*> free_fsts_;
+};
+
+// Rescores one lattice; the result is written in the destructor, so that
+// the lattices are written in order when run via TaskSequencer.
+class RnnlmRescoreTask {
+ public:
+  // Takes ownership of "clat".  The models are shared between the tasks and
+  // only read from; exactly one of "const_arpa" and "lm_to_subtract_fst" must
+  // be non-NULL.  If "ngram_lm_to_add" is non-NULL, it is added with scale
+  // 1 - lm_scale in the same pass.  If "fst_pool" is NULL, the RNNLM states
+  // are computed one at a time.
+  RnnlmRescoreTask(const ComposeLatticePrunedOptions &compose_opts,
+                   BaseFloat lm_scale, BaseFloat acoustic_scale,
+                   int32 max_ngram_order,
+                   const ConstArpaLm *const_arpa,
+                   const fst::VectorFst<fst::StdArc> *lm_to_subtract_fst,
+                   const ConstArpaLm *ngram_lm_to_add,
+                   const rnnlm::RnnlmComputeStateInfo &info,
+                   RnnlmBatchedFstPool *fst_pool,
+                   const std::string &key, CompactLattice *clat,
+                   CompactLatticeWriter *compact_lattice_writer,
+                   int32 *num_done, int32 *num_err):
+      compose_opts_(compose_opts), lm_scale_(lm_scale),
+      acoustic_scale_(acoustic_scale), max_ngram_order_(max_ngram_order),
+      const_arpa_(const_arpa), lm_to_subtract_fst_(lm_to_subtract_fst),
+      ngram_lm_to_add_(ngram_lm_to_add), info_(info), fst_pool_(fst_pool),
+      key_(key), clat_(clat),
+      compact_lattice_writer_(compact_lattice_writer), num_done_(num_done),
+      num_err_(num_err) { }
+
+  void operator () () {
+    // The LM wrappers cache the states they have seen, so each task needs its
+    // own.
+    fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_subtract;
+    if (const_arpa_ != NULL)
+      lm_to_subtract = new ConstArpaLmDeterministicFst(*const_arpa_);
+    else
+      lm_to_subtract = new fst::BackoffDeterministicOnDemandFst<fst::StdArc>(
+          *lm_to_subtract_fst_);
+
+    rnnlm::KaldiRnnlmDeterministicFst *lm_to_add_orig = NULL;
+    rnnlm::KaldiRnnlmBatchedDeterministicFst *lm_to_add_batched = NULL;
+    fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_add_rnnlm;
+    if (fst_pool_ != NULL) {
+      lm_to_add_batched = fst_pool_->Get();
+      lm_to_add_rnnlm = lm_to_add_batched;
+    } else {
+      lm_to_add_orig =
+          new rnnlm::KaldiRnnlmDeterministicFst(max_ngram_order_, info_);
+      lm_to_add_rnnlm = lm_to_add_orig;
+    }
+
+    // The LMs are applied in a single pruned composition.  Without an n-gram
+    // LM to add, the scores are lm_scale * (rnnlm - old); with one, the old
+    // LM is replaced entirely, i.e. the scores are
+    // (1 - lm_scale) * ngram + lm_scale * rnnlm - old.
+    std::vector<fst::DeterministicOnDemandFst<fst::StdArc>*> lms;
+    std::vector<BaseFloat> lm_scales;
+    lms.push_back(lm_to_subtract);
+    lm_scales.push_back(ngram_lm_to_add_ != NULL ? -1.0 : -lm_scale_);
+    ConstArpaLmDeterministicFst *ngram_lm_to_add = NULL;
+    if (ngram_lm_to_add_ != NULL) {
+      ngram_lm_to_add = new ConstArpaLmDeterministicFst(*ngram_lm_to_add_);
+      lms.push_back(ngram_lm_to_add);
+      lm_scales.push_back(1.0 - lm_scale_);
+    }
+    lms.push_back(lm_to_add_rnnlm);
+    lm_scales.push_back(lm_scale_);
+
+    // The LM scales are applied inside the composition (see lm_scales
+    // above), so the only scaling of the lattice is by the acoustic scale,
+    // which affects which paths the pruned composition explores; we undo it
+    // after composing.
+    if (acoustic_scale_ != 1.0) {
+      fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale_), clat_);
+    }
+    TopSortCompactLatticeIfNeeded(clat_);
+
+    // Composes lattice with the language models.
+    ComposeCompactLatticePruned(compose_opts_, *clat_, lms, lm_scales,
+                                &composed_clat_);
+    delete clat_;
+    clat_ = NULL;
+
+    if (lm_to_add_batched != NULL)
+      fst_pool_->Release(lm_to_add_batched);
+    delete lm_to_add_orig;
+    delete ngram_lm_to_add;
+    delete lm_to_subtract;
+
+    if (composed_clat_.NumStates() != 0 && acoustic_scale_ != 1.0) {
+      fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale_),
+                        &composed_clat_);
+    }
+  }
+
+  ~RnnlmRescoreTask() {
+    if (composed_clat_.NumStates() == 0) {
+      // Something went wrong.  A warning will already have been printed.
+      (*num_err_)++;
+    } else {
+      compact_lattice_writer_->Write(key_, composed_clat_);
+      (*num_done_)++;
+    }
+    delete clat_;
+  }
+
+ private:
+  const ComposeLatticePrunedOptions &compose_opts_;
+  BaseFloat lm_scale_;
+  BaseFloat acoustic_scale_;
+  int32 max_ngram_order_;
+  const ConstArpaLm *const_arpa_;
+  const fst::VectorFst<fst::StdArc> *lm_to_subtract_fst_;
+  const ConstArpaLm *ngram_lm_to_add_;
+  const rnnlm::RnnlmComputeStateInfo &info_;
+  RnnlmBatchedFstPool *fst_pool_;
+  std::string key_;
+  CompactLattice *clat_;  // The input lattice; owned here.
+  CompactLattice composed_clat_;  // The output, written in the destructor.
+  CompactLatticeWriter *compact_lattice_writer_;
+  int32 *num_done_;
+  int32 *num_err_;
+};
+
+}  // namespace kaldi
+
 int main(int argc, char *argv[]) {
   try {
     using namespace kaldi;
@@ -43,6 +237,12 @@ int main(int argc, char *argv[]) {
         "Rescores lattice with kaldi-rnnlm. This script is called from \n"
         "scripts/rnnlm/lmrescore_pruned.sh. An example for rescoring \n"
         "lattices is at egs/swbd/s5c/local/rnnlm/run_lstm.sh \n"
+        "With --num-threads > 1, several lattices are rescored in parallel\n"
+        "with the same models; the output order is unchanged.\n"
+        "With --add-ngram-lm, the old LM is replaced by an interpolation of\n"
+        "that n-gram LM and the RNNLM in a single pass of pruned composition.\n"
+        "This is equivalent, up to pruning, to lattice-lmrescore-const-arpa\n"
+        "followed by this program with the n-gram LM as the old LM.\n"
         "\n"
         "Usage: lattice-lmrescore-kaldi-rnnlm-pruned [options] \\\n"
         "             <old-lm-rxfilename> <embedding-file> \\\n"
@@ -55,16 +255,24 @@ int main(int argc, char *argv[]) {
         "       lattice-lmrescore-kaldi-rnnlm-pruned --lm-scale=-1.0 fst_words.txt \\\n"
         "              --bos-symbol=1 --eos-symbol=2 \\\n"
         "              data/lang_test_fg/G.carpa word_embedding.mat \\\n"
+        "              final.raw ark:in.lats ark:out.lats\n\n"
+        "       lattice-lmrescore-kaldi-rnnlm-pruned --lm-scale=0.5 \\\n"
+        "              --bos-symbol=1 --eos-symbol=2 \\\n"
+        "              --add-ngram-lm=data/lang_test_fg/G.carpa \\\n"
+        "              data/lang_test/G.fst word_embedding.mat \\\n"
         "              final.raw ark:in.lats ark:out.lats\n";
 
     ParseOptions po(usage);
     rnnlm::RnnlmComputeStateComputationOptions opts;
     ComposeLatticePrunedOptions compose_opts;
+    TaskSequencerConfig sequencer_config; // has --num-threads option
 
     int32 max_ngram_order = 3;
     BaseFloat lm_scale = 0.5;
     BaseFloat acoustic_scale = 0.1;
     bool use_carpa = false;
+    int32 batch_size = 0;
+    std::string ngram_lm_to_add_rxfilename;
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for <lm-to-add>; its negative "
                 "will be applied to <lm-to-subtract>.");
@@ -77,9 +285,20 @@ int main(int argc, char *argv[]) {
         "saves time and reduces output lattice size).");
     po.Register("use-const-arpa", &use_carpa, "If true, read the old-LM file "
                 "as a const-arpa file as opposed to an FST file");
+    po.Register("batch-size", &batch_size, "If >0, the RNNLM states on the "
+                "frontier of the pruned composition are computed together, "
+                "in minibatches of up to this many sequences, which can be "
+                "much faster (especially on GPU); the results are the same.  "
+                "The sizes of the minibatches and the speed are printed at "
+                "the end.");
+    po.Register("add-ngram-lm", &ngram_lm_to_add_rxfilename, "If set, an "
+                "n-gram LM in const-arpa format to add with scale "
+                "1 - lm-scale, in which case the old LM is subtracted with "
+                "scale -1 (i.e. fully replaced) rather than -lm-scale.");
 
     opts.Register(&po);
     compose_opts.Register(&po);
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -91,6 +310,8 @@ int main(int argc, char *argv[]) {
     if (opts.bos_index == -1 || opts.eos_index == -1) {
       KALDI_ERR << "must set --bos-symbol and --eos-symbol options";
     }
+    if (acoustic_scale == 0.0)
+      KALDI_ERR << "Acoustic scale cannot be zero.";
 
     std::string lm_to_subtract_rxfilename, lats_rspecifier,
                 word_embedding_rxfilename, rnnlm_rxfilename, lats_wspecifier;
@@ -101,31 +322,25 @@ int main(int argc, char *argv[]) {
     lats_rspecifier = po.GetArg(4);
     lats_wspecifier = po.GetArg(5);
 
+    // The models are read once and shared by all the threads.
     // for G.fst
-    fst::ScaleDeterministicOnDemandFst *lm_to_subtract_det_scale = NULL;
-    fst::BackoffDeterministicOnDemandFst<StdArc> *lm_to_subtract_det_backoff = NULL;
     VectorFst<StdArc> *lm_to_subtract_fst = NULL;
-
     // for G.carpa
     ConstArpaLm* const_arpa = NULL;
-    fst::DeterministicOnDemandFst<StdArc> *carpa_lm_to_subtract_fst = NULL;
 
     KALDI_LOG << "Reading old LMs...";
     if (use_carpa) {
       const_arpa = new ConstArpaLm();
-      ReadKaldiObject(lm_to_subtract_rxfilename, const_arpa);
-      carpa_lm_to_subtract_fst = new ConstArpaLmDeterministicFst(*const_arpa);
-      lm_to_subtract_det_scale
-        = new fst::ScaleDeterministicOnDemandFst(-lm_scale,
-                                                 carpa_lm_to_subtract_fst);
+      ReadConstArpaLm(lm_to_subtract_rxfilename, const_arpa);
     } else {
       lm_to_subtract_fst = fst::ReadAndPrepareLmFst(
           lm_to_subtract_rxfilename);
-      lm_to_subtract_det_backoff =
-        new fst::BackoffDeterministicOnDemandFst<StdArc>(*lm_to_subtract_fst);
-      lm_to_subtract_det_scale =
-           new fst::ScaleDeterministicOnDemandFst(-lm_scale,
-                                                  lm_to_subtract_det_backoff);
+    }
+
+    ConstArpaLm *ngram_lm_to_add = NULL;
+    if (!ngram_lm_to_add_rxfilename.empty()) {
+      ngram_lm_to_add = new ConstArpaLm();
+      ReadConstArpaLm(ngram_lm_to_add_rxfilename, ngram_lm_to_add);
     }
 
     kaldi::nnet3::Nnet rnnlm;
@@ -144,63 +359,38 @@ int main(int argc, char *argv[]) {
 
     int32 num_done = 0, num_err = 0;
 
-    rnnlm::KaldiRnnlmDeterministicFst* lm_to_add_orig = 
-         new rnnlm::KaldiRnnlmDeterministicFst(max_ngram_order, info);
-
-    for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
-      fst::DeterministicOnDemandFst<StdArc> *lm_to_add =
-         new fst::ScaleDeterministicOnDemandFst(lm_scale, lm_to_add_orig);
-
-      std::string key = compact_lattice_reader.Key();
-      CompactLattice clat = compact_lattice_reader.Value();
-      compact_lattice_reader.FreeCurrent();
-
-      // Before composing with the LM FST, we scale the lattice weights
-      // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
-      // We do it this way so we can determinize and it will give the
-      // right effect (taking the "best path" through the LM) regardless
-      // of the sign of lm_scale.
-      if (acoustic_scale != 1.0) {
-        fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale), &clat);
-      }
-      TopSortCompactLatticeIfNeeded(&clat);
-
-      fst::ComposeDeterministicOnDemandFst<StdArc> combined_lms(
-          lm_to_subtract_det_scale, lm_to_add);
-
-      // Composes lattice with language model.
-      CompactLattice composed_clat;
-      ComposeCompactLatticePruned(compose_opts, clat,
-                                  &combined_lms, &composed_clat);
-
-      lm_to_add_orig->Clear();
-
-      if (composed_clat.NumStates() == 0) {
-        // Something went wrong.  A warning will already have been printed.
-        num_err++;
-      } else {
-        if (acoustic_scale != 1.0) {
-          if (acoustic_scale == 0.0)
-            KALDI_ERR << "Acoustic scale cannot be zero.";
-          fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale),
-                            &composed_clat);
-        }
-        compact_lattice_writer.Write(key, composed_clat);
-        num_done++;
+    RnnlmBatchedFstPool *fst_pool = NULL;
+    if (batch_size > 0)
+      fst_pool = new RnnlmBatchedFstPool(max_ngram_order, info, batch_size);
+
+    Timer timer;
+    {
+      TaskSequencer<RnnlmRescoreTask> sequencer(sequencer_config);
+      for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
+        std::string key = compact_lattice_reader.Key();
+        CompactLattice *clat = new CompactLattice(
+            compact_lattice_reader.Value());
+        compact_lattice_reader.FreeCurrent();
+        sequencer.Run(new RnnlmRescoreTask(
+            compose_opts, lm_scale, acoustic_scale, max_ngram_order,
+            const_arpa, lm_to_subtract_fst, ngram_lm_to_add, info, fst_pool,
+            key, clat, &compact_lattice_writer, &num_done, &num_err));
       }
-      delete lm_to_add;
+      sequencer.Wait();
     }
 
-    delete lm_to_subtract_fst;
-    delete lm_to_add_orig;
-    delete lm_to_subtract_det_backoff;
-    delete lm_to_subtract_det_scale;
+    double elapsed = timer.Elapsed();
 
+    if (fst_pool != NULL)
+      fst_pool->PrintStats();
+    delete fst_pool;
+    delete lm_to_subtract_fst;
     delete const_arpa;
-    delete carpa_lm_to_subtract_fst;
+    delete ngram_lm_to_add;
 
     KALDI_LOG << "Overall, succeeded for " << num_done
-              << " lattices, failed for " << num_err;
+              << " lattices, failed for " << num_err << "; rescoring took "
+              << elapsed << " seconds.";
     return (num_done != 0 ? 0 : 1);
   } catch(const std::exception &e) {
     std::cerr << e.what();
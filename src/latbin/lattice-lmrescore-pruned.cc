@@ -26,6 +26,96 @@
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
 #include "lat/compose-lattice-pruned.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// Rescores one lattice; the result is written in the destructor, so that
+// the lattices are written in order when run via TaskSequencer.
+class PrunedRescoreTask {
+ public:
+  // Takes ownership of "clat".  The LMs are shared between the tasks:
+  // "lm_to_subtract" must be stateless (like the backoff FST wrapper), and
+  // exactly one of "const_arpa" and "lm_to_add_fst" must be non-NULL.
+  PrunedRescoreTask(const ComposeLatticePrunedOptions &compose_opts,
+                    BaseFloat lm_scale, BaseFloat acoustic_scale,
+                    fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_subtract,
+                    const ConstArpaLm *const_arpa,
+                    const fst::VectorFst<fst::StdArc> *lm_to_add_fst,
+                    const std::string &key, CompactLattice *clat,
+                    CompactLatticeWriter *compact_lattice_writer,
+                    int32 *num_done, int32 *num_err):
+      compose_opts_(compose_opts), lm_scale_(lm_scale),
+      acoustic_scale_(acoustic_scale), lm_to_subtract_(lm_to_subtract),
+      const_arpa_(const_arpa), lm_to_add_fst_(lm_to_add_fst), key_(key),
+      clat_(clat), compact_lattice_writer_(compact_lattice_writer),
+      num_done_(num_done), num_err_(num_err) { }
+
+  void operator () () {
+    if (acoustic_scale_ != 1.0) {
+      fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale_), clat_);
+    }
+    TopSortCompactLatticeIfNeeded(clat_);
+
+    // The ConstArpaLm wrapper caches the LM states it has seen, so each task
+    // needs its own; the backoff FST wrapper is stateless, but it's cheap.
+    // To avoid memory gradually increasing with time, we reconstruct them
+    // and the composed-LM FST for each lattice we process.
+    fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_add;
+    if (const_arpa_ != NULL)
+      lm_to_add = new ConstArpaLmDeterministicFst(*const_arpa_);
+    else
+      lm_to_add = new fst::BackoffDeterministicOnDemandFst<fst::StdArc>(
+          *lm_to_add_fst_);
+    fst::ScaleDeterministicOnDemandFst lm_to_add_scale(lm_scale_, lm_to_add);
+
+    //   It shouldn't make a difference in which order we provide the
+    // arguments to the composition; either way should work.  They are both
+    // acceptors so the result is the same either way.
+    fst::ComposeDeterministicOnDemandFst<fst::StdArc> combined_lms(
+        lm_to_subtract_, &lm_to_add_scale);
+
+    ComposeCompactLatticePruned(compose_opts_,
+                                *clat_,
+                                &combined_lms,
+                                &composed_clat_);
+    delete clat_;
+    clat_ = NULL;
+    delete lm_to_add;
+
+    if (composed_clat_.NumStates() != 0 && acoustic_scale_ != 1.0) {
+      fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale_),
+                        &composed_clat_);
+    }
+  }
+
+  ~PrunedRescoreTask() {
+    if (composed_clat_.NumStates() == 0) {
+      // Something went wrong.  A warning will already have been printed.
+      (*num_err_)++;
+    } else {
+      compact_lattice_writer_->Write(key_, composed_clat_);
+      (*num_done_)++;
+    }
+    delete clat_;
+  }
+
+ private:
+  const ComposeLatticePrunedOptions &compose_opts_;
+  BaseFloat lm_scale_;
+  BaseFloat acoustic_scale_;
+  fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_subtract_;
+  const ConstArpaLm *const_arpa_;
+  const fst::VectorFst<fst::StdArc> *lm_to_add_fst_;
+  std::string key_;
+  CompactLattice *clat_;  // The input lattice; owned here.
+  CompactLattice composed_clat_;  // The output, written in the destructor.
+  CompactLatticeWriter *compact_lattice_writer_;
+  int32 *num_done_;
+  int32 *num_err_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -44,7 +134,9 @@ int main(int argc, char *argv[]) {
         "language model is expected to be an FST, e.g. G.fst; the second one can\n"
         "either be in FST or const-arpa format.  Any FST-format language models will\n"
         "be projected on their output by this program, making it unnecessary for the\n"
-        "caller to remove disambiguation symbols.\n"
+        "caller to remove disambiguation symbols.  With --num-threads > 1, several\n"
+        "lattices are rescored in parallel with the same LMs; the output order is\n"
+        "unchanged.\n"
         "\n"
         "Usage: lattice-lmrescore-pruned [options] <lm-to-subtract> <lm-to-add> <lattice-rspecifier> <lattice-wspecifier>\n"
         " e.g.: lattice-lmrescore-pruned --acoustic-scale=0.1 \\\n"
@@ -60,6 +152,7 @@ int main(int argc, char *argv[]) {
     BaseFloat lm_scale = 1.0;
     BaseFloat acoustic_scale = 1.0;
     bool add_const_arpa = false;
+    TaskSequencerConfig sequencer_config; // has --num-threads option
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for <lm-to-add>; its negative "
                 "will be applied to <lm-to-subtract>.");
@@ -69,7 +162,8 @@ int main(int argc, char *argv[]) {
     po.Register("add-const-arpa", &add_const_arpa, "If true, <lm-to-add> is expected"
                 "to be in const-arpa format; if false it's expected to be in FST"
                 "format.");
-
+    compose_opts.Register(&po);
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -89,30 +183,18 @@ int main(int argc, char *argv[]) {
     VectorFst<StdArc> *lm_to_add_fst = NULL;
     ConstArpaLm const_arpa;
     if (add_const_arpa) {
-      ReadKaldiObject(lm_to_add_rxfilename, &const_arpa);
+      ReadConstArpaLm(lm_to_add_rxfilename, &const_arpa);
     } else {
       lm_to_add_fst = fst::ReadAndPrepareLmFst(lm_to_add_rxfilename);
     }
+    if (acoustic_scale == 0.0)
+      KALDI_ERR << "Acoustic scale cannot be zero.";
+    // These are stateless, so they can be shared between the threads.
     fst::BackoffDeterministicOnDemandFst<StdArc> lm_to_subtract_det_backoff(
         *lm_to_subtract_fst);
     fst::ScaleDeterministicOnDemandFst lm_to_subtract_det_scale(
         -lm_scale, &lm_to_subtract_det_backoff);
 
-
-    fst::DeterministicOnDemandFst<StdArc> *lm_to_add_orig = NULL,
-        *lm_to_add = NULL;
-    if (add_const_arpa) {
-      lm_to_add = new ConstArpaLmDeterministicFst(const_arpa);
-    } else {
-      lm_to_add = new fst::BackoffDeterministicOnDemandFst<StdArc>(
-          *lm_to_add_fst);
-    }
-    if (lm_scale != 1.0) {
-      lm_to_add_orig = lm_to_add;
-      lm_to_add = new fst::ScaleDeterministicOnDemandFst(lm_scale,
-                                                         lm_to_add_orig);
-    }
-
     KALDI_LOG << "Done.";
 
     // We read and write as CompactLattice.
@@ -123,47 +205,21 @@ int main(int argc, char *argv[]) {
 
     int32 num_done = 0, num_err = 0;
 
-    for (; !clat_reader.Done(); clat_reader.Next()) {
-      std::string key = clat_reader.Key();
-      CompactLattice &clat = clat_reader.Value();
-
-      if (acoustic_scale != 1.0) {
-        fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale), &clat);
-      }
-      TopSortCompactLatticeIfNeeded(&clat);
-
-      // To avoid memory gradually increasing with time, we reconstruct the
-      // composed-LM FST for each lattice we process.
-      //   It shouldn't make a difference in which order we provide the
-      // arguments to the composition; either way should work.  They are both
-      // acceptors so the result is the same either way.
-      fst::ComposeDeterministicOnDemandFst<StdArc> combined_lms(
-          &lm_to_subtract_det_scale, lm_to_add);
-
-      CompactLattice composed_clat;
-      ComposeCompactLatticePruned(compose_opts,
-                                  clat,
-                                  &combined_lms,
-                                  &composed_clat);
-
-      if (composed_clat.NumStates() == 0) {
-        // Something went wrong.  A warning will already have been printed.
-        num_err++;
-      } else {
-        if (acoustic_scale != 1.0) {
-          if (acoustic_scale == 0.0)
-            KALDI_ERR << "Acoustic scale cannot be zero.";
-          fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale),
-                            &composed_clat);
-        }
-        compact_lattice_writer.Write(key, composed_clat);
-        num_done++;
+    {
+      TaskSequencer<PrunedRescoreTask> sequencer(sequencer_config);
+      for (; !clat_reader.Done(); clat_reader.Next()) {
+        std::string key = clat_reader.Key();
+        CompactLattice *clat = new CompactLattice(clat_reader.Value());
+        clat_reader.FreeCurrent();
+        sequencer.Run(new PrunedRescoreTask(
+            compose_opts, lm_scale, acoustic_scale, &lm_to_subtract_det_scale,
+            (add_const_arpa ? &const_arpa : NULL), lm_to_add_fst, key, clat,
+            &compact_lattice_writer, &num_done, &num_err));
       }
+      sequencer.Wait();
     }
     delete lm_to_subtract_fst;
     delete lm_to_add_fst;
-    delete lm_to_add_orig;
-    delete lm_to_add;
 
     KALDI_LOG << "Overall, succeeded for " << num_done
               << " lattices, failed for " << num_err;
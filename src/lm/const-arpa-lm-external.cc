@@ -0,0 +1,797 @@
+// lm/const-arpa-lm-external.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#ifndef _MSC_VER
+#include <stdlib.h>
+#include <unistd.h>
+#endif
+
+#include "base/kaldi-math.h"
+#include "lm/const-arpa-lm.h"
+#include "lm/const-arpa-lm-external.h"
+#include "util/kaldi-io.h"
+#include "util/kaldi-thread.h"
+#include "util/text-utils.h"
+
+namespace kaldi {
+
+// Opens a temporary file in <dir> for reading and writing; it is deleted when
+// it is closed.
+static FILE *OpenTempFile(const std::string &dir) {
+#ifndef _MSC_VER
+  std::string name = dir + "/kaldi-const-arpa-XXXXXX";
+  std::vector<char> name_buf(name.begin(), name.end());
+  name_buf.push_back('\0');
+  int fd = mkstemp(&(name_buf[0]));
+  if (fd == -1)
+    KALDI_ERR << "Could not create a temporary file in " << dir << ": "
+              << strerror(errno);
+  unlink(&(name_buf[0]));
+  FILE *file = fdopen(fd, "w+b");
+#else
+  FILE *file = tmpfile();
+#endif
+  if (file == NULL)
+    KALDI_ERR << "Could not open a temporary file in " << dir << ": "
+              << strerror(errno);
+  return file;
+}
+
+// Sorts records, which are arrays of <record_size> int32s whose first
+// <key_size> elements are the key (compared lexicographically).  When the
+// records that have been added don't fit in the memory we were given, they
+// are sorted and written to a temporary file as a "run"; after Finish(), the
+// runs are merged as we read the records back in order, which we can do as
+// many times as needed.
+class ExternalRecordSorter {
+ public:
+  ExternalRecordSorter(int32 record_size, int32 key_size, int64 max_memory,
+                       const std::string &temp_dir):
+      record_size_(record_size), key_size_(key_size), temp_dir_(temp_dir),
+      num_records_(0) {
+    KALDI_ASSERT(key_size > 0 && key_size <= record_size);
+    // Each record also needs an int32 in the index we sort.
+    max_buffered_records_ = std::max<int64>(
+        1, max_memory / (sizeof(int32) * (record_size + 1)));
+  }
+
+  ~ExternalRecordSorter() {
+    for (size_t i = 0; i < runs_.size(); i++)
+      fclose(runs_[i].file);
+  }
+
+  void Add(const int32 *record) {
+    records_.insert(records_.end(), record, record + record_size_);
+    num_records_++;
+    if (records_.size() >= max_buffered_records_ * record_size_)
+      WriteRun();
+  }
+
+  // Called after the last record has been added.
+  void Finish() {
+    if (!records_.empty())
+      WriteRun();
+    std::vector<int32> temp;
+    records_.swap(temp);
+  }
+
+  int64 NumRecords() const { return num_records_; }
+
+  int32 NumRuns() const { return runs_.size(); }
+
+  // Starts reading the sorted records from the beginning, using about
+  // <max_memory> bytes of buffers.  Requires Finish() to have been called.
+  void Rewind(int64 max_memory) {
+    KALDI_ASSERT(records_.empty());
+    heap_.clear();
+    int64 buffer_records = 256;
+    if (!runs_.empty())
+      buffer_records = std::max<int64>(buffer_records, max_memory /
+          (runs_.size() * sizeof(int32) * record_size_));
+    for (size_t i = 0; i < runs_.size(); i++) {
+      Run &run = runs_[i];
+      if (fseek(run.file, 0, SEEK_SET) != 0)
+        KALDI_ERR << "Error seeking in temporary file: " << strerror(errno);
+      run.buffer.resize(buffer_records * record_size_);
+      run.num_read = 0;
+      if (FillBuffer(&run)) {
+        heap_.push_back(i);
+        std::push_heap(heap_.begin(), heap_.end(), RunGreater(this));
+      }
+    }
+  }
+
+  bool Done() const { return heap_.empty(); }
+
+  // Returns the current record; valid until the next call to Next().
+  const int32 *Value() const {
+    const Run &run = runs_[heap_[0]];
+    return &(run.buffer[run.pos]);
+  }
+
+  void Next() {
+    std::pop_heap(heap_.begin(), heap_.end(), RunGreater(this));
+    Run &run = runs_[heap_.back()];
+    run.pos += record_size_;
+    if (run.pos < run.size || FillBuffer(&run))
+      std::push_heap(heap_.begin(), heap_.end(), RunGreater(this));
+    else
+      heap_.pop_back();
+  }
+
+ private:
+  struct Run {
+    FILE *file;
+    int64 num_records;
+    int64 num_read;
+    std::vector<int32> buffer;
+    size_t pos;   // position of the current record in <buffer>.
+    size_t size;  // number of int32s in <buffer>.
+  };
+
+  // Compares records by their keys.
+  class RecordLess {
+   public:
+    RecordLess(const int32 *records, int32 record_size, int32 key_size):
+        records_(records), record_size_(record_size), key_size_(key_size) { }
+    bool operator () (int32 a, int32 b) const {
+      const int32 *ra = records_ + static_cast<size_t>(a) * record_size_,
+          *rb = records_ + static_cast<size_t>(b) * record_size_;
+      return std::lexicographical_compare(ra, ra + key_size_, rb,
+                                          rb + key_size_);
+    }
+   private:
+    const int32 *records_;
+    int32 record_size_;
+    int32 key_size_;
+  };
+
+  // Orders the runs in <heap_> so that the one with the smallest current
+  // record is at the top.
+  class RunGreater {
+   public:
+    explicit RunGreater(const ExternalRecordSorter *sorter): sorter_(sorter) { }
+    bool operator () (int32 a, int32 b) const {
+      const Run &run_a = sorter_->runs_[a], &run_b = sorter_->runs_[b];
+      const int32 *ra = &(run_a.buffer[run_a.pos]),
+          *rb = &(run_b.buffer[run_b.pos]);
+      return std::lexicographical_compare(rb, rb + sorter_->key_size_, ra,
+                                          ra + sorter_->key_size_);
+    }
+   private:
+    const ExternalRecordSorter *sorter_;
+  };
+
+  void WriteRun() {
+    int64 num_records = records_.size() / record_size_;
+    std::vector<int32> order(num_records);
+    for (int64 i = 0; i < num_records; i++)
+      order[i] = i;
+    std::sort(order.begin(), order.end(),
+              RecordLess(&(records_[0]), record_size_, key_size_));
+    Run run;
+    run.file = OpenTempFile(temp_dir_);
+    run.num_records = num_records;
+    run.num_read = 0;
+    run.pos = run.size = 0;
+    runs_.push_back(run);
+    for (int64 i = 0; i < num_records; i++) {
+      if (fwrite(&(records_[static_cast<size_t>(order[i]) * record_size_]),
+                 sizeof(int32), record_size_, run.file) !=
+          static_cast<size_t>(record_size_))
+        KALDI_ERR << "Error writing to temporary file (disk full?): "
+                  << strerror(errno);
+    }
+    if (fflush(run.file) != 0)
+      KALDI_ERR << "Error writing to temporary file (disk full?): "
+                << strerror(errno);
+    records_.clear();
+  }
+
+  // Reads the next records of <run> into its buffer; returns false if there
+  // are no more.
+  bool FillBuffer(Run *run) {
+    int64 num_records = std::min<int64>(run->buffer.size() / record_size_,
+                                        run->num_records - run->num_read);
+    run->pos = 0;
+    run->size = num_records * record_size_;
+    if (num_records == 0)
+      return false;
+    if (fread(&(run->buffer[0]), sizeof(int32) * record_size_, num_records,
+              run->file) != static_cast<size_t>(num_records))
+      KALDI_ERR << "Error reading temporary file: " << strerror(errno);
+    run->num_read += num_records;
+    return true;
+  }
+
+  int32 record_size_;
+  int32 key_size_;
+  std::string temp_dir_;
+  int64 max_buffered_records_;
+  int64 num_records_;
+  // The records that haven't been written to a run yet.
+  std::vector<int32> records_;
+  std::vector<Run> runs_;
+  // While reading: the runs that have records left, as a heap.
+  std::vector<int32> heap_;
+};
+
+
+// This class does the work of BuildConstArpaLmExternal().  With N the n-gram
+// order, the records we sort are:
+//   states: the words of an n-gram of order less than N (or all n-grams if
+//           N == 1) padded with zeros to N words, then its logprob and
+//           backoff logprob; sorted by the words.  This is the order of the
+//           LmStates in the ConstArpaLm.
+//   children: for the n-grams of order two or more, the history words padded
+//           to N - 1 words, the last word, then the logprob; sorted by the
+//           first N elements.  The children of each LmState are together, in
+//           the order of the LmStates.
+//   addresses: for the n-grams of order two or more that have an LmState, the
+//           first N elements as for children, then the address of the
+//           LmState in two int32s.
+class ConstArpaLmExternalBuilder {
+ public:
+  ConstArpaLmExternalBuilder(const ArpaParseOptions &options,
+                             const ConstArpaLmExternalOptions &external_opts):
+      options_(options), external_opts_(external_opts),
+      max_memory_(static_cast<int64>(external_opts.max_memory_mb * 1048576.0)),
+      ngram_order_(0),
+      num_words_(0), lm_states_size_(0),
+      max_address_offset_((1 << 30) - 1), states_(NULL), children_(NULL),
+      addresses_(NULL) { }
+
+  ~ConstArpaLmExternalBuilder() {
+    delete states_;
+    delete children_;
+    delete addresses_;
+  }
+
+  // Reads the Arpa file and sorts the states and children.
+  void Read(std::istream &is);
+
+  // Computes the addresses of the LmStates.
+  void ComputeAddresses();
+
+  // Writes the ConstArpaLm; the stream should be in binary mode.
+  void Write(std::ostream &os);
+
+  // The functions below are called by ArpaBlockTask.
+
+  // Parses <lines>, which are n-grams of order <order>, into the records
+  // for <states_> and <children_>.  Returns false and sets <error> if there
+  // was a problem.
+  bool ParseBlock(int32 order, int64 first_line_number,
+                  const std::vector<std::string> &lines,
+                  std::vector<int32> *state_records,
+                  std::vector<int32> *child_records, std::string *error) const;
+
+  // Adds the records from ParseBlock(); called in the order of the blocks.
+  void AddRecords(const std::vector<int32> &state_records,
+                  const std::vector<int32> &child_records,
+                  const std::string &error);
+
+ private:
+  // Returns the first error from parsing, if any.
+  std::string GetError() {
+    std::lock_guard<std::mutex> lock(error_mutex_);
+    return error_;
+  }
+
+  // Returns a printable form of the first <size> words of <words>, ignoring
+  // zeros (the padding).
+  static std::string WordsToString(const int32 *words, int32 size);
+
+  // Returns the number of words in the padded state record <state>.
+  int32 StateOrder(const int32 *state) const {
+    int32 order = 0;
+    while (order < ngram_order_ && state[order] != 0)
+      order++;
+    return order;
+  }
+
+  // Compares the words of <state> with the history words of <child>.
+  int32 CompareHistory(const int32 *state, const int32 *child) const {
+    for (int32 i = 0; i + 1 < ngram_order_; i++) {
+      if (state[i] != child[i])
+        return (state[i] < child[i] ? -1 : 1);
+    }
+    return 0;
+  }
+
+  // Checks that the next n-gram in <children_> doesn't have a history that
+  // comes before <state> (or, if <state> is NULL, that there are no more
+  // n-grams in <children_>); if it does, its history is not in the LM.
+  void CheckHistoryExists(const int32 *state) const;
+
+  ArpaParseOptions options_;
+  ConstArpaLmExternalOptions external_opts_;
+  // The memory the sorters may use for their buffers, in bytes, shared
+  // between the sorters that are in use at the same time.
+  int64 max_memory_;
+  int32 ngram_order_;
+  int32 num_words_;
+  int64 lm_states_size_;
+  int32 max_address_offset_;
+  // For each word, the address of its LmState, or -1.
+  std::vector<int64> unigram_addresses_;
+
+  ExternalRecordSorter *states_;
+  ExternalRecordSorter *children_;
+  ExternalRecordSorter *addresses_;
+
+  std::mutex error_mutex_;
+  std::string error_;
+};
+
+// Parses a block of lines of the Arpa file in operator (); the records are
+// added to the builder in the destructor, which TaskSequencer calls in the
+// order of the blocks.
+class ArpaBlockTask {
+ public:
+  // Swaps the contents of <lines> with an empty vector.
+  ArpaBlockTask(ConstArpaLmExternalBuilder *builder, int32 order,
+                int64 first_line_number, std::vector<std::string> *lines):
+      builder_(builder), order_(order), first_line_number_(first_line_number) {
+    lines_.swap(*lines);
+  }
+
+  void operator () () {
+    builder_->ParseBlock(order_, first_line_number_, lines_, &state_records_,
+                         &child_records_, &error_);
+  }
+
+  ~ArpaBlockTask() {
+    builder_->AddRecords(state_records_, child_records_, error_);
+  }
+
+ private:
+  ConstArpaLmExternalBuilder *builder_;
+  int32 order_;
+  int64 first_line_number_;
+  std::vector<std::string> lines_;
+  std::vector<int32> state_records_;
+  std::vector<int32> child_records_;
+  std::string error_;
+};
+
+static void TrimTrailingSpaces(std::string *str) {
+  str->erase(str->find_last_not_of(" \n\r\t") + 1);
+}
+
+std::string ConstArpaLmExternalBuilder::WordsToString(const int32 *words,
+                                                      int32 size) {
+  std::ostringstream os;
+  os << "[";
+  for (int32 i = 0; i < size; i++)
+    if (words[i] != 0)
+      os << " " << words[i];
+  os << " ]";
+  return os.str();
+}
+
+bool ConstArpaLmExternalBuilder::ParseBlock(
+    int32 order, int64 first_line_number,
+    const std::vector<std::string> &lines, std::vector<int32> *state_records,
+    std::vector<int32> *child_records, std::string *error) const {
+  int32 n = ngram_order_;
+  bool is_state = (order < n || n == 1), is_child = (order > 1);
+  std::vector<std::string> col;
+  std::vector<int32> words(order);
+  for (size_t l = 0; l < lines.size(); l++) {
+    // Line numbers are approximate, as we skip empty lines.
+    std::ostringstream line_ref;
+    line_ref << "line " << (first_line_number + l) << " [" << lines[l]
+             << "]: ";
+    SplitStringToVector(lines[l], " \t", true, &col);
+    int32 num_cols = col.size();
+    if (num_cols < 1 + order || num_cols > 2 + order ||
+        (order == n && num_cols != 1 + order)) {
+      *error = line_ref.str() + "Invalid n-gram data line";
+      return false;
+    }
+    float logprob, backoff = 0.0;
+    if (!ConvertStringToReal(col[0], &logprob)) {
+      *error = line_ref.str() + "invalid n-gram logprob";
+      return false;
+    }
+    if (num_cols > order + 1 &&
+        !ConvertStringToReal(col[order + 1], &backoff)) {
+      *error = line_ref.str() + "invalid backoff weight";
+      return false;
+    }
+    // Convert to natural log, as ArpaFileParser does.
+    logprob *= M_LN10;
+    backoff *= M_LN10;
+    for (int32 i = 0; i < order; i++) {
+      if (!ConvertStringToInteger(col[1 + i], &(words[i])) || words[i] < 0) {
+        *error = line_ref.str() + "invalid symbol '" + col[1 + i] + "'";
+        return false;
+      }
+      if (words[i] == 0) {
+        *error = line_ref.str() + "epsilon symbol '" + col[1 + i] +
+            "' is illegal in ARPA LM";
+        return false;
+      }
+    }
+    if (is_state) {
+      size_t begin = state_records->size();
+      state_records->resize(begin + n + 2, 0);
+      std::copy(words.begin(), words.end(), state_records->begin() + begin);
+      (*state_records)[begin + n] = Int32AndFloat(logprob).i;
+      (*state_records)[begin + n + 1] = Int32AndFloat(backoff).i;
+    }
+    if (is_child) {
+      size_t begin = child_records->size();
+      child_records->resize(begin + n + 1, 0);
+      std::copy(words.begin(), words.end() - 1,
+                child_records->begin() + begin);
+      (*child_records)[begin + n - 1] = words.back();
+      (*child_records)[begin + n] = Int32AndFloat(logprob).i;
+    }
+  }
+  return true;
+}
+
+void ConstArpaLmExternalBuilder::AddRecords(
+    const std::vector<int32> &state_records,
+    const std::vector<int32> &child_records, const std::string &error) {
+  {
+    std::lock_guard<std::mutex> lock(error_mutex_);
+    if (!error_.empty())
+      return;
+    if (!error.empty()) {
+      error_ = error;
+      return;
+    }
+  }
+  int32 n = ngram_order_;
+  for (size_t i = 0; i < state_records.size(); i += n + 2) {
+    // Figures out <num_words_> from the unigrams.
+    if (n == 1 || state_records[i + 1] == 0)
+      num_words_ = std::max(num_words_, state_records[i] + 1);
+    states_->Add(&(state_records[i]));
+  }
+  for (size_t i = 0; i < child_records.size(); i += n + 1)
+    children_->Add(&(child_records[i]));
+}
+
+void ConstArpaLmExternalBuilder::Read(std::istream &is) {
+  if (options_.bos_symbol <= 0 || options_.eos_symbol <= 0 ||
+      options_.bos_symbol == options_.eos_symbol)
+    KALDI_ERR << "BOS and EOS symbols are required, must not be epsilons, and "
+              << "differ from each other. Given:"
+              << " BOS=" << options_.bos_symbol
+              << " EOS=" << options_.eos_symbol;
+
+  // Processes the "\data\" section.
+  std::string line;
+  int64 line_number = 0;
+  bool keyword_found = false;
+  std::vector<int32> ngram_counts;
+  while (++line_number, std::getline(is, line)) {
+    if (line.find_first_not_of(" \t\n\r") == std::string::npos)
+      continue;
+    TrimTrailingSpaces(&line);
+    if (!keyword_found) {
+      if (line == "\\data\\") {
+        KALDI_LOG << "Reading \\data\\ section.";
+        keyword_found = true;
+      }
+      continue;
+    }
+    if (line[0] == '\\')
+      break;
+    std::size_t equal_symbol_pos = line.find("=");
+    if (equal_symbol_pos != std::string::npos)
+      line.replace(equal_symbol_pos, 1, " = ");
+    std::vector<std::string> col;
+    SplitStringToVector(line, " \t", true, &col);
+    int32 order, ngram_count = 0;
+    if (col.size() == 4 && col[0] == "ngram" && col[2] == "=" &&
+        ConvertStringToInteger(col[1], &order) && order > 0 &&
+        ConvertStringToInteger(col[3], &ngram_count)) {
+      if (ngram_counts.size() < order)
+        ngram_counts.resize(order, 0);
+      ngram_counts[order - 1] = ngram_count;
+    } else {
+      KALDI_WARN << "line " << line_number << " [" << line << "]: "
+                 << "uninterpretable line in \\data\\ section";
+    }
+  }
+  if (ngram_counts.empty())
+    KALDI_ERR << "\\data\\ section missing or empty.";
+  ngram_order_ = ngram_counts.size();
+  int32 n = ngram_order_;
+
+  // The memory is shared between the two sorters.
+  states_ = new ExternalRecordSorter(n + 2, n, max_memory_ / 2,
+                                     external_opts_.temp_dir);
+  children_ = new ExternalRecordSorter(n + 1, n, max_memory_ / 2,
+                                       external_opts_.temp_dir);
+
+  // Processes the "\N-grams:" sections, in blocks of lines that are parsed
+  // by the TaskSequencer's threads.
+  const size_t block_size = 100000;
+  TaskSequencerConfig sequencer_config;
+  sequencer_config.num_threads = external_opts_.num_threads;
+  {
+    TaskSequencer<ArpaBlockTask> sequencer(sequencer_config);
+    for (int32 cur_order = 1; cur_order <= n; cur_order++) {
+      std::ostringstream keyword, next_keyword;
+      keyword << "\\" << cur_order << "-grams:";
+      next_keyword << "\\" << (cur_order + 1) << "-grams:";
+      if (line != keyword.str())
+        KALDI_ERR << "line " << line_number << " [" << line << "]: "
+                  << "invalid directive, expecting '" << keyword.str() << "'";
+      KALDI_LOG << "Reading " << line << " section.";
+      std::vector<std::string> lines;
+      int64 first_line_number = line_number + 1, ngram_count = 0;
+      while (++line_number, std::getline(is, line)) {
+        if (line.find_first_not_of(" \t\n\r") == std::string::npos)
+          continue;
+        if (line[0] == '\\') {
+          TrimTrailingSpaces(&line);
+          if (line == next_keyword.str() || line == "\\end\\")
+            break;
+          KALDI_ERR << "line " << line_number << " [" << line << "]: "
+                    << "unexpected directive, expecting '"
+                    << next_keyword.str() << "'";
+        }
+        if (lines.empty())
+          first_line_number = line_number;
+        lines.push_back(line);
+        ngram_count++;
+        if (lines.size() == block_size) {
+          sequencer.Run(new ArpaBlockTask(this, cur_order, first_line_number,
+                                          &lines));
+          std::string error = GetError();
+          if (!error.empty())
+            KALDI_ERR << error;
+        }
+      }
+      if (!lines.empty())
+        sequencer.Run(new ArpaBlockTask(this, cur_order, first_line_number,
+                                        &lines));
+      if (ngram_count > ngram_counts[cur_order - 1])
+        KALDI_ERR << "header said there would be "
+                  << ngram_counts[cur_order - 1] << " n-grams of order "
+                  << cur_order << ", but we saw " << ngram_count;
+    }
+    sequencer.Wait();
+  }
+  std::string error = GetError();
+  if (!error.empty())
+    KALDI_ERR << error;
+  if (line != "\\end\\")
+    KALDI_ERR << "line " << line_number << " [" << line << "]: "
+              << "invalid or unexpected directive line, expecting \\end\\";
+
+  states_->Finish();
+  children_->Finish();
+  KALDI_LOG << "Sorted " << states_->NumRecords() << " history states in "
+            << states_->NumRuns() << " runs and " << children_->NumRecords()
+            << " n-grams of order two or more in " << children_->NumRuns()
+            << " runs.";
+}
+
+void ConstArpaLmExternalBuilder::CheckHistoryExists(
+    const int32 *state) const {
+  if (children_->Done() ||
+      (state != NULL && CompareHistory(state, children_->Value()) <= 0))
+    return;
+  const int32 *child = children_->Value();
+  int32 order = 1;
+  while (order < ngram_order_ && child[order - 1] != 0)
+    order++;
+  KALDI_ERR << order << "-gram " << WordsToString(child, ngram_order_)
+            << " does not have a parent model " << (order - 1) << "-gram.";
+}
+
+void ConstArpaLmExternalBuilder::ComputeAddresses() {
+  int32 n = ngram_order_;
+  addresses_ = new ExternalRecordSorter(n + 2, n, max_memory_ / 2,
+                                        external_opts_.temp_dir);
+  states_->Rewind(max_memory_ / 4);
+  children_->Rewind(max_memory_ / 4);
+  unigram_addresses_.assign(num_words_, -1);
+
+  std::vector<int32> prev_state, prev_child, record(n + 2);
+  int64 address = 0;
+  for (; !states_->Done(); states_->Next()) {
+    const int32 *state = states_->Value();
+    if (!prev_state.empty() && std::equal(state, state + n,
+                                          prev_state.begin()))
+      KALDI_ERR << "N-gram " << WordsToString(state, n)
+                << " appears twice in the arpa file";
+    prev_state.assign(state, state + n);
+    int32 order = StateOrder(state), num_children = 0;
+    if (order < n) {
+      CheckHistoryExists(state);
+      for (; !children_->Done() &&
+               CompareHistory(state, children_->Value()) == 0;
+           children_->Next()) {
+        const int32 *child = children_->Value();
+        if (!prev_child.empty() && std::equal(child, child + n,
+                                              prev_child.begin()))
+          KALDI_ERR << "N-gram " << WordsToString(child, n)
+                    << " appears twice in the arpa file";
+        prev_child.assign(child, child + n);
+        num_children++;
+      }
+    }
+    // An n-gram of order two or more with no backoff and no children is a
+    // leaf, which doesn't get an LmState.
+    float backoff = Int32AndFloat(state[n + 1]).f;
+    if (order > 1 && backoff == 0.0 && num_children == 0)
+      continue;
+    if (order == 1) {
+      unigram_addresses_[state[0]] = address;
+    } else {
+      std::fill(record.begin(), record.begin() + n, 0);
+      std::copy(state, state + order - 1, record.begin());
+      record[n - 1] = state[order - 1];
+      record[n] = static_cast<int32>(address & 0xFFFFFFFF);
+      record[n + 1] = static_cast<int32>(address >> 32);
+      addresses_->Add(&(record[0]));
+    }
+    address += 3 + 2 * num_children;
+  }
+  CheckHistoryExists(NULL);
+  addresses_->Finish();
+  lm_states_size_ = address;
+}
+
+void ConstArpaLmExternalBuilder::Write(std::ostream &os) {
+  int32 n = ngram_order_;
+  if (options_.bos_symbol >= num_words_ || options_.eos_symbol >= num_words_ ||
+      options_.unk_symbol >= num_words_ ||
+      (options_.unk_symbol <= 0 && options_.unk_symbol != -1))
+    KALDI_ERR << "Invalid BOS, EOS or UNK symbol (BOS=" << options_.bos_symbol
+              << ", EOS=" << options_.eos_symbol << ", UNK="
+              << options_.unk_symbol << ") for a language model whose "
+              << "largest unigram is " << (num_words_ - 1);
+
+  // This matches ConstArpaLm::Write().
+  WriteToken(os, true, "<ConstArpaLm>");
+  WriteToken(os, true, "<LmInfo>");
+  WriteBasicType(os, true, options_.bos_symbol);
+  WriteBasicType(os, true, options_.eos_symbol);
+  WriteBasicType(os, true, options_.unk_symbol);
+  WriteBasicType(os, true, ngram_order_);
+  WriteToken(os, true, "</LmInfo>");
+  WriteToken(os, true, "<LmStates>");
+  WriteBasicType(os, true, lm_states_size_);
+
+  states_->Rewind(max_memory_ / 4);
+  children_->Rewind(max_memory_ / 4);
+  addresses_->Rewind(max_memory_ / 4);
+  std::vector<int64> overflow_addresses;
+  std::vector<int32> lm_state, buffer;
+  int64 address = 0;
+  for (; !states_->Done(); states_->Next()) {
+    const int32 *state = states_->Value();
+    int32 order = StateOrder(state);
+    lm_state.resize(3);
+    lm_state[0] = state[n];
+    lm_state[1] = state[n + 1];
+    if (order < n) {
+      for (; !children_->Done() &&
+               CompareHistory(state, children_->Value()) == 0;
+           children_->Next()) {
+        const int32 *child = children_->Value();
+        int32 child_info;
+        // The children that are not of the highest order and have an LmState
+        // are exactly the ones in <addresses_>, in the same order.
+        if (order + 1 < n && !addresses_->Done() &&
+            std::equal(child, child + n, addresses_->Value())) {
+          const int32 *child_address = addresses_->Value();
+          int64 offset = ((static_cast<int64>(child_address[n + 1]) << 32) |
+                          static_cast<uint32>(child_address[n])) - address;
+          KALDI_ASSERT(offset > 0);
+          if (offset <= max_address_offset_) {
+            child_info = offset * 2;
+            child_info |= 1;
+          } else {
+            overflow_addresses.push_back(address + offset);
+            child_info = (overflow_addresses.size() - 1) * 2;
+            child_info |= 1;
+            child_info *= -1;
+          }
+          addresses_->Next();
+        } else {
+          // A leaf; we store the logprob instead, with the last bit 0.
+          child_info = child[n];
+          child_info &= ~1;
+        }
+        lm_state.push_back(child[n - 1]);
+        lm_state.push_back(child_info);
+      }
+    }
+    int32 num_children = (lm_state.size() - 3) / 2;
+    float backoff = Int32AndFloat(state[n + 1]).f;
+    if (order > 1 && backoff == 0.0 && num_children == 0)
+      continue;
+    lm_state[2] = num_children;
+    buffer.insert(buffer.end(), lm_state.begin(), lm_state.end());
+    address += lm_state.size();
+    if (buffer.size() >= (1 << 20)) {
+      os.write(reinterpret_cast<const char*>(&(buffer[0])),
+               sizeof(int32) * buffer.size());
+      buffer.clear();
+    }
+  }
+  if (!buffer.empty())
+    os.write(reinterpret_cast<const char*>(&(buffer[0])),
+             sizeof(int32) * buffer.size());
+  KALDI_ASSERT(address == lm_states_size_ && addresses_->Done());
+  if (!os.good())
+    KALDI_ERR << "ConstArpaLm <LmStates> section writing failed.";
+  WriteToken(os, true, "</LmStates>");
+
+  // See ConstArpaLm::Write() for the offsets we write.
+  WriteToken(os, true, "<LmUnigram>");
+  WriteBasicType(os, true, num_words_);
+  std::vector<int64> offsets(num_words_);
+  for (int32 i = 0; i < num_words_; i++)
+    offsets[i] = unigram_addresses_[i] + 1;
+  if (num_words_ > 0)
+    os.write(reinterpret_cast<const char*>(&(offsets[0])),
+             sizeof(int64) * num_words_);
+  WriteToken(os, true, "</LmUnigram>");
+
+  WriteToken(os, true, "<LmOverflow>");
+  int32 overflow_buffer_size = overflow_addresses.size();
+  WriteBasicType(os, true, overflow_buffer_size);
+  for (int32 i = 0; i < overflow_buffer_size; i++)
+    overflow_addresses[i] += 1;
+  if (overflow_buffer_size > 0)
+    os.write(reinterpret_cast<const char*>(&(overflow_addresses[0])),
+             sizeof(int64) * overflow_buffer_size);
+  if (!os.good())
+    KALDI_ERR << "ConstArpaLm writing failed.";
+  WriteToken(os, true, "</LmOverflow>");
+  WriteToken(os, true, "</ConstArpaLm>");
+  KALDI_LOG << "Wrote ConstArpaLm with " << lm_states_size_
+            << " int32s of LmStates.";
+}
+
+bool BuildConstArpaLmExternal(const ArpaParseOptions &options,
+                              const ConstArpaLmExternalOptions &external_opts,
+                              const std::string &arpa_rxfilename,
+                              const std::string &const_arpa_wxfilename) {
+  ConstArpaLmExternalBuilder builder(options, external_opts);
+  KALDI_LOG << "Reading " << arpa_rxfilename;
+  {
+    Input ki(arpa_rxfilename);
+    builder.Read(ki.Stream());
+  }
+  builder.ComputeAddresses();
+  Output ko(const_arpa_wxfilename, true);
+  builder.Write(ko.Stream());
+  return ko.Close();
+}
+
+}  // namespace kaldi
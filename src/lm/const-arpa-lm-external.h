@@ -0,0 +1,83 @@
+// lm/const-arpa-lm-external.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_LM_CONST_ARPA_LM_EXTERNAL_H_
+#define KALDI_LM_CONST_ARPA_LM_EXTERNAL_H_
+
+#include <string>
+
+#include "base/kaldi-common.h"
+#include "itf/options-itf.h"
+#include "lm/arpa-file-parser.h"
+
+namespace kaldi {
+
+/**
+   Options for BuildConstArpaLmExternal().
+*/
+struct ConstArpaLmExternalOptions {
+  BaseFloat max_memory_mb;
+  std::string temp_dir;
+  int32 num_threads;
+
+  ConstArpaLmExternalOptions(): max_memory_mb(1024.0), temp_dir("/tmp"),
+                                num_threads(1) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("max-memory-mb", &max_memory_mb, "Approximate amount of "
+                   "memory (in megabytes) to use for sorting the n-grams; "
+                   "the rest are sorted on disk in --temp-dir.");
+    opts->Register("temp-dir", &temp_dir, "Directory for the temporary files "
+                   "that hold the sorted n-grams; it needs space for about "
+                   "twice the size of the n-grams in binary form.");
+    opts->Register("num-threads", &num_threads, "Number of threads used to "
+                   "parse the ARPA file.");
+  }
+};
+
+/**
+   Builds a ConstArpaLm from an Arpa format language model whose words have
+   been converted into integers, like BuildConstArpaLm(), and writes it in
+   the ConstArpaLm format; the output is identical.  The difference is that
+   BuildConstArpaLm() holds all the n-grams in memory (as objects that are
+   much larger than the result), while this function sorts them on disk, in
+   sorted runs of bounded size that are merged, and writes the ConstArpaLm
+   in a streaming pass, so it can build language models that don't fit in
+   memory; only the unigram table and the overflow buffer are held in memory.
+
+   The layout of a ConstArpaLm (see the comment in const-arpa-lm.h) has the
+   LmStates sorted lexicographically by their word sequences; the address of
+   an LmState depends on the numbers of children of the LmStates before it,
+   and a parent needs the addresses of its children, which come after it.
+   So we sort two streams of records: the LmStates (n-grams below the highest
+   order) in lexicographic order, and the non-unigram n-grams ordered by
+   (history, last word), which groups the children of each LmState together
+   in the order of their parents.  A first merged pass over both computes the
+   addresses of the LmStates, which are sorted into the second order, and a
+   second pass writes the LmStates with all three streams.
+
+   The parsing of the Arpa file is done by <external_opts.num_threads>
+   threads, in blocks of lines.
+*/
+bool BuildConstArpaLmExternal(const ArpaParseOptions &options,
+                              const ConstArpaLmExternalOptions &external_opts,
+                              const std::string &arpa_rxfilename,
+                              const std::string &const_arpa_wxfilename);
+
+}  // namespace kaldi
+
+#endif  // KALDI_LM_CONST_ARPA_LM_EXTERNAL_H_
@@ -0,0 +1,277 @@
+// lm/const-arpa-lm-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <unistd.h>
+
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "base/kaldi-math.h"
+#include "lm/const-arpa-lm.h"
+#include "lm/const-arpa-lm-external.h"
+#include "util/kaldi-io.h"
+
+namespace kaldi {
+
+// Symbols of the random language models; words are kBos + 1 ... num_words.
+enum {
+  kBos = 1,
+  kEos = 2
+};
+
+// Writes a random trigram language model in the ARPA format, with integer
+// words, to <arpa_filename>.
+static void WriteRandomArpa(int32 num_words, const std::string &arpa_filename) {
+  std::vector<std::vector<int32> > ngrams[3];
+  for (int32 w = 1; w <= num_words; w++)
+    ngrams[0].push_back(std::vector<int32>(1, w));
+  std::set<std::vector<int32> > seen;
+  for (int32 order = 1; order < 3; order++) {
+    int32 num_ngrams = RandInt(1, 4 * num_words);
+    for (int32 i = 0; i < num_ngrams; i++) {
+      std::vector<int32> ngram(
+          ngrams[order - 1][RandInt(0, ngrams[order - 1].size() - 1)]);
+      if (ngram.back() == kEos)
+        continue;
+      int32 word = RandInt(kEos, num_words);
+      ngram.push_back(word);
+      if (seen.insert(ngram).second)
+        ngrams[order].push_back(ngram);
+    }
+  }
+  // The backoff weights are only for the n-grams that are prefixes of others.
+  std::set<std::vector<int32> > prefixes;
+  for (int32 order = 1; order < 3; order++) {
+    for (size_t i = 0; i < ngrams[order].size(); i++)
+      prefixes.insert(std::vector<int32>(ngrams[order][i].begin(),
+                                         ngrams[order][i].end() - 1));
+  }
+
+  Output ko(arpa_filename, false);
+  std::ostream &os = ko.Stream();
+  os << "\n\\data\\\n";
+  for (int32 order = 0; order < 3; order++)
+    os << "ngram " << (order + 1) << "=" << ngrams[order].size() << "\n";
+  for (int32 order = 0; order < 3; order++) {
+    os << "\n\\" << (order + 1) << "-grams:\n";
+    for (size_t i = 0; i < ngrams[order].size(); i++) {
+      const std::vector<int32> &ngram = ngrams[order][i];
+      float logprob = (ngram[0] == kBos && order == 0) ? -99.0 :
+          -5.0 * RandUniform();
+      os << logprob;
+      for (size_t j = 0; j < ngram.size(); j++)
+        os << " " << ngram[j];
+      if (prefixes.count(ngram) != 0)
+        os << " " << (RandInt(0, 3) == 0 ? 0.0 : -2.0 * RandUniform());
+      os << "\n";
+    }
+  }
+  os << "\n\\end\\\n";
+}
+
+// Checks that <lm2> gives the same results as <lm1>, up to <tolerance> for
+// the logprobs.
+static void CompareConstArpaLms(const ConstArpaLm &lm1, const ConstArpaLm &lm2,
+                                int32 num_words, float tolerance) {
+  KALDI_ASSERT(lm1.BosSymbol() == lm2.BosSymbol() &&
+               lm1.EosSymbol() == lm2.EosSymbol() &&
+               lm1.UnkSymbol() == lm2.UnkSymbol() &&
+               lm1.NgramOrder() == lm2.NgramOrder());
+  for (int32 i = 0; i < 1000; i++) {
+    std::vector<int32> hist;
+    int32 hist_length = RandInt(0, 2);
+    for (int32 j = 0; j < hist_length; j++)
+      hist.push_back(j == 0 && RandInt(0, 1) == 0 ? kBos :
+                     RandInt(kEos + 1, num_words));
+    int32 word = RandInt(kEos, num_words);
+    float logprob1 = lm1.GetNgramLogprob(word, hist),
+        logprob2 = lm2.GetNgramLogprob(word, hist);
+    if (tolerance == 0.0)
+      KALDI_ASSERT(logprob1 == logprob2);
+    else
+      KALDI_ASSERT(std::abs(logprob1 - logprob2) <= tolerance);
+    KALDI_ASSERT(lm1.HistoryStateExists(hist) == lm2.HistoryStateExists(hist));
+  }
+}
+
+// Returns the contents of the file <filename>.
+static std::string ReadFileContents(const std::string &filename) {
+  std::ifstream is(filename.c_str(), std::ios::binary);
+  return std::string((std::istreambuf_iterator<char>(is)),
+                     std::istreambuf_iterator<char>());
+}
+
+static void UnitTestConstArpaLmMapped() {
+  int32 num_words = RandInt(3, 100);
+  WriteRandomArpa(num_words, "tmp.arpa");
+  ArpaParseOptions options;
+  options.bos_symbol = kBos;
+  options.eos_symbol = kEos;
+  BuildConstArpaLm(options, "tmp.arpa", "tmp.carpa");
+  ConstArpaLm lm;
+  ReadKaldiObject("tmp.carpa", &lm);
+  KALDI_ASSERT(!ConstArpaLm::IsMappedFile("tmp.carpa"));
+
+  for (int32 quantize_bits = 0; quantize_bits <= 16; quantize_bits += 16) {
+    float tolerance = (quantize_bits == 0 ? 0.0 : 0.01);
+    BuildConstArpaLmMapped(options, "tmp.arpa", "tmp.mapped", quantize_bits);
+    KALDI_ASSERT(ConstArpaLm::IsMappedFile("tmp.mapped"));
+    {
+      ConstArpaLm mapped_lm;
+      mapped_lm.Map("tmp.mapped");
+      KALDI_ASSERT(mapped_lm.QuantizeBits() == quantize_bits);
+      CompareConstArpaLms(lm, mapped_lm, num_words, tolerance);
+    }
+    {
+      ConstArpaLm read_lm;
+      ReadKaldiObject("tmp.mapped", &read_lm);
+      CompareConstArpaLms(lm, read_lm, num_words, tolerance);
+    }
+    {
+      // Converting the ConstArpaLm gives the same file as building it.
+      Output ko("tmp.mapped2", true);
+      lm.WriteMapped(ko.Stream(), quantize_bits);
+      ko.Close();
+      std::string contents = ReadFileContents("tmp.mapped");
+      KALDI_ASSERT(!contents.empty() &&
+                   contents == ReadFileContents("tmp.mapped2"));
+      ConstArpaLm converted_lm;
+      ReadConstArpaLm("tmp.mapped2", &converted_lm);
+      CompareConstArpaLms(lm, converted_lm, num_words, tolerance);
+      // A mapped LM can be written again in the mapped format, and it is not
+      // quantized twice.
+      Output ko2("tmp.mapped3", true);
+      converted_lm.WriteMapped(ko2.Stream(), quantize_bits);
+      ko2.Close();
+      KALDI_ASSERT(contents == ReadFileContents("tmp.mapped3"));
+    }
+  }
+  unlink("tmp.arpa");
+  unlink("tmp.carpa");
+  unlink("tmp.mapped");
+  unlink("tmp.mapped2");
+  unlink("tmp.mapped3");
+}
+
+// Checks ConstArpaLmDeterministicFst against a straightforward implementation
+// with word sequences as states, using GetNgramLogprob() and
+// HistoryStateExists().
+static void TestConstArpaLmDeterministicFst(const ConstArpaLm &lm,
+                                            int32 num_words) {
+  typedef fst::StdArc::StateId StateId;
+  // A small cache, so that entries get replaced.
+  ConstArpaLmDeterministicFst det_fst(lm, RandInt(1, 64));
+  std::vector<std::vector<int32> > state_to_wseq;
+  std::map<std::vector<int32>, StateId> wseq_to_state;
+  state_to_wseq.push_back(std::vector<int32>(1, kBos));
+  wseq_to_state[state_to_wseq[0]] = det_fst.Start();
+  for (int32 i = 0; i < 2000; i++) {
+    // Pick a state we have seen, and follow an arc from it.
+    std::vector<int32> wseq = state_to_wseq[RandInt(0,
+                                                    state_to_wseq.size() - 1)];
+    StateId s = wseq_to_state[wseq];
+    float final_logprob = lm.GetNgramLogprob(kEos, wseq);
+    KALDI_ASSERT(det_fst.Final(s).Value() == -final_logprob);
+
+    // Words up to num_words + 2 are out of the vocabulary.
+    int32 word = RandInt(kEos, num_words + 2);
+    float logprob = lm.GetNgramLogprob(word, wseq);
+    fst::StdArc arc;
+    if (!det_fst.GetArc(s, word, &arc)) {
+      KALDI_ASSERT(logprob == std::numeric_limits<float>::min());
+      continue;
+    }
+    KALDI_ASSERT(arc.ilabel == word && arc.olabel == word &&
+                 arc.weight.Value() == -logprob);
+    wseq.push_back(word);
+    while (wseq.size() >= lm.NgramOrder())
+      wseq.erase(wseq.begin());
+    while (!lm.HistoryStateExists(wseq))
+      wseq.erase(wseq.begin());
+    std::map<std::vector<int32>, StateId>::iterator iter =
+        wseq_to_state.find(wseq);
+    if (iter == wseq_to_state.end()) {
+      wseq_to_state[wseq] = arc.nextstate;
+      state_to_wseq.push_back(wseq);
+    } else {
+      KALDI_ASSERT(iter->second == arc.nextstate);
+    }
+  }
+}
+
+static void UnitTestConstArpaLmDeterministicFst() {
+  int32 num_words = RandInt(3, 100);
+  WriteRandomArpa(num_words, "tmp.arpa");
+  ArpaParseOptions options;
+  options.bos_symbol = kBos;
+  options.eos_symbol = kEos;
+  if (RandInt(0, 1) == 0)
+    options.unk_symbol = num_words;
+  BuildConstArpaLm(options, "tmp.arpa", "tmp.carpa");
+  ConstArpaLm lm;
+  ReadKaldiObject("tmp.carpa", &lm);
+  TestConstArpaLmDeterministicFst(lm, num_words);
+  unlink("tmp.arpa");
+  unlink("tmp.carpa");
+}
+
+// Checks that BuildConstArpaLmExternal() writes the same file as
+// BuildConstArpaLm(), with the n-grams sorted in several runs.
+static void UnitTestConstArpaLmExternal() {
+  int32 num_words = RandInt(3, 100);
+  WriteRandomArpa(num_words, "tmp.arpa");
+  ArpaParseOptions options;
+  options.bos_symbol = kBos;
+  options.eos_symbol = kEos;
+  if (RandInt(0, 1) == 0)
+    options.unk_symbol = num_words;
+  BuildConstArpaLm(options, "tmp.arpa", "tmp.carpa");
+
+  ConstArpaLmExternalOptions external_opts;
+  external_opts.max_memory_mb = 0.0002 * RandInt(1, 20);
+  external_opts.temp_dir = ".";
+  external_opts.num_threads = RandInt(1, 3);
+  BuildConstArpaLmExternal(options, external_opts, "tmp.arpa",
+                           "tmp.carpa.external");
+
+  std::string contents = ReadFileContents("tmp.carpa");
+  KALDI_ASSERT(!contents.empty() &&
+               contents == ReadFileContents("tmp.carpa.external"));
+  unlink("tmp.arpa");
+  unlink("tmp.carpa");
+  unlink("tmp.carpa.external");
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 10; i++)
+    UnitTestConstArpaLmMapped();
+  for (int32 i = 0; i < 10; i++)
+    UnitTestConstArpaLmDeterministicFst();
+  for (int32 i = 0; i < 10; i++)
+    UnitTestConstArpaLmExternal();
+  KALDI_LOG << "Tests succeeded.";
+  return 0;
+}
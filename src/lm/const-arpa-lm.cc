@@ -18,10 +18,20 @@
 // limitations under the License.
 
 #include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
 #include <limits>
 #include <sstream>
 #include <utility>
 
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "base/kaldi-math.h"
 #include "lm/arpa-file-parser.h"
 #include "lm/const-arpa-lm.h"
@@ -205,6 +215,9 @@ class ConstArpaLmBuilder : public ArpaFileParser {
   // Writes ConstArpaLm.
   void Write(std::ostream &os, bool binary) const;
 
+  // Writes ConstArpaLm in the mapped format; see ConstArpaLm::WriteMapped().
+  void WriteMapped(std::ostream &os, int32 quantize_bits) const;
+
   void SetMaxAddressOffset(const int32 max_address_offset) {
     KALDI_WARN << "You are changing <max_address_offset_>; the default should "
         << "not be changed unless you are in testing mode.";
@@ -494,11 +507,150 @@ void ConstArpaLmBuilder::Write(std::ostream &os, bool binary) const {
   const_arpa_lm.Write(os, binary);
 }
 
+void ConstArpaLmBuilder::WriteMapped(std::ostream &os,
+                                     int32 quantize_bits) const {
+  KALDI_ASSERT(is_built_);
+  ConstArpaLm const_arpa_lm(
+      Options().bos_symbol, Options().eos_symbol, Options().unk_symbol,
+      ngram_order_, num_words_, overflow_buffer_size_, lm_states_size_,
+      unigram_states_, overflow_buffer_, lm_states_);
+  const_arpa_lm.WriteMapped(os, quantize_bits);
+}
+
+// The mapped format.  The file starts with the binary-mode header "\0B" and
+// the token "<ConstArpaLmMapped> ", then two bytes of padding and the struct
+// below; positions are in bytes from the start of the file, and are multiples
+// of 8.
+static const char kMappedPrefix[] = "\0B<ConstArpaLmMapped> ";
+static const int64 kMappedPrefixSize = sizeof(kMappedPrefix) - 1,
+    kMappedHeaderPosition = 24;
+
+struct ConstArpaLmMappedHeader {
+  int64 version;
+  int64 bos_symbol;
+  int64 eos_symbol;
+  int64 unk_symbol;
+  int64 ngram_order;
+  int64 num_words;
+  int64 overflow_buffer_size;
+  int64 lm_states_size;
+  int64 quantize_bits;
+  // int64 array: for each word, 1 + the offset of its LmState in the LmStates
+  // array, or 0.
+  int64 unigram_position;
+  // int64 array: 1 + the offset of each overflow LmState, or 0.
+  int64 overflow_position;
+  // int32 array of size lm_states_size.
+  int64 lm_states_position;
+  // two float arrays of size 2^quantize_bits: the logprob and backoff
+  // codebooks (empty if quantize_bits == 0).
+  int64 codebook_position;
+  int64 file_size;
+};
+
+static inline int64 RoundUpTo8(int64 n) {
+  return ((n + 7) / 8) * 8;
+}
+
+// Writes zeros until <*position> is a multiple of 8.
+static void WritePadding(std::ostream &os, int64 *position) {
+  while (*position % 8 != 0) {
+    os.put('\0');
+    (*position)++;
+  }
+}
+
+// Sets <codebook> to <num_codes> values representing <samples> (which it
+// sorts); each value stands for an equal share of the samples.  If
+// <reserve_zero>, code 0 represents exactly zero (which is very common for
+// backoffs).  The codebook is sorted, apart from the reserved zero.
+static void ComputeCodebook(std::vector<float> *samples, int32 num_codes,
+                            bool reserve_zero, std::vector<float> *codebook) {
+  codebook->clear();
+  if (reserve_zero) {
+    codebook->push_back(0.0);
+    samples->erase(std::remove(samples->begin(), samples->end(), 0.0f),
+                   samples->end());
+  }
+  std::sort(samples->begin(), samples->end());
+  int64 num_samples = samples->size();
+  int32 num_bins = num_codes - codebook->size();
+  for (int32 b = 0; b < num_bins; b++) {
+    int64 begin = (num_samples * b) / num_bins,
+        end = (num_samples * (b + 1)) / num_bins;
+    if (begin == end)
+      continue;
+    double sum = 0.0;
+    for (int64 i = begin; i < end; i++)
+      sum += (*samples)[i];
+    float centroid = sum / (end - begin);
+    if (codebook->size() > (reserve_zero ? 1 : 0) &&
+        codebook->back() == centroid)
+      continue;
+    codebook->push_back(centroid);
+  }
+  if (codebook->empty())
+    codebook->push_back(0.0);
+  // Pads the codebook to its full size, so that any code is valid.
+  codebook->resize(num_codes, codebook->back());
+}
+
+// Returns the code of the codebook entry nearest to <value>; see
+// ComputeCodebook() for <reserve_zero>.
+static int32 EncodeValue(const std::vector<float> &codebook, bool reserve_zero,
+                         float value) {
+  if (reserve_zero && value == 0.0)
+    return 0;
+  std::vector<float>::const_iterator begin = codebook.begin() +
+      (reserve_zero ? 1 : 0), iter = std::lower_bound(begin, codebook.end(),
+                                                      value);
+  if (iter == codebook.end())
+    --iter;
+  else if (iter != begin && value - *(iter - 1) < *iter - value)
+    --iter;
+  return iter - codebook.begin();
+}
+
+// Given the sorted offsets of the LmStates in the unquantized LmStates
+// array, returns the offset of the LmState at offset <old_offset> in the
+// quantized array, where each LmState is one int32 smaller.
+static int64 QuantizedStateOffset(const std::vector<int64> &state_offsets,
+                                  int64 old_offset) {
+  std::vector<int64>::const_iterator iter =
+      std::lower_bound(state_offsets.begin(), state_offsets.end(), old_offset);
+  KALDI_ASSERT(iter != state_offsets.end() && *iter == old_offset);
+  return old_offset - (iter - state_offsets.begin());
+}
+
+ConstArpaLm::~ConstArpaLm() {
+  if (memory_assigned_) {
+    delete[] lm_states_;
+    delete[] unigram_states_;
+    delete[] overflow_buffer_;
+  }
+  if (data_ != NULL) {
+    // <lm_states_> points into <data_>; the arrays of pointers are ours.
+    delete[] unigram_states_;
+    delete[] overflow_buffer_;
+    if (data_mapped_) {
+#ifndef _MSC_VER
+      munmap(data_, data_size_);
+#endif
+    } else {
+      delete[] data_;
+    }
+  }
+}
+
 void ConstArpaLm::Write(std::ostream &os, bool binary) const {
   KALDI_ASSERT(initialized_);
   if (!binary) {
     KALDI_ERR << "text-mode writing is not implemented for ConstArpaLm.";
   }
+  if (quantize_bits_ != 0) {
+    KALDI_ERR << "A ConstArpaLm with quantized logprobs can only be written "
+              << "in the mapped format.";
+  }
 
   WriteToken(os, binary, "<ConstArpaLm>");
 
@@ -579,8 +731,17 @@ void ConstArpaLm::Read(std::istream &is, bool binary) {
   int first_char = is.peek();
   if (first_char == 4) {  // Old on-disk format starts with length of int32.
     ReadInternalOldFormat(is, binary);
-  } else {                // New on-disk format starts with token <ConstArpaLm>.
-    ReadInternal(is, binary);
+  } else {                // New on-disk formats start with a token.
+    std::string token;
+    ReadToken(is, binary, &token);
+    if (token == "<ConstArpaLm>") {
+      ReadInternal(is, binary);
+    } else if (token == "<ConstArpaLmMapped>") {
+      ReadInternalMapped(is, binary);
+    } else {
+      KALDI_ERR << "Expected <ConstArpaLm> or <ConstArpaLmMapped>, got "
+                << token;
+    }
   }
 }
 
@@ -590,8 +751,6 @@ void ConstArpaLm::ReadInternal(std::istream &is, bool binary) {
     KALDI_ERR << "text-mode reading is not implemented for ConstArpaLm.";
   }
 
-  ExpectToken(is, binary, "<ConstArpaLm>");
-
   // Misc info.
   ExpectToken(is, binary, "<LmInfo>");
   ReadBasicType(is, binary, &bos_symbol_);
@@ -718,6 +877,303 @@ void ConstArpaLm::ReadInternalOldFormat(std::istream &is, bool binary) {
   initialized_ = true;
 }
 
+void ConstArpaLm::WriteMapped(std::ostream &os, int32 quantize_bits) const {
+  KALDI_ASSERT(initialized_);
+  // The codes of an LmState share one int32, so fewer than 16 bits would not
+  // make the file any smaller.
+  if (quantize_bits != 0 && quantize_bits != 16)
+    KALDI_ERR << "Invalid number of bits for quantization: " << quantize_bits
+              << " (must be 0 or 16)";
+  if (quantize_bits_ != 0 && quantize_bits != quantize_bits_)
+    KALDI_ERR << "Cannot change the quantization of a ConstArpaLm that is "
+              << "already quantized.";
+  // True if we have to quantize the logprobs and change the layout.
+  bool quantize = (quantize_bits != 0 && quantize_bits_ == 0);
+
+  std::vector<int64> state_offsets;
+  std::vector<float> logprob_codebook(logprob_codebook_),
+      backoff_codebook(backoff_codebook_);
+  int64 lm_states_size = lm_states_size_;
+  if (quantize) {
+    // LmStates are stored one after another, so we can find them all by
+    // scanning the array.
+    int64 num_logprobs = 0;
+    for (int64 offset = 0; offset < lm_states_size_; ) {
+      state_offsets.push_back(offset);
+      int32 num_children = StateNumChildren(lm_states_ + offset);
+      num_logprobs += 1 + num_children;
+      offset += num_children_offset_ + 1 + 2 * num_children;
+    }
+    lm_states_size = lm_states_size_ - state_offsets.size();
+    // We compute the codebooks from a subset of the logprobs (including
+    // those of the leaves, which are in the child_info) if there are many.
+    int64 max_samples = 10000000,
+        stride = std::max<int64>(1, num_logprobs / max_samples),
+        logprob_index = 0;
+    std::vector<float> logprob_samples, backoff_samples;
+    for (size_t s = 0; s < state_offsets.size(); s++) {
+      int32 *lm_state = lm_states_ + state_offsets[s];
+      if (logprob_index++ % stride == 0) {
+        logprob_samples.push_back(StateLogprob(lm_state));
+        backoff_samples.push_back(StateBackoffLogprob(lm_state));
+      }
+      int32 num_children = StateNumChildren(lm_state);
+      const int32 *children = StateChildren(lm_state);
+      for (int32 c = 0; c < num_children; c++) {
+        float logprob;
+        int32 *child_lm_state;
+        DecodeChildInfo(children[2 * c + 1], lm_state, &child_lm_state,
+                        &logprob);
+        // We only sample the leaves; the others are LmStates.
+        if (child_lm_state == NULL && logprob_index++ % stride == 0)
+          logprob_samples.push_back(logprob);
+      }
+    }
+    int32 num_codes = 1 << quantize_bits;
+    ComputeCodebook(&logprob_samples, num_codes, false, &logprob_codebook);
+    ComputeCodebook(&backoff_samples, num_codes, true, &backoff_codebook);
+  }
+
+  ConstArpaLmMappedHeader header;
+  header.version = 1;
+  header.bos_symbol = bos_symbol_;
+  header.eos_symbol = eos_symbol_;
+  header.unk_symbol = unk_symbol_;
+  header.ngram_order = ngram_order_;
+  header.num_words = num_words_;
+  header.overflow_buffer_size = overflow_buffer_size_;
+  header.lm_states_size = lm_states_size;
+  header.quantize_bits = quantize_bits;
+  header.unigram_position =
+      RoundUpTo8(kMappedHeaderPosition + sizeof(header));
+  header.overflow_position =
+      RoundUpTo8(header.unigram_position + sizeof(int64) * num_words_);
+  header.lm_states_position = RoundUpTo8(
+      header.overflow_position + sizeof(int64) * overflow_buffer_size_);
+  header.codebook_position = RoundUpTo8(
+      header.lm_states_position + sizeof(int32) * lm_states_size);
+  header.file_size = header.codebook_position + sizeof(float) *
+      (logprob_codebook.size() + backoff_codebook.size());
+
+  // This writes the token and a space; the binary-mode header precedes it.
+  WriteToken(os, true, "<ConstArpaLmMapped>");
+  int64 position = kMappedPrefixSize;
+  WritePadding(os, &position);
+  KALDI_ASSERT(position == kMappedHeaderPosition);
+  os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  position += sizeof(header);
+
+  // Unigram and overflow sections; see Write() for the offsets.
+  for (int32 section = 0; section < 2; section++) {
+    int32 size = (section == 0 ? num_words_ : overflow_buffer_size_);
+    int32 **states = (section == 0 ? unigram_states_ : overflow_buffer_);
+    WritePadding(os, &position);
+    KALDI_ASSERT(position == (section == 0 ? header.unigram_position :
+                              header.overflow_position));
+    std::vector<int64> offsets(size);
+    for (int32 i = 0; i < size; ++i) {
+      if (states[i] == NULL) {
+        offsets[i] = 0;
+      } else {
+        int64 offset = states[i] - lm_states_;
+        offsets[i] = 1 + (quantize ? QuantizedStateOffset(state_offsets,
+                                                          offset) : offset);
+      }
+    }
+    if (size > 0)
+      os.write(reinterpret_cast<const char*>(&(offsets[0])),
+               sizeof(int64) * size);
+    position += sizeof(int64) * size;
+  }
+
+  // LmStates section.
+  WritePadding(os, &position);
+  KALDI_ASSERT(position == header.lm_states_position);
+  if (!quantize) {
+    os.write(reinterpret_cast<const char*>(lm_states_),
+             sizeof(int32) * lm_states_size_);
+  } else {
+    std::vector<int32> buffer;
+    for (size_t s = 0; s < state_offsets.size(); s++) {
+      int32 *lm_state = lm_states_ + state_offsets[s];
+      int32 logprob_code = EncodeValue(logprob_codebook, false,
+                                       StateLogprob(lm_state)),
+          backoff_code = EncodeValue(backoff_codebook, true,
+                                     StateBackoffLogprob(lm_state));
+      buffer.push_back(static_cast<int32>(static_cast<uint32>(logprob_code) |
+                                     (static_cast<uint32>(backoff_code) << 16)));
+      int32 num_children = StateNumChildren(lm_state);
+      buffer.push_back(num_children);
+      const int32 *children = StateChildren(lm_state);
+      for (int32 c = 0; c < num_children; c++) {
+        int32 child_info = children[2 * c + 1];
+        if (child_info % 2 == 0) {
+          // Leaf: we store the code of its logprob.
+          Int32AndFloat logprob_i(child_info);
+          child_info = 2 * EncodeValue(logprob_codebook, false, logprob_i.f);
+        } else if (child_info / 2 > 0) {
+          // Relative address; it gets smaller because each LmState in between
+          // loses one int32.  Overflow entries don't change.
+          int64 child_offset = state_offsets[s] + child_info / 2;
+          int64 new_offset = QuantizedStateOffset(state_offsets, child_offset)
+              - (state_offsets[s] - s);
+          child_info = 2 * new_offset + 1;
+        }
+        buffer.push_back(children[2 * c]);
+        buffer.push_back(child_info);
+      }
+      if (buffer.size() >= (1 << 20) || s + 1 == state_offsets.size()) {
+        os.write(reinterpret_cast<const char*>(&(buffer[0])),
+                 sizeof(int32) * buffer.size());
+        buffer.clear();
+      }
+    }
+  }
+  position += sizeof(int32) * lm_states_size;
+
+  // Codebooks section.
+  WritePadding(os, &position);
+  KALDI_ASSERT(position == header.codebook_position);
+  if (!logprob_codebook.empty()) {
+    os.write(reinterpret_cast<const char*>(&(logprob_codebook[0])),
+             sizeof(float) * logprob_codebook.size());
+    os.write(reinterpret_cast<const char*>(&(backoff_codebook[0])),
+             sizeof(float) * backoff_codebook.size());
+  }
+  if (!os.good())
+    KALDI_ERR << "ConstArpaLm writing failed.";
+}
+
+void ConstArpaLm::ReadInternalMapped(std::istream &is, bool binary) {
+  KALDI_ASSERT(!initialized_);
+  if (!binary) {
+    KALDI_ERR << "text-mode reading is not implemented for ConstArpaLm.";
+  }
+  // We have read the token and the space after it; we read the rest of the
+  // file into memory laid out as it is on disk, so the arrays are aligned.
+  char prefix[kMappedHeaderPosition];
+  ConstArpaLmMappedHeader header;
+  is.read(prefix + kMappedPrefixSize,
+          kMappedHeaderPosition - kMappedPrefixSize);
+  is.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!is.good() || header.version != 1 ||
+      header.file_size < kMappedHeaderPosition +
+      static_cast<int64>(sizeof(header))) {
+    KALDI_ERR << "ConstArpaLm header reading failed.";
+  }
+  memcpy(prefix, kMappedPrefix, kMappedPrefixSize);
+  data_ = new char[header.file_size];
+  data_size_ = header.file_size;
+  data_mapped_ = false;
+  memcpy(data_, prefix, kMappedHeaderPosition);
+  memcpy(data_ + kMappedHeaderPosition, &header, sizeof(header));
+  int64 position = kMappedHeaderPosition + sizeof(header);
+  is.read(data_ + position, header.file_size - position);
+  if (!is.good()) {
+    KALDI_ERR << "ConstArpaLm reading failed.";
+  }
+  InitFromMappedData();
+}
+
+void ConstArpaLm::Map(const std::string &filename) {
+  KALDI_ASSERT(!initialized_);
+#ifdef _MSC_VER
+  KALDI_ERR << "Memory-mapping ConstArpaLm is not supported on Windows.";
+#else
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    KALDI_ERR << "Failed to open " << filename << ": " << strerror(errno);
+  }
+  struct stat stat_buf;
+  if (fstat(fd, &stat_buf) != 0) {
+    close(fd);
+    KALDI_ERR << "Failed to stat " << filename << ": " << strerror(errno);
+  }
+  void *addr = mmap(NULL, stat_buf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    KALDI_ERR << "Failed to mmap " << filename << ": " << strerror(errno);
+  }
+  data_ = static_cast<char*>(addr);
+  data_size_ = stat_buf.st_size;
+  data_mapped_ = true;
+  if (data_size_ < kMappedHeaderPosition + sizeof(ConstArpaLmMappedHeader) ||
+      memcmp(data_, kMappedPrefix, kMappedPrefixSize) != 0) {
+    KALDI_ERR << "File " << filename << " is not a ConstArpaLm in the mapped "
+              << "format.";
+  }
+  InitFromMappedData();
+  KALDI_LOG << "Memory-mapped ConstArpaLm from " << filename;
+#endif
+}
+
+bool ConstArpaLm::IsMappedFile(const std::string &filename) {
+  if (ClassifyRxfilename(filename) != kFileInput)
+    return false;
+  std::ifstream is(filename.c_str(), std::ios::in | std::ios::binary);
+  char prefix[kMappedPrefixSize];
+  is.read(prefix, kMappedPrefixSize);
+  return is.good() && memcmp(prefix, kMappedPrefix, kMappedPrefixSize) == 0;
+}
+
+void ConstArpaLm::InitFromMappedData() {
+  ConstArpaLmMappedHeader header;
+  memcpy(&header, data_ + kMappedHeaderPosition, sizeof(header));
+  if (header.version != 1 ||
+      (header.quantize_bits != 0 && header.quantize_bits != 16) ||
+      header.file_size != static_cast<int64>(data_size_) ||
+      header.unigram_position % 8 != 0 || header.overflow_position % 8 != 0 ||
+      header.lm_states_position % 8 != 0 ||
+      header.codebook_position % 8 != 0 ||
+      header.codebook_position + sizeof(float) * 2 *
+      (header.quantize_bits == 0 ? 0 : 1 << header.quantize_bits) !=
+      header.file_size) {
+    KALDI_ERR << "ConstArpaLm in the mapped format is corrupted or truncated.";
+  }
+  bos_symbol_ = header.bos_symbol;
+  eos_symbol_ = header.eos_symbol;
+  unk_symbol_ = header.unk_symbol;
+  ngram_order_ = header.ngram_order;
+  num_words_ = header.num_words;
+  overflow_buffer_size_ = header.overflow_buffer_size;
+  lm_states_size_ = header.lm_states_size;
+  quantize_bits_ = header.quantize_bits;
+  num_children_offset_ = (quantize_bits_ == 0 ? 2 : 1);
+  lm_states_ = reinterpret_cast<int32*>(data_ + header.lm_states_position);
+
+  const int64 *unigram_offsets = reinterpret_cast<const int64*>(
+      data_ + header.unigram_position);
+  unigram_states_ = new int32*[num_words_];
+  for (int32 i = 0; i < num_words_; ++i) {
+    unigram_states_[i] = (unigram_offsets[i] == 0) ? NULL
+        : lm_states_ + unigram_offsets[i] - 1;
+  }
+  const int64 *overflow_offsets = reinterpret_cast<const int64*>(
+      data_ + header.overflow_position);
+  overflow_buffer_ = new int32*[overflow_buffer_size_];
+  for (int32 i = 0; i < overflow_buffer_size_; ++i) {
+    overflow_buffer_[i] = (overflow_offsets[i] == 0) ? NULL
+        : lm_states_ + overflow_offsets[i] - 1;
+  }
+  if (quantize_bits_ != 0) {
+    int32 num_codes = 1 << quantize_bits_;
+    const float *codebooks = reinterpret_cast<const float*>(
+        data_ + header.codebook_position);
+    logprob_codebook_.assign(codebooks, codebooks + num_codes);
+    backoff_codebook_.assign(codebooks + num_codes,
+                             codebooks + 2 * num_codes);
+  }
+
+  KALDI_ASSERT(ngram_order_ > 0);
+  KALDI_ASSERT(bos_symbol_ < num_words_ && bos_symbol_ > 0);
+  KALDI_ASSERT(eos_symbol_ < num_words_ && eos_symbol_ > 0);
+  KALDI_ASSERT(unk_symbol_ < num_words_ &&
+               (unk_symbol_ > 0 || unk_symbol_ == -1));
+  lm_states_end_ = lm_states_ + lm_states_size_ - 1;
+  memory_assigned_ = false;
+  initialized_ = true;
+}
+
 bool ConstArpaLm::HistoryStateExists(const std::vector<int32>& hist) const {
   // We do not create LmState for empty word sequence, but technically it is the
   // history state of all unigrams.
@@ -734,9 +1190,8 @@ bool ConstArpaLm::HistoryStateExists(const std::vector<int32>& hist) const {
     // Note that we always create LmState for unigrams, so even if <lm_state> is
     // not NULL, we still have to check if it has child.
     KALDI_ASSERT(lm_state >= lm_states_);
-    KALDI_ASSERT(lm_state + 2 <= lm_states_end_);
-    // <lm_state + 2> points to <num_children>.
-    if (*(lm_state + 2) > 0) {
+    KALDI_ASSERT(lm_state + num_children_offset_ <= lm_states_end_);
+    if (StateNumChildren(lm_state) > 0) {
       return true;
     } else {
       return false;
@@ -793,8 +1248,7 @@ float ConstArpaLm::GetNgramLogprobRecurse(
       // defined.
       return std::numeric_limits<float>::min();
     } else {
-      Int32AndFloat logprob_i(*unigram_states_[word]);
-      return logprob_i.f;
+      return StateLogprob(unigram_states_[word]);
     }
   }
 
@@ -809,8 +1263,7 @@ float ConstArpaLm::GetNgramLogprobRecurse(
       DecodeChildInfo(child_info, state, &child_lm_state, &logprob);
       return logprob;
     } else {
-      Int32AndFloat backoff_logprob_i(*(state + 1));
-      backoff_logprob = backoff_logprob_i.f;
+      backoff_logprob = StateBackoffLogprob(state);
     }
   }
   std::vector<int32> new_hist(hist);
@@ -854,20 +1307,23 @@ bool ConstArpaLm::GetChildInfo(const int32 word,
   KALDI_ASSERT(parent >= lm_states_);
   KALDI_ASSERT(child_info != NULL);
 
-  KALDI_ASSERT(parent + 2 <= lm_states_end_);
-  int32 num_children = *(parent + 2);
-  KALDI_ASSERT(parent + 2 + 2 * num_children <= lm_states_end_);
+  KALDI_ASSERT(parent + num_children_offset_ <= lm_states_end_);
+  int32 num_children = StateNumChildren(parent);
+  KALDI_ASSERT(parent + num_children_offset_ + 2 * num_children <=
+               lm_states_end_);
 
   if (num_children == 0) return false;
 
-  // A binary search into the children memory block.
+  // A binary search into the children memory block.  <children> is indexed
+  // from one here.
+  const int32 *children = StateChildren(parent) - 2;
   int32 start_index = 1;
   int32 end_index = num_children;
   while (start_index <= end_index) {
     int32 mid_index = round((start_index + end_index) / 2);
-    int32 mid_word = *(parent + 1 + 2 * mid_index);
+    int32 mid_word = children[2 * mid_index];
     if (mid_word == word) {
-      *child_info = *(parent + 2 + 2 * mid_index);
+      *child_info = children[2 * mid_index + 1];
       return true;
     } else if (mid_word < word) {
       start_index = mid_index + 1;
@@ -889,20 +1345,21 @@ void ConstArpaLm::DecodeChildInfo(const int32 child_info,
   if (child_info % 2 == 0) {
     // Child is a leaf, only returns the log probability.
     *child_lm_state = NULL;
-    Int32AndFloat logprob_i(child_info);
-    *logprob = logprob_i.f;
+    if (quantize_bits_ == 0) {
+      Int32AndFloat logprob_i(child_info);
+      *logprob = logprob_i.f;
+    } else {
+      *logprob = logprob_codebook_[child_info >> 1];
+    }
   } else {
     int32 child_offset = child_info / 2;
     if (child_offset > 0) {
       *child_lm_state = parent + child_offset;
-      Int32AndFloat logprob_i(**child_lm_state);
-      *logprob = logprob_i.f;
     } else {
       KALDI_ASSERT(-child_offset < overflow_buffer_size_);
       *child_lm_state = overflow_buffer_[-child_offset];
-      Int32AndFloat logprob_i(**child_lm_state);
-      *logprob = logprob_i.f;
     }
+    *logprob = StateLogprob(*child_lm_state);
     KALDI_ASSERT(*child_lm_state >= lm_states_);
     KALDI_ASSERT(*child_lm_state <= lm_states_end_);
   }
@@ -914,24 +1371,24 @@ void ConstArpaLm::WriteArpaRecurse(int32* lm_state,
   if (lm_state == NULL) return;
 
   KALDI_ASSERT(lm_state >= lm_states_);
-  KALDI_ASSERT(lm_state + 2 <= lm_states_end_);
+  KALDI_ASSERT(lm_state + num_children_offset_ <= lm_states_end_);
 
   // Inserts the current LmState to <output>.
   ArpaLine arpa_line;
   arpa_line.words = seq;
-  Int32AndFloat logprob_i(*lm_state);
-  arpa_line.logprob = logprob_i.f;
-  Int32AndFloat backoff_logprob_i(*(lm_state + 1));
-  arpa_line.backoff_logprob = backoff_logprob_i.f;
+  arpa_line.logprob = StateLogprob(lm_state);
+  arpa_line.backoff_logprob = StateBackoffLogprob(lm_state);
   output->push_back(arpa_line);
 
   // Scans for possible children, and recursively adds child to <output>.
-  int32 num_children = *(lm_state + 2);
-  KALDI_ASSERT(lm_state + 2 + 2 * num_children <= lm_states_end_);
+  int32 num_children = StateNumChildren(lm_state);
+  KALDI_ASSERT(lm_state + num_children_offset_ + 2 * num_children <=
+               lm_states_end_);
+  const int32 *children = StateChildren(lm_state);
   for (int32 i = 0; i < num_children; ++i) {
     std::vector<int32> new_seq(seq);
-    new_seq.push_back(*(lm_state + 3 + 2 * i));
-    int32 child_info = *(lm_state + 4 + 2 * i);
+    new_seq.push_back(children[2 * i]);
+    int32 child_info = children[2 * i + 1];
     float logprob;
     int32* child_lm_state = NULL;
     DecodeChildInfo(child_info, lm_state, &child_lm_state, &logprob);
@@ -1011,62 +1468,161 @@ void ConstArpaLm::WriteArpa(std::ostream &os) const {
 }
 
 ConstArpaLmDeterministicFst::ConstArpaLmDeterministicFst(
-    const ConstArpaLm& lm) : lm_(lm) {
-  // Creates a history state for <s>.
-  std::vector<Label> bos_state(1, lm_.BosSymbol());
-  state_to_wseq_.push_back(bos_state);
-  wseq_to_state_[bos_state] = 0;
-  start_state_ = 0;
+    const ConstArpaLm& lm, int32 cache_size) :
+    lm_(lm), max_history_length_(lm.NgramOrder() - 1) {
+  int32 num_sets = 1;
+  while (2 * num_sets < cache_size)
+    num_sets *= 2;
+  CacheEntry unused_entry = { -1, 0, -1, 0.0 };
+  cache_.resize(2 * num_sets, unused_entry);
+  cache_lru_.resize(num_sets, 0);
+  cache_mask_ = num_sets - 1;
+  new_chain_.resize(max_history_length_ + 1);
+
+  // Creates a history state for <s>, which GetNgramLogprob() would map to
+  // <unk> if it's not in the language model.
+  int32 bos = lm_.BosSymbol(), chain_length = 0;
+  if (lm_.unk_symbol_ != -1 && lm_.unigram_states_[bos] == NULL)
+    bos = lm_.unk_symbol_;
+  if (max_history_length_ > 0 && lm_.unigram_states_[bos] != NULL) {
+    new_chain_[0] = lm_.unigram_states_[bos];
+    chain_length = 1;
+  }
+  start_state_ = FindOrAddState(&(new_chain_[0]), chain_length);
+}
+
+float ConstArpaLmDeterministicFst::GetLogprob(int32* const* chain,
+                                              int32 chain_length,
+                                              int32 word) const {
+  float logprob;
+  int32 i = 0;
+  for (; i < chain_length; i++) {
+    int32 child_info;
+    if (chain[i] != NULL && lm_.GetChildInfo(word, chain[i], &child_info)) {
+      int32 *child_lm_state;
+      lm_.DecodeChildInfo(child_info, chain[i], &child_lm_state, &logprob);
+      break;
+    }
+  }
+  if (i == chain_length) {
+    // Unigram case; this matches ConstArpaLm::GetNgramLogprobRecurse(), also
+    // for words that are not in the language model.
+    if (word >= lm_.num_words_ || lm_.unigram_states_[word] == NULL)
+      logprob = std::numeric_limits<float>::min();
+    else
+      logprob = lm_.StateLogprob(lm_.unigram_states_[word]);
+  }
+  // Adds the backoff logprobs of the longer histories, in the same order as
+  // GetNgramLogprobRecurse() so that the result is identical.
+  for (i--; i >= 0; i--)
+    if (chain[i] != NULL)
+      logprob = lm_.StateBackoffLogprob(chain[i]) + logprob;
+  return logprob;
 }
 
 fst::StdArc::Weight ConstArpaLmDeterministicFst::Final(StateId s) {
   // At this point, we should have created the state.
-  KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
-  const std::vector<Label>& wseq = state_to_wseq_[s];
-  float logprob = lm_.GetNgramLogprob(lm_.EosSymbol(), wseq);
+  KALDI_ASSERT(static_cast<size_t>(s) < state_chain_lengths_.size());
+  int32 eos = lm_.EosSymbol();
+  if (lm_.unk_symbol_ != -1 && lm_.unigram_states_[eos] == NULL)
+    eos = lm_.unk_symbol_;
+  float logprob = GetLogprob(StateChain(s), state_chain_lengths_[s], eos);
   return Weight(-logprob);
 }
 
-bool ConstArpaLmDeterministicFst::GetArc(StateId s,
-                                         Label ilabel, fst::StdArc *oarc) {
-  // At this point, we should have created the state.
-  KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
-  std::vector<Label> wseq = state_to_wseq_[s];
-
-  float logprob = lm_.GetNgramLogprob(ilabel, wseq);
-  if (logprob == std::numeric_limits<float>::min()) {
+bool ConstArpaLmDeterministicFst::ComputeArc(StateId s, Label ilabel,
+                                             float *logprob,
+                                             StateId *next_state) {
+  int32* const* chain = StateChain(s);
+  int32 chain_length = state_chain_lengths_[s];
+  KALDI_ASSERT(ilabel >= 0);
+  bool in_lm = (ilabel < lm_.num_words_ &&
+                lm_.unigram_states_[ilabel] != NULL);
+
+  // Maps possible out-of-vocabulary words to <unk>, as GetNgramLogprob() does.
+  int32 mapped_word = (in_lm || lm_.unk_symbol_ == -1 ? ilabel :
+                       lm_.unk_symbol_);
+  *logprob = GetLogprob(chain, chain_length, mapped_word);
+  if (*logprob == std::numeric_limits<float>::min())
     return false;
-  }
 
-  // Locates the next state in ConstArpaLm. Note that OOV and backoff have been
-  // taken care of in ConstArpaLm.
-  wseq.push_back(ilabel);
-  while (wseq.size() >= lm_.NgramOrder()) {
-    // History state has at most lm_.NgramOrder() -1 words in the state.
-    wseq.erase(wseq.begin(), wseq.begin() + 1);
-  }
-  while (!lm_.HistoryStateExists(wseq)) {
-    KALDI_ASSERT(wseq.size() > 0);
-    wseq.erase(wseq.begin(), wseq.begin() + 1);
+  // The next state is the longest history (of at most max_history_length_
+  // words) made of a suffix of the current one followed by <ilabel>, that has
+  // children.  Its backoff chain consists of the children for <ilabel> of the
+  // LmStates in our backoff chain, followed by the unigram state of <ilabel>.
+  // Histories with out-of-vocabulary words don't have LmStates, so those
+  // give the empty history.
+  int32 new_chain_length = 0;
+  if (in_lm && max_history_length_ > 0) {
+    int32 begin = std::max(0, chain_length + 1 - max_history_length_);
+    for (int32 i = begin; i < chain_length; i++) {
+      int32 *child_lm_state = NULL, child_info;
+      if (chain[i] != NULL && lm_.GetChildInfo(ilabel, chain[i], &child_info)) {
+        float child_logprob;
+        lm_.DecodeChildInfo(child_info, chain[i], &child_lm_state,
+                            &child_logprob);
+      }
+      if (new_chain_length == 0 && (child_lm_state == NULL ||
+                                    lm_.StateNumChildren(child_lm_state) == 0))
+        continue;  // This history has no children, so it's not a state.
+      new_chain_[new_chain_length++] = child_lm_state;
+    }
+    int32 *unigram_state = lm_.unigram_states_[ilabel];
+    if (new_chain_length > 0 || lm_.StateNumChildren(unigram_state) > 0)
+      new_chain_[new_chain_length++] = unigram_state;
   }
+  *next_state = FindOrAddState(&(new_chain_[0]), new_chain_length);
+  return true;
+}
 
-  std::pair<const std::vector<Label>, StateId> wseq_state_pair(
-      wseq, static_cast<Label>(state_to_wseq_.size()));
-
-  // Attemps to insert the current <wseq_state_pair>. If the pair already exists
-  // then it returns false.
-  typedef MapType::iterator IterType;
-  std::pair<IterType, bool> result = wseq_to_state_.insert(wseq_state_pair);
+ConstArpaLmDeterministicFst::StateId
+ConstArpaLmDeterministicFst::FindOrAddState(int32* const* chain,
+                                            int32 chain_length) {
+  const int32 *lm_state = (chain_length == 0 ? NULL : chain[0]);
+  std::pair<unordered_map<const int32*, StateId>::iterator, bool> result =
+      lm_state_to_state_.insert(std::make_pair(
+          lm_state, static_cast<StateId>(state_chain_lengths_.size())));
+  if (result.second) {
+    // It's a new state.
+    state_chains_.insert(state_chains_.end(), chain, chain + chain_length);
+    state_chains_.resize(state_chain_lengths_.size() * max_history_length_ +
+                         max_history_length_, NULL);
+    state_chain_lengths_.push_back(chain_length);
+  }
+  return result.first->second;
+}
 
-  // If the pair was just inserted, then also add it to <state_to_wseq_>.
-  if (result.second == true)
-    state_to_wseq_.push_back(wseq);
+bool ConstArpaLmDeterministicFst::GetArc(StateId s,
+                                         Label ilabel, fst::StdArc *oarc) {
+  // At this point, we should have created the state.
+  KALDI_ASSERT(static_cast<size_t>(s) < state_chain_lengths_.size());
+
+  int32 set = static_cast<int32>((static_cast<uint64>(s) * 1000003 +
+                                  static_cast<uint64>(ilabel)) & cache_mask_);
+  CacheEntry *entries = &(cache_[2 * set]);
+  int32 way;
+  if (entries[0].state == s && entries[0].word == ilabel) {
+    way = 0;
+  } else if (entries[1].state == s && entries[1].word == ilabel) {
+    way = 1;
+  } else {
+    way = cache_lru_[set];
+    CacheEntry &entry = entries[way];
+    entry.state = s;
+    entry.word = ilabel;
+    if (!ComputeArc(s, ilabel, &entry.logprob, &entry.next_state))
+      entry.next_state = -1;
+  }
+  cache_lru_[set] = 1 - way;
+  const CacheEntry &entry = entries[way];
+  if (entry.next_state == -1)
+    return false;
 
   // Creates the arc.
   oarc->ilabel = ilabel;
   oarc->olabel = ilabel;
-  oarc->nextstate = result.first->second;
-  oarc->weight = Weight(-logprob);
+  oarc->nextstate = entry.next_state;
+  oarc->weight = Weight(-entry.logprob);
 
   return true;
 }
@@ -1082,4 +1638,24 @@ bool BuildConstArpaLm(const ArpaParseOptions& options,
   return true;
 }
 
+bool BuildConstArpaLmMapped(const ArpaParseOptions& options,
+                            const std::string& arpa_rxfilename,
+                            const std::string& const_arpa_wxfilename,
+                            int32 quantize_bits) {
+  ConstArpaLmBuilder lm_builder(options);
+  KALDI_LOG << "Reading " << arpa_rxfilename;
+  Input ki(arpa_rxfilename);
+  lm_builder.Read(ki.Stream());
+  Output ko(const_arpa_wxfilename, true);
+  lm_builder.WriteMapped(ko.Stream(), quantize_bits);
+  return ko.Close();
+}
+
+void ReadConstArpaLm(const std::string& rxfilename, ConstArpaLm *lm) {
+  if (ConstArpaLm::IsMappedFile(rxfilename))
+    lm->Map(rxfilename);
+  else
+    ReadKaldiObject(rxfilename, lm);
+}
+
 }  // namespace kaldi
@@ -194,6 +194,25 @@ namespace kaldi {
        of LmState whose address differs too much from the parent address. See
        above how we handle the leaf case.
     5. With the information in step 4, create the class ConstArpaLm.
+
+    There is also a "mapped" on-disk format (see ConstArpaLm::WriteMapped()),
+    for very large language models.  In it, <unigram_states_> and
+    <overflow_buffer_> are stored as offsets into <lm_states_>, and all the
+    arrays start at 8-byte aligned positions in the file. Then ConstArpaLm::Map()
+    can mmap() the file read-only. This means the model is loaded on demand and
+    its memory is shared by all processes using it. Only the small arrays of
+    pointers have to be set up when it is loaded.  Optionally, the logprobs
+    and backoff logprobs can be quantized to 16 bits. In that case an
+    LmState is
+      struct LmState {
+        int32 codes;
+        int32 num_children;
+        std::pair<int32, int32> [] children;
+      }
+    The low 16 bits of <codes> index a codebook of logprobs and the high 16
+    bits index a codebook of backoff logprobs, so each LmState is one int32
+    smaller.  For a leaf, child_info is twice the code of its logprob (it
+    still takes an int32, like the child_info of the other children).
 */
 
 // Forward declaration of Auxiliary struct ArpaLine.
@@ -219,6 +238,11 @@ class ConstArpaLm {
     overflow_buffer_ = NULL;
     memory_assigned_ = false;
     initialized_ = false;
+    quantize_bits_ = 0;
+    num_children_offset_ = 2;
+    data_ = NULL;
+    data_size_ = 0;
+    data_mapped_ = false;
   }
 
   // Special constructor, will be used when you initialize ConstArpaLm from
@@ -244,23 +268,39 @@ class ConstArpaLm {
     lm_states_end_ = lm_states_ + lm_states_size_ - 1;
     memory_assigned_ = false;
     initialized_ = true;
+    quantize_bits_ = 0;
+    num_children_offset_ = 2;
+    data_ = NULL;
+    data_size_ = 0;
+    data_mapped_ = false;
   }
 
-  ~ConstArpaLm() {
-    if (memory_assigned_) {
-      delete[] lm_states_;
-      delete[] unigram_states_;
-      delete[] overflow_buffer_;
-    }
-  }
+  ~ConstArpaLm();
 
-  // Reads the ConstArpaLm format language model. It calls ReadInternal() or
-  // ReadInternalOldFormat() to do the actual reading.
+  // Reads the ConstArpaLm format language model. It calls ReadInternal(),
+  // ReadInternalOldFormat() or ReadInternalMapped() to do the actual reading.
   void Read(std::istream &is, bool binary);
 
-  // Writes the language model in ConstArpaLm format.
+  // Writes the language model in ConstArpaLm format.  Not supported if the
+  // logprobs are quantized.
   void Write(std::ostream &os, bool binary) const;
 
+  // Writes the language model in the mapped format (see the comment at the
+  // top of this file), which Map() can memory-map; Read() can read it too.
+  // If <quantize_bits> is 16, the logprobs and backoff logprobs are
+  // quantized to 16 bits (which changes the layout of LmStates);
+  // if it is 0 they are stored unchanged.  The stream should be the stream
+  // of an Output object opened in binary mode, because the alignment of the
+  // arrays assumes that the file starts with the binary-mode header.
+  void WriteMapped(std::ostream &os, int32 quantize_bits) const;
+
+  // Memory-maps a language model written by WriteMapped() from the file
+  // <filename>, which must be a regular file. Crashes on error.
+  void Map(const std::string &filename);
+
+  // Returns true if <filename> is a regular file in the mapped format.
+  static bool IsMappedFile(const std::string &filename);
+
   // Creates Arpa format language model from ConstArpaLm format, and writes it
   // to output stream. This will be useful in testing.
   void WriteArpa(std::ostream &os) const;
@@ -277,11 +317,48 @@ class ConstArpaLm {
   int32 EosSymbol() const { return eos_symbol_; }
   int32 UnkSymbol() const { return unk_symbol_; }
   int32 NgramOrder() const { return ngram_order_; }
+  // 0 if the logprobs are not quantized, else 16.
+  int32 QuantizeBits() const { return quantize_bits_; }
 
  private:
-  // Function that loads data from stream to the class.
+  // ConstArpaLmDeterministicFst looks up n-grams in <lm_states_> directly.
+  friend class ConstArpaLmDeterministicFst;
+
+  // Function that loads data from stream to the class, after the token
+  // <ConstArpaLm>.
   void ReadInternal(std::istream &is, bool binary);
 
+  // Reads the mapped format from a stream (into memory that we allocate),
+  // after the token <ConstArpaLmMapped>.
+  void ReadInternalMapped(std::istream &is, bool binary);
+
+  // Sets up the class from <data_>, which holds a file in the mapped format.
+  void InitFromMappedData();
+
+  // Functions to access the fields of an LmState, which depend on whether the
+  // logprobs are quantized.
+  inline float StateLogprob(const int32 *lm_state) const {
+    if (quantize_bits_ == 0) {
+      Int32AndFloat logprob_i(*lm_state);
+      return logprob_i.f;
+    }
+    return logprob_codebook_[*lm_state & 0xFFFF];
+  }
+  inline float StateBackoffLogprob(const int32 *lm_state) const {
+    if (quantize_bits_ == 0) {
+      Int32AndFloat backoff_logprob_i(*(lm_state + 1));
+      return backoff_logprob_i.f;
+    }
+    return backoff_codebook_[(*lm_state >> 16) & 0xFFFF];
+  }
+  inline int32 StateNumChildren(const int32 *lm_state) const {
+    return *(lm_state + num_children_offset_);
+  }
+  // Returns a pointer to the first (child_word, child_info) pair.
+  inline int32 *StateChildren(int32 *lm_state) const {
+    return lm_state + num_children_offset_ + 1;
+  }
+
   // Function that loads data from stream to the class. This is a deprecated one
   // that handles the old on-disk format. We keep this for back-compatibility
   // purpose. We have modified the Write() function so for all the new on-disk
@@ -367,6 +444,25 @@ class ConstArpaLm {
   // relative address has more than 30-bits.
   int32** overflow_buffer_;
 
+  // 0 or 16; see QuantizeBits().
+  int32 quantize_bits_;
+
+  // Position of <num_children> in an LmState: 2 normally, or 1 if the logprobs
+  // are quantized.
+  int32 num_children_offset_;
+
+  // The codebooks that the quantized logprobs and backoff logprobs index.
+  // Empty if quantize_bits_ == 0.
+  std::vector<float> logprob_codebook_;
+  std::vector<float> backoff_codebook_;
+
+  // If we read or mapped the mapped format, this is the contents of the file,
+  // including its binary-mode header; <lm_states_> points into it.  It is
+  // either memory-mapped (if data_mapped_) or allocated with new[].
+  char *data_;
+  size_t data_size_;
+  bool data_mapped_;
+
   // Memory chunk that contains the actual LmStates. One LmState has the
   // following structure:
   //
@@ -387,6 +483,15 @@ class ConstArpaLm {
 /**
  This class wraps a ConstArpaLm format language model with the interface defined
  in DeterministicOnDemandFst.
+
+ A state is a history of the language model, identified by its LmState in
+ the ConstArpaLm (or the empty history).  For each state we store the
+ LmStates of the history and of its suffixes (its "backoff chain"), so that
+ GetArc() can compute the n-gram logprob and find the next state by looking
+ up the word among the children of each of them, without any word sequences
+ being created or hashed.  GetArc() results are also cached in a fixed-size,
+ two-way set-associative cache with least-recently-used replacement, since
+ composition asks for the same arcs repeatedly.
  */
 class ConstArpaLmDeterministicFst
   : public fst::DeterministicOnDemandFst<fst::StdArc> {
@@ -395,7 +500,10 @@ class ConstArpaLmDeterministicFst
   typedef fst::StdArc::StateId StateId;
   typedef fst::StdArc::Label Label;
 
-  explicit ConstArpaLmDeterministicFst(const ConstArpaLm& lm);
+  // <cache_size> is the number of (state, word) pairs the arc cache can hold;
+  // it's rounded up to a power of two.
+  explicit ConstArpaLmDeterministicFst(const ConstArpaLm& lm,
+                                       int32 cache_size = 16384);
 
   // We cannot use "const" because the pure virtual function in the interface is
   // not const.
@@ -408,12 +516,54 @@ class ConstArpaLmDeterministicFst
   virtual bool GetArc(StateId s, Label ilabel, fst::StdArc* oarc);
 
  private:
-  typedef unordered_map<std::vector<Label>,
-                        StateId, VectorHasher<Label> > MapType;
-  StateId start_state_;
-  MapType wseq_to_state_;
-  std::vector<std::vector<Label> > state_to_wseq_;
+  struct CacheEntry {
+    StateId state;  // -1 if the entry is unused.
+    Label word;
+    StateId next_state;  // -1 if there is no arc.
+    float logprob;
+  };
+
+  // Returns the backoff chain of state <s>, of length
+  // state_chain_lengths_[s].
+  int32* const* StateChain(StateId s) const {
+    return state_chains_.data() + static_cast<size_t>(s) * max_history_length_;
+  }
+
+  // Returns the logprob of <word> (which must have been mapped to <unk> if
+  // necessary) after the history with backoff chain <chain>, in the same way
+  // as ConstArpaLm::GetNgramLogprob().
+  float GetLogprob(int32* const* chain, int32 chain_length, int32 word) const;
+
+  // Does the work of GetArc(), without the cache.  Returns false if there is
+  // no arc.
+  bool ComputeArc(StateId s, Label ilabel, float *logprob,
+                  StateId *next_state);
+
+  // Returns the state with backoff chain <chain>, creating it if necessary.
+  StateId FindOrAddState(int32* const* chain, int32 chain_length);
+
   const ConstArpaLm& lm_;
+  // lm_.NgramOrder() - 1: the maximum number of words in a history.
+  int32 max_history_length_;
+  StateId start_state_;
+
+  // Maps the LmState of each history (NULL for the empty history) to its
+  // state.
+  unordered_map<const int32*, StateId> lm_state_to_state_;
+  // The backoff chain of state s: the LmStates of its history and its
+  // suffixes, longest first, at positions s * max_history_length_ and
+  // onwards.  Entries can be NULL if a suffix has no LmState.
+  std::vector<int32*> state_chains_;
+  std::vector<int32> state_chain_lengths_;
+
+  // The arc cache: entries 2 * i and 2 * i + 1 form set i, and
+  // cache_lru_[i] is the one to be replaced next.
+  std::vector<CacheEntry> cache_;
+  std::vector<char> cache_lru_;
+  int32 cache_mask_;  // number of sets minus one.
+
+  // Temporary storage for the backoff chain of a new state.
+  std::vector<int32*> new_chain_;
 };
 
 // Reads in an Arpa format language model and converts it into ConstArpaLm
@@ -423,6 +573,19 @@ bool BuildConstArpaLm(const ArpaParseOptions& options,
                       const std::string& arpa_rxfilename,
                       const std::string& const_arpa_wxfilename);
 
+// As above, but writes the ConstArpaLm in the mapped format (see
+// ConstArpaLm::WriteMapped()), with the logprobs quantized to <quantize_bits>
+// bits if it is nonzero.
+bool BuildConstArpaLmMapped(const ArpaParseOptions& options,
+                            const std::string& arpa_rxfilename,
+                            const std::string& const_arpa_wxfilename,
+                            int32 quantize_bits);
+
+// Reads a ConstArpaLm from <rxfilename>. If it is a regular file in the
+// mapped format, it is memory-mapped (see ConstArpaLm::Map()), otherwise it is
+// read with ReadKaldiObject().  Programs that read ConstArpaLms should use this.
+void ReadConstArpaLm(const std::string& rxfilename, ConstArpaLm *lm);
+
 }  // namespace kaldi
 
 #endif  // KALDI_LM_CONST_ARPA_LM_H_
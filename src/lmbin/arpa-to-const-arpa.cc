@@ -20,6 +20,7 @@
 #include <string>
 
 #include "lm/const-arpa-lm.h"
+#include "lm/const-arpa-lm-external.h"
 #include "util/parse-options.h"
 
 int main(int argc, char *argv[]) {
@@ -38,9 +39,23 @@ int main(int argc, char *argv[]) {
         "format language model to integers using utils/map_arpa_m.pl, and\n"
         "then use this program to build a ConstArpaLm format language model.\n"
         "\n"
+        "With --mapped-format=true, the output is written in a format that\n"
+        "the programs that read it can memory-map instead of reading it (so\n"
+        "that it loads instantly, and processes on the same machine share the\n"
+        "memory); with --quantize-bits=16 the log-probabilities are also\n"
+        "quantized, which makes the model smaller.  With\n"
+        "--input-const-arpa=true, the input is a ConstArpaLm format language\n"
+        "model instead, which is converted to the mapped format.\n"
+        "\n"
+        "With --external-sort=true, the n-grams are sorted on disk instead of\n"
+        "in memory (see --max-memory-mb and --temp-dir), for language models\n"
+        "that are too large to build in memory; the output is the same.\n"
+        "\n"
         "Usage: arpa-to-const-arpa [opts] <input-arpa> <const-arpa>\n"
         " e.g.: arpa-to-const-arpa --bos-symbol=1 --eos-symbol=2 \\\n"
-        "                          arpa.txt const_arpa";
+        "                          arpa.txt const_arpa\n"
+        "       arpa-to-const-arpa --input-const-arpa --mapped-format \\\n"
+        "                          --quantize-bits=16 const_arpa const_arpa.mapped";
 
     kaldi::ParseOptions po(usage);
 
@@ -60,6 +75,25 @@ int main(int argc, char *argv[]) {
                 "Integer corresponds to </s>. You must set this to your actual "
                 "EOS integer.");
 
+    bool mapped_format = false, input_const_arpa = false;
+    int32 quantize_bits = 0;
+    po.Register("mapped-format", &mapped_format, "If true, write the "
+                "language model in a format that can be memory-mapped.");
+    po.Register("quantize-bits", &quantize_bits, "If 16, quantize the "
+                "log-probabilities to 16 bits (requires "
+                "--mapped-format=true).");
+    po.Register("input-const-arpa", &input_const_arpa, "If true, the input "
+                "is a ConstArpaLm format language model rather than an Arpa "
+                "one; --bos-symbol etc. are then ignored.");
+
+    bool external_sort = false;
+    ConstArpaLmExternalOptions external_opts;
+    po.Register("external-sort", &external_sort, "If true, sort the n-grams "
+                "on disk, using bounded memory (cannot be combined with "
+                "--mapped-format; convert the output afterwards with "
+                "--input-const-arpa instead).");
+    external_opts.Register(&po);
+
     po.Read(argc, argv);
 
     if (po.NumArgs() != 2) {
@@ -67,7 +101,16 @@ int main(int argc, char *argv[]) {
       exit(1);
     }
 
-    if (options.bos_symbol == -1 || options.eos_symbol == -1) {
+    if (quantize_bits != 0 && !mapped_format)
+      KALDI_ERR << "--quantize-bits requires --mapped-format=true.";
+    if (input_const_arpa && !mapped_format)
+      KALDI_ERR << "--input-const-arpa requires --mapped-format=true.";
+    if (external_sort && mapped_format)
+      KALDI_ERR << "--external-sort cannot be combined with "
+                << "--mapped-format=true.";
+
+    if (!input_const_arpa &&
+        (options.bos_symbol == -1 || options.eos_symbol == -1)) {
       KALDI_ERR << "Please set --bos-symbol and --eos-symbol.";
       exit(1);
     }
@@ -75,8 +118,23 @@ int main(int argc, char *argv[]) {
     std::string arpa_rxfilename = po.GetArg(1),
         const_arpa_wxfilename = po.GetOptArg(2);
 
-    bool ans = BuildConstArpaLm(options, arpa_rxfilename,
-                                const_arpa_wxfilename);
+    bool ans;
+    if (input_const_arpa) {
+      ConstArpaLm const_arpa;
+      ReadConstArpaLm(arpa_rxfilename, &const_arpa);
+      Output ko(const_arpa_wxfilename, true);
+      const_arpa.WriteMapped(ko.Stream(), quantize_bits);
+      ans = ko.Close();
+    } else if (external_sort) {
+      ans = BuildConstArpaLmExternal(options, external_opts, arpa_rxfilename,
+                                     const_arpa_wxfilename);
+    } else if (mapped_format) {
+      ans = BuildConstArpaLmMapped(options, arpa_rxfilename,
+                                   const_arpa_wxfilename, quantize_bits);
+    } else {
+      ans = BuildConstArpaLm(options, arpa_rxfilename,
+                             const_arpa_wxfilename);
+    }
     if (ans)
       return 0;
     else
@@ -524,23 +524,41 @@ void MatrixBase<Real>::AddMatSmat(Real alpha, const MatrixBase<Real> &A,
     this->Scale(beta);
     MatrixIndexT b_num_rows = B.NumRows(),
         this_num_rows = this->NumRows();
-    // Iterate over the rows of sparse matrix B and columns of *this.
-    for (MatrixIndexT j = 0; j < b_num_rows; ++j) {
-      const SparseVector<Real> &B_row_j = B.Row(j);
-      MatrixIndexT num_elems = B_row_j.NumElements();
-      Real *this_col_j = this->Data() + j;
-      for (MatrixIndexT e = 0; e < num_elems; ++e) {
-        const std::pair<MatrixIndexT, Real> &p = B_row_j.GetElement(e);
-        MatrixIndexT k = p.first;
-        Real alpha_B_jk = alpha * p.second;
-        const Real *a_col_k = A.Data() + k;
-        // Add to entire 'j'th column of *this at once using cblas_Xaxpy.
-        // pass stride to write a column as matrices are stored in row major order.
-        cblas_Xaxpy(this_num_rows, alpha_B_jk, a_col_k, A.stride_,
-                    this_col_j, this->stride_);
-        //for (MatrixIndexT i = 0; i < this_num_rows; ++i) 
-        // this_col_j[i*this->stride_] +=  alpha_B_jk * a_col_k[i*A.stride_];
+    // Accessing the columns of A and *this directly would be slow as they are
+    // strided, so we process the rows in blocks, and transpose each block of A
+    // and of *this.  Then, for each element B(j, k), we add a row of the
+    // transposed block of A to a row of the transposed block of *this, which
+    // is contiguous (so BLAS can vectorize it); and the transposed blocks are
+    // small enough to stay in cache.
+    const MatrixIndexT block_size = 64;
+    Matrix<Real> A_block_trans, this_block_trans;
+    for (MatrixIndexT row_offset = 0; row_offset < this_num_rows;
+         row_offset += block_size) {
+      MatrixIndexT num_rows = std::min(block_size, this_num_rows - row_offset);
+      if (A_block_trans.NumCols() != num_rows) {
+        A_block_trans.Resize(A.NumCols(), num_rows, kUndefined);
+        this_block_trans.Resize(b_num_rows, num_rows, kUndefined);
+      }
+      A_block_trans.CopyFromMat(A.RowRange(row_offset, num_rows), kTrans);
+      this_block_trans.SetZero();
+      for (MatrixIndexT j = 0; j < b_num_rows; ++j) {
+        const SparseVector<Real> &B_row_j = B.Row(j);
+        MatrixIndexT num_elems = B_row_j.NumElements();
+        Real *this_row_j = this_block_trans.RowData(j);
+        for (MatrixIndexT e = 0; e < num_elems; ++e) {
+          const std::pair<MatrixIndexT, Real> &p = B_row_j.GetElement(e);
+          Real alpha_B_jk = alpha * p.second;
+          const Real *A_row_k = A_block_trans.RowData(p.first);
+          if (num_rows >= 16) {
+            cblas_Xaxpy(num_rows, alpha_B_jk, A_row_k, 1, this_row_j, 1);
+          } else {  // avoid the function-call overhead for short rows.
+            for (MatrixIndexT i = 0; i < num_rows; ++i)
+              this_row_j[i] += alpha_B_jk * A_row_k[i];
+          }
+        }
       }
+      this->RowRange(row_offset, num_rows).AddMat(1.0, this_block_trans,
+                                                  kTrans);
     }
   }
 }
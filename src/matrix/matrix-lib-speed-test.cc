@@ -254,6 +254,46 @@ static void UnitTestAddVecToColsSpeed() {
   CsvResult<Real>(__func__, sizes.size(), t.Elapsed(), "seconds");
 }
 
+// Compares the dense product A B^T with the product by a sparse B
+// (AddMatSmat(), as used by SparseAffineComponent in nnet3) as a function of
+// the density of B, to show at what density the sparse version is faster.
+template<typename Real>
+static void UnitTestAddMatSmatSpeed() {
+  Timer t;
+  // The sizes of a typical TDNN layer: 1536 x 1536 weights, and a chunk of 64
+  // frames (or 64 sequences) at a time.
+  MatrixIndexT num_rows = 64, dim = 1536;
+  Matrix<Real> A(num_rows, dim), C(num_rows, dim), B_dense(dim, dim);
+  A.SetRandn();
+  std::vector<BaseFloat> densities;
+  densities.push_back(0.5);
+  densities.push_back(0.3);
+  densities.push_back(0.2);
+  densities.push_back(0.1);
+  densities.push_back(0.05);
+  int32 num_iters = 10;
+  {
+    B_dense.SetRandn();
+    Timer t1;
+    for (int32 i = 0; i < num_iters; i++)
+      C.AddMatMat(1.0, A, kNoTrans, B_dense, kTrans, 0.0);
+    CsvResult<Real>("AddMatMat, dense, dim", dim,
+                    1.0e+03 * t1.Elapsed() / num_iters, "milliseconds");
+  }
+  for (size_t d = 0; d < densities.size(); d++) {
+    SparseMatrix<Real> B(dim, dim);
+    B.SetRandn(1.0 - densities[d]);
+    Timer t1;
+    for (int32 i = 0; i < num_iters; i++)
+      C.AddMatSmat(1.0, A, B, kTrans, 0.0);
+    std::ostringstream name;
+    name << "AddMatSmat, density " << densities[d] << ", dim";
+    CsvResult<Real>(name.str(), dim, 1.0e+03 * t1.Elapsed() / num_iters,
+                    "milliseconds");
+  }
+  CsvResult<Real>(__func__, dim, t.Elapsed(), "seconds");
+}
+
 template<typename Real> static void MatrixUnitSpeedTest() {
   UnitTestRealFftSpeed<Real>();
   UnitTestSplitRadixRealFftSpeed<Real>();
@@ -263,6 +303,7 @@ template<typename Real> static void MatrixUnitSpeedTest() {
   UnitTestAddColSumMatSpeed<Real>();
   UnitTestAddVecToRowsSpeed<Real>();
   UnitTestAddVecToColsSpeed<Real>();
+  UnitTestAddMatSmatSpeed<Real>();
 }
 
 } // namespace kaldi
@@ -229,7 +229,8 @@ template <typename Real>
 void UnitTestMatrixAddMatSmat() {
 
   for (int32 t = 0; t < 4; t++) {
-    MatrixIndexT m = RandInt(10, 20), n = RandInt(10, 20), o = RandInt(10, 20);
+    // m can be more than the block size used when Btrans == kTrans.
+    MatrixIndexT m = RandInt(10, 200), n = RandInt(10, 20), o = RandInt(10, 20);
     MatrixTransposeType Btrans = (RandInt(0, 1) == 0 ? kTrans : kNoTrans);
 
     // we are effectively comparing trace(A B C) computed as
@@ -78,7 +78,19 @@ int32 DecodableNnetLoopedOnlineBase::NumFramesReady() const {
     // doesn't need any attention to rounding because info_.frames_per_chunk
     // is always a multiple of 'sf' (see 'frames_per_chunk = GetChunksize..."
     // in decodable-simple-looped.cc).
-    return num_chunks_ready * info_.frames_per_chunk / sf;
+    int32 num_frames_ready = num_chunks_ready * info_.frames_per_chunk / sf;
+    if (info_.opts.partial_chunk_frames > 0) {
+      // We can also compute the output frames of the next chunk whose right
+      // context we have, once there are enough of them; see AdvanceChunk().
+      // Note: this never makes the return value decrease as more features
+      // arrive.
+      int32 partial_frames_ready = (non_subsampled_output_frames_ready +
+                                    sf - 1) / sf;
+      if (partial_frames_ready - num_frames_ready >=
+          info_.opts.partial_chunk_frames)
+        return partial_frames_ready;
+    }
+    return num_frames_ready;
   }
 }
 
@@ -129,18 +141,34 @@ void DecodableNnetLoopedOnlineBase::AdvanceChunk() {
   int32 num_feature_frames_ready = input_features_->NumFramesReady();
   bool is_finished = input_features_->IsLastFrame(num_feature_frames_ready - 1);
 
+  int32 sf = info_.opts.frame_subsampling_factor,
+      chunk_output_frames = info_.frames_per_chunk / sf,
+      chunk_output_offset = num_chunks_computed_ * chunk_output_frames;
+  // If we compute only part of the chunk (see the --partial-chunk-frames
+  // option), this is the number of output frames we keep.
+  int32 num_partial_frames = 0;
   if (end_input_frame > num_feature_frames_ready && !is_finished) {
     // we shouldn't be attempting to read past the end of the available features
     // until we have reached the end of the input (i.e. the end-user called
     // InputFinished(), announcing that there is no more waveform; at this point
     // we pad as needed with copies of the last frame, to flush out the last of
-    // the output.
+    // the output.  The exception is with --partial-chunk-frames, where we
+    // compute the chunk with the missing input padded in the same way, and keep
+    // the output frames whose right context was all available.
+    if (info_.opts.partial_chunk_frames > 0)
+      num_partial_frames = (num_feature_frames_ready -
+                            info_.frames_right_context -
+                            num_chunks_computed_ * info_.frames_per_chunk +
+                            sf - 1) / sf;
     // If the following error happens, it likely indicates a bug in this
     // decodable code somewhere (although it could possibly indicate the
     // user asking for a frame that was not ready, which would be a misuse
     // of this class.. it can be figured out from gdb as in either case it
     // would be a bug in the code.
-    KALDI_ERR << "Attempt to access frame past the end of the available input";
+    if (num_partial_frames <= 0 ||
+        (current_log_post_subsampled_offset_ == chunk_output_offset &&
+         num_partial_frames <= current_log_post_.NumRows()))
+      KALDI_ERR << "Attempt to access frame past the end of the available input";
   }
 
 
@@ -148,17 +176,28 @@ void DecodableNnetLoopedOnlineBase::AdvanceChunk() {
   { // this block sets 'feats_chunk'.
     Matrix<BaseFloat> this_feats(end_input_frame - begin_input_frame,
                                  input_features_->Dim());
+    // Get the whole chunk with one call to GetFrames(), so it only passes
+    // through the feature pipeline once.
+    std::vector<int32> input_frames(end_input_frame - begin_input_frame);
     for (int32 i = begin_input_frame; i < end_input_frame; i++) {
-      SubVector<BaseFloat> this_row(this_feats, i - begin_input_frame);
       int32 input_frame = i;
       if (input_frame < 0) input_frame = 0;
       if (input_frame >= num_feature_frames_ready)
         input_frame = num_feature_frames_ready - 1;
-      input_features_->GetFrame(input_frame, &this_row);
+      input_frames[i - begin_input_frame] = input_frame;
     }
+    input_features_->GetFrames(input_frames, &this_feats);
     feats_chunk.Swap(&this_feats);
   }
-  computer_.AcceptInput("input", &feats_chunk);
+  // When computing part of a chunk, we use a copy of computer_ (which copies the
+  // activations kept from previous chunks), so that we can compute the whole
+  // chunk later on when we have all its input.
+  NnetComputer *partial_computer = NULL;
+  if (num_partial_frames > 0)
+    partial_computer = new NnetComputer(computer_);
+  NnetComputer &computer = (num_partial_frames > 0 ? *partial_computer :
+                            computer_);
+  computer.AcceptInput("input", &feats_chunk);
 
   if (info_.has_ivectors) {
     KALDI_ASSERT(ivector_features_ != NULL);
@@ -196,9 +235,9 @@ void DecodableNnetLoopedOnlineBase::AdvanceChunk() {
     ivectors.CopyRowsFromVec(ivector);
     CuMatrix<BaseFloat> cu_ivectors;
     cu_ivectors.Swap(&ivectors);
-    computer_.AcceptInput("ivector", &cu_ivectors);
+    computer.AcceptInput("ivector", &cu_ivectors);
   }
-  computer_.Run();
+  computer.Run();
 
   {
     // Note: it's possible in theory that if you had weird recurrence that went
@@ -207,7 +246,7 @@ void DecodableNnetLoopedOnlineBase::AdvanceChunk() {
     // instead of GetOutputDestructive().  But we don't anticipate this will
     // happen in practice.
     CuMatrix<BaseFloat> output;
-    computer_.GetOutputDestructive("output", &output);
+    computer.GetOutputDestructive("output", &output);
 
     if (info_.log_priors.Dim() != 0) {
       // subtract log-prior (divide by prior)
@@ -218,15 +257,18 @@ void DecodableNnetLoopedOnlineBase::AdvanceChunk() {
     current_log_post_.Resize(0, 0);
     current_log_post_.Swap(&output);
   }
-  KALDI_ASSERT(current_log_post_.NumRows() == info_.frames_per_chunk /
-               info_.opts.frame_subsampling_factor &&
+  KALDI_ASSERT(current_log_post_.NumRows() == chunk_output_frames &&
                current_log_post_.NumCols() == info_.output_dim);
 
-  num_chunks_computed_++;
-
-  current_log_post_subsampled_offset_ =
-      (num_chunks_computed_ - 1) *
-      (info_.frames_per_chunk / info_.opts.frame_subsampling_factor);
+  current_log_post_subsampled_offset_ = chunk_output_offset;
+  if (num_partial_frames > 0) {
+    // the remaining output frames depend on input we don't have yet.
+    delete partial_computer;
+    KALDI_ASSERT(num_partial_frames < chunk_output_frames);
+    current_log_post_.Resize(num_partial_frames, info_.output_dim, kCopyData);
+  } else {
+    num_chunks_computed_++;
+  }
 }
 
 BaseFloat DecodableNnetLoopedOnline::LogLikelihood(int32 subsampled_frame,
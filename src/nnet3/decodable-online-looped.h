@@ -98,15 +98,18 @@ class DecodableNnetLoopedOnlineBase: public DecodableInterface {
   }
 
   // The current log-posteriors that we got from the last time we
-  // ran the computation.
+  // ran the computation.  If that was for part of a chunk (see the
+  // --partial-chunk-frames option), it contains only the frames we could
+  // compute exactly.
   Matrix<BaseFloat> current_log_post_;
 
-  // The number of chunks we have computed so far.
+  // The number of whole chunks we have computed so far.
   int32 num_chunks_computed_;
 
   // The time-offset of the current log-posteriors, equals
   // (num_chunks_computed_ - 1) *
-  //    (info_.frames_per_chunk_ / info_.opts_.frame_subsampling_factor).
+  //    (info_.frames_per_chunk_ / info_.opts_.frame_subsampling_factor),
+  // or num_chunks_computed_ * (...) if they are for part of a chunk.
   int32 current_log_post_subsampled_offset_;
 
   const DecodableNnetSimpleLoopedInfo &info_;
@@ -115,7 +118,11 @@ class DecodableNnetLoopedOnlineBase: public DecodableInterface {
 
   // This function does the computation for the next chunk.  It will change
   // current_log_post_ and current_log_post_subsampled_offset_, and
-  // increment num_chunks_computed_.
+  // increment num_chunks_computed_.  With --partial-chunk-frames, if we don't
+  // have all the input for the chunk yet, it computes it on a copy of
+  // computer_ and keeps only the output frames whose right context we have,
+  // without incrementing num_chunks_computed_; it will then be called again
+  // for the same chunk.
   void AdvanceChunk();
 
   OnlineFeatureInterface *input_features_;
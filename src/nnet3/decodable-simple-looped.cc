@@ -83,8 +83,22 @@ void DecodableNnetSimpleLoopedInfo::Init(
                                  num_sequences,
                                  &request1, &request2, &request3);
 
-  CompileLooped(*nnet, opts.optimize_config, request1, request2, request3,
-                &computation);
+  if (opts.cache_dir.empty()) {
+    CompileLooped(*nnet, opts.optimize_config, request1, request2, request3,
+                  &computation);
+  } else {
+    ComputationDiskCache disk_cache(opts.cache_dir, *nnet,
+                                    opts.optimize_config, "looped");
+    std::vector<const ComputationRequest*> requests;
+    requests.push_back(&request1);
+    requests.push_back(&request2);
+    requests.push_back(&request3);
+    if (!disk_cache.Read(requests, &computation)) {
+      CompileLooped(*nnet, opts.optimize_config, request1, request2, request3,
+                    &computation);
+      disk_cache.Write(requests, computation);
+    }
+  }
   computation.ComputeCudaIndexes();
   if (GetVerboseLevel() >= 3) {
     KALDI_VLOG(3) << "Computation is:";
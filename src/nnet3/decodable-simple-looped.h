@@ -47,21 +47,30 @@ struct NnetSimpleLoopedComputationOptions {
   int32 extra_left_context_initial;
   int32 frame_subsampling_factor;
   int32 frames_per_chunk;
+  int32 partial_chunk_frames;
   BaseFloat acoustic_scale;
   bool debug_computation;
   NnetOptimizeOptions optimize_config;
   NnetComputeOptions compute_config;
+  // Directory for the on-disk cache of compiled computations; see
+  // ComputationDiskCache.
+  std::string cache_dir;
   NnetSimpleLoopedComputationOptions():
       extra_left_context_initial(0),
       frame_subsampling_factor(1),
       frames_per_chunk(20),
+      partial_chunk_frames(0),
       acoustic_scale(0.1),
-      debug_computation(false) { }
+      debug_computation(false) {
+    // The looped computation is run once per chunk, so it's worth planning
+    // its memory; this way it does no allocation in steady state.
+    compute_config.use_memory_arena = true;
+  }
 
   void Check() const {
     KALDI_ASSERT(extra_left_context_initial >= 0 &&
                  frame_subsampling_factor > 0 && frames_per_chunk > 0 &&
-                 acoustic_scale > 0.0);
+                 partial_chunk_frames >= 0 && acoustic_scale > 0.0);
   }
 
   void Register(OptionsItf *opts) {
@@ -81,6 +90,15 @@ struct NnetSimpleLoopedComputationOptions {
                    "--frame-subsampling-factor options is used (i.e. counts "
                    "input frames.  This is only advisory (may be rounded up "
                    "if needed.");
+    opts->Register("partial-chunk-frames", &partial_chunk_frames,
+                   "Only relevant for online decoding.  If >0, output frames "
+                   "are made available as soon as this many output frames "
+                   "(after subsampling) of the next chunk have all their "
+                   "right context, instead of only when the whole chunk can "
+                   "be computed; this reduces latency at the cost of "
+                   "recomputing the chunk, so it should be less than the "
+                   "number of output frames per chunk.  E.g. 1 gives the "
+                   "lowest latency.");
     opts->Register("debug-computation", &debug_computation, "If true, turn on "
                    "debug for the actual computation (very verbose!)");
 
@@ -91,6 +109,16 @@ struct NnetSimpleLoopedComputationOptions {
     // register the compute options with the prefix "computation".
     ParseOptions compute_opts("computation", opts);
     compute_config.Register(&compute_opts);
+
+    // this is named like the cache-dir option of
+    // CachingOptimizingCompilerOptions, as registered by other programs.
+    ParseOptions compiler_opts("compiler", opts);
+    compiler_opts.Register("cache-dir", &cache_dir,
+                           "If set, an existing directory in which the "
+                           "compiled computation is stored, so that other "
+                           "processes using the same model and options don't "
+                           "have to compile it again.  It is safe for several "
+                           "processes to share the directory.");
   }
 };
 
@@ -63,6 +63,9 @@ struct NnetSimpleComputationOptions {
       acoustic_scale(0.1),
       debug_computation(false) {
     compiler_config.cache_capacity += frames_per_chunk;
+    // The computation is run once per chunk, so it's worth planning its
+    // memory.
+    compute_config.use_memory_arena = true;
   }
 
   void Register(OptionsItf *opts) {
@@ -102,6 +105,10 @@ struct NnetSimpleComputationOptions {
     // register the compute options with the prefix "computation".
     ParseOptions compute_opts("computation", opts);
     compute_config.Register(&compute_opts);
+
+    // register the compiler options with the prefix "compiler".
+    ParseOptions compiler_opts("compiler", opts);
+    compiler_config.Register(&compiler_opts);
   }
 };
 
@@ -495,6 +495,13 @@ void ChainExampleMerger::WriteMinibatch(
   size_t structure_hash = eg_hasher((*egs)[0]);
   int32 minibatch_size = egs->size();
   stats_.WroteExample(eg_size, structure_hash, minibatch_size);
+  if (writer_ == NULL) {
+    NnetChainExample *merged_eg = new NnetChainExample();
+    MergeChainExamples(config_.compress, egs, merged_eg);
+    merged_egs_.push_back(merged_eg);
+    num_egs_written_++;
+    return;
+  }
   NnetChainExample merged_eg;
   MergeChainExamples(config_.compress, egs, &merged_eg);
   std::ostringstream key;
@@ -502,6 +509,18 @@ void ChainExampleMerger::WriteMinibatch(
   writer_->Write(key.str(), merged_eg);
 }
 
+void ChainExampleMerger::GetMergedExamples(
+    std::vector<NnetChainExample*> *egs) {
+  KALDI_ASSERT(writer_ == NULL);
+  egs->insert(egs->end(), merged_egs_.begin(), merged_egs_.end());
+  merged_egs_.clear();
+}
+
+ChainExampleMerger::~ChainExampleMerger() {
+  Finish();
+  DeletePointers(&merged_egs_);
+}
+
 void ChainExampleMerger::Finish() {
   if (finished_) return;  // already finished.
   finished_ = true;
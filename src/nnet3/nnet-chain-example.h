@@ -233,6 +233,8 @@ int32 GetChainNnetExampleSize(const NnetChainExample &a);
 /// in suitable minibatches as defined by ExampleMergingConfig.
 class ChainExampleMerger {
  public:
+  // If 'writer' is NULL, the merged examples are not written out but kept in
+  // this object, and you can get them with GetMergedExamples().
   ChainExampleMerger(const ExampleMergingConfig &config,
                      NnetChainExampleWriter *writer);
 
@@ -251,7 +253,12 @@ class ChainExampleMerger {
   // returns a suitable exit status for a program.
   int32 ExitStatus() { Finish(); return (num_egs_written_ > 0 ? 0 : 1); }
 
-  ~ChainExampleMerger() { Finish(); };
+  // This is only applicable if the writer given to the constructor was NULL.
+  // It appends the merged examples produced so far to 'egs', and transfers
+  // their ownership to the caller.
+  void GetMergedExamples(std::vector<NnetChainExample*> *egs);
+
+  ~ChainExampleMerger();
  private:
   // called by Finish() and AcceptExample().  Merges, updates the stats, and
   // writes.  The 'egs' is non-const only because the egs are temporarily
@@ -263,6 +270,9 @@ class ChainExampleMerger {
   int32 num_egs_written_;
   const ExampleMergingConfig &config_;
   NnetChainExampleWriter *writer_;
+  // The merged examples not yet collected by GetMergedExamples(), if writer_
+  // is NULL.
+  std::vector<NnetChainExample*> merged_egs_;
   ExampleMergingStats stats_;
 
   // Note: the "key" into the egs is the first element of the vector.
@@ -0,0 +1,48 @@
+// nnet3/nnet-chain-training-parallel.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/nnet-chain-training-parallel.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+NnetChainParallelTrainer::NnetChainParallelTrainer(
+    const NnetChainTrainingOptions &config,
+    const NnetParallelTrainerOptions &parallel_config,
+    const fst::StdVectorFst &den_fst,
+    Nnet *nnet):
+    NnetParallelTrainerTpl<NnetChainTrainer, NnetChainExample>(
+        parallel_config, nnet) {
+  int32 num_threads = nnets_.size();
+  if (config.nnet_config.backstitch_training_scale > 0.0 && num_threads > 1)
+    KALDI_WARN << "Backstitch training uses srand() to get the same dropout "
+               << "masks in both passes; this is not reliable with multiple "
+               << "threads.";
+  std::vector<NnetChainTrainer*> trainers;
+  for (int32 i = 0; i < num_threads; i++) {
+    NnetChainTrainingOptions this_config(config);
+    // Only the first thread writes the computation cache.
+    if (i > 0)
+      this_config.nnet_config.write_cache = "";
+    trainers.push_back(new NnetChainTrainer(this_config, den_fst, nnets_[i]));
+  }
+  Start(trainers);
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
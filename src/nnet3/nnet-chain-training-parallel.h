@@ -0,0 +1,47 @@
+// nnet3/nnet-chain-training-parallel.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_CHAIN_TRAINING_PARALLEL_H_
+#define KALDI_NNET3_NNET_CHAIN_TRAINING_PARALLEL_H_
+
+#include "nnet3/nnet-chain-training.h"
+#include "nnet3/nnet-training-parallel.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+/**
+   This class is for multi-threaded training of neural nets on CPU using the
+   'chain' model; see NnetParallelTrainerTpl.  Each thread has its own
+   NnetChainTrainer, with its own copy of the denominator graph.
+ */
+class NnetChainParallelTrainer:
+      public NnetParallelTrainerTpl<NnetChainTrainer, NnetChainExample> {
+ public:
+  // 'nnet' is the model to train; it contains the averaged model after
+  // Finish() is called.
+  NnetChainParallelTrainer(const NnetChainTrainingOptions &config,
+                           const NnetParallelTrainerOptions &parallel_config,
+                           const fst::StdVectorFst &den_fst,
+                           Nnet *nnet);
+};
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+#endif // KALDI_NNET3_NNET_CHAIN_TRAINING_PARALLEL_H_
@@ -362,6 +362,20 @@ bool NnetChainTrainer::PrintTotalStats() const {
   return ans;
 }
 
+void NnetChainTrainer::AddTotalStats(
+    unordered_map<std::string, ObjectiveFunctionInfo, StringHasher>
+    *objf_info) const {
+  unordered_map<std::string, ObjectiveFunctionInfo, StringHasher>::const_iterator
+      iter = objf_info_.begin(),
+      end = objf_info_.end();
+  for (; iter != end; ++iter) {
+    ObjectiveFunctionInfo &info = (*objf_info)[iter->first];
+    info.tot_weight += iter->second.tot_weight;
+    info.tot_objf += iter->second.tot_objf;
+    info.tot_aux_objf += iter->second.tot_aux_objf;
+  }
+}
+
 void NnetChainTrainer::PrintMaxChangeStats() const {
   KALDI_ASSERT(delta_nnet_ != NULL);
   const NnetTrainerOptions &nnet_config = opts_.nnet_config;
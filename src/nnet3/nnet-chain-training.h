@@ -68,6 +68,12 @@ class NnetChainTrainer {
   // per-component max-change and global max-change were enforced.
   void PrintMaxChangeStats() const;
 
+  // Adds the total objective-function stats of this object to 'objf_info'.
+  // This is used when combining the stats of several trainers, see class
+  // NnetChainParallelTrainer.
+  void AddTotalStats(unordered_map<std::string, ObjectiveFunctionInfo,
+                                   StringHasher> *objf_info) const;
+
   ~NnetChainTrainer();
  private:
   // The internal function for doing one step of conventional SGD training.
@@ -124,6 +124,8 @@ Component* Component::NewComponentOfType(const std::string &component_type) {
     ans = new SumGroupComponent();
   } else if (component_type == "FixedAffineComponent") {
     ans = new FixedAffineComponent();
+  } else if (component_type == "SparseAffineComponent") {
+    ans = new SparseAffineComponent();
   } else if (component_type == "FixedScaleComponent") {
     ans = new FixedScaleComponent();
   } else if (component_type == "FixedBiasComponent") {
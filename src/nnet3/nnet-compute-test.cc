@@ -27,6 +27,7 @@
 #include "nnet3/nnet-compute.h"
 #include "nnet3/nnet-am-decodable-simple.h"
 #include "nnet3/decodable-simple-looped.h"
+#include "nnet3/decodable-online-looped.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -75,6 +76,28 @@ void UnitTestComputationRequestIo(ComputationRequest *request) {
   }
 }
 
+// An online feature that returns the rows of a matrix, of which only the first
+// 'num_frames_ready' are available; we use it to simulate online decoding.
+class TestOnlineMatrixFeature: public OnlineFeatureInterface {
+ public:
+  explicit TestOnlineMatrixFeature(const MatrixBase<BaseFloat> &mat):
+      mat_(mat), num_frames_ready_(0) { }
+  virtual int32 Dim() const { return mat_.NumCols(); }
+  virtual int32 NumFramesReady() const { return num_frames_ready_; }
+  virtual bool IsLastFrame(int32 frame) const {
+    return num_frames_ready_ == mat_.NumRows() && frame == num_frames_ready_ - 1;
+  }
+  virtual BaseFloat FrameShiftInSeconds() const { return 0.01; }
+  virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
+    KALDI_ASSERT(frame < num_frames_ready_);
+    feat->CopyFromVec(mat_.Row(frame));
+  }
+  void SetNumFramesReady(int32 n) { num_frames_ready_ = n; }
+ private:
+  const MatrixBase<BaseFloat> &mat_;
+  int32 num_frames_ready_;
+};
+
 // this checks that a couple of different decodable objects give the same
 // answer.
 void TestNnetDecodable(Nnet *nnet) {
@@ -124,6 +147,35 @@ void TestNnetDecodable(Nnet *nnet) {
     }
   }
 
+  {
+    // Check that the online looped decodable, with features arriving a few
+    // frames at a time, gives the same output as the looped one, also when
+    // outputting partial chunks.
+    NnetSimpleLoopedComputationOptions opts;
+    opts.partial_chunk_frames = RandInt(0, 3);
+    DecodableNnetSimpleLoopedInfo info(opts, priors, nnet);
+    Matrix<BaseFloat> ivectors;
+    if (ivector_dim != 0) {
+      ivectors.Resize(num_frames, ivector_dim);
+      ivectors.CopyRowsFromVec(ivector);
+    }
+    TestOnlineMatrixFeature input_feature(input), ivector_feature(ivectors);
+    DecodableNnetLoopedOnline decodable(
+        info, &input_feature, (ivector_dim != 0 ? &ivector_feature : NULL));
+    int32 num_frames_ready = 0, t = 0;
+    while (t < num_frames) {
+      num_frames_ready = std::min(num_frames,
+                                  num_frames_ready + RandInt(1, 4));
+      input_feature.SetNumFramesReady(num_frames_ready);
+      ivector_feature.SetNumFramesReady(num_frames_ready);
+      for (; t < decodable.NumFramesReady(); t++) {
+        for (int32 i = 0; i < output_dim; i++)
+          KALDI_ASSERT(ApproxEqual(decodable.LogLikelihood(t, i + 1),
+                                   output2(t, i)));
+      }
+    }
+  }
+
 
   // the components that we exclude from this test, are excluded because they
   // all take "optional" right context, and this destroys the equivalence that
@@ -276,6 +328,117 @@ void UnitTestNnetCompute() {
   }
 }
 
+// Runs the computation forward and (if there is an output derivative)
+// backward, with options 'compute_opts'; outputs the output, the input
+// derivatives and the model derivative.
+void RunComputationWithOptions(const Nnet &nnet,
+                               const ComputationRequest &request,
+                               const NnetComputation &computation,
+                               const std::vector<Matrix<BaseFloat> > &inputs,
+                               const CuMatrix<BaseFloat> &output_deriv,
+                               const NnetComputeOptions &compute_opts,
+                               CuMatrix<BaseFloat> *output,
+                               std::vector<CuMatrix<BaseFloat> > *input_derivs,
+                               Nnet *nnet_deriv) {
+  NnetComputer computer(compute_opts, computation, nnet, nnet_deriv);
+  for (size_t i = 0; i < request.inputs.size(); i++) {
+    CuMatrix<BaseFloat> temp(inputs[i]);
+    computer.AcceptInput(request.inputs[i].name, &temp);
+  }
+  computer.Run();
+  *output = computer.GetOutput("output");
+  input_derivs->clear();
+  input_derivs->resize(request.inputs.size());
+  if (request.outputs[0].has_deriv) {
+    CuMatrix<BaseFloat> temp(output_deriv);
+    computer.AcceptInput("output", &temp);
+    computer.Run();
+    for (size_t i = 0; i < request.inputs.size(); i++)
+      if (request.inputs[i].has_deriv)
+        (*input_derivs)[i] = computer.GetOutput(request.inputs[i].name);
+  }
+}
+
+// Checks that running computations multi-threaded, and/or with the memory
+// arena, gives the same results as running them single-threaded without it.
+void UnitTestNnetComputeMultiThreaded() {
+  for (int32 n = 0; n < 10; n++) {
+    struct NnetGenerationOptions gen_config;
+    std::vector<std::string> configs;
+    GenerateConfigSequence(gen_config, &configs);
+    Nnet nnet;
+    for (size_t j = 0; j < configs.size(); j++) {
+      std::istringstream is(configs[j]);
+      nnet.ReadConfig(is);
+    }
+    // Make the computation deterministic.
+    SetBatchnormTestMode(true, &nnet);
+    SetDropoutTestMode(true, &nnet);
+
+    ComputationRequest request;
+    std::vector<Matrix<BaseFloat> > inputs;
+    ComputeExampleComputationRequestSimple(nnet, &request, &inputs);
+    request.need_model_derivative = request.outputs[0].has_deriv;
+
+    NnetComputation computation;
+    Compiler compiler(request, nnet);
+    CompilerOptions opts;
+    compiler.CreateComputation(opts, &computation);
+    if (RandInt(0, 1) == 0) {
+      NnetOptimizeOptions opt_config;
+      Optimize(opt_config, nnet, MaxOutputTimeInRequest(request),
+               &computation);
+    }
+    computation.ComputeCudaIndexes();
+
+    int32 output_dim = nnet.OutputDim("output"),
+        num_output_rows = request.outputs[0].indexes.size();
+    CuMatrix<BaseFloat> output_deriv(num_output_rows, output_dim);
+    output_deriv.SetRandn();
+
+    CuMatrix<BaseFloat> output1, output2;
+    std::vector<CuMatrix<BaseFloat> > input_derivs1, input_derivs2;
+    Nnet nnet_deriv1(nnet), nnet_deriv2(nnet);
+    ScaleNnet(0.0, &nnet_deriv1);
+    SetNnetAsGradient(&nnet_deriv1);
+    ScaleNnet(0.0, &nnet_deriv2);
+    SetNnetAsGradient(&nnet_deriv2);
+
+    NnetComputeOptions compute_opts1, compute_opts2;
+    compute_opts1.use_memory_arena = false;
+    compute_opts2.num_threads = RandInt(1, 4);
+    compute_opts2.use_memory_arena = true;
+    {
+      std::vector<int32> block_end;
+      ComputationMemoryPlan plan;
+      PlanComputationMemory(computation, block_end, &plan);
+      CheckComputationMemoryPlan(computation, block_end, plan);
+      KALDI_LOG << "Memory arena has " << plan.arena_size
+                << " elements, for matrices with total size "
+                << plan.total_size;
+      KALDI_ASSERT(plan.arena_size <= plan.total_size);
+    }
+
+    RunComputationWithOptions(nnet, request, computation, inputs,
+                              output_deriv, compute_opts1, &output1,
+                              &input_derivs1, &nnet_deriv1);
+    RunComputationWithOptions(nnet, request, computation, inputs,
+                              output_deriv, compute_opts2, &output2,
+                              &input_derivs2, &nnet_deriv2);
+    KALDI_LOG << "Output sums are " << output1.Sum() << " and "
+              << output2.Sum();
+    KALDI_ASSERT(output1.ApproxEqual(output2, 1.0e-05));
+    for (size_t i = 0; i < input_derivs1.size(); i++)
+      KALDI_ASSERT(input_derivs1[i].ApproxEqual(input_derivs2[i], 1.0e-05));
+    BaseFloat prod11 = DotProduct(nnet_deriv1, nnet_deriv1),
+        prod12 = DotProduct(nnet_deriv1, nnet_deriv2),
+        prod22 = DotProduct(nnet_deriv2, nnet_deriv2);
+    KALDI_LOG << "Model-derivative dot-products are " << prod11 << ", "
+              << prod12 << ", " << prod22;
+    KALDI_ASSERT(ApproxEqual(prod11, prod12) && ApproxEqual(prod11, prod22));
+  }
+}
+
 } // namespace nnet3
 } // namespace kaldi
 
@@ -296,6 +459,7 @@ int main() {
       CuDevice::Instantiate().SelectGpuId("yes");
 #endif
     UnitTestNnetCompute();
+    UnitTestNnetComputeMultiThreaded();
   }
 
   KALDI_LOG << "Nnet tests succeeded.";
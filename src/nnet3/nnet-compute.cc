@@ -17,8 +17,16 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
 #include <iterator>
+#include <limits>
+#include <map>
+#include <mutex>
 #include <sstream>
+#include <thread>
 #include "nnet3/nnet-compute.h"
 
 namespace kaldi {
@@ -62,6 +70,311 @@ void NnetComputer::Init() {
     KALDI_LOG << preamble;
     computation_.GetSubmatrixStrings(nnet_, &submatrix_strings_);
   }
+  bool multi_threaded = (options_.num_threads > 1 && !debug_);
+#if HAVE_CUDA == 1
+  // On the GPU the kernels are queued asynchronously anyway.
+  if (CuDevice::Instantiate().Enabled())
+    multi_threaded = false;
+#endif
+  if (multi_threaded)
+    InitMultiThreaded();
+  if (options_.use_memory_arena) {
+    // This has to come after InitMultiThreaded(), as the plan depends on
+    // block_end_.
+    PlanComputationMemory(computation_, block_end_, &memory_plan_);
+    if (memory_plan_.arena_size >
+        std::numeric_limits<MatrixIndexT>::max()) {
+      // A CuVector can't be this large; allocate the matrices as usual.
+      KALDI_WARN << "Computation is too large for the memory arena ("
+                 << memory_plan_.arena_size << " elements); not using it.";
+      memory_plan_ = ComputationMemoryPlan();
+    } else if (memory_plan_.arena_size > 0) {
+      arena_.Resize(memory_plan_.arena_size, kUndefined);
+    }
+    KALDI_VLOG(3) << "Memory arena has " << memory_plan_.arena_size
+                  << " elements, for matrices with total size "
+                  << memory_plan_.total_size;
+  }
+}
+
+// Returns true if commands of this type are not part of any block of commands
+// that we run multi-threaded; see InitMultiThreaded().  The labels and markers
+// are included because after a goto, or after I/O, we start executing just
+// after them.
+static bool IsBlockBoundary(CommandType command_type) {
+  switch (command_type) {
+    case kAcceptInput: case kProvideOutput: case kGotoLabel:
+    case kNoOperationLabel: case kNoOperationMarker:
+      return true;
+    default:
+      return false;
+  }
+}
+
+void NnetComputer::InitMultiThreaded() {
+  const std::vector<NnetComputation::Command> &c = computation_.commands;
+  int32 num_commands = c.size();
+  ComputationVariables variables;
+  variables.Init(computation_);
+  std::vector<CommandAttributes> attributes;
+  ComputeCommandAttributes(nnet_, computation_, variables, &attributes);
+
+  block_end_.resize(num_commands, -1);
+  command_successors_.resize(num_commands);
+  command_num_predecessors_.resize(num_commands, 0);
+
+  int32 num_variables = variables.NumVariables(),
+      num_components = nnet_.NumComponents();
+  // For each variable, the last command that wrote to it and the commands that
+  // have read it since then; and for each component, the last command that
+  // used it.  Entries from earlier blocks are ignored.
+  std::vector<int32> last_writer(num_variables, -1),
+      last_component_command(num_components, -1);
+  std::vector<std::vector<int32> > readers(num_variables);
+  // level[c] is the length of the longest chain of dependencies ending at c;
+  // it tells us whether a block is just a chain of commands, in which case
+  // there is no point running it multi-threaded.
+  std::vector<int32> level(num_commands, 0);
+  int32 max_memo_index = 0;
+
+  int32 begin = 0;
+  while (begin < num_commands) {
+    if (IsBlockBoundary(c[begin].command_type)) {
+      begin++;
+      continue;
+    }
+    int32 end = begin + 1;
+    while (end < num_commands && !IsBlockBoundary(c[end].command_type))
+      end++;
+    int32 max_level = 0;
+    for (int32 command = begin; command < end; command++) {
+      const NnetComputation::Command &cmd = c[command];
+      std::vector<int32> variables_read(attributes[command].variables_read),
+          variables_written(attributes[command].variables_written);
+      switch (cmd.command_type) {
+        case kAllocMatrix: case kDeallocMatrix: case kSwapMatrix:
+        case kCompressMatrix: case kDecompressMatrix: {
+          // ComputeCommandAttributes() records no accesses for these, but they
+          // change the whole matrix (or matrices).
+          variables.AppendVariablesForMatrix(
+              computation_.submatrices[cmd.arg1].matrix_index,
+              &variables_written);
+          if (cmd.command_type == kSwapMatrix)
+            variables.AppendVariablesForMatrix(
+                computation_.submatrices[cmd.arg2].matrix_index,
+                &variables_written);
+          SortAndUniq(&variables_written);
+          break;
+        }
+        default:
+          break;
+      }
+      std::vector<int32> predecessors;
+      for (size_t i = 0; i < variables_read.size(); i++) {
+        int32 v = variables_read[i];
+        if (last_writer[v] >= begin)
+          predecessors.push_back(last_writer[v]);
+      }
+      for (size_t i = 0; i < variables_written.size(); i++) {
+        int32 v = variables_written[i];
+        if (last_writer[v] >= begin)
+          predecessors.push_back(last_writer[v]);
+        for (size_t j = 0; j < readers[v].size(); j++)
+          if (readers[v][j] >= begin)
+            predecessors.push_back(readers[v][j]);
+        readers[v].clear();
+        last_writer[v] = command;
+      }
+      for (size_t i = 0; i < variables_read.size(); i++) {
+        int32 v = variables_read[i];
+        if (last_writer[v] != command)
+          readers[v].push_back(command);
+      }
+      if (cmd.command_type == kPropagate || cmd.command_type == kBackprop ||
+          cmd.command_type == kBackpropNoModelUpdate) {
+        // Commands that use the same component are kept in order, since they
+        // may use its internal state (e.g. random number generation, stats
+        // accumulation, model update, and memos).
+        int32 component = cmd.arg1;
+        if (last_component_command[component] >= begin)
+          predecessors.push_back(last_component_command[component]);
+        last_component_command[component] = command;
+        if (cmd.command_type == kPropagate)
+          max_memo_index = std::max(max_memo_index, cmd.arg5);
+      }
+      SortAndUniq(&predecessors);
+      command_num_predecessors_[command] = predecessors.size();
+      for (size_t i = 0; i < predecessors.size(); i++) {
+        command_successors_[predecessors[i]].push_back(command);
+        level[command] = std::max(level[command], level[predecessors[i]] + 1);
+      }
+      max_level = std::max(max_level, level[command]);
+    }
+    if (max_level + 1 < end - begin)
+      block_end_[begin] = end;
+    begin = end;
+  }
+  // Make sure SaveMemo() never has to resize memos_, as it may be called from
+  // several threads at once.
+  if (max_memo_index > 0)
+    memos_.resize(max_memo_index + 1, NULL);
+}
+
+// A pool of worker threads shared by all NnetComputer objects, so that we
+// don't create and join threads for each block of commands that we run
+// multi-threaded, which would often take as long as the commands themselves.
+// Threads are started as they are first needed and live until the program
+// exits.
+class NnetComputeThreadPool {
+ public:
+  static NnetComputeThreadPool &Instance() {
+    static NnetComputeThreadPool pool;
+    return pool;
+  }
+
+  // Queues 'num_jobs' calls of 'job', tagged with 'tag', and makes sure there
+  // are at least 'num_jobs' threads.
+  void Submit(const void *tag, int32 num_jobs,
+              const std::function<void()> &job) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int32 i = 0; i < num_jobs; i++)
+      queue_.push_back(std::make_pair(tag, job));
+    while (static_cast<int32>(threads_.size()) < num_jobs)
+      threads_.push_back(std::thread(&NnetComputeThreadPool::ThreadMain,
+                                     this));
+    job_cond_.notify_all();
+  }
+
+  // Removes the jobs tagged with 'tag' that have not been started yet, and
+  // waits for the ones that have been started to finish.
+  void Finish(const void *tag) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (std::deque<TaggedJob>::iterator iter = queue_.begin();
+         iter != queue_.end();) {
+      if (iter->first == tag)
+        iter = queue_.erase(iter);
+      else
+        ++iter;
+    }
+    while (num_running_.count(tag) != 0)
+      done_cond_.wait(lock);
+  }
+
+  ~NnetComputeThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      exit_ = true;
+      job_cond_.notify_all();
+    }
+    for (size_t i = 0; i < threads_.size(); i++)
+      threads_[i].join();
+  }
+
+ private:
+  typedef std::pair<const void*, std::function<void()> > TaggedJob;
+
+  NnetComputeThreadPool(): exit_(false) { }
+
+  void ThreadMain() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      while (queue_.empty() && !exit_)
+        job_cond_.wait(lock);
+      if (exit_)
+        return;
+      TaggedJob job = queue_.front();
+      queue_.pop_front();
+      num_running_[job.first]++;
+      lock.unlock();
+      job.second();
+      lock.lock();
+      if (--num_running_[job.first] == 0) {
+        num_running_.erase(job.first);
+        done_cond_.notify_all();
+      }
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable job_cond_;  // signaled when jobs are queued.
+  std::condition_variable done_cond_;  // signaled when jobs finish.
+  std::deque<TaggedJob> queue_;
+  // The number of jobs with each tag that are running.
+  std::map<const void*, int32> num_running_;
+  std::vector<std::thread> threads_;
+  bool exit_;
+};
+
+struct NnetComputer::BlockState {
+  std::mutex mutex;
+  std::condition_variable cond;
+  // The commands that are ready to run, i.e. whose predecessors have all
+  // finished.  Used as a stack.
+  std::vector<int32> ready;
+  // For each command in the block (indexed by command minus 'begin'), the
+  // number of its predecessors that have not finished yet.
+  std::vector<int32> num_pending;
+  int32 begin;
+  // The number of commands in the block that have not finished yet.
+  int32 num_remaining;
+  // Set if a command threw an exception.
+  std::exception_ptr error;
+};
+
+void NnetComputer::ExecuteBlockMultiThreaded(int32 begin) {
+  int32 end = block_end_[begin];
+  BlockState state;
+  state.begin = begin;
+  state.num_remaining = end - begin;
+  state.num_pending.assign(command_num_predecessors_.begin() + begin,
+                           command_num_predecessors_.begin() + end);
+  // Push in reverse order so that the commands are started in roughly the
+  // order they appear in the computation.
+  for (int32 command = end - 1; command >= begin; command--)
+    if (command_num_predecessors_[command] == 0)
+      state.ready.push_back(command);
+
+  // The calling thread does its share too, so we need one helper less.
+  int32 num_helpers = std::min(options_.num_threads, end - begin) - 1;
+  NnetComputeThreadPool &pool = NnetComputeThreadPool::Instance();
+  pool.Submit(&state, num_helpers,
+              std::bind(&NnetComputer::ExecuteBlockWorker, this, &state));
+  ExecuteBlockWorker(&state);
+  // Helpers that have not started yet are no longer needed; 'state' must
+  // outlive the ones that have.
+  pool.Finish(&state);
+  if (state.error)
+    std::rethrow_exception(state.error);
+}
+
+void NnetComputer::ExecuteBlockWorker(BlockState *state) {
+  std::unique_lock<std::mutex> lock(state->mutex);
+  while (true) {
+    while (state->ready.empty() && state->num_remaining > 0 && !state->error)
+      state->cond.wait(lock);
+    if (state->num_remaining == 0 || state->error)
+      return;
+    int32 command = state->ready.back();
+    state->ready.pop_back();
+    lock.unlock();
+    try {
+      ExecuteCommand(command);
+    } catch (...) {
+      lock.lock();
+      if (!state->error)
+        state->error = std::current_exception();
+      state->cond.notify_all();
+      return;
+    }
+    lock.lock();
+    state->num_remaining--;
+    const std::vector<int32> &successors = command_successors_[command];
+    for (size_t i = 0; i < successors.size(); i++)
+      if (--(state->num_pending[successors[i] - state->begin]) == 0)
+        state->ready.push_back(successors[i]);
+    if (!state->ready.empty() || state->num_remaining == 0)
+      state->cond.notify_all();
+  }
 }
 
 //static
@@ -88,7 +401,7 @@ void NnetComputer::DebugBeforeExecute(int32 command,
     info->matrices_written_stddevs.resize(size);
     for (size_t i = 0; i < size; i++) {
       int32 m = matrices_written[i];
-      info->matrices_written_stddevs[i] = MatrixStddev(matrices_[m]);
+      info->matrices_written_stddevs[i] = MatrixStddev(GetMatrix(m));
     }
   }
   {
@@ -126,7 +439,7 @@ void NnetComputer::DebugAfterExecute(int32 command,
     for (size_t i = 0; i < size; i++) {
       int32 m = matrices_written[i];
       BaseFloat old_stddev = info.matrices_written_stddevs[i],
-          stddev = MatrixStddev(matrices_[m]);
+          stddev = MatrixStddev(GetMatrix(m));
       os << 'm' << m << ": " << old_stddev << "->" << stddev << " ";
     }
   }
@@ -199,29 +512,39 @@ NnetComputer::NnetComputer(const NnetComputer &other):
     submatrix_strings_(other.submatrix_strings_),
     command_strings_(other.command_strings_),
     matrices_(other.matrices_),
-    memos_(other.memos_) {
-  // Note: this is the same as the default copy constructor, except for the check below.
-  if (!memos_.empty()) {
-    KALDI_ERR << "You cannot use the copy constructor of NnetComputer if "
-        "memos are used.";
+    memory_plan_(other.memory_plan_),
+    arena_(other.arena_),
+    memos_(other.memos_),
+    block_end_(other.block_end_),
+    command_successors_(other.command_successors_),
+    command_num_predecessors_(other.command_num_predecessors_) {
+  // Note: this is the same as the default copy constructor, except for the
+  // check below.  (memos_ may have been resized in InitMultiThreaded(), so we
+  // check for actual memos.)
+  for (size_t i = 0; i < memos_.size(); i++) {
+    if (memos_[i] != NULL)
+      KALDI_ERR << "You cannot use the copy constructor of NnetComputer if "
+          "memos are used.";
   }
 }
 
-void NnetComputer::ExecuteCommand() {
-  const NnetComputation::Command &c = computation_.commands[program_counter_];
+void NnetComputer::ExecuteCommand(int32 command) {
+  const NnetComputation::Command &c = computation_.commands[command];
   int32 m1, m2;
   try {
     switch (c.command_type) {
       case kAllocMatrix:
         m1 = computation_.submatrices[c.arg1].matrix_index;
-        matrices_[m1].Resize(computation_.matrices[m1].num_rows,
-                             computation_.matrices[m1].num_cols,
-                             kUndefined,
-                             computation_.matrices[m1].stride_type);
+        if (!InArena(m1))
+          matrices_[m1].Resize(computation_.matrices[m1].num_rows,
+                               computation_.matrices[m1].num_cols,
+                               kUndefined,
+                               computation_.matrices[m1].stride_type);
         break;
       case kDeallocMatrix:
         m1 = computation_.submatrices[c.arg1].matrix_index;
-        matrices_[m1].Resize(0, 0);
+        if (!InArena(m1))
+          matrices_[m1].Resize(0, 0);
         break;
       case kSwapMatrix:
         m1 = computation_.submatrices[c.arg1].matrix_index;
@@ -430,17 +753,20 @@ void NnetComputer::ExecuteCommand() {
         KALDI_ERR << "Invalid command in computation";
     }
   } catch (...) {
+    // In multi-threaded execution, more than one command may fail at once.
+    static std::mutex error_mutex;
+    std::lock_guard<std::mutex> lock(error_mutex);
     if (!debug_) {
       std::string preamble;
       computation_.GetCommandStrings(nnet_, &preamble, &command_strings_);
       KALDI_WARN << "Printing some background info since error was detected";
       KALDI_LOG << preamble;
-      for (int32 prev_c = 0; prev_c < program_counter_; prev_c++)
+      for (int32 prev_c = 0; prev_c < command; prev_c++)
         KALDI_LOG << command_strings_[prev_c];
     }
     // the following will re-throw the error, but now we've printed more info
     // about what went wrong.
-    KALDI_ERR << "Error running command " << command_strings_[program_counter_];
+    KALDI_ERR << "Error running command " << command_strings_[command];
   }
 }
 
@@ -449,11 +775,30 @@ CuSubMatrix<BaseFloat> NnetComputer::GetSubMatrix(int32 submatrix_index) {
                         computation_.submatrices.size());
   const NnetComputation::SubMatrixInfo &info =
       computation_.submatrices[submatrix_index];
+  if (InArena(info.matrix_index)) {
+    int32 stride = memory_plan_.strides[info.matrix_index];
+    const BaseFloat *data = arena_.Data() +
+        memory_plan_.offsets[info.matrix_index] +
+        static_cast<int64>(info.row_offset) * stride + info.col_offset;
+    return CuSubMatrix<BaseFloat>(data, info.num_rows, info.num_cols, stride);
+  }
   const CuMatrix<BaseFloat> &mat = matrices_[info.matrix_index];
   return CuSubMatrix<BaseFloat>(
       mat, info.row_offset, info.num_rows, info.col_offset, info.num_cols);
 }
 
+CuSubMatrix<BaseFloat> NnetComputer::GetMatrix(int32 matrix_index) {
+  if (InArena(matrix_index)) {
+    const NnetComputation::MatrixInfo &info =
+        computation_.matrices[matrix_index];
+    return CuSubMatrix<BaseFloat>(
+        arena_.Data() + memory_plan_.offsets[matrix_index], info.num_rows,
+        info.num_cols, memory_plan_.strides[matrix_index]);
+  }
+  const CuMatrix<BaseFloat> &mat = matrices_[matrix_index];
+  return CuSubMatrix<BaseFloat>(mat, 0, mat.NumRows(), 0, mat.NumCols());
+}
+
 void NnetComputer::GetPointers(int32 indexes_multi_index,
                                int32 num_cols,
                                CuArray<BaseFloat*> *pointers) {
@@ -527,9 +872,15 @@ void NnetComputer::Run() {
       // interaction, e.g. the end of the forward or backward phase.
       break;
     }
+    if (!block_end_.empty() && block_end_[program_counter_] != -1) {
+      int32 end = block_end_[program_counter_];
+      ExecuteBlockMultiThreaded(program_counter_);
+      program_counter_ = end - 1;  // the loop increments it.
+      continue;
+    }
     if (debug_)
       DebugBeforeExecute(program_counter_, &info);
-    ExecuteCommand();
+    ExecuteCommand(program_counter_);
     if (debug_) {
       double total_elapsed_now = timer.Elapsed();
       DebugAfterExecute(program_counter_, info,
@@ -588,6 +939,12 @@ void NnetComputer::GetOutputDestructive(const std::string &node_name,
   matrices_[matrix_index].Resize(0, 0);
 }
 
+CuMatrix<BaseFloat> &NnetComputer::GetComputationMatrix(int32 matrix_index) {
+  KALDI_ASSERT(static_cast<size_t>(matrix_index) < matrices_.size() &&
+               !InArena(matrix_index));
+  return matrices_[matrix_index];
+}
+
 
 void NnetComputer::CheckNoPendingIo() {
   const std::vector<NnetComputation::Command> &c = computation_.commands;
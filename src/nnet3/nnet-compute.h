@@ -25,6 +25,7 @@
 #include "nnet3/nnet-computation.h"
 #include "nnet3/nnet-analyze.h"
 #include "nnet3/nnet-example.h"
+#include "nnet3/nnet-memory-plan.h"
 
 #include <iostream>
 #include <sstream>
@@ -38,11 +39,28 @@ namespace nnet3 {
 
 struct NnetComputeOptions {
   bool debug;
-  NnetComputeOptions(): debug(false) { }
+  int32 num_threads;
+  bool use_memory_arena;
+  NnetComputeOptions(): debug(false), num_threads(1),
+                        use_memory_arena(false) { }
   void Register(OptionsItf *opts) {
     opts->Register("debug", &debug, "If true, turn on "
                    "debug for the neural net computation (very verbose!) "
                    "Will be turned on regardless if --verbose >= 5");
+    opts->Register("num-threads", &num_threads, "Number of threads used to "
+                   "execute the computation.  If >1, commands that do not "
+                   "depend on each other (e.g. the separate branches of a "
+                   "network) are run in parallel; the results are the same "
+                   "as with one thread.  Ignored if a GPU is used or if "
+                   "debug is on.");
+    opts->Register("use-memory-arena", &use_memory_arena, "If true, the "
+                   "matrices of the computation are placed in a single block "
+                   "of memory that is allocated once, with matrices that are "
+                   "not needed at the same time sharing memory (see "
+                   "nnet-memory-plan.h), instead of being allocated and freed "
+                   "as the computation runs.  It's on by default only in "
+                   "decoding, where the same computation is run for every "
+                   "chunk.");
   }
 
 };
@@ -124,6 +142,13 @@ class NnetComputer {
   void GetOutputDestructive(const std::string &output_name,
                             CuMatrix<BaseFloat> *output);
 
+  // Returns matrix 'matrix_index' of the computation, which will be empty if
+  // it is not currently allocated.  This is for code that saves and restores
+  // the state of individual sequences between the chunks of a looped
+  // computation (see RnnlmBatchComputer); the matrix must not be in the
+  // memory arena, so you will normally set use_memory_arena = false.
+  CuMatrix<BaseFloat> &GetComputationMatrix(int32 matrix_index);
+
 
   ~NnetComputer();
  private:
@@ -156,9 +181,16 @@ class NnetComputer {
   // command_strings_ is only used if debug_=true, or in case of error.
   std::vector<std::string> command_strings_;
 
-  // The matrices used in the computation.
+  // The matrices used in the computation.  The ones that are in the arena
+  // (see memory_plan_) are always empty here.
   std::vector<CuMatrix<BaseFloat> > matrices_;
 
+  // If options_.use_memory_arena is true, this says where in arena_ each
+  // matrix lives (if it is in the arena); otherwise its offsets are empty.
+  ComputationMemoryPlan memory_plan_;
+  // The memory for the matrices that are in the arena; allocated in Init().
+  CuVector<BaseFloat> arena_;
+
   // Memos returned by Propagate() that must be passed to the corresponding
   // Backprop() routines, indexed by memo-index (zeroth element always
   // NULL).
@@ -173,8 +205,41 @@ class NnetComputer {
   std::vector<CuCompressedMatrixBase*> compressed_matrices_;
 
 
-  // executes the command in computation_.commands[program_counter_].
-  void ExecuteCommand();
+  // executes the command in computation_.commands[command].  If it is
+  // kGotoLabel, it sets program_counter_.
+  void ExecuteCommand(int32 command);
+
+  // The following are only used if options_.num_threads > 1 and we are not
+  // using a GPU.  We divide the commands into blocks, separated by the I/O
+  // commands, labels, markers and gotos (which are executed as usual), and
+  // within each block we run the commands on several threads in an order
+  // consistent with the dependencies between them, which we work out from the
+  // variables they access (see ComputeCommandAttributes() in nnet-analyze.h).
+
+  // Called from Init(); sets up block_end_, command_successors_ and
+  // command_num_predecessors_.
+  void InitMultiThreaded();
+
+  // Executes the commands from 'begin' to block_end_[begin] - 1 using up to
+  // options_.num_threads threads: the calling thread and helper threads from
+  // a pool shared by all NnetComputer objects.
+  void ExecuteBlockMultiThreaded(int32 begin);
+
+  // The state shared by the threads executing a block; defined in the .cc.
+  struct BlockState;
+  // This is the function each thread runs in ExecuteBlockMultiThreaded().
+  void ExecuteBlockWorker(BlockState *state);
+
+  // If a block that is worth running multi-threaded starts at command c,
+  // block_end_[c] is the end of the block (one past its last command);
+  // otherwise it is -1.  Empty if we are not running multi-threaded.
+  std::vector<int32> block_end_;
+  // command_successors_[c] lists the commands in the same block as command c
+  // that cannot be started until c has finished.
+  std::vector<std::vector<int32> > command_successors_;
+  // command_num_predecessors_[c] is the number of commands in the same block
+  // as command c that have to finish before c can be started.
+  std::vector<int32> command_num_predecessors_;
 
   // Returns the matrix index where the input (if is_output==false) or output
   // matrix index for "node_name" is stored.  This looks at the next command (at
@@ -195,6 +260,16 @@ class NnetComputer {
 
   CuSubMatrix<BaseFloat> GetSubMatrix(int32 submatrix_index);
 
+  // Returns true if matrix 'matrix_index' lives in arena_.
+  inline bool InArena(int32 matrix_index) const {
+    return !memory_plan_.offsets.empty() &&
+        memory_plan_.offsets[matrix_index] != -1;
+  }
+
+  // Returns the whole of matrix 'matrix_index' (which may be empty if it is
+  // not currently allocated).
+  CuSubMatrix<BaseFloat> GetMatrix(int32 matrix_index);
+
   void GetPointers(int32 indexes_multi_index,
                    int32 num_cols,
                    CuArray<BaseFloat*> *pointers);
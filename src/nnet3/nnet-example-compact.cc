@@ -0,0 +1,445 @@
+// nnet3/nnet-example-compact.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/nnet-example-compact.h"
+#include "util/stl-utils.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// The version of the format that we write; we can read versions <= this.
+static const int32 kCompactEgsVersion = 1;
+
+// The functions below do the parts of the reading and writing that depend on
+// the type of the example.
+
+static const char *CompactEgsType(const NnetExample &eg) {
+  return "NnetExample";
+}
+
+static const char *CompactEgsType(const NnetChainExample &eg) {
+  return "NnetChainExample";
+}
+
+static void WriteIoStructure(std::ostream &os, bool binary,
+                             const std::string &name,
+                             const std::vector<Index> &indexes) {
+  WriteToken(os, binary, name);
+  WriteIndexVector(os, binary, indexes);
+}
+
+static void ReadIoStructure(std::istream &is, bool binary,
+                            std::string *name,
+                            std::vector<Index> *indexes) {
+  ReadToken(is, binary, name);
+  ReadIndexVector(is, binary, indexes);
+}
+
+static void WriteStructure(std::ostream &os, bool binary,
+                           const NnetExample &eg) {
+  WriteToken(os, binary, "<NumIo>");
+  int32 size = eg.io.size();
+  WriteBasicType(os, binary, size);
+  for (int32 i = 0; i < size; i++)
+    WriteIoStructure(os, binary, eg.io[i].name, eg.io[i].indexes);
+}
+
+static void ReadStructure(std::istream &is, bool binary,
+                          NnetExample *eg) {
+  ExpectToken(is, binary, "<NumIo>");
+  int32 size;
+  ReadBasicType(is, binary, &size);
+  if (size < 0 || size > 1000000)
+    KALDI_ERR << "Invalid size " << size;
+  eg->io.resize(size);
+  for (int32 i = 0; i < size; i++)
+    ReadIoStructure(is, binary, &(eg->io[i].name), &(eg->io[i].indexes));
+}
+
+static void WriteStructure(std::ostream &os, bool binary,
+                           const NnetChainExample &eg) {
+  WriteToken(os, binary, "<NumInputs>");
+  int32 size = eg.inputs.size();
+  WriteBasicType(os, binary, size);
+  for (int32 i = 0; i < size; i++)
+    WriteIoStructure(os, binary, eg.inputs[i].name, eg.inputs[i].indexes);
+  WriteToken(os, binary, "<NumOutputs>");
+  size = eg.outputs.size();
+  WriteBasicType(os, binary, size);
+  for (int32 i = 0; i < size; i++)
+    WriteIoStructure(os, binary, eg.outputs[i].name, eg.outputs[i].indexes);
+}
+
+static void ReadStructure(std::istream &is, bool binary,
+                          NnetChainExample *eg) {
+  ExpectToken(is, binary, "<NumInputs>");
+  int32 size;
+  ReadBasicType(is, binary, &size);
+  if (size < 0 || size > 1000000)
+    KALDI_ERR << "Invalid size " << size;
+  eg->inputs.resize(size);
+  for (int32 i = 0; i < size; i++)
+    ReadIoStructure(is, binary, &(eg->inputs[i].name),
+                    &(eg->inputs[i].indexes));
+  ExpectToken(is, binary, "<NumOutputs>");
+  ReadBasicType(is, binary, &size);
+  if (size < 0 || size > 1000000)
+    KALDI_ERR << "Invalid size " << size;
+  eg->outputs.resize(size);
+  for (int32 i = 0; i < size; i++)
+    ReadIoStructure(is, binary, &(eg->outputs[i].name),
+                    &(eg->outputs[i].indexes));
+}
+
+static void WriteData(std::ostream &os, bool binary,
+                      const NnetExample &eg) {
+  for (size_t i = 0; i < eg.io.size(); i++)
+    eg.io[i].features.Write(os, binary);
+}
+
+// Reads the features of an NnetIo whose name and indexes are copied from
+// 'structure'.
+static void ReadIoData(std::istream &is, bool binary,
+                       const NnetIo &structure, NnetIo *io) {
+  if (io->name != structure.name)
+    io->name = structure.name;
+  // This reuses the memory of io->indexes, which will normally be of the
+  // right size already.
+  io->indexes = structure.indexes;
+  io->features.Read(is, binary);
+  if (io->features.NumRows() != static_cast<int32>(io->indexes.size()))
+    KALDI_ERR << "Mismatch in number of rows of features ("
+              << io->features.NumRows() << ") versus indexes ("
+              << io->indexes.size() << ")";
+}
+
+static void ReadData(std::istream &is, bool binary,
+                     const NnetExample &structure, NnetExample *eg) {
+  size_t size = structure.io.size();
+  eg->io.resize(size);
+  for (size_t i = 0; i < size; i++)
+    ReadIoData(is, binary, structure.io[i], &(eg->io[i]));
+}
+
+static void WriteData(std::ostream &os, bool binary,
+                      const NnetChainExample &eg) {
+  for (size_t i = 0; i < eg.inputs.size(); i++)
+    eg.inputs[i].features.Write(os, binary);
+  for (size_t i = 0; i < eg.outputs.size(); i++) {
+    eg.outputs[i].supervision.Write(os, binary);
+    eg.outputs[i].deriv_weights.Write(os, binary);
+  }
+}
+
+static void ReadData(std::istream &is, bool binary,
+                     const NnetChainExample &structure,
+                     NnetChainExample *eg) {
+  size_t size = structure.inputs.size();
+  eg->inputs.resize(size);
+  for (size_t i = 0; i < size; i++)
+    ReadIoData(is, binary, structure.inputs[i], &(eg->inputs[i]));
+  size = structure.outputs.size();
+  eg->outputs.resize(size);
+  for (size_t i = 0; i < size; i++) {
+    const NnetChainSupervision &sup_structure = structure.outputs[i];
+    NnetChainSupervision &sup = eg->outputs[i];
+    if (sup.name != sup_structure.name)
+      sup.name = sup_structure.name;
+    sup.indexes = sup_structure.indexes;
+    sup.supervision.Read(is, binary);
+    sup.deriv_weights.Read(is, binary);
+    sup.CheckDim();
+  }
+}
+
+
+template<class Example>
+CompactEgsWriter<Example>::CompactEgsWriter(const std::string &wxfilename,
+                                            bool binary):
+    binary_(binary), num_written_(0) {
+  Open(wxfilename, binary);
+}
+
+template<class Example>
+void CompactEgsWriter<Example>::Open(const std::string &wxfilename,
+                                     bool binary) {
+  if (IsOpen())
+    Close();
+  binary_ = binary;
+  num_written_ = 0;
+  output_.Open(wxfilename, binary, true);
+  std::ostream &os = output_.Stream();
+  WriteToken(os, binary_, "<CompactEgs>");
+  WriteToken(os, binary_, "<Version>");
+  WriteBasicType(os, binary_, kCompactEgsVersion);
+  WriteToken(os, binary_, "<Type>");
+  WriteToken(os, binary_, CompactEgsType(Example()));
+  if (!binary_) os << '\n';
+}
+
+template<class Example>
+void CompactEgsWriter<Example>::Write(const std::string &key,
+                                      const Example &eg) {
+  KALDI_ASSERT(IsOpen());
+  if (!IsToken(key))
+    KALDI_ERR << "Invalid key '" << key << "'";
+  std::ostream &os = output_.Stream();
+  int32 id;
+  typename unordered_map<const Example*, int32, Hasher, Compare>::iterator
+      iter = structures_.find(&eg);
+  if (iter == structures_.end()) {
+    id = structures_.size();
+    // We keep a copy of the whole example, as the structure comparison looks
+    // at the feature dimensions too.  There are normally only a few distinct
+    // structures.
+    structures_[new Example(eg)] = id;
+    WriteToken(os, binary_, "<Structure>");
+    WriteBasicType(os, binary_, id);
+    WriteStructure(os, binary_, eg);
+    if (!binary_) os << '\n';
+  } else {
+    id = iter->second;
+  }
+  WriteToken(os, binary_, "<Eg>");
+  WriteToken(os, binary_, key);
+  WriteBasicType(os, binary_, id);
+  WriteData(os, binary_, eg);
+  if (!binary_) os << '\n';
+  if (!os.good())
+    KALDI_ERR << "Error writing example " << key << " to compact egs file.";
+  num_written_++;
+}
+
+template<class Example>
+void CompactEgsWriter<Example>::ClearStructures() {
+  typename unordered_map<const Example*, int32, Hasher, Compare>::iterator
+      iter = structures_.begin(), end = structures_.end();
+  for (; iter != end; ++iter)
+    delete iter->first;
+  structures_.clear();
+}
+
+template<class Example>
+void CompactEgsWriter<Example>::Close() {
+  if (!IsOpen())
+    return;
+  WriteToken(output_.Stream(), binary_, "</CompactEgs>");
+  if (!binary_) output_.Stream() << '\n';
+  ClearStructures();
+  if (!output_.Close())
+    KALDI_ERR << "Error closing compact egs file.";
+}
+
+template<class Example>
+CompactEgsWriter<Example>::~CompactEgsWriter() {
+  Close();
+}
+
+
+template<class Example>
+SequentialCompactEgsReader<Example>::SequentialCompactEgsReader(
+    const std::string &rxfilename): binary_(true), done_(true) {
+  Open(rxfilename);
+}
+
+template<class Example>
+void SequentialCompactEgsReader<Example>::Open(const std::string &rxfilename) {
+  Close();
+  rxfilename_ = rxfilename;
+  if (!input_.Open(rxfilename, &binary_))
+    KALDI_ERR << "Error opening compact egs file "
+              << PrintableRxfilename(rxfilename);
+  std::istream &is = input_.Stream();
+  ExpectToken(is, binary_, "<CompactEgs>");
+  ExpectToken(is, binary_, "<Version>");
+  int32 version;
+  ReadBasicType(is, binary_, &version);
+  if (version < 1 || version > kCompactEgsVersion)
+    KALDI_ERR << "Compact egs file " << PrintableRxfilename(rxfilename)
+              << " has version " << version << ", but we can only read "
+              << "versions up to " << kCompactEgsVersion
+              << "; you need newer code.";
+  ExpectToken(is, binary_, "<Type>");
+  std::string type;
+  ReadToken(is, binary_, &type);
+  if (type != CompactEgsType(Example()))
+    KALDI_ERR << "Compact egs file " << PrintableRxfilename(rxfilename)
+              << " contains examples of type " << type << ", expected "
+              << CompactEgsType(Example());
+  done_ = false;
+  Next();
+}
+
+template<class Example>
+const std::string &SequentialCompactEgsReader<Example>::Key() const {
+  KALDI_ASSERT(!done_);
+  return key_;
+}
+
+template<class Example>
+const Example &SequentialCompactEgsReader<Example>::Value() const {
+  KALDI_ASSERT(!done_);
+  return value_;
+}
+
+template<class Example>
+void SequentialCompactEgsReader<Example>::Next() {
+  KALDI_ASSERT(!done_);
+  std::istream &is = input_.Stream();
+  std::string token;
+  ReadToken(is, binary_, &token);
+  while (token == "<Structure>") {
+    int32 id;
+    ReadBasicType(is, binary_, &id);
+    if (id != static_cast<int32>(structures_.size()))
+      KALDI_ERR << "Unexpected structure id " << id << " in compact egs file "
+                << PrintableRxfilename(rxfilename_) << ", expected "
+                << structures_.size();
+    Example *structure = new Example();
+    structures_.push_back(structure);
+    ReadStructure(is, binary_, structure);
+    ReadToken(is, binary_, &token);
+  }
+  if (token == "</CompactEgs>") {
+    done_ = true;
+    key_.clear();
+    value_ = Example();
+    return;
+  }
+  if (token != "<Eg>")
+    KALDI_ERR << "Expected <Eg> in compact egs file "
+              << PrintableRxfilename(rxfilename_) << ", got " << token;
+  ReadToken(is, binary_, &key_);
+  int32 id;
+  ReadBasicType(is, binary_, &id);
+  if (id < 0 || id >= static_cast<int32>(structures_.size()))
+    KALDI_ERR << "Invalid structure id " << id << " for example " << key_
+              << " in compact egs file " << PrintableRxfilename(rxfilename_);
+  ReadData(is, binary_, *(structures_[id]), &value_);
+}
+
+template<class Example>
+void SequentialCompactEgsReader<Example>::ClearStructures() {
+  DeletePointers(&structures_);
+  structures_.clear();
+}
+
+template<class Example>
+void SequentialCompactEgsReader<Example>::Close() {
+  if (input_.IsOpen())
+    input_.Close();
+  ClearStructures();
+  done_ = true;
+  key_.clear();
+}
+
+template<class Example>
+SequentialCompactEgsReader<Example>::~SequentialCompactEgsReader() {
+  ClearStructures();
+}
+
+
+bool IsCompactEgsRspecifier(const std::string &rspecifier,
+                            std::string *rxfilename) {
+  const char *prefix = "compact:";
+  size_t prefix_len = strlen(prefix);
+  if (rspecifier.compare(0, prefix_len, prefix) != 0)
+    return false;
+  if (rxfilename != NULL)
+    *rxfilename = rspecifier.substr(prefix_len);
+  return true;
+}
+
+template<class Example>
+SequentialEgsReader<Example>::SequentialEgsReader(
+    const std::string &rspecifier): compact_reader_(NULL),
+                                    table_reader_(NULL) {
+  Open(rspecifier);
+}
+
+template<class Example>
+void SequentialEgsReader<Example>::Open(const std::string &rspecifier) {
+  Close();
+  std::string rxfilename;
+  if (IsCompactEgsRspecifier(rspecifier, &rxfilename)) {
+    compact_reader_ = new SequentialCompactEgsReader<Example>(rxfilename);
+  } else {
+    table_reader_ = new SequentialTableReader<KaldiObjectHolder<Example> >();
+    if (!table_reader_->Open(rspecifier))
+      KALDI_ERR << "Error opening examples from " << rspecifier;
+  }
+}
+
+template<class Example>
+bool SequentialEgsReader<Example>::Done() {
+  if (compact_reader_ != NULL)
+    return compact_reader_->Done();
+  KALDI_ASSERT(table_reader_ != NULL);
+  return table_reader_->Done();
+}
+
+template<class Example>
+const std::string &SequentialEgsReader<Example>::Key() {
+  if (compact_reader_ != NULL)
+    return compact_reader_->Key();
+  KALDI_ASSERT(table_reader_ != NULL);
+  return table_reader_->Key();
+}
+
+template<class Example>
+const Example &SequentialEgsReader<Example>::Value() {
+  if (compact_reader_ != NULL)
+    return compact_reader_->Value();
+  KALDI_ASSERT(table_reader_ != NULL);
+  return table_reader_->Value();
+}
+
+template<class Example>
+void SequentialEgsReader<Example>::Next() {
+  if (compact_reader_ != NULL) {
+    compact_reader_->Next();
+  } else {
+    KALDI_ASSERT(table_reader_ != NULL);
+    table_reader_->Next();
+  }
+}
+
+template<class Example>
+void SequentialEgsReader<Example>::Close() {
+  delete compact_reader_;
+  compact_reader_ = NULL;
+  if (table_reader_ != NULL) {
+    bool ok = !table_reader_->IsOpen() || table_reader_->Close();
+    delete table_reader_;
+    table_reader_ = NULL;
+    if (!ok)
+      KALDI_ERR << "Error detected reading examples (corrupt or truncated "
+                << "archive?)";
+  }
+}
+
+
+template class CompactEgsWriter<NnetExample>;
+template class CompactEgsWriter<NnetChainExample>;
+template class SequentialCompactEgsReader<NnetExample>;
+template class SequentialCompactEgsReader<NnetChainExample>;
+template class SequentialEgsReader<NnetExample>;
+template class SequentialEgsReader<NnetChainExample>;
+
+
+} // namespace nnet3
+} // namespace kaldi
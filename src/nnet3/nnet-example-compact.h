@@ -0,0 +1,212 @@
+// nnet3/nnet-example-compact.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_EXAMPLE_COMPACT_H_
+#define KALDI_NNET3_NNET_EXAMPLE_COMPACT_H_
+
+#include <type_traits>
+#include "nnet3/nnet-example.h"
+#include "nnet3/nnet-chain-example.h"
+#include "util/kaldi-io.h"
+#include "util/kaldi-table.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+/**
+   The "compact egs" format is an alternative to archives of NnetExample or
+   NnetChainExample (as written by e.g. nnet3-merge-egs) in which the
+   "structure" of the examples-- the names of the inputs and outputs and their
+   vectors of Index-- is written only once for each distinct structure, and the
+   examples refer to it by an integer id.  After merging, all minibatches of a
+   given size normally have the same structure, and reading the Index vectors
+   (which are run-length encoded, see WriteIndexVector()) otherwise dominates
+   the time to read the examples.
+
+   A compact egs file is a single stream (not a Table), and looks like this:
+
+     <CompactEgs> <Version> 1 <Type> NnetExample
+       <Structure> 0 <NumIo> 2 input <I1V> ... output <I1V> ...
+       <Eg> eg-key-1 0 [features of input] [features of output]
+       <Eg> eg-key-2 0 ...
+       <Structure> 1 ...
+       <Eg> eg-key-3 1 ...
+     </CompactEgs>
+
+   where a structure is written just before the first example that uses it.
+   For NnetChainExample (<Type> NnetChainExample), a structure contains the
+   names and indexes of the inputs and then of the outputs, and an example
+   contains the features of the inputs followed by the supervision and the
+   deriv-weights of the outputs.  The structure is defined by
+   NnetExampleStructureHasher / NnetChainExampleStructureHasher and the
+   corresponding Compare classes, i.e. it also includes the feature dimensions
+   of the inputs.
+
+   Use nnet3-compact-egs to convert archives to and from this format.  The
+   programs that read examples through SequentialEgsReader (e.g. nnet3-train,
+   nnet3-chain-train and nnet3-merge-egs, via ExamplePipeline or directly) read
+   a compact egs file if it is given as "compact:<rxfilename>" in place of the
+   egs rspecifier, e.g. "compact:1.cegs" or "compact:-".
+*/
+
+/// Writes examples in the compact egs format; Example may be NnetExample or
+/// NnetChainExample.
+template<class Example>
+class CompactEgsWriter {
+ public:
+  CompactEgsWriter(): binary_(true), num_written_(0) { }
+
+  /// Calls Open(wxfilename, binary).
+  CompactEgsWriter(const std::string &wxfilename, bool binary = true);
+
+  /// Opens the file and writes the header.  Crashes on failure.
+  void Open(const std::string &wxfilename, bool binary = true);
+
+  void Write(const std::string &key, const Example &eg);
+
+  /// Writes the terminating token and closes the file.  Crashes on failure.
+  /// Called from the destructor if you didn't call it.
+  void Close();
+
+  bool IsOpen() { return output_.IsOpen(); }
+
+  int64 NumWritten() const { return num_written_; }
+
+  int32 NumStructures() const { return structures_.size(); }
+
+  ~CompactEgsWriter();
+ private:
+  typedef typename std::conditional<
+    std::is_same<Example, NnetExample>::value,
+    NnetExampleStructureHasher, NnetChainExampleStructureHasher>::type Hasher;
+  typedef typename std::conditional<
+    std::is_same<Example, NnetExample>::value,
+    NnetExampleStructureCompare, NnetChainExampleStructureCompare>::type
+    Compare;
+
+  void ClearStructures();
+
+  Output output_;
+  bool binary_;
+  // Maps from (a copy of) the first example with each structure to the id of
+  // the structure.  We own the pointers.
+  unordered_map<const Example*, int32, Hasher, Compare> structures_;
+  int64 num_written_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(CompactEgsWriter);
+};
+
+
+/// Reads examples in the compact egs format; it has the same interface as a
+/// SequentialTableReader, except that it is opened with an rxfilename instead
+/// of an rspecifier.  Example may be NnetExample or NnetChainExample.
+template<class Example>
+class SequentialCompactEgsReader {
+ public:
+  SequentialCompactEgsReader(): binary_(true), done_(true) { }
+
+  /// Calls Open(rxfilename).
+  explicit SequentialCompactEgsReader(const std::string &rxfilename);
+
+  /// Opens the file, checks the header and reads the first example.  Crashes
+  /// on failure.
+  void Open(const std::string &rxfilename);
+
+  bool Done() const { return done_; }
+
+  const std::string &Key() const;
+
+  const Example &Value() const;
+
+  /// Reads the next example.  Crashes if the file is corrupted or truncated.
+  void Next();
+
+  void Close();
+
+  ~SequentialCompactEgsReader();
+ private:
+  void ClearStructures();
+
+  Input input_;
+  bool binary_;
+  bool done_;
+  std::string rxfilename_;
+  std::string key_;
+  Example value_;
+  // Indexed by structure id; contains only the names and indexes (and, for
+  // the outputs of NnetChainExample, nothing else).  We own the pointers.
+  std::vector<Example*> structures_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(SequentialCompactEgsReader);
+};
+
+/// Reads examples from either an archive or a compact egs file: if the
+/// rspecifier is of the form "compact:<rxfilename>", e.g. "compact:1.cegs", it
+/// reads the compact egs file <rxfilename> using SequentialCompactEgsReader;
+/// otherwise it reads the examples as a Table, like SequentialTableReader.
+/// This is what the training programs use to read examples.
+template<class Example>
+class SequentialEgsReader {
+ public:
+  SequentialEgsReader(): compact_reader_(NULL), table_reader_(NULL) { }
+
+  /// Calls Open(rspecifier).
+  explicit SequentialEgsReader(const std::string &rspecifier);
+
+  /// Opens the archive or compact egs file.  Crashes on failure.
+  void Open(const std::string &rspecifier);
+
+  bool Done();
+
+  const std::string &Key();
+
+  const Example &Value();
+
+  void Next();
+
+  /// Closes the reader.  Crashes if there was an error reading the archive
+  /// (e.g. if it was truncated), which SequentialTableReader reports by
+  /// Done() returning true.
+  void Close();
+
+  ~SequentialEgsReader() { Close(); }
+ private:
+  // Exactly one of these is non-NULL while the reader is open.
+  SequentialCompactEgsReader<Example> *compact_reader_;
+  SequentialTableReader<KaldiObjectHolder<Example> > *table_reader_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(SequentialEgsReader);
+};
+
+/// Returns true if 'rspecifier' is of the form "compact:<rxfilename>", in
+/// which case it outputs <rxfilename> to 'rxfilename' if it is non-NULL.
+bool IsCompactEgsRspecifier(const std::string &rspecifier,
+                            std::string *rxfilename = NULL);
+
+typedef CompactEgsWriter<NnetExample> CompactNnetExampleWriter;
+typedef CompactEgsWriter<NnetChainExample> CompactNnetChainExampleWriter;
+typedef SequentialCompactEgsReader<NnetExample> SequentialCompactNnetExampleReader;
+typedef SequentialCompactEgsReader<NnetChainExample>
+    SequentialCompactNnetChainExampleReader;
+typedef SequentialEgsReader<NnetExample> SequentialNnetEgsReader;
+typedef SequentialEgsReader<NnetChainExample> SequentialNnetChainEgsReader;
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+#endif // KALDI_NNET3_NNET_EXAMPLE_COMPACT_H_
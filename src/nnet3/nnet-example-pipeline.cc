@@ -0,0 +1,206 @@
+// nnet3/nnet-example-pipeline.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/nnet-example-pipeline.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+template<class Example, class Reader, class Merger>
+ExamplePipeline<Example, Reader, Merger>::ExamplePipeline(
+    const ExamplePipelineOptions &opts,
+    const std::string &examples_rspecifier):
+    opts_(opts), reader_(examples_rspecifier), merger_(NULL),
+    finished_(false), stop_(false) {
+  KALDI_ASSERT(opts_.shuffle_buffer_size >= 0 && opts_.prefetch >= 0);
+  if (opts_.merge_egs) {
+    opts_.merging_config.ComputeDerived();
+    merger_ = new Merger(opts_.merging_config, NULL);
+  }
+  if (opts_.prefetch > 0)
+    thread_ = std::thread(&ExamplePipeline::Run, this);
+}
+
+template<class Example, class Reader, class Merger>
+bool ExamplePipeline<Example, Reader, Merger>::Done() {
+  Wait();
+  std::unique_lock<std::mutex> lock(mutex_);
+  return queue_.empty();
+}
+
+template<class Example, class Reader, class Merger>
+const Example& ExamplePipeline<Example, Reader, Merger>::Value() {
+  Wait();
+  std::unique_lock<std::mutex> lock(mutex_);
+  KALDI_ASSERT(!queue_.empty());
+  return *(queue_.front());
+}
+
+template<class Example, class Reader, class Merger>
+void ExamplePipeline<Example, Reader, Merger>::Next() {
+  Wait();
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    KALDI_ASSERT(!queue_.empty());
+    delete queue_.front();
+    queue_.pop_front();
+  }
+  condition_.notify_all();
+}
+
+template<class Example, class Reader, class Merger>
+void ExamplePipeline<Example, Reader, Merger>::Wait() {
+  if (opts_.prefetch == 0) {
+    while (queue_.empty() && !finished_)
+      ProduceOne();
+    return;
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (queue_.empty() && !finished_)
+    condition_.wait(lock);
+  // We rethrow the exception itself, as KALDI_ERR throws with an empty
+  // message (it has already been logged).
+  if (error_)
+    std::rethrow_exception(error_);
+}
+
+template<class Example, class Reader, class Merger>
+void ExamplePipeline<Example, Reader, Merger>::Run() {
+  std::exception_ptr error;
+  try {
+    while (ProduceOne());
+  } catch (...) {
+    error = std::current_exception();
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    finished_ = true;
+    error_ = error;
+  }
+  condition_.notify_all();
+}
+
+template<class Example, class Reader, class Merger>
+bool ExamplePipeline<Example, Reader, Merger>::ProduceOne() {
+  int32 buffer_size = opts_.shuffle_buffer_size;
+  if (!reader_.Done()) {
+    Example *eg = new Example(reader_.Value());
+    reader_.Next();
+    if (buffer_size > 0) {
+      if (shuffle_buffer_.size() < static_cast<size_t>(buffer_size)) {
+        shuffle_buffer_.push_back(eg);
+        return true;
+      }
+      // Output a randomly chosen example from the buffer, and put the new one
+      // in its place.
+      int32 index = RandInt(0, buffer_size - 1, &random_state_);
+      std::swap(eg, shuffle_buffer_[index]);
+    }
+    return ProcessExample(eg);
+  }
+  // We reached the end of the input.  Closing the reader throws if there was
+  // an error reading the archive, which otherwise would only be noticed in
+  // the destructor.
+  reader_.Close();
+  // Output the rest of the shuffle buffer in random order.
+  for (size_t i = shuffle_buffer_.size(); i > 0; i--) {
+    int32 index = RandInt(0, i - 1, &random_state_);
+    Example *eg = shuffle_buffer_[index];
+    shuffle_buffer_[index] = shuffle_buffer_[i - 1];
+    shuffle_buffer_.pop_back();
+    if (!ProcessExample(eg))
+      return false;
+  }
+  if (merger_ != NULL) {
+    merger_->Finish();
+    std::vector<Example*> merged_egs;
+    merger_->GetMergedExamples(&merged_egs);
+    for (size_t i = 0; i < merged_egs.size(); i++) {
+      if (!Output(merged_egs[i])) {
+        for (size_t j = i + 1; j < merged_egs.size(); j++)
+          delete merged_egs[j];
+        return false;
+      }
+    }
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    finished_ = true;
+  }
+  condition_.notify_all();
+  return false;
+}
+
+template<class Example, class Reader, class Merger>
+bool ExamplePipeline<Example, Reader, Merger>::ProcessExample(Example *eg) {
+  if (merger_ == NULL)
+    return Output(eg);
+  merger_->AcceptExample(eg);
+  std::vector<Example*> merged_egs;
+  merger_->GetMergedExamples(&merged_egs);
+  for (size_t i = 0; i < merged_egs.size(); i++) {
+    if (!Output(merged_egs[i])) {
+      for (size_t j = i + 1; j < merged_egs.size(); j++)
+        delete merged_egs[j];
+      return false;
+    }
+  }
+  return true;
+}
+
+template<class Example, class Reader, class Merger>
+bool ExamplePipeline<Example, Reader, Merger>::Output(Example *eg) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (opts_.prefetch > 0) {
+      while (queue_.size() >= static_cast<size_t>(opts_.prefetch) && !stop_)
+        condition_.wait(lock);
+    }
+    if (stop_) {
+      delete eg;
+      return false;
+    }
+    queue_.push_back(eg);
+  }
+  condition_.notify_all();
+  return true;
+}
+
+template<class Example, class Reader, class Merger>
+ExamplePipeline<Example, Reader, Merger>::~ExamplePipeline() {
+  if (thread_.joinable()) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    condition_.notify_all();
+    thread_.join();
+  }
+  DeletePointers(&shuffle_buffer_);
+  for (size_t i = 0; i < queue_.size(); i++)
+    delete queue_[i];
+  delete merger_;
+}
+
+template class ExamplePipeline<NnetExample, SequentialNnetEgsReader,
+                               ExampleMerger>;
+template class ExamplePipeline<NnetChainExample,
+                               SequentialNnetChainEgsReader,
+                               ChainExampleMerger>;
+
+} // namespace nnet3
+} // namespace kaldi
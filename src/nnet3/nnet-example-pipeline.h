@@ -0,0 +1,144 @@
+// nnet3/nnet-example-pipeline.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_EXAMPLE_PIPELINE_H_
+#define KALDI_NNET3_NNET_EXAMPLE_PIPELINE_H_
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include "nnet3/nnet-example-utils.h"
+#include "nnet3/nnet-chain-example.h"
+#include "nnet3/nnet-example-compact.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+struct ExamplePipelineOptions {
+  bool merge_egs;
+  int32 shuffle_buffer_size;
+  int32 prefetch;
+  ExampleMergingConfig merging_config;
+
+  ExamplePipelineOptions(const char *default_minibatch_size = "256"):
+      merge_egs(false), shuffle_buffer_size(0), prefetch(10),
+      merging_config(default_minibatch_size) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("merge-egs", &merge_egs, "If true, the input examples are "
+                   "not merged yet (e.g. as written by nnet3-get-egs), and "
+                   "are merged into minibatches in this program as "
+                   "nnet3-merge-egs would do (see --minibatch-size), instead "
+                   "of in the input pipeline.");
+    opts->Register("shuffle-buffer-size", &shuffle_buffer_size, "If >0, the "
+                   "order of the input examples is randomized (before merging) "
+                   "using a buffer of this many examples, as "
+                   "nnet3-shuffle-egs --buffer-size would do.");
+    opts->Register("prefetch", &prefetch, "Number of minibatches that are "
+                   "read (and shuffled and merged) ahead in a background "
+                   "thread.  If 0, everything is done in the main thread.");
+    merging_config.Register(opts);
+  }
+};
+
+
+/**
+   This class reads examples and gives you minibatches for training, doing what
+   the pipeline
+     nnet3-shuffle-egs --buffer-size=B ark:egs.ark ark:- | nnet3-merge-egs ark:- ark:-
+   would do, but without writing and reading the examples between programs,
+   and (with --prefetch > 0) in a background thread, so it overlaps with the
+   training.  It has the same interface as a SequentialTableReader, minus
+   Key(); it is instantiated for NnetExample and NnetChainExample, see the
+   typedefs below.  The examples are read with SequentialEgsReader, so
+   'examples_rspecifier' may also be a compact egs file given as
+   "compact:<rxfilename>" (see nnet-example-compact.h).
+
+   If neither --merge-egs nor --shuffle-buffer-size is given, it just reads the
+   examples.  When shuffling, we use our own random number generator, seeded
+   from rand() in the constructor, so the order is reproducible with --srand
+   even though it's done in another thread.
+ */
+template<class Example, class Reader, class Merger>
+class ExamplePipeline {
+ public:
+  ExamplePipeline(const ExamplePipelineOptions &opts,
+                  const std::string &examples_rspecifier);
+
+  bool Done();
+
+  const Example &Value();
+
+  void Next();
+
+  ~ExamplePipeline();
+ private:
+  // Makes sure that there is an example in queue_ or that we know that there
+  // are no more examples.  Throws if there was an error in the background
+  // thread.
+  void Wait();
+
+  // The main function of the background thread; calls ProduceOne() until it
+  // returns false, and catches exceptions.
+  void Run();
+
+  // Reads one example and processes it; or, at the end of the input, flushes
+  // the shuffle buffer and the merger, sets finished_ and returns false.  Also
+  // returns false if stop_ is set.
+  bool ProduceOne();
+
+  // Gives a shuffled example to the merger, or outputs it directly if we're
+  // not merging.  Takes ownership of 'eg'.  Returns false if stop_ is set.
+  bool ProcessExample(Example *eg);
+
+  // Adds 'eg' to queue_, waiting while the queue is full if we're using a
+  // background thread.  Takes ownership of 'eg'.  Returns false if stop_ is
+  // set.
+  bool Output(Example *eg);
+
+  ExamplePipelineOptions opts_;
+  Reader reader_;
+  // NULL if !opts_.merge_egs.
+  Merger *merger_;
+  std::vector<Example*> shuffle_buffer_;
+  RandomState random_state_;
+
+  std::thread thread_;
+  // Guards queue_, finished_, stop_ and error_.
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::deque<Example*> queue_;
+  // Set when all the examples have been put in the queue.
+  bool finished_;
+  // Set in the destructor to ask the background thread to exit.
+  bool stop_;
+  // The exception thrown in the background thread, if any.
+  std::exception_ptr error_;
+};
+
+typedef ExamplePipeline<NnetExample, SequentialNnetEgsReader,
+                        ExampleMerger> NnetExamplePipeline;
+typedef ExamplePipeline<NnetChainExample, SequentialNnetChainEgsReader,
+                        ChainExampleMerger> NnetChainExamplePipeline;
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+#endif // KALDI_NNET3_NNET_EXAMPLE_PIPELINE_H_
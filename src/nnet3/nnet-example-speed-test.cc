@@ -0,0 +1,107 @@
+// nnet3/nnet-example-speed-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <unistd.h>
+#include "nnet3/nnet-example.h"
+#include "nnet3/nnet-example-compact.h"
+#include "base/timer.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+static void CsvResult(std::string test, int dim, BaseFloat measure,
+                      std::string units) {
+  std::cout << test << "," << dim << "," << measure << "," << units << "\n";
+}
+
+// Creates an NnetIo like the ones we get after merging 'num_seqs' examples
+// with frames t_begin ... t_begin + num_frames - 1 each; if 'sparse' it
+// contains one-hot posteriors of dimension 'dim', else compressed features.
+static void GenerateMergedIo(const std::string &name, int32 num_seqs,
+                             int32 t_begin, int32 num_frames, int32 dim,
+                             bool sparse, NnetIo *io) {
+  io->name = name;
+  io->indexes.resize(num_seqs * num_frames);
+  for (int32 n = 0; n < num_seqs; n++)
+    for (int32 t = 0; t < num_frames; t++)
+      io->indexes[n * num_frames + t] = Index(n, t_begin + t);
+  if (sparse) {
+    Posterior post(num_seqs * num_frames);
+    for (size_t i = 0; i < post.size(); i++)
+      post[i].push_back(std::pair<int32, BaseFloat>(RandInt(0, dim - 1), 1.0));
+    SparseMatrix<BaseFloat> smat(dim, post);
+    io->features.SwapSparseMatrix(&smat);
+  } else {
+    Matrix<BaseFloat> feats(num_seqs * num_frames, dim);
+    feats.SetRandn();
+    io->features = feats;
+    io->features.Compress();
+  }
+}
+
+// Compares the time to read merged examples from an archive and from a compact
+// egs file.
+static void UnitTestCompactEgsSpeed(int32 minibatch_size) {
+  int32 num_egs = 200;
+  NnetExample eg;
+  eg.io.resize(3);
+  GenerateMergedIo("input", minibatch_size, -20, 48, 40, false, &(eg.io[0]));
+  GenerateMergedIo("ivector", minibatch_size, 0, 1, 100, false, &(eg.io[1]));
+  GenerateMergedIo("output", minibatch_size, 0, 8, 3000, true, &(eg.io[2]));
+  {
+    NnetExampleWriter writer("ark:tmp.egs");
+    CompactNnetExampleWriter compact_writer("tmp.cegs");
+    for (int32 i = 0; i < num_egs; i++) {
+      std::ostringstream key;
+      key << "eg-" << i;
+      writer.Write(key.str(), eg);
+      compact_writer.Write(key.str(), eg);
+    }
+  }
+  int64 num_indexes = 0;
+  Timer timer;
+  for (SequentialNnetExampleReader reader("ark:tmp.egs"); !reader.Done();
+       reader.Next())
+    num_indexes += reader.Value().io[0].indexes.size();
+  double archive_time = timer.Elapsed();
+  timer.Reset();
+  for (SequentialCompactNnetExampleReader reader("tmp.cegs"); !reader.Done();
+       reader.Next())
+    num_indexes -= reader.Value().io[0].indexes.size();
+  double compact_time = timer.Elapsed();
+  KALDI_ASSERT(num_indexes == 0);
+
+  CsvResult("read-egs-archive", minibatch_size, num_egs / archive_time,
+            "egs/s");
+  CsvResult("read-egs-compact", minibatch_size, num_egs / compact_time,
+            "egs/s");
+  unlink("tmp.egs");
+  unlink("tmp.cegs");
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::nnet3;
+  for (int32 minibatch_size = 64; minibatch_size <= 256; minibatch_size *= 2)
+    UnitTestCompactEgsSpeed(minibatch_size);
+  KALDI_LOG << "Nnet-example speed tests finished.";
+  return 0;
+}
@@ -17,6 +17,8 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <unistd.h>
+#include <fstream>
 #include "nnet3/nnet-nnet.h"
 #include "nnet3/nnet-compile.h"
 #include "nnet3/nnet-analyze.h"
@@ -25,6 +27,8 @@
 #include "nnet3/nnet-compute.h"
 #include "nnet3/nnet-example.h"
 #include "nnet3/nnet-example-utils.h"
+#include "nnet3/nnet-example-pipeline.h"
+#include "nnet3/nnet-example-compact.h"
 #include "base/kaldi-math.h"
 
 namespace kaldi {
@@ -95,7 +99,229 @@ void UnitTestNnetMergeExamples() {
   }
 }
 
+// Returns the sum of the input features of 'eg', which we use to check that
+// the examples come out of ExamplePipeline unchanged.
+static double SumOfInput(const NnetExample &eg) {
+  for (size_t i = 0; i < eg.io.size(); i++) {
+    if (eg.io[i].name == "input") {
+      Matrix<BaseFloat> feats;
+      eg.io[i].features.GetMatrix(&feats);
+      return feats.Sum();
+    }
+  }
+  KALDI_ERR << "No input in example.";
+  return 0.0;
+}
+
+void UnitTestExamplePipeline() {
+  int32 num_egs = RandInt(1, 40);
+  std::vector<double> input_sums;
+  {
+    NnetExampleWriter writer("ark:tmpf");
+    for (int32 i = 0; i < num_egs; i++) {
+      NnetExample eg;
+      GenerateSimpleNnetTrainingExample(2, 1, 1, 3, 5, 0, &eg);
+      input_sums.push_back(SumOfInput(eg));
+      std::ostringstream key;
+      key << "eg-" << i;
+      writer.Write(key.str(), eg);
+    }
+  }
+  std::sort(input_sums.begin(), input_sums.end());
+  for (int32 n = 0; n < 20; n++) {
+    ExamplePipelineOptions opts;
+    opts.merge_egs = (RandInt(0, 1) == 0);
+    // Examples with different structure are not merged together, so we allow
+    // smaller minibatches at the end to make sure no examples are discarded.
+    opts.merging_config.minibatch_size = "1:4";
+    opts.shuffle_buffer_size = RandInt(0, 1) * RandInt(1, 50);
+    opts.prefetch = RandInt(0, 3);
+    std::vector<double> output_sums;
+    int32 num_output = 0;
+    NnetExamplePipeline pipeline(opts, "ark:tmpf");
+    for (; !pipeline.Done(); pipeline.Next()) {
+      output_sums.push_back(SumOfInput(pipeline.Value()));
+      num_output++;
+    }
+    if (opts.merge_egs) {
+      KALDI_ASSERT(num_output * 4 >= num_egs && num_output <= num_egs);
+      double tot_input = 0.0, tot_output = 0.0;
+      for (size_t i = 0; i < input_sums.size(); i++)
+        tot_input += input_sums[i];
+      for (size_t i = 0; i < output_sums.size(); i++)
+        tot_output += output_sums[i];
+      KALDI_ASSERT(ApproxEqual(tot_input, tot_output));
+    } else {
+      KALDI_ASSERT(num_output == num_egs);
+      std::sort(output_sums.begin(), output_sums.end());
+      KALDI_ASSERT(input_sums == output_sums);
+    }
+  }
+  {
+    // Test destroying the pipeline before reading all the examples.
+    ExamplePipelineOptions opts;
+    opts.prefetch = 1;
+    NnetExamplePipeline pipeline(opts, "ark:tmpf");
+    KALDI_ASSERT(!pipeline.Done());
+  }
+  {
+    // Test that an error reading a truncated archive is not lost, whether it
+    // happens in the background thread or not.
+    std::string contents;
+    {
+      std::ifstream is("tmpf", std::ios::binary);
+      std::ostringstream os;
+      os << is.rdbuf();
+      contents = os.str();
+    }
+    {
+      std::ofstream os("tmpf", std::ios::binary);
+      os << contents.substr(0, contents.size() - 5);
+    }
+    for (int32 prefetch = 0; prefetch < 2; prefetch++) {
+      ExamplePipelineOptions opts;
+      opts.merge_egs = (RandInt(0, 1) == 0);
+      opts.merging_config.minibatch_size = "1:4";
+      opts.prefetch = prefetch;
+      bool threw = false;
+      try {
+        NnetExamplePipeline pipeline(opts, "ark:tmpf");
+        for (; !pipeline.Done(); pipeline.Next());
+      } catch (const std::exception &e) {
+        threw = true;
+      }
+      KALDI_ASSERT(threw);
+    }
+  }
+  unlink("tmpf");
+}
 
+void UnitTestCompactEgs() {
+  for (int32 n = 0; n < 10; n++) {
+    // We generate examples with a few different structures, so that most
+    // examples share their structure with an earlier one.
+    int32 num_structures = RandInt(1, 3), num_egs = RandInt(0, 20);
+    std::vector<NnetExample> templates(num_structures);
+    for (int32 s = 0; s < num_structures; s++)
+      GenerateSimpleNnetTrainingExample(RandInt(1, 10), RandInt(0, 5),
+                                        RandInt(0, 5), RandInt(1, 10), 5,
+                                        RandInt(-1, 2), &(templates[s]));
+    bool binary = (RandInt(0, 1) == 0);
+    std::vector<std::string> keys;
+    std::vector<NnetExample> egs(num_egs);
+    {
+      CompactNnetExampleWriter writer("tmpf", binary);
+      for (int32 i = 0; i < num_egs; i++) {
+        egs[i] = templates[RandInt(0, num_structures - 1)];
+        // Change the input features, keeping the structure.
+        Matrix<BaseFloat> feats;
+        egs[i].io[0].features.GetMatrix(&feats);
+        feats.SetRandn();
+        egs[i].io[0].features = feats;
+        std::ostringstream key;
+        key << "eg-" << i;
+        keys.push_back(key.str());
+        writer.Write(key.str(), egs[i]);
+      }
+      KALDI_ASSERT(writer.NumWritten() == num_egs &&
+                   writer.NumStructures() <= std::min(num_structures,
+                                                      num_egs));
+    }
+    // Read it back through SequentialEgsReader, as the training programs do.
+    int32 i = 0;
+    for (SequentialNnetEgsReader reader("compact:tmpf"); !reader.Done();
+         reader.Next(), i++) {
+      KALDI_ASSERT(i < num_egs && reader.Key() == keys[i]);
+      if (binary)
+        KALDI_ASSERT(reader.Value() == egs[i]);
+      KALDI_ASSERT(ExampleApproxEqual(reader.Value(), egs[i], 0.1));
+    }
+    KALDI_ASSERT(i == num_egs);
+  }
+  unlink("tmpf");
+}
+
+// Creates a chain example with 'num_sequences' sequences of
+// 'frames_per_sequence' frames each, whose supervision FST is a single linear
+// path with random labels.
+static void GenerateSimpleChainExample(int32 num_sequences,
+                                       int32 frames_per_sequence,
+                                       int32 input_dim, int32 label_dim,
+                                       NnetChainExample *eg) {
+  chain::Supervision supervision;
+  supervision.num_sequences = num_sequences;
+  supervision.frames_per_sequence = frames_per_sequence;
+  supervision.label_dim = label_dim;
+  int32 num_frames = num_sequences * frames_per_sequence;
+  fst::StdVectorFst::StateId state = supervision.fst.AddState();
+  supervision.fst.SetStart(state);
+  for (int32 t = 0; t < num_frames; t++) {
+    fst::StdVectorFst::StateId next_state = supervision.fst.AddState();
+    int32 label = RandInt(1, label_dim);
+    supervision.fst.AddArc(state, fst::StdArc(label, label,
+                                              fst::TropicalWeight::One(),
+                                              next_state));
+    state = next_state;
+  }
+  supervision.fst.SetFinal(state, fst::TropicalWeight::One());
+
+  Vector<BaseFloat> deriv_weights;
+  if (RandInt(0, 1) == 0) {
+    deriv_weights.Resize(num_frames);
+    deriv_weights.SetRandUniform();
+  }
+  eg->outputs.clear();
+  eg->outputs.push_back(NnetChainSupervision("output", supervision,
+                                             deriv_weights, 0, 1));
+  Matrix<BaseFloat> feats(frames_per_sequence, input_dim);
+  feats.SetRandn();
+  eg->inputs.clear();
+  eg->inputs.push_back(NnetIo("input", 0, feats));
+}
+
+void UnitTestCompactChainEgs() {
+  for (int32 n = 0; n < 10; n++) {
+    int32 num_structures = RandInt(1, 3), num_egs = RandInt(0, 20);
+    std::vector<NnetChainExample> templates(num_structures);
+    for (int32 s = 0; s < num_structures; s++)
+      GenerateSimpleChainExample(1, RandInt(2, 10), RandInt(1, 10),
+                                 RandInt(1, 5), &(templates[s]));
+    bool binary = (RandInt(0, 1) == 0);
+    std::vector<std::string> keys;
+    std::vector<NnetChainExample> egs(num_egs);
+    {
+      CompactNnetChainExampleWriter writer("tmpf", binary);
+      for (int32 i = 0; i < num_egs; i++) {
+        const NnetChainExample &src =
+            templates[RandInt(0, num_structures - 1)];
+        // Generate new data with the same structure as 'src'.
+        GenerateSimpleChainExample(
+            1, src.outputs[0].supervision.frames_per_sequence,
+            src.inputs[0].features.NumCols(),
+            src.outputs[0].supervision.label_dim, &(egs[i]));
+        std::ostringstream key;
+        key << "eg-" << i;
+        keys.push_back(key.str());
+        writer.Write(key.str(), egs[i]);
+      }
+      KALDI_ASSERT(writer.NumWritten() == num_egs);
+    }
+    int32 i = 0;
+    NnetChainExampleStructureCompare compare;
+    for (SequentialNnetChainEgsReader reader("compact:tmpf"); !reader.Done();
+         reader.Next(), i++) {
+      KALDI_ASSERT(i < num_egs && reader.Key() == keys[i]);
+      const NnetChainExample &eg = reader.Value();
+      KALDI_ASSERT(compare(eg, egs[i]));
+      if (binary)
+        KALDI_ASSERT(eg == egs[i]);
+      KALDI_ASSERT(eg.outputs[0].supervision.fst.NumStates() ==
+                   egs[i].outputs[0].supervision.fst.NumStates());
+    }
+    KALDI_ASSERT(i == num_egs);
+  }
+  unlink("tmpf");
+}
 
 } // namespace nnet3
 } // namespace kaldi
@@ -106,6 +332,9 @@ int main() {
 
   UnitTestNnetExample();
   UnitTestNnetMergeExamples();
+  UnitTestExamplePipeline();
+  UnitTestCompactEgs();
+  UnitTestCompactChainEgs();
 
   KALDI_LOG << "Nnet-example tests succeeded.";
 
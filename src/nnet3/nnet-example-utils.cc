@@ -1229,6 +1229,13 @@ void ExampleMerger::WriteMinibatch(const std::vector<NnetExample> &egs) {
   size_t structure_hash = eg_hasher(egs[0]);
   int32 minibatch_size = egs.size();
   stats_.WroteExample(eg_size, structure_hash, minibatch_size);
+  if (writer_ == NULL) {
+    NnetExample *merged_eg = new NnetExample();
+    MergeExamples(egs, config_.compress, merged_eg);
+    merged_egs_.push_back(merged_eg);
+    num_egs_written_++;
+    return;
+  }
   NnetExample merged_eg;
   MergeExamples(egs, config_.compress, &merged_eg);
   std::ostringstream key;
@@ -1236,6 +1243,17 @@ void ExampleMerger::WriteMinibatch(const std::vector<NnetExample> &egs) {
   writer_->Write(key.str(), merged_eg);
 }
 
+void ExampleMerger::GetMergedExamples(std::vector<NnetExample*> *egs) {
+  KALDI_ASSERT(writer_ == NULL);
+  egs->insert(egs->end(), merged_egs_.begin(), merged_egs_.end());
+  merged_egs_.clear();
+}
+
+ExampleMerger::~ExampleMerger() {
+  Finish();
+  DeletePointers(&merged_egs_);
+}
+
 void ExampleMerger::Finish() {
   if (finished_) return;  // already finished.
   finished_ = true;
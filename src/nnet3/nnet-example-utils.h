@@ -479,6 +479,8 @@ class ExampleMergingStats {
 /// as defined by ExampleMergingConfig.
 class ExampleMerger {
  public:
+  // If 'writer' is NULL, the merged examples are not written out but kept in
+  // this object, and you can get them with GetMergedExamples().
   ExampleMerger(const ExampleMergingConfig &config,
                 NnetExampleWriter *writer);
 
@@ -497,7 +499,12 @@ class ExampleMerger {
   // returns a suitable exit status for a program.
   int32 ExitStatus() { Finish(); return (num_egs_written_ > 0 ? 0 : 1); }
 
-  ~ExampleMerger() { Finish(); };
+  // This is only applicable if the writer given to the constructor was NULL.
+  // It appends the merged examples produced so far to 'egs', and transfers
+  // their ownership to the caller.
+  void GetMergedExamples(std::vector<NnetExample*> *egs);
+
+  ~ExampleMerger();
  private:
   // called by Finish() and AcceptExample().  Merges, updates the
   // stats, and writes.
@@ -507,6 +514,9 @@ class ExampleMerger {
   int32 num_egs_written_;
   const ExampleMergingConfig &config_;
   NnetExampleWriter *writer_;
+  // The merged examples not yet collected by GetMergedExamples(), if writer_
+  // is NULL.
+  std::vector<NnetExample*> merged_egs_;
   ExampleMergingStats stats_;
 
   // Note: the "key" into the egs is the first element of the vector.
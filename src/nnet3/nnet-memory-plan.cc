@@ -0,0 +1,206 @@
+// nnet3/nnet-memory-plan.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include "nnet3/nnet-memory-plan.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// Rows of matrices with the default stride start at multiples of 16 bytes, as
+// in class Matrix, and matrices start at multiples of 64 bytes.
+static const int32 kRowAlignment = 16 / sizeof(BaseFloat),
+    kMatrixAlignment = 64 / sizeof(BaseFloat);
+
+static inline int64 RoundUp(int64 n, int64 alignment) {
+  return ((n + alignment - 1) / alignment) * alignment;
+}
+
+// Outputs, for each matrix that can go in the arena, the first and last
+// commands during which it is live; for the other matrices, both are -1.
+static void ComputeMatrixLifetimes(const NnetComputation &computation,
+                                   const std::vector<int32> &block_end,
+                                   std::vector<int32> *first_command,
+                                   std::vector<int32> *last_command) {
+  int32 num_matrices = computation.matrices.size(),
+      num_commands = computation.commands.size();
+  first_command->assign(num_matrices, -1);
+  last_command->assign(num_matrices, -1);
+  std::vector<bool> excluded(num_matrices, false);
+  // The first and last commands of the block that each command is in, where
+  // commands not in any multi-threaded block are in a block of their own.
+  std::vector<int32> block_first(num_commands), block_last(num_commands);
+  for (int32 c = 0; c < num_commands; c++)
+    block_first[c] = block_last[c] = c;
+  if (!block_end.empty()) {
+    KALDI_ASSERT(static_cast<int32>(block_end.size()) == num_commands);
+    for (int32 c = 0; c < num_commands; c++) {
+      if (block_end[c] == -1)
+        continue;
+      for (int32 d = c; d < block_end[c]; d++) {
+        block_first[d] = c;
+        block_last[d] = block_end[c] - 1;
+      }
+    }
+  }
+  for (int32 c = 0; c < num_commands; c++) {
+    const NnetComputation::Command &command = computation.commands[c];
+    switch (command.command_type) {
+      case kAllocMatrix: {
+        int32 m = computation.submatrices[command.arg1].matrix_index;
+        if ((*first_command)[m] != -1)
+          excluded[m] = true;
+        (*first_command)[m] = block_first[c];
+        break;
+      }
+      case kDeallocMatrix: {
+        int32 m = computation.submatrices[command.arg1].matrix_index;
+        if ((*last_command)[m] != -1)
+          excluded[m] = true;
+        (*last_command)[m] = block_last[c];
+        break;
+      }
+      case kSwapMatrix:
+        excluded[computation.submatrices[command.arg1].matrix_index] = true;
+        excluded[computation.submatrices[command.arg2].matrix_index] = true;
+        break;
+      case kCompressMatrix: case kDecompressMatrix:
+      case kAcceptInput: case kProvideOutput:
+        excluded[computation.submatrices[command.arg1].matrix_index] = true;
+        break;
+      default:
+        break;
+    }
+  }
+  for (int32 m = 0; m < num_matrices; m++) {
+    if (excluded[m] || (*first_command)[m] == -1 ||
+        (*last_command)[m] < (*first_command)[m]) {
+      (*first_command)[m] = -1;
+      (*last_command)[m] = -1;
+    }
+  }
+}
+
+// Returns the stride that matrix 'info' has in the arena.
+static int32 ArenaStride(const NnetComputation::MatrixInfo &info) {
+  if (info.stride_type == kStrideEqualNumCols)
+    return info.num_cols;
+  else
+    return RoundUp(info.num_cols, kRowAlignment);
+}
+
+void PlanComputationMemory(const NnetComputation &computation,
+                           const std::vector<int32> &block_end,
+                           ComputationMemoryPlan *plan) {
+  std::vector<int32> first_command, last_command;
+  ComputeMatrixLifetimes(computation, block_end,
+                         &first_command, &last_command);
+  int32 num_matrices = computation.matrices.size();
+  plan->offsets.assign(num_matrices, -1);
+  plan->strides.assign(num_matrices, 0);
+  plan->arena_size = 0;
+  plan->total_size = 0;
+
+  std::vector<int64> sizes(num_matrices, 0);
+  // pairs (-size, matrix-index), so that sorting puts the largest first.
+  std::vector<std::pair<int64, int32> > order;
+  for (int32 m = 0; m < num_matrices; m++) {
+    if (first_command[m] == -1)
+      continue;
+    const NnetComputation::MatrixInfo &info = computation.matrices[m];
+    int32 stride = ArenaStride(info);
+    sizes[m] = RoundUp(static_cast<int64>(info.num_rows) * stride,
+                       kMatrixAlignment);
+    if (sizes[m] == 0)
+      continue;
+    plan->strides[m] = stride;
+    order.push_back(std::pair<int64, int32>(-sizes[m], m));
+  }
+  std::sort(order.begin(), order.end());
+
+  std::vector<int32> placed;
+  // The regions of the arena used by the matrices already placed whose
+  // lifetimes overlap with that of the matrix we are placing.
+  std::vector<std::pair<int64, int64> > busy;
+  for (size_t i = 0; i < order.size(); i++) {
+    int32 m = order[i].second;
+    int64 size = sizes[m];
+    busy.clear();
+    for (size_t j = 0; j < placed.size(); j++) {
+      int32 p = placed[j];
+      if (first_command[p] <= last_command[m] &&
+          first_command[m] <= last_command[p])
+        busy.push_back(std::pair<int64, int64>(plan->offsets[p],
+                                               plan->offsets[p] + sizes[p]));
+    }
+    std::sort(busy.begin(), busy.end());
+    // Find the lowest gap that is large enough.
+    int64 offset = 0;
+    for (size_t j = 0; j < busy.size(); j++) {
+      if (busy[j].first >= offset + size)
+        break;
+      offset = std::max(offset, busy[j].second);
+    }
+    plan->offsets[m] = offset;
+    plan->arena_size = std::max(plan->arena_size, offset + size);
+    plan->total_size += size;
+    placed.push_back(m);
+  }
+}
+
+void CheckComputationMemoryPlan(const NnetComputation &computation,
+                                const std::vector<int32> &block_end,
+                                const ComputationMemoryPlan &plan) {
+  std::vector<int32> first_command, last_command;
+  ComputeMatrixLifetimes(computation, block_end,
+                         &first_command, &last_command);
+  int32 num_matrices = computation.matrices.size();
+  KALDI_ASSERT(static_cast<int32>(plan.offsets.size()) == num_matrices &&
+               static_cast<int32>(plan.strides.size()) == num_matrices);
+  std::vector<int64> end(num_matrices, -1);
+  for (int32 m = 0; m < num_matrices; m++) {
+    if (plan.offsets[m] == -1)
+      continue;
+    const NnetComputation::MatrixInfo &info = computation.matrices[m];
+    KALDI_ASSERT(first_command[m] != -1 && plan.offsets[m] >= 0 &&
+                 plan.strides[m] >= info.num_cols &&
+                 (info.stride_type == kDefaultStride ||
+                  plan.strides[m] == info.num_cols));
+    end[m] = plan.offsets[m] +
+        static_cast<int64>(info.num_rows) * plan.strides[m];
+    KALDI_ASSERT(end[m] <= plan.arena_size);
+  }
+  for (int32 m = 0; m < num_matrices; m++) {
+    if (plan.offsets[m] == -1)
+      continue;
+    for (int32 n = m + 1; n < num_matrices; n++) {
+      if (plan.offsets[n] == -1)
+        continue;
+      bool live_together = (first_command[m] <= last_command[n] &&
+                            first_command[n] <= last_command[m]),
+          share_memory = (plan.offsets[m] < end[n] &&
+                          plan.offsets[n] < end[m]);
+      if (live_together && share_memory)
+        KALDI_ERR << "Matrices " << m << " and " << n << " are live at the "
+                  << "same time but overlap in the arena.";
+    }
+  }
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
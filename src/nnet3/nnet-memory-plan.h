@@ -0,0 +1,97 @@
+// nnet3/nnet-memory-plan.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_MEMORY_PLAN_H_
+#define KALDI_NNET3_NNET_MEMORY_PLAN_H_
+
+#include <vector>
+#include "nnet3/nnet-computation.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+/**
+   @file nnet-memory-plan.h
+
+   This file contains a pass that plans, before a computation is run, where in
+   a single preallocated block of memory (the "arena") each of its matrices
+   will live.  Two matrices may share memory if they are never allocated at
+   the same time.  NnetComputer uses this (see
+   NnetComputeOptions::use_memory_arena) so that the kAllocMatrix and
+   kDeallocMatrix commands do no work; this matters most for looped
+   computations, which would otherwise allocate and free the same matrices
+   for every chunk.
+*/
+
+
+/// The output of PlanComputationMemory().
+struct ComputationMemoryPlan {
+  /// Indexed by matrix index: the offset of the matrix in the arena, in
+  /// elements of BaseFloat, or -1 if the matrix is not in the arena.  The
+  /// matrices not in the arena are those that are not both allocated by
+  /// kAllocMatrix and deallocated by kDeallocMatrix, and those that appear
+  /// in kSwapMatrix, kCompressMatrix, kDecompressMatrix, kAcceptInput or
+  /// kProvideOutput commands (e.g. the inputs and outputs, and the state
+  /// that looped computations carry from one chunk to the next).
+  std::vector<int64> offsets;
+  /// Indexed by matrix index: the row stride of the matrix in the arena (or
+  /// 0 if it is not in the arena).
+  std::vector<int32> strides;
+  /// The number of elements of BaseFloat the arena needs to have.
+  int64 arena_size;
+  /// The total size of the matrices in the arena, i.e. the memory they would
+  /// use if they did not share any; for diagnostics.
+  int64 total_size;
+
+  ComputationMemoryPlan(): arena_size(0), total_size(0) { }
+};
+
+/**
+   Works out an assignment of the matrices of 'computation' to offsets in an
+   arena such that matrices whose lifetimes (from their kAllocMatrix to their
+   kDeallocMatrix command) overlap do not overlap in memory.  We use the
+   "greedy by size" heuristic: the matrices are placed in order of decreasing
+   size, each at the lowest offset where it fits.
+
+     @param [in] computation  The computation; it may be a looped computation
+                         (with kGotoLabel), since the matrices that are live
+                         across iterations are never in the arena.
+     @param [in] block_end  Either empty, or (if the commands are to be run
+                         multi-threaded; see NnetComputer) a vector indexed by
+                         command, where if block_end[c] != -1 the commands
+                         c ... block_end[c] - 1 may run in any order consistent
+                         with their dependencies.  Matrices are then treated
+                         as live for the whole of any such block in which they
+                         are allocated or deallocated, because commands that
+                         access different matrices may run at the same time.
+     @param [out] plan   The plan.
+*/
+void PlanComputationMemory(const NnetComputation &computation,
+                           const std::vector<int32> &block_end,
+                           ComputationMemoryPlan *plan);
+
+/// Checks that no two matrices that are live at the same time overlap in the
+/// arena; crashes if the plan is not valid.  For testing.
+void CheckComputationMemoryPlan(const NnetComputation &computation,
+                                const std::vector<int32> &block_end,
+                                const ComputationMemoryPlan &plan);
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+#endif // KALDI_NNET3_NNET_MEMORY_PLAN_H_
@@ -0,0 +1,127 @@
+// nnet3/nnet-optimize-speed-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/nnet-nnet.h"
+#include "nnet3/nnet-optimize.h"
+#include "nnet3/nnet-compute.h"
+#include "nnet3/nnet-utils.h"
+#include "base/timer.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+static void CsvResult(std::string test, int dim, BaseFloat measure,
+                      std::string units) {
+  std::cout << test << "," << dim << "," << measure << "," << units << "\n";
+}
+
+// Returns the config of a TDNN-like network where each layer is an affine
+// component followed by ReLU, renormalization and a scale-and-offset, as in
+// our "relu-batchnorm" layers once the batch-norm has been collapsed into a
+// scale and offset.
+static std::string TdnnConfig(int32 input_dim, int32 hidden_dim,
+                              int32 num_layers) {
+  std::ostringstream os;
+  os << "input-node name=input dim=" << input_dim << "\n";
+  std::string input = "input";
+  int32 dim = input_dim;
+  for (int32 l = 1; l <= num_layers; l++) {
+    os << "component name=affine" << l << " type=AffineComponent input-dim="
+       << (3 * dim) << " output-dim=" << hidden_dim << "\n"
+       << "component-node name=affine" << l << " component=affine" << l
+       << " input=Append(Offset(" << input << ", -1), " << input
+       << ", Offset(" << input << ", 1))\n"
+       << "component name=relu" << l << " type=RectifiedLinearComponent dim="
+       << hidden_dim << "\n"
+       << "component-node name=relu" << l << " component=relu" << l
+       << " input=affine" << l << "\n"
+       << "component name=renorm" << l << " type=NormalizeComponent dim="
+       << hidden_dim << "\n"
+       << "component-node name=renorm" << l << " component=renorm" << l
+       << " input=relu" << l << "\n"
+       << "component name=scale" << l
+       << " type=ScaleAndOffsetComponent dim=" << hidden_dim << "\n"
+       << "component-node name=scale" << l << " component=scale" << l
+       << " input=renorm" << l << "\n";
+    std::ostringstream name;
+    name << "scale" << l;
+    input = name.str();
+    dim = hidden_dim;
+  }
+  os << "output-node name=output input=" << input << "\n";
+  return os.str();
+}
+
+// Times the forward computation of a TDNN on 'num_frames' frames, with and
+// without the fuse-elementwise optimization.
+static void UnitTestFuseElementwiseSpeed(int32 hidden_dim, int32 num_frames) {
+  int32 input_dim = 40, num_layers = 3;
+  Nnet nnet;
+  {
+    std::istringstream is(TdnnConfig(input_dim, hidden_dim, num_layers));
+    nnet.ReadConfig(is);
+  }
+  ComputationRequest request;
+  request.inputs.resize(1);
+  request.outputs.resize(1);
+  request.inputs[0].name = "input";
+  request.outputs[0].name = "output";
+  for (int32 t = -num_layers; t < num_frames + num_layers; t++)
+    request.inputs[0].indexes.push_back(Index(0, t));
+  for (int32 t = 0; t < num_frames; t++)
+    request.outputs[0].indexes.push_back(Index(0, t));
+  Matrix<BaseFloat> input(request.inputs[0].indexes.size(), input_dim);
+  input.SetRandn();
+
+  for (int32 fuse = 0; fuse <= 1; fuse++) {
+    NnetOptimizeOptions opt_config;
+    opt_config.fuse_elementwise = (fuse != 0);
+    CachingOptimizingCompiler compiler(nnet, opt_config);
+    const NnetComputation &computation = *compiler.Compile(request);
+    NnetComputeOptions compute_opts;
+    int32 num_runs = 10;
+    Timer timer;
+    for (int32 i = 0; i < num_runs; i++) {
+      NnetComputer computer(compute_opts, computation, nnet, NULL);
+      CuMatrix<BaseFloat> temp(input);
+      computer.AcceptInput("input", &temp);
+      computer.Run();
+    }
+    std::ostringstream name;
+    name << "Forward computation, " << num_frames << " frames, "
+         << (fuse ? "fuse-elementwise=true" : "fuse-elementwise=false")
+         << ", hidden-dim";
+    CsvResult(name.str(), hidden_dim,
+              1.0e+03 * timer.Elapsed() / num_runs, "milliseconds");
+  }
+}
+
+} // namespace nnet3
+} // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::nnet3;
+  Timer t;
+  UnitTestFuseElementwiseSpeed(256, 2000);
+  UnitTestFuseElementwiseSpeed(512, 2000);
+  UnitTestFuseElementwiseSpeed(1024, 2000);
+  UnitTestFuseElementwiseSpeed(1536, 2000);
+  KALDI_LOG << "Tests succeeded, total duration " << t.Elapsed()
+            << " seconds.";
+  return 0;
+}
@@ -22,6 +22,7 @@
 #include "nnet3/nnet-analyze.h"
 #include "nnet3/nnet-test-utils.h"
 #include "nnet3/nnet-optimize.h"
+#include "nnet3/nnet-optimize-utils.h"
 #include "nnet3/nnet-compute.h"
 
 namespace kaldi {
@@ -300,6 +301,151 @@ static void UnitTestNnetOptimize() {
   }
 }
 
+// This test checks that FuseElementwiseOps() does not change the output of a
+// computation; we use a small block size so that the short computations we
+// generate get split into several blocks.  The randomly generated networks
+// rarely have chains of element-wise components, so we use a TDNN-like
+// network.
+static void UnitTestFuseElementwiseOps() {
+  int32 num_fused = 0;
+  for (int32 n = 0; n < 20; n++) {
+    int32 input_dim = RandInt(5, 20), hidden_dim = RandInt(10, 100),
+        output_dim = RandInt(5, 50);
+    std::ostringstream config;
+    config << "input-node name=input dim=" << input_dim << "\n"
+           << "component name=affine1 type=NaturalGradientAffineComponent "
+           << "input-dim=" << (3 * input_dim) << " output-dim=" << hidden_dim
+           << "\n"
+           << "component-node name=affine1 component=affine1 "
+           << "input=Append(Offset(input, -1), input, Offset(input, 1))\n"
+           << "component name=relu1 type=RectifiedLinearComponent dim="
+           << hidden_dim << "\n"
+           << "component-node name=relu1 component=relu1 input=affine1\n"
+           << "component name=renorm1 type=NormalizeComponent dim="
+           << hidden_dim << "\n"
+           << "component-node name=renorm1 component=renorm1 input=relu1\n"
+           << "component name=affine2 type=AffineComponent input-dim="
+           << hidden_dim << " output-dim=" << hidden_dim << "\n"
+           << "component-node name=affine2 component=affine2 input=renorm1\n"
+           << "component name=sigmoid2 type=SigmoidComponent dim="
+           << hidden_dim << "\n"
+           << "component-node name=sigmoid2 component=sigmoid2 input=affine2\n"
+           << "component name=final-affine type=AffineComponent input-dim="
+           << hidden_dim << " output-dim=" << output_dim << "\n"
+           << "component-node name=final-affine component=final-affine "
+           << "input=sigmoid2\n"
+           << "component name=log-softmax type=LogSoftmaxComponent dim="
+           << output_dim << "\n"
+           << "component-node name=log-softmax component=log-softmax "
+           << "input=final-affine\n"
+           << "output-node name=output input=log-softmax\n";
+    Nnet nnet;
+    {
+      std::istringstream is(config.str());
+      nnet.ReadConfig(is);
+    }
+    ComputationRequest request;
+    std::vector<Matrix<BaseFloat> > inputs;
+    ComputeExampleComputationRequestSimple(nnet, &request, &inputs);
+    // FuseElementwiseOps() only does anything for computations without
+    // backprop.
+    for (size_t i = 0; i < request.inputs.size(); i++)
+      request.inputs[i].has_deriv = false;
+    for (size_t i = 0; i < request.outputs.size(); i++)
+      request.outputs[i].has_deriv = false;
+    request.need_model_derivative = false;
+    request.store_component_stats = false;
+
+    NnetComputation computation;
+    Compiler compiler(request, nnet);
+    CompilerOptions opts;
+    compiler.CreateComputation(opts, &computation);
+    NnetOptimizeOptions optimize_opts;
+    Optimize(optimize_opts, nnet, MaxOutputTimeInRequest(request),
+             &computation);
+    NnetComputation computation_fused(computation);
+    FuseElementwiseOps(nnet, RandInt(1, 500), &computation_fused);
+    CheckComputation(nnet, computation_fused, false);
+    if (computation_fused.commands.size() != computation.commands.size())
+      num_fused++;
+    computation.ComputeCudaIndexes();
+    computation_fused.ComputeCudaIndexes();
+
+    NnetComputeOptions compute_opts;
+    NnetComputer computer(compute_opts, computation, nnet, NULL),
+        computer_fused(compute_opts, computation_fused, nnet, NULL);
+    for (size_t i = 0; i < request.inputs.size(); i++) {
+      CuMatrix<BaseFloat> temp(inputs[i]), temp2(inputs[i]);
+      computer.AcceptInput(request.inputs[i].name, &temp);
+      computer_fused.AcceptInput(request.inputs[i].name, &temp2);
+    }
+    computer.Run();
+    computer_fused.Run();
+    const CuMatrixBase<BaseFloat> &output(computer.GetOutput("output")),
+        &output_fused(computer_fused.GetOutput("output"));
+    if (!ApproxEqual(output, output_fused))
+      KALDI_ERR << "Computations with and without FuseElementwiseOps() give "
+                << "different outputs: " << output << " vs. " << output_fused;
+  }
+  KALDI_LOG << "FuseElementwiseOps() changed " << num_fused
+            << " out of 20 computations.";
+  KALDI_ASSERT(num_fused > 0);
+}
+
+// This test checks that computations written to the on-disk cache by one
+// CachingOptimizingCompiler are read back by another, and that changing the
+// options means they're not used.
+static void UnitTestComputationDiskCache() {
+  for (int32 n = 0; n < 10; n++) {
+    struct NnetGenerationOptions gen_config;
+    std::vector<std::string> configs;
+    GenerateConfigSequence(gen_config, &configs);
+    Nnet nnet;
+    for (size_t j = 0; j < configs.size(); j++) {
+      std::istringstream is(configs[j]);
+      nnet.ReadConfig(is);
+    }
+    ComputationRequest request;
+    std::vector<Matrix<BaseFloat> > inputs;
+    ComputeExampleComputationRequestSimple(nnet, &request, &inputs);
+    std::vector<const ComputationRequest*> requests(1, &request);
+
+    NnetOptimizeOptions opt_config;
+    CachingOptimizingCompilerOptions compiler_config;
+    compiler_config.cache_dir = ".";
+    // with the shortcut, the computation for the 'mini' request would be
+    // cached too, and we'd have to clean that up.
+    compiler_config.use_shortcut = false;
+    ComputationDiskCache disk_cache(".", nnet, opt_config, "no-shortcut");
+    std::string filename = disk_cache.Filename(requests);
+    std::remove(filename.c_str());
+
+    std::string computation_str;
+    {
+      CachingOptimizingCompiler compiler(nnet, opt_config, compiler_config);
+      std::ostringstream os;
+      compiler.Compile(request)->Write(os, true);
+      computation_str = os.str();
+    }
+    NnetComputation computation;
+    KALDI_ASSERT(disk_cache.Read(requests, &computation));
+    {
+      // check that a new compiler gets the same computation.
+      CachingOptimizingCompiler compiler(nnet, opt_config, compiler_config);
+      std::ostringstream os;
+      compiler.Compile(request)->Write(os, true);
+      KALDI_ASSERT(os.str() == computation_str);
+    }
+    // different options or a different compilation type should not find it.
+    NnetOptimizeOptions opt_config2;
+    opt_config2.optimize_row_ops = false;
+    ComputationDiskCache disk_cache2(".", nnet, opt_config2, "no-shortcut");
+    KALDI_ASSERT(!disk_cache2.Read(requests, &computation));
+    ComputationDiskCache disk_cache3(".", nnet, opt_config, "shortcut");
+    KALDI_ASSERT(!disk_cache3.Read(requests, &computation));
+    KALDI_ASSERT(std::remove(filename.c_str()) == 0);
+  }
+}
 
 
 } // namespace nnet3
@@ -317,6 +463,8 @@ int main() {
   CuDevice::Instantiate().SelectGpuId("yes");
 #endif
   UnitTestNnetOptimize();
+  UnitTestFuseElementwiseOps();
+  UnitTestComputationDiskCache();
 
   KALDI_LOG << "Nnet tests succeeded.";
 
@@ -18,6 +18,7 @@
 // limitations under the License.
 
 #include <map>
+#include <unordered_set>
 #include "nnet3/nnet-optimize-utils.h"
 #include "nnet3/nnet-optimize.h"
 
@@ -4966,6 +4967,246 @@ std::shared_ptr<const NnetComputation> ComputationCache::Find(
 }
 
 
+/**
+   This class implements FuseElementwiseOps(); see its declaration for more
+   information.
+ */
+class ElementwiseOpFuser {
+ public:
+  ElementwiseOpFuser(const Nnet &nnet, int32 block_floats,
+                     NnetComputation *computation):
+      nnet_(nnet), block_floats_(block_floats), computation_(computation) { }
+
+  void Fuse() {
+    const std::vector<NnetComputation::Command> &commands =
+        computation_->commands;
+    int32 num_commands = commands.size();
+    for (int32 c = 0; c < num_commands; c++)
+      if (commands[c].command_type == kBackprop ||
+          commands[c].command_type == kBackpropNoModelUpdate)
+        return;  // this optimization is only for inference.
+
+    std::vector<NnetComputation::Command> new_commands;
+    new_commands.reserve(num_commands);
+    int32 c = 0;
+    while (c < num_commands) {
+      if (!IsRowWisePropagate(c)) {
+        new_commands.push_back(commands[c]);
+        c++;
+        continue;
+      }
+      Chain chain;
+      FindChain(c, &chain);
+      int32 num_rows = computation_->submatrices[commands[c].arg3].num_rows,
+          block_rows = GetBlockRows(chain);
+      if (num_rows <= block_rows || !IsCheapToSplit(c, block_rows)) {
+        new_commands.push_back(commands[c]);
+        c++;
+        continue;
+      }
+      int32 chain_length = 1;
+      while (chain_length < static_cast<int32>(chain.commands.size()) &&
+             IsCheapToSplit(chain.commands[chain_length], block_rows))
+        chain_length++;
+      if (chain_length == 1) {
+        new_commands.push_back(commands[c]);
+        c++;
+        continue;
+      }
+      // The allocation and zeroing commands go before the chain, and the
+      // deallocation commands after it.
+      for (int32 i = 1; i < chain_length; i++) {
+        for (size_t j = 0; j < chain.commands_between[i].size(); j++) {
+          const NnetComputation::Command &other =
+              commands[chain.commands_between[i][j]];
+          if (other.command_type != kDeallocMatrix)
+            new_commands.push_back(other);
+        }
+      }
+      for (int32 row = 0; row < num_rows; row += block_rows) {
+        int32 this_num_rows = std::min(block_rows, num_rows - row);
+        for (int32 i = 0; i < chain_length; i++) {
+          NnetComputation::Command command = commands[chain.commands[i]];
+          command.arg3 = GetBlockSubmatrix(command.arg3, row, this_num_rows);
+          command.arg4 = GetBlockSubmatrix(command.arg4, row, this_num_rows);
+          new_commands.push_back(command);
+        }
+      }
+      for (int32 i = 1; i < chain_length; i++) {
+        for (size_t j = 0; j < chain.commands_between[i].size(); j++) {
+          const NnetComputation::Command &other =
+              commands[chain.commands_between[i][j]];
+          if (other.command_type == kDeallocMatrix)
+            new_commands.push_back(other);
+        }
+      }
+      c = chain.commands[chain_length - 1] + 1;
+    }
+    computation_->commands.swap(new_commands);
+  }
+
+ private:
+  // A chain of kPropagate commands, each of which reads the output of the
+  // previous one.
+  struct Chain {
+    // The indexes of the kPropagate commands.
+    std::vector<int32> commands;
+    // commands_between[i], for i > 0, contains the indexes of the allocation,
+    // zeroing and deallocation commands between commands[i - 1] and
+    // commands[i].  commands_between[0] is empty.
+    std::vector<std::vector<int32> > commands_between;
+  };
+
+  // Returns true if command c is a kPropagate command for a component that
+  // acts on each row separately, so we can split it up by rows.
+  bool IsRowWisePropagate(int32 c) const {
+    const NnetComputation::Command &command = computation_->commands[c];
+    if (command.command_type != kPropagate || command.arg2 != 0 ||
+        command.arg5 != 0 || command.arg6 != 0)
+      return false;
+    int32 properties = nnet_.GetComponent(command.arg1)->Properties();
+    // kUsesMemo excludes things like batch-norm in training mode, which
+    // computes statistics over all the rows; we exclude random components
+    // (e.g. dropout in training mode) so the output does not depend on the
+    // block size.
+    return (properties & kSimpleComponent) && !(properties & kUsesMemo) &&
+        !(properties & kRandomComponent);
+  }
+
+  // Returns true if splitting the kPropagate command c into blocks of
+  // 'block_rows' rows is cheap, i.e. it is not a matrix operation whose
+  // parameters are larger than a block of its output (since the parameters
+  // have to be read once per block).
+  bool IsCheapToSplit(int32 c, int32 block_rows) const {
+    const Component *component =
+        nnet_.GetComponent(computation_->commands[c].arg1);
+    int64 num_params;
+    if (component->Properties() & kUpdatableComponent) {
+      num_params = dynamic_cast<const UpdatableComponent*>(
+          component)->NumParameters();
+    } else if (component->InputDim() != component->OutputDim()) {
+      // e.g. FixedAffineComponent; assume it's a matrix operation.
+      num_params = static_cast<int64>(component->InputDim()) *
+          component->OutputDim();
+    } else {
+      return true;  // an element-wise operation, or something like it.
+    }
+    return num_params <=
+        static_cast<int64>(block_rows) * component->OutputDim();
+  }
+
+  // Finds the longest chain of kPropagate commands starting at command c (see
+  // IsRowWisePropagate()) that we can run one block of rows at a time.
+  void FindChain(int32 c, Chain *chain) const {
+    const std::vector<NnetComputation::Command> &commands =
+        computation_->commands;
+    const std::vector<NnetComputation::SubMatrixInfo> &submatrices =
+        computation_->submatrices;
+    int32 num_commands = commands.size();
+    chain->commands.assign(1, c);
+    chain->commands_between.assign(1, std::vector<int32>());
+    // The row offset of the submatrices of each matrix used in the chain.  If
+    // two submatrices of the same matrix had different row offsets, running a
+    // block of one command could overwrite rows another block still needs.
+    unordered_map<int32, int32> row_offsets;
+    // The matrices deallocated between commands of the chain; the commands
+    // that follow must not use them, as the deallocation will be moved to
+    // after the chain.
+    std::unordered_set<int32> deallocated;
+    if (!AddSubmatrix(commands[c].arg3, &row_offsets) ||
+        !AddSubmatrix(commands[c].arg4, &row_offsets))
+      return;
+    int32 num_rows = submatrices[commands[c].arg3].num_rows;
+    while (true) {
+      int32 prev_c = chain->commands.back(), next_c = prev_c + 1;
+      std::vector<int32> between;
+      bool ok = true;
+      for (; next_c < num_commands && ok; next_c++) {
+        const NnetComputation::Command &command = commands[next_c];
+        CommandType type = command.command_type;
+        if (type != kAllocMatrix && type != kSetConst &&
+            type != kDeallocMatrix)
+          break;
+        int32 m = submatrices[command.arg1].matrix_index;
+        if (type == kDeallocMatrix) {
+          deallocated.insert(m);
+        } else if (row_offsets.count(m) != 0) {
+          // we can't move this before the chain, as the chain already uses
+          // this matrix.
+          ok = false;
+        }
+        between.push_back(next_c);
+      }
+      if (!ok || next_c == num_commands || !IsRowWisePropagate(next_c))
+        return;
+      const NnetComputation::Command &command = commands[next_c];
+      int32 output_matrix = submatrices[command.arg4].matrix_index;
+      if (command.arg3 != commands[prev_c].arg4 ||
+          submatrices[command.arg4].num_rows != num_rows ||
+          deallocated.count(output_matrix) != 0 ||
+          deallocated.count(submatrices[command.arg3].matrix_index) != 0 ||
+          !AddSubmatrix(command.arg4, &row_offsets))
+        return;
+      chain->commands.push_back(next_c);
+      chain->commands_between.push_back(between);
+    }
+  }
+
+  // Records the row offset of submatrix s in 'row_offsets' (indexed by matrix
+  // index); returns false if a submatrix of the same matrix with a different
+  // row offset was already recorded.
+  bool AddSubmatrix(int32 s, unordered_map<int32, int32> *row_offsets) const {
+    const NnetComputation::SubMatrixInfo &info = computation_->submatrices[s];
+    unordered_map<int32, int32>::iterator iter =
+        row_offsets->find(info.matrix_index);
+    if (iter == row_offsets->end()) {
+      (*row_offsets)[info.matrix_index] = info.row_offset;
+      return true;
+    }
+    return iter->second == info.row_offset;
+  }
+
+  // Returns the number of rows per block for this chain: as many as fit in
+  // block_floats_ for the widest submatrix, rounded down to a multiple of 8.
+  int32 GetBlockRows(const Chain &chain) const {
+    const std::vector<NnetComputation::SubMatrixInfo> &submatrices =
+        computation_->submatrices;
+    int32 max_cols =
+        submatrices[computation_->commands[chain.commands[0]].arg3].num_cols;
+    for (size_t i = 0; i < chain.commands.size(); i++)
+      max_cols = std::max(max_cols, submatrices[
+          computation_->commands[chain.commands[i]].arg4].num_cols);
+    return std::max<int32>(8, (block_floats_ / max_cols) / 8 * 8);
+  }
+
+  // Returns the index of a submatrix for rows [row, row + num_rows) of
+  // submatrix s (creating it if we have not already done so).
+  int32 GetBlockSubmatrix(int32 s, int32 row, int32 num_rows) {
+    std::pair<int32, int32> key(s, row);
+    std::map<std::pair<int32, int32>, int32>::iterator iter =
+        block_submatrices_.find(key);
+    if (iter != block_submatrices_.end())
+      return iter->second;
+    int32 ans = computation_->NewSubMatrix(s, row, num_rows, 0, -1);
+    block_submatrices_[key] = ans;
+    return ans;
+  }
+
+  const Nnet &nnet_;
+  int32 block_floats_;
+  NnetComputation *computation_;
+  // Maps from (submatrix index, row offset) to the submatrix for a block.
+  std::map<std::pair<int32, int32>, int32> block_submatrices_;
+};
+
+void FuseElementwiseOps(const Nnet &nnet, int32 block_floats,
+                        NnetComputation *computation) {
+  KALDI_ASSERT(block_floats > 0);
+  ElementwiseOpFuser fuser(nnet, block_floats, computation);
+  fuser.Fuse();
+}
+
+
 ComputationCache::ComputationCache(int32 cache_capacity):
     cache_capacity_(cache_capacity) {
   KALDI_ASSERT(cache_capacity > 0);
@@ -594,6 +594,29 @@ void OptimizeMemoryCompression(const Nnet &nnet,
                                NnetComputation *computation);
 
 
+/// This function, used for inference on CPU, reorders the work done by chains
+/// of kPropagate commands where each command takes its input from the output
+/// of the previous one and the components act on each row separately (simple
+/// components with no precomputed indexes, memos or stats; e.g. an affine
+/// component followed by ReLU, batch-norm and scale-and-offset components).
+/// Instead of each command reading and writing the whole matrix, the whole
+/// chain is run on one block of rows at a time, by splitting each command into
+/// one command per block, acting on submatrices; this keeps each block in
+/// cache between the commands.  The number of rows per block is chosen so
+/// that a block of the widest matrix in the chain has about 'block_floats'
+/// elements.  A component with a lot of parameters (like a
+/// large affine component) is only included at the start of a chain if
+/// re-reading its parameters for each block is cheap compared with the
+/// activations, and chains with no more rows than a block are left alone.
+/// Allocation, zeroing and deallocation commands between the commands of a
+/// chain are moved to before or after it.  Does nothing if the computation
+/// has any backprop commands.  The submatrices it creates can't be handled by
+/// ExpandComputation(), so don't use it for computations that are to be
+/// expanded.
+void FuseElementwiseOps(const Nnet &nnet, int32 block_floats,
+                        NnetComputation *computation);
+
+
 /// This function tries to optimize computation 'computation' for an 'looped'
 /// computation.  It expects as input a computation with no backprop but with
 /// multiple 'segments' separated by command kNoOperationLabel, where each
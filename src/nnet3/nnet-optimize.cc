@@ -18,7 +18,10 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstdio>
+#include <fstream>
 #include <iomanip>
+#include <random>
 #include "nnet3/nnet-optimize.h"
 #include "nnet3/nnet-optimize-utils.h"
 #include "nnet3/nnet-utils.h"
@@ -79,6 +82,10 @@ void NnetOptimizeOptions::Read(std::istream &is, bool binary) {
     ExpectToken(is, binary, "<MemoryCompressionLevel>");
     ReadBasicType(is, binary, &memory_compression_level);
   }
+  if (PeekToken(is, binary) == 'F') {
+    ExpectToken(is, binary, "<FuseElementwise>");
+    ReadBasicType(is, binary, &fuse_elementwise);
+  }
   ExpectToken(is, binary, "</NnetOptimizeOptions>");
 }
 
@@ -122,6 +129,8 @@ void NnetOptimizeOptions::Write(std::ostream &os, bool binary) const {
   WriteBasicType(os, binary, snip_row_ops);
   WriteToken(os, binary, "<MemoryCompressionLevel>");
   WriteBasicType(os, binary, memory_compression_level);
+  WriteToken(os, binary, "<FuseElementwise>");
+  WriteBasicType(os, binary, fuse_elementwise);
   WriteToken(os, binary, "</NnetOptimizeOptions>");
 }
 
@@ -143,7 +152,8 @@ bool NnetOptimizeOptions::operator == (const NnetOptimizeOptions &other) const {
           other.max_deriv_time == max_deriv_time &&
           other.max_deriv_time_relative == max_deriv_time_relative &&
           other.snip_row_ops == snip_row_ops &&
-          other.memory_compression_level == memory_compression_level);
+          other.memory_compression_level == memory_compression_level &&
+          other.fuse_elementwise == fuse_elementwise);
 }
 
 // move commands that resize and zero matrices to as late/early as possible.
@@ -606,6 +616,14 @@ void Optimize(const NnetOptimizeOptions &config,
       CheckComputation(nnet, *computation, false);
   }
 
+  if (config.optimize && config.fuse_elementwise) {
+    // 256k floats (1MB) per block of the widest matrix is about the size of
+    // a typical L2 cache.
+    FuseElementwiseOps(nnet, 262144, computation);
+    if (GetVerboseLevel() >= 3)
+      CheckComputation(nnet, *computation, false);
+  }
+
   // The following is not configurable because it is necessary for
   // the computation to run correctly (we do it after compilation too,
   // but the operations may have been put out of order by
@@ -640,6 +658,7 @@ CachingOptimizingCompiler::CachingOptimizingCompiler(
     seconds_taken_optimize_(0.0), seconds_taken_expand_(0.0),
     seconds_taken_check_(0.0), seconds_taken_indexes_(0.0),
     seconds_taken_io_(0.0), cache_(config.cache_capacity),
+    disk_cache_(NULL),
     nnet_left_context_(-1), nnet_right_context_(-1) { }
 
 CachingOptimizingCompiler::CachingOptimizingCompiler(
@@ -651,6 +670,7 @@ CachingOptimizingCompiler::CachingOptimizingCompiler(
     seconds_taken_optimize_(0.0), seconds_taken_expand_(0.0),
     seconds_taken_check_(0.0), seconds_taken_indexes_(0.0),
     seconds_taken_io_(0.0), cache_(config.cache_capacity),
+    disk_cache_(NULL),
     nnet_left_context_(-1), nnet_right_context_(-1) { }
 
 void CachingOptimizingCompiler::GetSimpleNnetContext(
@@ -693,6 +713,7 @@ void CachingOptimizingCompiler::WriteCache(std::ostream &os, bool binary) {
 }
 
 CachingOptimizingCompiler::~CachingOptimizingCompiler() {
+  delete disk_cache_;
   if (seconds_taken_total_ > 0.0 || seconds_taken_io_ > 0.0) {
     std::ostringstream os;
     double seconds_taken_misc = seconds_taken_total_ - seconds_taken_compile_
@@ -727,16 +748,183 @@ std::shared_ptr<const NnetComputation> CachingOptimizingCompiler::CompileInterna
   if (ans != NULL) {
     return ans;
   } else {
+    const ComputationDiskCache *disk_cache = GetDiskCache();
+    std::vector<const ComputationRequest*> requests(1, &request);
+    if (disk_cache != NULL) {
+      Timer timer;
+      NnetComputation *computation = new NnetComputation();
+      bool found = disk_cache->Read(requests, computation);
+      seconds_taken_io_ += timer.Elapsed();
+      if (found)
+        return cache_.Insert(request, computation);
+      delete computation;
+    }
     const NnetComputation *computation = NULL;
-    if (config_.use_shortcut)
+    // ExpandComputation() can't handle the submatrices that
+    // FuseElementwiseOps() creates, so we don't use the shortcut in that case.
+    if (config_.use_shortcut && !opt_config_.fuse_elementwise)
       computation = CompileViaShortcut(request);
     if (computation == NULL)
       computation = CompileNoShortcut(request);
     KALDI_ASSERT(computation != NULL);
+    if (disk_cache != NULL) {
+      Timer timer;
+      disk_cache->Write(requests, *computation);
+      seconds_taken_io_ += timer.Elapsed();
+    }
     return cache_.Insert(request, computation);
   }
 }
 
+const ComputationDiskCache *CachingOptimizingCompiler::GetDiskCache() {
+  if (config_.cache_dir.empty())
+    return NULL;
+  std::lock_guard<std::mutex> lock(disk_cache_mutex_);
+  if (disk_cache_ == NULL) {
+    // The way the computation is compiled depends on 'use_shortcut' as well as
+    // on the optimization options.
+    disk_cache_ = new ComputationDiskCache(
+        config_.cache_dir, nnet_, opt_config_,
+        config_.use_shortcut ? "shortcut" : "no-shortcut");
+  }
+  return disk_cache_;
+}
+
+
+// This stream buffer computes a 64-bit FNV-1a hash of whatever is written to
+// it, and discards the data; it is used to hash objects via their Write()
+// functions without storing their serialized form.
+class HashingStreambuf: public std::streambuf {
+ public:
+  HashingStreambuf(): hash_(14695981039346656037ULL) { }
+  uint64 Hash() const { return hash_; }
+ protected:
+  virtual int_type overflow(int_type c) {
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+      Add(traits_type::to_char_type(c));
+    return traits_type::not_eof(c);
+  }
+  virtual std::streamsize xsputn(const char *s, std::streamsize n) {
+    for (std::streamsize i = 0; i < n; i++)
+      Add(s[i]);
+    return n;
+  }
+ private:
+  inline void Add(char c) {
+    hash_ = (hash_ ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+  }
+  uint64 hash_;
+};
+
+// Returns 'value' as a 16-digit hexadecimal string.
+static std::string HexString(uint64 value) {
+  std::ostringstream os;
+  os << std::hex << std::setw(16) << std::setfill('0') << value;
+  return os.str();
+}
+
+ComputationDiskCache::ComputationDiskCache(
+    const std::string &dir,
+    const Nnet &nnet,
+    const NnetOptimizeOptions &opt_config,
+    const std::string &compilation_type): dir_(dir) {
+  KALDI_ASSERT(!dir.empty());
+  Timer timer;
+  HashingStreambuf buf;
+  std::ostream os(&buf);
+  bool binary = true;
+  WriteToken(os, binary, compilation_type);
+  opt_config.Write(os, binary);
+  nnet.Write(os, binary);
+  model_hash_ = buf.Hash();
+  KALDI_VLOG(2) << "Hashed model in " << timer.Elapsed() << " seconds; "
+                << "computation cache files will be named " << dir_ << "/"
+                << HexString(model_hash_) << "-*";
+}
+
+std::string ComputationDiskCache::Filename(
+    const std::vector<const ComputationRequest*> &requests) const {
+  HashingStreambuf buf;
+  std::ostream os(&buf);
+  for (size_t i = 0; i < requests.size(); i++)
+    requests[i]->Write(os, true);
+  return dir_ + "/" + HexString(model_hash_) + "-" + HexString(buf.Hash());
+}
+
+bool ComputationDiskCache::Read(
+    const std::vector<const ComputationRequest*> &requests,
+    NnetComputation *computation) const {
+  std::string filename = Filename(requests);
+  std::ifstream is(filename.c_str(), std::ios::in | std::ios::binary);
+  if (!is.is_open())
+    return false;
+  try {
+    bool binary;
+    if (!InitKaldiInputStream(is, &binary))
+      KALDI_ERR << "Could not read header";
+    ExpectToken(is, binary, "<NumRequests>");
+    int32 num_requests;
+    ReadBasicType(is, binary, &num_requests);
+    if (num_requests != static_cast<int32>(requests.size()))
+      return false;  // a hash collision.
+    for (int32 i = 0; i < num_requests; i++) {
+      ComputationRequest request;
+      request.Read(is, binary);
+      if (!(request == *(requests[i])))
+        return false;  // a hash collision.
+    }
+    computation->Read(is, binary);
+  } catch (const std::exception &e) {
+    // e.g. the file is from an older version of the code.
+    KALDI_WARN << "Error reading cached computation from " << filename
+               << ", will recompile it.";
+    return false;
+  }
+  KALDI_VLOG(2) << "Read cached computation from " << filename;
+  return true;
+}
+
+void ComputationDiskCache::Write(
+    const std::vector<const ComputationRequest*> &requests,
+    const NnetComputation &computation) const {
+  std::string filename = Filename(requests);
+  // The random part of the name is in case other processes are writing the
+  // same file.
+  std::random_device rd;
+  std::string tmp_filename = filename + ".tmp." +
+      HexString((static_cast<uint64>(rd()) << 32) + rd());
+  {
+    std::ofstream os(tmp_filename.c_str(), std::ios::out | std::ios::binary);
+    if (!os.is_open()) {
+      KALDI_WARN << "Could not open " << tmp_filename << " for writing; not "
+                 << "caching computation.  Does the directory " << dir_
+                 << " exist?";
+      return;
+    }
+    bool binary = true;
+    InitKaldiOutputStream(os, binary);
+    WriteToken(os, binary, "<NumRequests>");
+    WriteBasicType(os, binary, static_cast<int32>(requests.size()));
+    for (size_t i = 0; i < requests.size(); i++)
+      requests[i]->Write(os, binary);
+    computation.Write(os, binary);
+    os.close();
+    if (os.fail()) {
+      KALDI_WARN << "Error writing cached computation to " << tmp_filename;
+      std::remove(tmp_filename.c_str());
+      return;
+    }
+  }
+  // rename() is atomic (on POSIX systems), so a reader sees either the old
+  // file or the complete new one.
+  if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+    KALDI_WARN << "Could not rename " << tmp_filename << " to " << filename;
+    std::remove(tmp_filename.c_str());
+    return;
+  }
+  KALDI_VLOG(2) << "Wrote cached computation to " << filename;
+}
+
 
 const NnetComputation *CachingOptimizingCompiler::CompileNoShortcut(
     const ComputationRequest &request) {
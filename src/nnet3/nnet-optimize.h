@@ -54,6 +54,7 @@ struct NnetOptimizeOptions {
   int32 max_deriv_time_relative;
   bool snip_row_ops;
   int32 memory_compression_level;
+  bool fuse_elementwise;
   // optimize_looped_computation is a 'hidden config' not available from
   // the command line; it's set to true to enable the optimization for
   // looped computation that turns a linear computation into a loop.
@@ -79,6 +80,7 @@ struct NnetOptimizeOptions {
       max_deriv_time_relative(std::numeric_limits<int32>::max()),
       snip_row_ops(true),
       memory_compression_level(1),
+      fuse_elementwise(false),
       optimize_looped_computation(false) { }
 
   void Register(OptionsItf *opts) {
@@ -145,6 +147,14 @@ struct NnetOptimizeOptions {
                    "potentially at the expense of speed and the accuracy "
                    "of derivatives.  0 means no compression at all; 1 means "
                    "compression that shouldn't affect results at all.");
+    opts->Register("fuse-elementwise", &fuse_elementwise, "Set this to true "
+                   "to enable an optimization for CPU inference that runs "
+                   "chains of components that act on each row separately "
+                   "(e.g. an affine component followed by ReLU, batch-norm "
+                   "and scale components) a block of rows at a time, so that "
+                   "each block stays in cache.  Only applies to computations "
+                   "without backprop; disables shortcut compilation.  Not "
+                   "useful when using a GPU.");
 
   }
   void Read(std::istream &is, bool binary);
@@ -192,6 +202,7 @@ void Optimize(const NnetOptimizeOptions &config,
 struct CachingOptimizingCompilerOptions {
   bool use_shortcut;
   int32 cache_capacity;
+  std::string cache_dir;
 
   CachingOptimizingCompilerOptions():
       use_shortcut(true),
@@ -208,9 +219,63 @@ struct CachingOptimizingCompilerOptions {
     opts->Register("cache-capacity", &cache_capacity,
                    "Determines how many computations the computation-cache will "
                    "store (most-recently-used).");
+    opts->Register("cache-dir", &cache_dir,
+                   "If set, an existing directory in which compiled "
+                   "computations are stored, one file per model and "
+                   "computation request, so that other processes using the "
+                   "same model (e.g. the other jobs of a decoding or training "
+                   "run) don't have to compile them again.  It is safe for "
+                   "several processes to share the directory.");
   }
 };
 
+
+/// This class implements a cache of compiled computations on disk, in a
+/// directory that can be shared between processes, so that the compilation of
+/// a computation (which can take seconds for large models) only has to be done
+/// once for all the jobs of, say, a decoding run.  Each computation is stored
+/// in its own file, named after a hash of the model, the optimization options
+/// and the computation requests; the requests are also stored in the file and
+/// compared on reading, in case of hash collisions.  Files are written under a
+/// temporary name and then renamed, so a reader never sees a partly written
+/// file and processes writing the same computation at once don't interfere.
+/// Read() and Write() may be called from multiple threads.
+class ComputationDiskCache {
+ public:
+  /// 'dir' is the directory, which must exist.  'nnet' is only used in the
+  /// constructor, to compute a hash of it (this includes the parameters,
+  /// because it's simpler and safer than working out exactly what the
+  /// computation depends on).  'compilation_type' is included in the hash; use
+  /// different strings for computations compiled in different ways from the
+  /// same requests.
+  ComputationDiskCache(const std::string &dir,
+                       const Nnet &nnet,
+                       const NnetOptimizeOptions &opt_config,
+                       const std::string &compilation_type);
+
+  /// Reads the computation for these computation requests (typically just
+  /// one) into 'computation' and returns true if it is in the cache; returns
+  /// false if it is not, or could not be read.
+  bool Read(const std::vector<const ComputationRequest*> &requests,
+            NnetComputation *computation) const;
+
+  /// Writes the computation for these computation requests to the cache; it
+  /// only prints a warning if this fails.
+  void Write(const std::vector<const ComputationRequest*> &requests,
+             const NnetComputation &computation) const;
+
+  /// Returns the name of the file in which the computation for these requests
+  /// is stored.
+  std::string Filename(
+      const std::vector<const ComputationRequest*> &requests) const;
+
+ private:
+
+  std::string dir_;
+  // A hash of the model, the optimization options and the compilation type.
+  uint64 model_hash_;
+};
+
 /// This class enables you to do the compilation and optimization in one call,
 /// and also ensures that if the ComputationRequest is identical to the previous
 /// one, the compilation process is not repeated.
@@ -285,6 +350,12 @@ class CachingOptimizingCompiler {
   // the computation cache).
   const NnetComputation *CompileNoShortcut(const ComputationRequest &request);
 
+  // Returns the on-disk cache if config_.cache_dir is set, creating it the
+  // first time (we don't create it in the constructor because that requires a
+  // pass over the model, and this object is often created without being used);
+  // otherwise returns NULL.
+  const ComputationDiskCache *GetDiskCache();
+
   const Nnet &nnet_;
   CachingOptimizingCompilerOptions config_;
   NnetOptimizeOptions opt_config_;
@@ -301,6 +372,10 @@ class CachingOptimizingCompiler {
 
   ComputationCache cache_;
 
+  // The on-disk cache; see GetDiskCache().
+  ComputationDiskCache *disk_cache_;
+  std::mutex disk_cache_mutex_;
+
   // These following two variables are only used by the function GetSimpleNnetContext().
   int32 nnet_left_context_;
   int32 nnet_right_context_;
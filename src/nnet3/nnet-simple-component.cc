@@ -3420,6 +3420,93 @@ void FixedAffineComponent::Read(std::istream &is, bool binary) {
   ExpectToken(is, binary, "</FixedAffineComponent>");
 }
 
+SparseAffineComponent::SparseAffineComponent(
+    const MatrixBase<BaseFloat> &linear_params,
+    const VectorBase<BaseFloat> &bias_params):
+    bias_params_(bias_params) {
+  KALDI_ASSERT(linear_params.NumRows() == bias_params.Dim() &&
+               linear_params.NumCols() > 0);
+  SparseMatrix<BaseFloat> smat(linear_params);
+  linear_params_.Swap(&smat);
+}
+
+std::string SparseAffineComponent::Info() const {
+  std::ostringstream stream;
+  stream << Component::Info();
+  int64 num_elements = static_cast<int64>(linear_params_.NumRows()) *
+      linear_params_.NumCols();
+  stream << ", num-nonzero=" << linear_params_.NumElements()
+         << ", density=" << (linear_params_.NumElements() /
+                             static_cast<BaseFloat>(num_elements));
+  PrintParameterStats(stream, "bias", bias_params_, true);
+  return stream.str();
+}
+
+void SparseAffineComponent::InitFromConfig(ConfigLine *cfl) {
+  int32 input_dim = -1, output_dim = -1;
+  BaseFloat density = 0.1;
+  cfl->GetValue("density", &density);
+  if (!cfl->GetValue("input-dim", &input_dim) ||
+      !cfl->GetValue("output-dim", &output_dim) || cfl->HasUnusedValues() ||
+      input_dim <= 0 || output_dim <= 0 || density < 0.0 || density > 1.0)
+    KALDI_ERR << "Invalid initializer for layer of type "
+              << Type() << ": \"" << cfl->WholeLine() << "\"";
+  SparseMatrix<BaseFloat> smat(output_dim, input_dim);
+  smat.SetRandn(1.0 - density);
+  linear_params_.Swap(&smat);
+  bias_params_.Resize(output_dim);
+  bias_params_.SetRandn();
+}
+
+void* SparseAffineComponent::Propagate(
+    const ComponentPrecomputedIndexes *indexes,
+    const CuMatrixBase<BaseFloat> &in,
+    CuMatrixBase<BaseFloat> *out) const  {
+  out->CopyRowsFromVec(bias_params_); // Adds the bias term first.
+  out->AddMatSmat(1.0, in, linear_params_, kTrans, 1.0);
+  return NULL;
+}
+
+void SparseAffineComponent::Backprop(
+    const std::string &debug_info,
+    const ComponentPrecomputedIndexes *indexes,
+    const CuMatrixBase<BaseFloat> &, //in_value
+    const CuMatrixBase<BaseFloat> &, //out_value
+    const CuMatrixBase<BaseFloat> &out_deriv,
+    void *memo,
+    Component *, //to_update
+    CuMatrixBase<BaseFloat> *in_deriv) const {
+  // kBackpropAdds is true. It's the user's responsibility to zero out
+  // <in_deriv> if they need it to be so.
+  if (in_deriv)
+    in_deriv->AddMatSmat(1.0, out_deriv, linear_params_, kNoTrans, 1.0);
+}
+
+Component* SparseAffineComponent::Copy() const {
+  SparseAffineComponent *ans = new SparseAffineComponent();
+  ans->linear_params_ = linear_params_;
+  ans->bias_params_ = bias_params_;
+  return ans;
+}
+
+void SparseAffineComponent::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<SparseAffineComponent>");
+  WriteToken(os, binary, "<LinearParams>");
+  linear_params_.Write(os, binary);
+  WriteToken(os, binary, "<BiasParams>");
+  bias_params_.Write(os, binary);
+  WriteToken(os, binary, "</SparseAffineComponent>");
+}
+
+void SparseAffineComponent::Read(std::istream &is, bool binary) {
+  ExpectOneOrTwoTokens(is, binary, "<SparseAffineComponent>",
+                       "<LinearParams>");
+  linear_params_.Read(is, binary);
+  ExpectToken(is, binary, "<BiasParams>");
+  bias_params_.Read(is, binary);
+  ExpectToken(is, binary, "</SparseAffineComponent>");
+}
+
 void SumGroupComponent::Init(const std::vector<int32> &sizes) {
   KALDI_ASSERT(!sizes.empty());
   std::vector<Int32Pair> cpu_vec(sizes.size());
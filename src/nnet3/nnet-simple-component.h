@@ -1038,6 +1038,62 @@ class FixedAffineComponent: public Component {
   KALDI_DISALLOW_COPY_AND_ASSIGN(FixedAffineComponent);
 };
 
+/// SparseAffineComponent is an affine transform whose linear parameters are
+/// stored as a sparse matrix; it is not trainable.  It is intended for
+/// inference with models whose weights have been pruned, and is normally
+/// created from an AffineComponent, LinearComponent or FixedAffineComponent by
+/// the program nnet3-sparsify.  Note: the sparse matrix multiplication is only
+/// faster than the dense one if the weights are very sparse; on CPU, less than
+/// about 10% nonzero for typical layer sizes (see UnitTestAddMatSmatSpeed() in
+/// matrix/matrix-lib-speed-test.cc).
+///
+/// The config line (only used for testing) accepts input-dim, output-dim and
+/// density, which is the proportion of nonzero linear parameters (default
+/// 0.1); the parameters are random.
+class SparseAffineComponent: public Component {
+ public:
+  SparseAffineComponent() { }
+  virtual std::string Type() const { return "SparseAffineComponent"; }
+  virtual std::string Info() const;
+
+  /// Initializes from dense parameters; only the nonzero elements of
+  /// 'linear_params' are stored.
+  SparseAffineComponent(const MatrixBase<BaseFloat> &linear_params,
+                        const VectorBase<BaseFloat> &bias_params);
+
+  virtual void InitFromConfig(ConfigLine *cfl);
+
+  virtual int32 Properties() const { return kSimpleComponent|kBackpropAdds; }
+  virtual int32 InputDim() const { return linear_params_.NumCols(); }
+  virtual int32 OutputDim() const { return linear_params_.NumRows(); }
+
+  virtual void* Propagate(const ComponentPrecomputedIndexes *indexes,
+                         const CuMatrixBase<BaseFloat> &in,
+                         CuMatrixBase<BaseFloat> *out) const;
+  virtual void Backprop(const std::string &debug_info,
+                        const ComponentPrecomputedIndexes *indexes,
+                        const CuMatrixBase<BaseFloat> &in_value,
+                        const CuMatrixBase<BaseFloat> &, // out_value
+                        const CuMatrixBase<BaseFloat> &out_deriv,
+                        void *memo,
+                        Component *to_update,
+                        CuMatrixBase<BaseFloat> *in_deriv) const;
+
+  virtual Component* Copy() const;
+  virtual void Read(std::istream &is, bool binary);
+  virtual void Write(std::ostream &os, bool binary) const;
+
+  const CuSparseMatrix<BaseFloat> &LinearParams() const {
+    return linear_params_;
+  }
+  const CuVector<BaseFloat> &BiasParams() const { return bias_params_; }
+ private:
+  CuSparseMatrix<BaseFloat> linear_params_;
+  CuVector<BaseFloat> bias_params_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(SparseAffineComponent);
+};
+
 /// SumGroupComponent is used to sum up groups of posteriors.
 /// It's used to introduce a kind of Gaussian-mixture-model-like
 /// idea into neural nets.  This is basically a degenerate case of
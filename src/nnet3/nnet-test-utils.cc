@@ -132,7 +132,10 @@ void GenerateConfigSequenceSimple(
 
   bool use_final_nonlinearity = (opts.allow_final_nonlinearity &&
                                  RandInt(0, 1) == 0);
-  bool use_batch_norm = (RandInt(0, 1) == 0);
+  bool use_batch_norm = (RandInt(0, 1) == 0),
+      // if true, put the batch-norm between affine1 and relu1 (this tests
+      // the affine-then-batchnorm case of CollapseModel()).
+      batch_norm_first = use_batch_norm && (RandInt(0, 1) == 0);
 
   os << "component name=affine1 type=NaturalGradientAffineComponent input-dim="
      << spliced_dim << " output-dim=" << hidden_dim << std::endl;
@@ -177,15 +180,22 @@ void GenerateConfigSequenceSimple(
       os << ", ";
   }
   os << ")\n";
+  std::string nonlin_input = "affine1_node";
+  if (batch_norm_first) {
+    os << "component-node name=batch-norm component=batch-norm input=affine1_node\n";
+    nonlin_input = "batch-norm";
+  }
   if (RandInt(0, 1) == 0) {
-    os << "component-node name=nonlin1 component=relu1 input=affine1_node\n";
+    os << "component-node name=nonlin1 component=relu1 input="
+       << nonlin_input << "\n";
   } else if (RandInt(0, 1) == 0) {
-    os << "component-node name=nonlin1 component=relu1 input=Scale(-1.0, affine1_node)\n";
+    os << "component-node name=nonlin1 component=relu1 input=Scale(-1.0, "
+       << nonlin_input << ")\n";
   } else {
     os << "component-node name=nonlin1 component=relu1 input=Sum(Const(1.0, "
-       << hidden_dim << "), Scale(-1.0, affine1_node))\n";
+       << hidden_dim << "), Scale(-1.0, " << nonlin_input << "))\n";
   }
-  if (use_batch_norm) {
+  if (use_batch_norm && !batch_norm_first) {
     os << "component-node name=batch-norm component=batch-norm input=nonlin1\n";
     os << "component-node name=final_affine component=final_affine input=batch-norm\n";
   } else {
@@ -1400,7 +1410,7 @@ void ComputeExampleComputationRequestSimple(
 static void GenerateRandomComponentConfig(std::string *component_type,
                                           std::string *config) {
 
-  int32 n = RandInt(0, 35);
+  int32 n = RandInt(0, 36);
   BaseFloat learning_rate = 0.001 * RandInt(1, 100);
 
   std::ostringstream os;
@@ -1757,6 +1767,13 @@ static void GenerateRandomComponentConfig(std::string *component_type,
          << " use-bias=" << (RandInt(0,1) == 0 ? "true":"false");
       break;
     }
+    case 36: {
+      *component_type = "SparseAffineComponent";
+      int32 input_dim = RandInt(1, 50), output_dim = RandInt(1, 50);
+      os << "input-dim=" << input_dim << " output-dim=" << output_dim
+         << " density=" << (0.1 * RandInt(1, 10));
+      break;
+    }
     default:
       KALDI_ERR << "Error generating random component";
   }
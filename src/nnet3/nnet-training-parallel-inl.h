@@ -0,0 +1,200 @@
+// nnet3/nnet-training-parallel-inl.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_TRAINING_PARALLEL_INL_H_
+#define KALDI_NNET3_NNET_TRAINING_PARALLEL_INL_H_
+
+#include <algorithm>
+#include "nnet3/nnet-utils.h"
+
+// Do not include this file directly.  It is included by
+// nnet3/nnet-training-parallel.h
+
+namespace kaldi {
+namespace nnet3 {
+
+template <class Trainer, class Example>
+NnetParallelTrainerTpl<Trainer, Example>::NnetParallelTrainerTpl(
+    const NnetParallelTrainerOptions &parallel_config,
+    Nnet *nnet):
+    parallel_config_(parallel_config),
+    nnet_(nnet),
+    num_busy_(0),
+    done_(false),
+    num_minibatches_since_average_(0) {
+  int32 num_threads = parallel_config.num_threads;
+  KALDI_ASSERT(num_threads > 0 && parallel_config.average_interval > 0);
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled() && num_threads > 1)
+    KALDI_ERR << "Multi-threaded training is not supported with a GPU; "
+              << "use --num-threads=1.";
+#endif
+  nnets_.push_back(nnet);
+  for (int32 i = 1; i < num_threads; i++)
+    nnets_.push_back(nnet->Copy());
+}
+
+template <class Trainer, class Example>
+void NnetParallelTrainerTpl<Trainer, Example>::Start(
+    const std::vector<Trainer*> &trainers) {
+  KALDI_ASSERT(trainers.size() == nnets_.size() && trainers_.empty());
+  trainers_ = trainers;
+  for (size_t i = 0; i < trainers_.size(); i++)
+    threads_.push_back(std::thread(
+        &NnetParallelTrainerTpl<Trainer, Example>::RunThread, this, i));
+}
+
+template <class Trainer, class Example>
+void NnetParallelTrainerTpl<Trainer, Example>::CheckForError() const {
+  // We have to rethrow the exception here rather than let it escape the
+  // thread, as an uncaught exception in a thread would terminate the program.
+  // Its message (if it came from KALDI_ERR) has already been printed.
+  if (error_)
+    std::rethrow_exception(error_);
+}
+
+template <class Trainer, class Example>
+void NnetParallelTrainerTpl<Trainer, Example>::Train(const Example &eg) {
+  Example *eg_copy = new Example(eg);
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // Don't let the queue get much longer than needed to keep the threads
+    // busy, to limit memory use.
+    while (queue_.size() >= static_cast<size_t>(parallel_config_.num_threads)
+           && !error_)
+      condition_.wait(lock);
+    if (error_) {
+      delete eg_copy;
+      CheckForError();
+    }
+    queue_.push_back(eg_copy);
+  }
+  condition_.notify_all();
+  if (++num_minibatches_since_average_ ==
+      parallel_config_.num_threads * parallel_config_.average_interval)
+    AverageModels();
+}
+
+template <class Trainer, class Example>
+void NnetParallelTrainerTpl<Trainer, Example>::RunThread(int32 thread) {
+  while (true) {
+    Example *eg;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (queue_.empty() && !done_ && !error_)
+        condition_.wait(lock);
+      // After an error, the remaining minibatches are not used.
+      if (queue_.empty() || error_)
+        return;
+      eg = queue_.front();
+      queue_.pop_front();
+      num_busy_++;
+    }
+    condition_.notify_all();
+    std::exception_ptr error;
+    try {
+      trainers_[thread]->Train(*eg);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    delete eg;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      num_busy_--;
+      if (error && !error_)
+        error_ = error;
+    }
+    condition_.notify_all();
+  }
+}
+
+template <class Trainer, class Example>
+void NnetParallelTrainerTpl<Trainer, Example>::AverageModels() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while ((!queue_.empty() || num_busy_ > 0) && !error_)
+      condition_.wait(lock);
+    CheckForError();
+  }
+  num_minibatches_since_average_ = 0;
+  int32 num_threads = nnets_.size();
+  if (num_threads == 1)
+    return;
+  // The threads are idle now, so we can access their models.
+  BaseFloat scale = 1.0 / num_threads;
+  ScaleNnet(scale, nnet_);
+  for (int32 i = 1; i < num_threads; i++)
+    AddNnet(*(nnets_[i]), scale, nnet_);
+  for (int32 i = 1; i < num_threads; i++) {
+    ScaleNnet(0.0, nnets_[i]);
+    AddNnet(*nnet_, 1.0, nnets_[i]);
+  }
+}
+
+template <class Trainer, class Example>
+void NnetParallelTrainerTpl<Trainer, Example>::Finish() {
+  AverageModels();
+}
+
+template <class Trainer, class Example>
+bool NnetParallelTrainerTpl<Trainer, Example>::PrintTotalStats() const {
+  unordered_map<std::string, ObjectiveFunctionInfo, StringHasher> objf_info;
+  for (size_t i = 0; i < trainers_.size(); i++)
+    trainers_[i]->AddTotalStats(&objf_info);
+  std::vector<std::pair<std::string, const ObjectiveFunctionInfo*> > all_pairs;
+  unordered_map<std::string, ObjectiveFunctionInfo, StringHasher>::const_iterator
+      iter = objf_info.begin(),
+      end = objf_info.end();
+  for (; iter != end; ++iter)
+    all_pairs.push_back(std::pair<std::string, const ObjectiveFunctionInfo*>(
+        iter->first, &(iter->second)));
+  // ensure deterministic order of these names.
+  std::sort(all_pairs.begin(), all_pairs.end());
+  bool ans = false;
+  for (size_t i = 0; i < all_pairs.size(); i++) {
+    bool ok = all_pairs[i].second->PrintTotalStats(all_pairs[i].first);
+    ans = ans || ok;
+  }
+  for (size_t i = 0; i < trainers_.size(); i++) {
+    KALDI_LOG << "Max-change stats for thread " << i << ':';
+    trainers_[i]->PrintMaxChangeStats();
+  }
+  return ans;
+}
+
+template <class Trainer, class Example>
+NnetParallelTrainerTpl<Trainer, Example>::~NnetParallelTrainerTpl() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_ = true;
+  }
+  condition_.notify_all();
+  for (size_t i = 0; i < threads_.size(); i++)
+    threads_[i].join();
+  // The queue is only nonempty here if a thread failed.
+  for (size_t i = 0; i < queue_.size(); i++)
+    delete queue_[i];
+  DeletePointers(&trainers_);
+  for (size_t i = 1; i < nnets_.size(); i++)
+    delete nnets_[i];
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+#endif // KALDI_NNET3_NNET_TRAINING_PARALLEL_INL_H_
@@ -0,0 +1,46 @@
+// nnet3/nnet-training-parallel.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/nnet-training-parallel.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+NnetParallelTrainer::NnetParallelTrainer(
+    const NnetTrainerOptions &config,
+    const NnetParallelTrainerOptions &parallel_config,
+    Nnet *nnet):
+    NnetParallelTrainerTpl<NnetTrainer, NnetExample>(parallel_config, nnet) {
+  int32 num_threads = nnets_.size();
+  if (config.backstitch_training_scale > 0.0 && num_threads > 1)
+    KALDI_WARN << "Backstitch training uses srand() to get the same dropout "
+               << "masks in both passes; this is not reliable with multiple "
+               << "threads.";
+  std::vector<NnetTrainer*> trainers;
+  for (int32 i = 0; i < num_threads; i++) {
+    NnetTrainerOptions this_config(config);
+    // Only the first thread writes the computation cache.
+    if (i > 0)
+      this_config.write_cache = "";
+    trainers.push_back(new NnetTrainer(this_config, nnets_[i]));
+  }
+  Start(trainers);
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
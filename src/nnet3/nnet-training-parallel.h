@@ -0,0 +1,165 @@
+// nnet3/nnet-training-parallel.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_TRAINING_PARALLEL_H_
+#define KALDI_NNET3_NNET_TRAINING_PARALLEL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "nnet3/nnet-training.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+struct NnetParallelTrainerOptions {
+  int32 num_threads;
+  int32 average_interval;
+  NnetParallelTrainerOptions(): num_threads(1), average_interval(10) { }
+  void Register(OptionsItf *opts) {
+    opts->Register("num-threads", &num_threads, "Number of training threads; "
+                   "each thread trains its own copy of the model on different "
+                   "minibatches. [Note: if you use a parallel implementation of "
+                   "BLAS, the actual number of threads may be larger.]");
+    opts->Register("average-interval", &average_interval, "Number of "
+                   "minibatches per thread after which the models of the "
+                   "threads are averaged.");
+  }
+};
+
+
+/**
+   This templated class does multi-threaded training of neural nets on CPU; see
+   NnetParallelTrainer and NnetChainParallelTrainer (in
+   nnet-chain-training-parallel.h), which instantiate it with Trainer ==
+   NnetTrainer and NnetChainTrainer respectively, and Example == the type of
+   example that Trainer::Train() takes.  Each of the --num-threads threads has
+   its own copy of the model and its own trainer, and trains on different
+   minibatches; every --average-interval minibatches per thread the threads
+   wait for each other and the models are averaged, as nnet3-average does
+   between training jobs.
+
+   We don't do "Hogwild" updates of a single shared model as in nnet2 (see
+   nnet2/nnet-update-parallel.h), because nnet3 components keep state in the
+   model that is written during training (stats for diagnostics and
+   self-repair, batchnorm stats, random generators for dropout), and in the
+   model that stores the parameter change (the state of
+   OnlineNaturalGradient and the momentum), and none of this is thread-safe.
+   Here each thread's natural-gradient state is estimated from the gradients
+   of that thread only, and is never shared.
+
+   Note: averaging K models that each took a step is like taking a single step
+   on K minibatches, with 1/K of the learning rate; so, as with training with
+   multiple jobs, you may want to scale the learning rate by the number of
+   threads.  The component stats are averaged along with the parameters.
+
+   If training fails in one of the threads, the next call to Train() or
+   Finish() dies with its error message, and the other threads stop taking
+   new minibatches.
+ */
+template <class Trainer, class Example>
+class NnetParallelTrainerTpl {
+ public:
+  // Gives one minibatch to the threads to train on.  May block until a thread
+  // is free.
+  void Train(const Example &eg);
+
+  // Waits for the threads to finish the minibatches they are working on and
+  // averages the models into the nnet given to the constructor.  Must be
+  // called before using that nnet or calling PrintTotalStats().
+  void Finish();
+
+  // Prints out the final stats, summed over threads, and returns true if there
+  // was a nonzero count.
+  bool PrintTotalStats() const;
+
+  ~NnetParallelTrainerTpl();
+ protected:
+  // 'nnet' is the model to train; it is the copy of the model used by the
+  // first thread, and it contains the averaged model after Finish() is called.
+  // This sets up nnets_; the child class then creates a trainer for each of
+  // them and calls Start().
+  NnetParallelTrainerTpl(const NnetParallelTrainerOptions &parallel_config,
+                         Nnet *nnet);
+
+  // Takes ownership of 'trainers', where trainers[i] trains nnets_[i], and
+  // starts the threads.
+  void Start(const std::vector<Trainer*> &trainers);
+
+  // The models of the threads; nnets_[0] is nnet_.
+  std::vector<Nnet*> nnets_;
+
+ private:
+  // The main loop of the worker thread with index 'thread'.
+  void RunThread(int32 thread);
+
+  // Waits for all the threads to be idle, and averages the models.
+  void AverageModels();
+
+  // Rethrows the exception if a thread has failed; must be called with mutex_
+  // held.
+  void CheckForError() const;
+
+  const NnetParallelTrainerOptions parallel_config_;
+  Nnet *nnet_;
+  std::vector<Trainer*> trainers_;
+  std::vector<std::thread> threads_;
+
+  // Guards queue_, num_busy_, done_ and error_.
+  std::mutex mutex_;
+  // Notified whenever queue_, num_busy_, done_ or error_ changes.
+  std::condition_variable condition_;
+  // Minibatches waiting to be picked up by a thread.
+  std::deque<Example*> queue_;
+  // Number of threads currently training on a minibatch.
+  int32 num_busy_;
+  // Set when the threads should exit.
+  bool done_;
+  // The first exception thrown in a thread, if any.
+  std::exception_ptr error_;
+
+  // Number of minibatches given to Train() since we last averaged.
+  int32 num_minibatches_since_average_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(NnetParallelTrainerTpl);
+};
+
+
+/**
+   This class is for multi-threaded training of neural nets on CPU with the
+   conventional objectives; see NnetParallelTrainerTpl.
+ */
+class NnetParallelTrainer:
+      public NnetParallelTrainerTpl<NnetTrainer, NnetExample> {
+ public:
+  // 'nnet' is the model to train; it contains the averaged model after
+  // Finish() is called.
+  NnetParallelTrainer(const NnetTrainerOptions &config,
+                      const NnetParallelTrainerOptions &parallel_config,
+                      Nnet *nnet);
+};
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+#include "nnet3/nnet-training-parallel-inl.h"
+
+#endif // KALDI_NNET3_NNET_TRAINING_PARALLEL_H_
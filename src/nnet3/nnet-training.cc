@@ -270,6 +270,20 @@ void NnetTrainer::PrintMaxChangeStats() const {
               << " \% of the time.";
 }
 
+void NnetTrainer::AddTotalStats(
+    unordered_map<std::string, ObjectiveFunctionInfo, StringHasher>
+    *objf_info) const {
+  unordered_map<std::string, ObjectiveFunctionInfo, StringHasher>::const_iterator
+      iter = objf_info_.begin(),
+      end = objf_info_.end();
+  for (; iter != end; ++iter) {
+    ObjectiveFunctionInfo &info = (*objf_info)[iter->first];
+    info.tot_weight += iter->second.tot_weight;
+    info.tot_objf += iter->second.tot_objf;
+    info.tot_aux_objf += iter->second.tot_aux_objf;
+  }
+}
+
 void ObjectiveFunctionInfo::UpdateStats(
     const std::string &output_name,
     int32 minibatches_per_phase,
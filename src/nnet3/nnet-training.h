@@ -191,6 +191,12 @@ class NnetTrainer {
   // per-component max-change and global max-change were enforced.
   void PrintMaxChangeStats() const;
 
+  // Adds the total objective-function stats of this object to 'objf_info'.
+  // This is used when combining the stats of several trainers, see class
+  // NnetParallelTrainer.
+  void AddTotalStats(unordered_map<std::string, ObjectiveFunctionInfo,
+                                   StringHasher> *objf_info) const;
+
   ~NnetTrainer();
  private:
   // The internal function for doing one step of conventional SGD training.
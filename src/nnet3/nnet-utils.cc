@@ -1631,7 +1631,10 @@ class ModelCollapser {
      'component_index2' with input given by 'component_index1'.  This handles
      the case where 'component_index1' is of type BatchnormComponent, and where
      'component_index2' is of type AffineComponent or
-     NaturalGradientAffineComponent.
+     NaturalGradientAffineComponent; and the case where 'component_index1'
+     is of type AffineComponent or NaturalGradientAffineComponent and
+     'component_index2' is of type BatchNormComponent (i.e. batch-norm
+     directly after the affine, with no nonlinearity in between).
 
      Returns -1 if this code can't produce a combined component (normally
      because the components have the wrong types).
@@ -1641,8 +1644,20 @@ class ModelCollapser {
     const BatchNormComponent *batchnorm_component =
         dynamic_cast<const BatchNormComponent*>(
             nnet_->GetComponent(component_index1));
-    if (batchnorm_component == NULL)
-      return -1;
+    if (batchnorm_component == NULL) {
+      batchnorm_component = dynamic_cast<const BatchNormComponent*>(
+          nnet_->GetComponent(component_index2));
+      if (batchnorm_component == NULL ||
+          nnet_->GetComponent(component_index1)->OutputDim() !=
+          batchnorm_component->InputDim())
+        return -1;
+      if (batchnorm_component->Offset().Dim() == 0) {
+        KALDI_ERR << "Expected batch-norm components to have test-mode set.";
+      }
+      return GetDiagonallyPostModifiedComponentIndex(
+          batchnorm_component->Offset(), batchnorm_component->Scale(),
+          nnet_->GetComponentName(component_index2), component_index1);
+    }
 
     if (batchnorm_component->Offset().Dim() == 0) {
       KALDI_ERR << "Expected batch-norm components to have test-mode set.";
@@ -1805,9 +1820,9 @@ class ModelCollapser {
   /**
      This function finds, or creates, a component which is like
      'component_index' but is combined with a diagonal offset-and-scale
-     transform *before* the component.  (We may later create a function called
-     GetDiagonallyPostModifiedComponentIndex if we need to apply the
-     transform *after* the component.
+     transform *before* the component.  (See also
+     GetDiagonallyPostModifiedComponentIndex(), which applies the transform
+     *after* the component.)
 
      This function doesn't work for convolutional components, because
      due to zero-padding, it's not possible to represent an offset/scale
@@ -1901,6 +1916,54 @@ class ModelCollapser {
     return nnet_->AddComponent(new_component_name, new_component);
   }
 
+  /**
+     This function finds, or creates, a component which is like
+     'component_index' but is combined with a diagonal offset-and-scale
+     transform y = a x + b *after* the component.  The arguments are as for
+     GetDiagonallyPreModifiedComponentIndex(), except that 'src_identifier'
+     goes after the component name in the name of the new component, and
+     only AffineComponent and NaturalGradientAffineComponent are supported;
+     the dimension of 'offset' and 'scale' must divide the component's output
+     dimension.  Returns -1 if the component is not of a supported type.
+  */
+  int32 GetDiagonallyPostModifiedComponentIndex(
+      const CuVectorBase<BaseFloat> &offset,
+      const CuVectorBase<BaseFloat> &scale,
+      const std::string &src_identifier,
+      int32 component_index) {
+    KALDI_ASSERT(offset.Dim() > 0 && offset.Dim() == scale.Dim());
+    const AffineComponent *affine_component =
+        dynamic_cast<const AffineComponent*>(
+            nnet_->GetComponent(component_index));
+    if (affine_component == NULL)
+      return -1;
+    std::ostringstream new_component_name_os;
+    new_component_name_os << nnet_->GetComponentName(component_index)
+                          << "." << src_identifier;
+    std::string new_component_name = new_component_name_os.str();
+    int32 new_component_index = nnet_->GetComponentIndex(new_component_name);
+    if (new_component_index >= 0)
+      return new_component_index;  // we previously created this.
+
+    int32 output_dim = affine_component->OutputDim(),
+        transform_dim = offset.Dim();
+    KALDI_ASSERT(output_dim % transform_dim == 0);
+    CuVector<BaseFloat> full_offset(output_dim),
+        full_scale(output_dim);
+    for (int32 d = 0; d < output_dim; d += transform_dim) {
+      full_offset.Range(d, transform_dim).CopyFromVec(offset);
+      full_scale.Range(d, transform_dim).CopyFromVec(scale);
+    }
+    AffineComponent *new_affine_component =
+        dynamic_cast<AffineComponent*>(affine_component->Copy());
+    // The affine component does y = a x + b, and after the post-transform
+    // we have s (a x + b) + o = (s a) x + (s b + o).
+    new_affine_component->LinearParams().MulRowsVec(full_scale);
+    new_affine_component->BiasParams().MulElements(full_scale);
+    new_affine_component->BiasParams().AddVec(1.0, full_offset);
+    return nnet_->AddComponent(new_component_name, new_affine_component);
+  }
+
   /**
      This helper function, used GetDiagonallyPreModifiedComponentIndex,
      modifies the linear and bias parameters of an affine transform to
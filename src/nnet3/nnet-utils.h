@@ -222,7 +222,8 @@ void FindOrphanNodes(const Nnet &nnet, std::vector<int32> *nodes);
    is reponsible for collapsing together sequential components where
    doing so could make the test-time operation more efficient.
    For example, dropout components and batch-norm components that
-   are in test mode can be combined with the next layer; and if there
+   are in test mode can be combined with the next layer (or, for batch-norm,
+   with a directly preceding affine layer); and if there
    are successive affine components it may also be possible to
    combine these under some circumstances.
 
@@ -231,7 +232,8 @@ void FindOrphanNodes(const Nnet &nnet, std::vector<int32> *nodes);
  */
 struct CollapseModelConfig {
   bool collapse_dropout;  // dropout then affine/conv.
-  bool collapse_batchnorm;  // batchnorm then affine.
+  bool collapse_batchnorm;  // batchnorm then affine, or affine then
+                            // batchnorm.
   bool collapse_affine;  // affine or fixed-affine then affine.
   bool collapse_scale;  // affine then fixed-scale.
   CollapseModelConfig(): collapse_dropout(true),
@@ -0,0 +1,117 @@
+// nnet3bin/nnet3-compact-egs.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "nnet3/nnet-example.h"
+#include "nnet3/nnet-chain-example.h"
+#include "nnet3/nnet-example-compact.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+template<class Example, class Reader>
+void CopyToCompactEgs(const std::string &examples_rspecifier,
+                      const std::string &compact_wxfilename,
+                      bool binary) {
+  Reader example_reader(examples_rspecifier);
+  CompactEgsWriter<Example> writer(compact_wxfilename, binary);
+  for (; !example_reader.Done(); example_reader.Next())
+    writer.Write(example_reader.Key(), example_reader.Value());
+  KALDI_LOG << "Wrote " << writer.NumWritten() << " examples with "
+            << writer.NumStructures() << " distinct structures to "
+            << PrintableWxfilename(compact_wxfilename);
+  writer.Close();
+}
+
+template<class Example, class Writer>
+void CopyFromCompactEgs(const std::string &compact_rxfilename,
+                        const std::string &examples_wspecifier) {
+  SequentialCompactEgsReader<Example> reader(compact_rxfilename);
+  Writer example_writer(examples_wspecifier);
+  int64 num_done = 0;
+  for (; !reader.Done(); reader.Next(), num_done++)
+    example_writer.Write(reader.Key(), reader.Value());
+  KALDI_LOG << "Copied " << num_done << " examples from "
+            << PrintableRxfilename(compact_rxfilename);
+}
+
+}
+}
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+
+    const char *usage =
+        "Converts an archive of nnet3 training examples (NnetExample, or\n"
+        "NnetChainExample with --chain=true) to the 'compact egs' format, in\n"
+        "which the indexes of the examples are written only once for each\n"
+        "distinct structure (see nnet3/nnet-example-compact.h); or, with\n"
+        "--expand=true, converts back.  This is mostly useful for merged\n"
+        "examples, as written by nnet3-merge-egs or nnet3-chain-merge-egs.\n"
+        "\n"
+        "Usage:  nnet3-compact-egs [options] <egs-rspecifier> <compact-egs-wxfilename>\n"
+        "   or:  nnet3-compact-egs --expand [options] <compact-egs-rxfilename> <egs-wspecifier>\n"
+        "e.g.\n"
+        "nnet3-merge-egs --minibatch-size=256 ark:1.egs ark:- | \\\n"
+        "  nnet3-compact-egs ark:- 1.cegs\n"
+        "nnet3-compact-egs --expand 1.cegs ark,t:- | less\n"
+        "The training programs (e.g. nnet3-train, nnet3-chain-train) and\n"
+        "nnet3-merge-egs read compact egs directly if given compact:<rxfilename>,\n"
+        "e.g. nnet3-train 1.raw compact:1.cegs 2.raw\n";
+
+    bool binary_write = true, chain = false, expand = false;
+
+    ParseOptions po(usage);
+    po.Register("binary", &binary_write, "Write compact egs in binary mode");
+    po.Register("chain", &chain, "If true, the examples are NnetChainExample "
+                "(as used in 'chain' training); else NnetExample.");
+    po.Register("expand", &expand, "If true, convert from the compact egs "
+                "format to an archive instead of the other way round.");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string input = po.GetArg(1),
+        output = po.GetArg(2);
+
+    if (!expand) {
+      if (chain)
+        CopyToCompactEgs<NnetChainExample, SequentialNnetChainExampleReader>(
+            input, output, binary_write);
+      else
+        CopyToCompactEgs<NnetExample, SequentialNnetExampleReader>(
+            input, output, binary_write);
+    } else {
+      if (chain)
+        CopyFromCompactEgs<NnetChainExample, NnetChainExampleWriter>(
+            input, output);
+      else
+        CopyFromCompactEgs<NnetExample, NnetExampleWriter>(input, output);
+    }
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+}
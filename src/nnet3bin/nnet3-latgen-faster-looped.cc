@@ -25,6 +25,7 @@
 #include "hmm/transition-model.h"
 #include "fstext/fstext-lib.h"
 #include "decoder/decoder-wrappers.h"
+#include "decoder/decodable-frame-skip.h"
 #include "nnet3/decodable-simple-looped.h"
 #include "nnet3/nnet-utils.h"
 #include "base/timer.h"
@@ -54,6 +55,7 @@ int main(int argc, char *argv[]) {
     bool allow_partial = false;
     LatticeFasterDecoderConfig config;
     NnetSimpleLoopedComputationOptions decodable_opts;
+    FrameSkipOptions skip_opts;
 
     std::string word_syms_filename;
     std::string ivector_rspecifier,
@@ -62,6 +64,7 @@ int main(int argc, char *argv[]) {
     int32 online_ivector_period = 0;
     config.Register(&po);
     decodable_opts.Register(&po);
+    skip_opts.Register(&po);
     po.Register("word-symbol-table", &word_syms_filename,
                 "Symbol table for words [for debug output]");
     po.Register("allow-partial", &allow_partial,
@@ -101,6 +104,13 @@ int main(int argc, char *argv[]) {
       SetDropoutTestMode(true, &(am_nnet.GetNnet()));
       CollapseModel(CollapseModelConfig(), &(am_nnet.GetNnet()));
     }
+    if (skip_opts.max_merged_frames > 1 &&
+        !(AllStatesHaveSelfLoops(trans_model) &&
+          SelfLoopPdfsMatch(trans_model)))
+      KALDI_ERR << "--max-merged-frames > 1 requires an HMM topology in "
+                << "which all states have self-loops with the same pdf as "
+                << "the transitions out of the state (so not 'chain' "
+                << "models).";
 
     bool determinize = config.determinize_lattice;
     CompactLatticeWriter compact_lattice_writer;
@@ -178,10 +188,14 @@ int main(int argc, char *argv[]) {
           DecodableAmNnetSimpleLooped nnet_decodable(
               decodable_info, trans_model, features, ivector, online_ivectors,
               online_ivector_period);
+          DecodableFrameSkip skip_decodable(skip_opts, &nnet_decodable);
+          DecodableInterface &decodable =
+              (skip_opts.max_merged_frames > 1 ?
+               static_cast<DecodableInterface&>(skip_decodable) : nnet_decodable);
 
           double like;
           if (DecodeUtteranceLatticeFaster(
-                  decoder, nnet_decodable, trans_model, word_syms, utt,
+                  decoder, decodable, trans_model, word_syms, utt,
                   decodable_opts.acoustic_scale, determinize, allow_partial,
                   &alignment_writer, &words_writer, &compact_lattice_writer,
                   &lattice_writer,
@@ -237,10 +251,14 @@ int main(int argc, char *argv[]) {
         DecodableAmNnetSimpleLooped nnet_decodable(
             decodable_info, trans_model, features, ivector, online_ivectors,
             online_ivector_period);
+        DecodableFrameSkip skip_decodable(skip_opts, &nnet_decodable);
+        DecodableInterface &decodable =
+            (skip_opts.max_merged_frames > 1 ?
+             static_cast<DecodableInterface&>(skip_decodable) : nnet_decodable);
 
         double like;
         if (DecodeUtteranceLatticeFaster(
-                decoder, nnet_decodable, trans_model, word_syms, utt,
+                decoder, decodable, trans_model, word_syms, utt,
                 decodable_opts.acoustic_scale, determinize, allow_partial,
                 &alignment_writer, &words_writer, &compact_lattice_writer,
                 &lattice_writer, &like)) {
@@ -25,6 +25,7 @@
 #include "hmm/transition-model.h"
 #include "fstext/fstext-lib.h"
 #include "decoder/decoder-wrappers.h"
+#include "decoder/decodable-frame-skip.h"
 #include "nnet3/nnet-am-decodable-simple.h"
 #include "nnet3/nnet-utils.h"
 #include "base/timer.h"
@@ -51,6 +52,7 @@ int main(int argc, char *argv[]) {
     bool allow_partial = false;
     LatticeFasterDecoderConfig config;
     NnetSimpleComputationOptions decodable_opts;
+    FrameSkipOptions skip_opts;
 
     std::string word_syms_filename;
     std::string ivector_rspecifier,
@@ -59,6 +61,7 @@ int main(int argc, char *argv[]) {
     int32 online_ivector_period = 0;
     config.Register(&po);
     decodable_opts.Register(&po);
+    skip_opts.Register(&po);
     po.Register("word-symbol-table", &word_syms_filename,
                 "Symbol table for words [for debug output]");
     po.Register("allow-partial", &allow_partial,
@@ -100,6 +103,13 @@ int main(int argc, char *argv[]) {
       SetDropoutTestMode(true, &(am_nnet.GetNnet()));
       CollapseModel(CollapseModelConfig(), &(am_nnet.GetNnet()));
     }
+    if (skip_opts.max_merged_frames > 1 &&
+        !(AllStatesHaveSelfLoops(trans_model) &&
+          SelfLoopPdfsMatch(trans_model)))
+      KALDI_ERR << "--max-merged-frames > 1 requires an HMM topology in "
+                << "which all states have self-loops with the same pdf as "
+                << "the transitions out of the state (so not 'chain' "
+                << "models).";
 
     bool determinize = config.determinize_lattice;
     CompactLatticeWriter compact_lattice_writer;
@@ -174,10 +184,14 @@ int main(int argc, char *argv[]) {
               decodable_opts, trans_model, am_nnet,
               features, ivector, online_ivectors,
               online_ivector_period, &compiler);
+          DecodableFrameSkip skip_decodable(skip_opts, &nnet_decodable);
+          DecodableInterface &decodable =
+              (skip_opts.max_merged_frames > 1 ?
+               static_cast<DecodableInterface&>(skip_decodable) : nnet_decodable);
 
           double like;
           if (DecodeUtteranceLatticeFaster(
-                  decoder, nnet_decodable, trans_model, word_syms, utt,
+                  decoder, decodable, trans_model, word_syms, utt,
                   decodable_opts.acoustic_scale, determinize, allow_partial,
                   &alignment_writer, &words_writer, &compact_lattice_writer,
                   &lattice_writer,
@@ -234,10 +248,14 @@ int main(int argc, char *argv[]) {
             decodable_opts, trans_model, am_nnet,
             features, ivector, online_ivectors,
             online_ivector_period, &compiler);
+        DecodableFrameSkip skip_decodable(skip_opts, &nnet_decodable);
+        DecodableInterface &decodable =
+            (skip_opts.max_merged_frames > 1 ?
+             static_cast<DecodableInterface&>(skip_decodable) : nnet_decodable);
 
         double like;
         if (DecodeUtteranceLatticeFaster(
-                decoder, nnet_decodable, trans_model, word_syms, utt,
+                decoder, decodable, trans_model, word_syms, utt,
                 decodable_opts.acoustic_scale, determinize, allow_partial,
                 &alignment_writer, &words_writer, &compact_lattice_writer,
                 &lattice_writer, &like)) {
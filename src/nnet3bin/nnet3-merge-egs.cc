@@ -23,6 +23,7 @@
 #include "hmm/transition-model.h"
 #include "nnet3/nnet-example.h"
 #include "nnet3/nnet-example-utils.h"
+#include "nnet3/nnet-example-compact.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -49,7 +50,8 @@ int main(int argc, char *argv[]) {
     const char *usage =
         "This copies nnet training examples from input to output, but while doing so it\n"
         "merges many NnetExample objects into one, forming a minibatch consisting of a\n"
-        "single NnetExample.\n"
+        "single NnetExample.  The input may also be a compact egs file (see\n"
+        "nnet3-compact-egs) given as compact:<rxfilename>.\n"
         "\n"
         "Usage:  nnet3-merge-egs [options] <egs-rspecifier> <egs-wspecifier>\n"
         "e.g.\n"
@@ -73,7 +75,7 @@ int main(int argc, char *argv[]) {
 
     merging_config.ComputeDerived();
 
-    SequentialNnetExampleReader example_reader(examples_rspecifier);
+    SequentialNnetEgsReader example_reader(examples_rspecifier);
     NnetExampleWriter example_writer(examples_wspecifier);
 
     ExampleMerger merger(merging_config, &example_writer);
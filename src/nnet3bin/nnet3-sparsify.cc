@@ -0,0 +1,195 @@
+// nnet3bin/nnet3-sparsify.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "nnet3/nnet-nnet.h"
+#include "nnet3/nnet-parse.h"
+#include "nnet3/nnet-simple-component.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// Gets the linear and bias parameters of an affine-type component; returns
+// false if the component is not of a type we can convert.
+static bool GetAffineParams(const Component &c, Matrix<BaseFloat> *linear,
+                            Vector<BaseFloat> *bias) {
+  if (const AffineComponent *ac = dynamic_cast<const AffineComponent*>(&c)) {
+    linear->Resize(ac->OutputDim(), ac->InputDim());
+    ac->LinearParams().CopyToMat(linear);
+    bias->Resize(ac->OutputDim());
+    ac->BiasParams().CopyToVec(bias);
+  } else if (const LinearComponent *lc =
+             dynamic_cast<const LinearComponent*>(&c)) {
+    linear->Resize(lc->OutputDim(), lc->InputDim());
+    lc->Params().CopyToMat(linear);
+    bias->Resize(lc->OutputDim());
+  } else if (const FixedAffineComponent *fc =
+             dynamic_cast<const FixedAffineComponent*>(&c)) {
+    linear->Resize(fc->OutputDim(), fc->InputDim());
+    fc->LinearParams().CopyToMat(linear);
+    bias->Resize(fc->OutputDim());
+    fc->BiasParams().CopyToVec(bias);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Returns the absolute value below which we have to zero elements of 'mat' to
+// keep the proportion 'density' of them.
+static BaseFloat DensityThreshold(const MatrixBase<BaseFloat> &mat,
+                                  BaseFloat density) {
+  std::vector<BaseFloat> abs_values;
+  abs_values.reserve(static_cast<size_t>(mat.NumRows()) * mat.NumCols());
+  for (int32 r = 0; r < mat.NumRows(); r++)
+    for (int32 c = 0; c < mat.NumCols(); c++)
+      abs_values.push_back(std::abs(mat(r, c)));
+  size_t num_keep = static_cast<size_t>(density * abs_values.size() + 0.5);
+  if (num_keep >= abs_values.size())
+    return 0.0;
+  std::vector<BaseFloat>::iterator nth = abs_values.end() - num_keep - 1;
+  std::nth_element(abs_values.begin(), nth, abs_values.end());
+  // Elements with absolute value <= *nth will be zeroed.
+  return *nth;
+}
+
+}  // namespace nnet3
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Prunes the weights of affine components (AffineComponent and its\n"
+        "child classes, LinearComponent and FixedAffineComponent) of a 'raw'\n"
+        "nnet3 neural network and replaces them with SparseAffineComponent,\n"
+        "which stores the linear parameters as a sparse matrix.  The result\n"
+        "is only for decoding, as SparseAffineComponent is not trainable.\n"
+        "Elements are zeroed if their absolute value is <= --threshold, or\n"
+        "to achieve the proportion --density of nonzero elements, or where\n"
+        "the matrix given in --masks is zero.  Components whose density would\n"
+        "exceed --max-density are left as they are, since the sparse\n"
+        "multiplication is slower than the dense one unless the matrix is\n"
+        "very sparse.\n"
+        "\n"
+        "Usage:  nnet3-sparsify [options] <nnet-in> <nnet-out>\n"
+        "e.g.:\n"
+        " nnet3-sparsify --density=0.05 final.raw sparse.raw\n";
+
+    bool binary_write = true;
+    std::string name_pattern = "*", masks_rspecifier;
+    BaseFloat threshold = 0.0, density = 1.0, max_density = 0.1;
+
+    ParseOptions po(usage);
+    po.Register("binary", &binary_write, "Write output in binary mode");
+    po.Register("name-pattern", &name_pattern, "Only components whose names "
+                "match this pattern (e.g. 'tdnn*', or 'tdnn1*:tdnn2*') are "
+                "converted.");
+    po.Register("threshold", &threshold, "Elements of the linear parameters "
+                "whose absolute value is <= this are set to zero.");
+    po.Register("density", &density, "If < 1.0, the smallest elements (in "
+                "absolute value) of each linear parameter matrix are set to "
+                "zero so that this proportion of them is nonzero.");
+    po.Register("masks", &masks_rspecifier, "Rspecifier of pruning masks, "
+                "indexed by component name, e.g. as produced by a structured "
+                "pruning recipe; elements where the mask is zero are set to "
+                "zero.  Components with no mask are pruned according to "
+                "--threshold and --density only.");
+    po.Register("max-density", &max_density, "Only convert components whose "
+                "proportion of nonzero linear parameters after pruning is "
+                "<= this.");
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+    if (density <= 0.0 || density > 1.0 || threshold < 0.0)
+      KALDI_ERR << "Invalid --density or --threshold option";
+
+    std::string raw_nnet_rxfilename = po.GetArg(1),
+                raw_nnet_wxfilename = po.GetArg(2);
+
+    Nnet nnet;
+    ReadKaldiObject(raw_nnet_rxfilename, &nnet);
+
+    RandomAccessBaseFloatMatrixReader mask_reader;
+    if (!masks_rspecifier.empty() && !mask_reader.Open(masks_rspecifier))
+      KALDI_ERR << "Error opening masks from " << masks_rspecifier;
+
+    int32 num_converted = 0, num_skipped = 0;
+    for (int32 c = 0; c < nnet.NumComponents(); c++) {
+      const std::string &name = nnet.GetComponentName(c);
+      if (!NameMatchesPattern(name.c_str(), name_pattern.c_str()))
+        continue;
+      Matrix<BaseFloat> linear;
+      Vector<BaseFloat> bias;
+      if (!GetAffineParams(*nnet.GetComponent(c), &linear, &bias))
+        continue;
+      if (!masks_rspecifier.empty() && mask_reader.HasKey(name)) {
+        const Matrix<BaseFloat> &mask = mask_reader.Value(name);
+        if (!SameDim(mask, linear))
+          KALDI_ERR << "Mask for component " << name << " has wrong dimension "
+                    << mask.NumRows() << " x " << mask.NumCols();
+        for (int32 r = 0; r < linear.NumRows(); r++)
+          for (int32 i = 0; i < linear.NumCols(); i++)
+            if (mask(r, i) == 0.0)
+              linear(r, i) = 0.0;
+      }
+      BaseFloat this_threshold = threshold;
+      if (density < 1.0)
+        this_threshold = std::max(this_threshold,
+                                  DensityThreshold(linear, density));
+      int64 num_elements = static_cast<int64>(linear.NumRows()) *
+          linear.NumCols(), num_nonzero = 0;
+      for (int32 r = 0; r < linear.NumRows(); r++) {
+        for (int32 i = 0; i < linear.NumCols(); i++) {
+          if (std::abs(linear(r, i)) <= this_threshold)
+            linear(r, i) = 0.0;
+          else if (linear(r, i) != 0.0)
+            num_nonzero++;
+        }
+      }
+      BaseFloat this_density = num_nonzero /
+          static_cast<BaseFloat>(num_elements);
+      if (this_density > max_density) {
+        KALDI_LOG << "Not converting component " << name << " since its "
+                  << "density " << this_density << " would be more than "
+                  << "--max-density=" << max_density;
+        num_skipped++;
+        continue;
+      }
+      KALDI_VLOG(1) << "Converting component " << name << " to "
+                    << "SparseAffineComponent with density " << this_density;
+      nnet.SetComponent(c, new SparseAffineComponent(linear, bias));
+      num_converted++;
+    }
+    WriteKaldiObject(nnet, raw_nnet_wxfilename, binary_write);
+    KALDI_LOG << "Converted " << num_converted << " components to "
+              << "SparseAffineComponent (left " << num_skipped << " as they "
+              << "were) and wrote neural net to " << raw_nnet_wxfilename;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+}
@@ -0,0 +1,94 @@
+// nnet3bin/nnet3-train-parallel.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "nnet3/nnet-training-parallel.h"
+#include "nnet3/nnet-example-pipeline.h"
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+    typedef kaldi::int64 int64;
+
+    const char *usage =
+        "Train nnet3 neural network parameters with backprop and stochastic\n"
+        "gradient descent, using multiple threads (for CPU, not GPU).  Each\n"
+        "thread trains its own copy of the model on different minibatches,\n"
+        "and the copies are averaged every --average-interval minibatches.\n"
+        "Minibatches are to be created by nnet3-merge-egs in the input\n"
+        "pipeline, or by this program if --merge-egs=true.  Otherwise the same\n"
+        "as nnet3-train.\n"
+        "\n"
+        "Usage:  nnet3-train-parallel [options] <raw-model-in> <training-examples-in> <raw-model-out>\n"
+        "\n"
+        "e.g.:\n"
+        "nnet3-train-parallel --num-threads=8 1.raw 'ark:nnet3-merge-egs 1.egs ark:-|' 2.raw\n";
+
+    int32 srand_seed = 0;
+    bool binary_write = true;
+    NnetTrainerOptions train_config;
+    NnetParallelTrainerOptions parallel_config;
+    ExamplePipelineOptions pipeline_opts;
+
+    ParseOptions po(usage);
+    po.Register("srand", &srand_seed, "Seed for random number generator ");
+    po.Register("binary", &binary_write, "Write output in binary mode");
+
+    train_config.Register(&po);
+    parallel_config.Register(&po);
+    pipeline_opts.Register(&po);
+
+    po.Read(argc, argv);
+
+    srand(srand_seed);
+
+    if (po.NumArgs() != 3) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string nnet_rxfilename = po.GetArg(1),
+        examples_rspecifier = po.GetArg(2),
+        nnet_wxfilename = po.GetArg(3);
+
+    Nnet nnet;
+    ReadKaldiObject(nnet_rxfilename, &nnet);
+
+    bool ok;
+    {
+      NnetParallelTrainer trainer(train_config, parallel_config, &nnet);
+
+      NnetExamplePipeline example_reader(pipeline_opts, examples_rspecifier);
+
+      for (; !example_reader.Done(); example_reader.Next())
+        trainer.Train(example_reader.Value());
+
+      trainer.Finish();
+      ok = trainer.PrintTotalStats();
+    }
+
+    WriteKaldiObject(nnet, nnet_wxfilename, binary_write);
+    KALDI_LOG << "Wrote model to " << nnet_wxfilename;
+    return (ok ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+}
@@ -20,6 +20,7 @@
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "nnet3/nnet-training.h"
+#include "nnet3/nnet-example-pipeline.h"
 #include "cudamatrix/cu-allocator.h"
 
 int main(int argc, char *argv[]) {
@@ -32,19 +33,25 @@ int main(int argc, char *argv[]) {
     const char *usage =
         "Train nnet3 neural network parameters with backprop and stochastic\n"
         "gradient descent.  Minibatches are to be created by nnet3-merge-egs in\n"
-        "the input pipeline.  This training program is single-threaded (best to\n"
+        "the input pipeline, or by this program if --merge-egs=true (see also\n"
+        "--shuffle-buffer-size).  This training program is single-threaded (best to\n"
         "use it with a GPU); see nnet3-train-parallel for multi-threaded training\n"
-        "that is better suited to CPUs.\n"
+        "that is better suited to CPUs.  The examples may also be read from a\n"
+        "compact egs file (see nnet3-compact-egs) given as compact:<rxfilename>.\n"
         "\n"
         "Usage:  nnet3-train [options] <raw-model-in> <training-examples-in> <raw-model-out>\n"
         "\n"
         "e.g.:\n"
-        "nnet3-train 1.raw 'ark:nnet3-merge-egs 1.egs ark:-|' 2.raw\n";
+        "nnet3-train 1.raw 'ark:nnet3-merge-egs 1.egs ark:-|' 2.raw\n"
+        "nnet3-train --merge-egs=true --minibatch-size=256 --shuffle-buffer-size=5000 \\\n"
+        "  1.raw ark:egs.1.ark 2.raw\n"
+        "nnet3-train 1.raw compact:1.cegs 2.raw\n";
 
     int32 srand_seed = 0;
     bool binary_write = true;
     std::string use_gpu = "yes";
     NnetTrainerOptions train_config;
+    ExamplePipelineOptions pipeline_opts;
 
     ParseOptions po(usage);
     po.Register("srand", &srand_seed, "Seed for random number generator ");
@@ -53,6 +60,7 @@ int main(int argc, char *argv[]) {
                 "yes|no|optional|wait, only has effect if compiled with CUDA");
 
     train_config.Register(&po);
+    pipeline_opts.Register(&po);
     RegisterCuAllocatorOptions(&po);
 
     po.Read(argc, argv);
@@ -77,7 +85,7 @@ int main(int argc, char *argv[]) {
 
     NnetTrainer trainer(train_config, &nnet);
 
-    SequentialNnetExampleReader example_reader(examples_rspecifier);
+    NnetExamplePipeline example_reader(pipeline_opts, examples_rspecifier);
 
     for (; !example_reader.Done(); example_reader.Next())
       trainer.Train(example_reader.Value());
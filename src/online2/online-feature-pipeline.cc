@@ -98,6 +98,7 @@ OnlineFeaturePipelineConfig::OnlineFeaturePipelineConfig(
               << "and --splice-feats options";
 
   lda_rxfilename = config.lda_rxfilename;
+  fused_splice_lda = config.fused_splice_lda;
 }
 
 
@@ -196,9 +197,15 @@ void OnlineFeaturePipeline::Init() {
     feature_ = cmvn_;
   }
 
+  splice_lda_ = NULL;
   if (config_.splice_feats && config_.add_deltas) {
     KALDI_ERR << "You cannot supply both --add-deltas and "
               << "--splice-feats options.";
+  } else if (config_.splice_feats && config_.fused_splice_lda &&
+             lda_mat_.NumRows() != 0) {
+    splice_lda_ = new OnlineSpliceTransform(config_.splice_opts, lda_mat_,
+                                            feature_);
+    splice_or_delta_ = NULL;
   } else if (config_.splice_feats) {
     splice_or_delta_ = new OnlineSpliceFrames(config_.splice_opts,
                                               feature_);
@@ -209,7 +216,9 @@ void OnlineFeaturePipeline::Init() {
     splice_or_delta_ = NULL;
   }
 
-  if (lda_mat_.NumRows() != 0) {
+  if (splice_lda_ != NULL) {
+    lda_ = splice_lda_;
+  } else if (lda_mat_.NumRows() != 0) {
     lda_ = new OnlineTransform(lda_mat_,
                                (splice_or_delta_ != NULL ?
                                 splice_or_delta_ : feature_));
@@ -236,6 +245,9 @@ void OnlineFeaturePipeline::SetTransform(
 
 void OnlineFeaturePipeline::FreezeCmvn() {
   cmvn_->Freeze(cmvn_->NumFramesReady() - 1);
+  // Freezing changes the CMVN of frames we may already have processed.
+  if (splice_lda_ != NULL)
+    splice_lda_->ClearCache();
 }
 
 int32 OnlineFeaturePipeline::Dim() const {
@@ -253,6 +265,11 @@ void OnlineFeaturePipeline::GetFrame(int32 frame,
   AdaptedFeature()->GetFrame(frame, feat);
 }
 
+void OnlineFeaturePipeline::GetFrames(const std::vector<int32> &frames,
+                                       MatrixBase<BaseFloat> *feats) {
+  AdaptedFeature()->GetFrames(frames, feats);
+}
+
 OnlineFeaturePipeline::~OnlineFeaturePipeline() {
   // Note: the delete command only deletes pointers that are non-NULL.  Not all
   // of the pointers below will be non-NULL.
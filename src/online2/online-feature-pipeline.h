@@ -61,10 +61,11 @@ struct OnlineFeaturePipelineCommandLineConfig {
   bool splice_feats;
   std::string splice_config;
   std::string lda_rxfilename;
+  bool fused_splice_lda;
 
   OnlineFeaturePipelineCommandLineConfig() :
     feature_type("mfcc"), add_pitch(false), add_deltas(false),
-    splice_feats(false) { }
+    splice_feats(false), fused_splice_lda(false) { }
 
   void Register(OptionsItf *opts) {
     opts->Register("feature-type", &feature_type,
@@ -98,6 +99,10 @@ struct OnlineFeaturePipelineCommandLineConfig {
                    "for frame splicing, if done (e.g. prior to LDA)");
     opts->Register("lda-matrix", &lda_rxfilename, "Filename of LDA matrix (if "
                    "using LDA), e.g. exp/foo/final.mat");
+    opts->Register("fused-splice-lda", &fused_splice_lda, "If true and both "
+                   "--splice-feats and --lda-matrix are supplied, do the "
+                   "splicing and LDA as a single stage that processes blocks "
+                   "of frames (faster, same result up to roundoff).");
   }
 };
 
@@ -112,7 +117,7 @@ struct OnlineFeaturePipelineCommandLineConfig {
 struct OnlineFeaturePipelineConfig {
   OnlineFeaturePipelineConfig():
       feature_type("mfcc"), add_pitch(false), add_deltas(true),
-      splice_feats(false) { }
+      splice_feats(false), fused_splice_lda(false) { }
 
   OnlineFeaturePipelineConfig(
       const OnlineFeaturePipelineCommandLineConfig &cmdline_config);
@@ -142,6 +147,8 @@ struct OnlineFeaturePipelineConfig {
 
   std::string lda_rxfilename;  // Filename for reading LDA or LDA+MLLT matrix,
                                // if used.
+  bool fused_splice_lda;  // If true, do the splicing and LDA (if both are
+                          // done) using class OnlineSpliceTransform.
   std::string global_cmvn_stats_rxfilename;  // Filename used for reading global
                                              // CMVN stats
 };
@@ -163,6 +170,8 @@ class OnlineFeaturePipeline: public OnlineFeatureInterface {
   virtual bool IsLastFrame(int32 frame) const;
   virtual int32 NumFramesReady() const;
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
 
   // This is supplied for debug purposes.
   void GetAsMatrix(Matrix<BaseFloat> *feats);
@@ -237,6 +246,9 @@ class OnlineFeaturePipeline: public OnlineFeatureInterface {
 
   OnlineFeatureInterface *lda_;  // If non-NULL, the LDA or LDA+MLLT transform.
 
+  OnlineSpliceTransform *splice_lda_;  // If non-NULL, the fused splicing and
+                                       // LDA stage; equals lda_.
+
   /// returns lda_ if it exists, else splice_or_delta_, else cmvn_.  If this
   /// were not private we would have const and non-const versions returning
   /// const and non-const pointers.
@@ -513,11 +513,10 @@ bool SingleUtteranceNnet2DecoderThreaded::RunNnetEvaluationInternal() {
     if (num_frames_evaluate > 0) {
       // we have something to do...
       feats.Resize(num_frames_evaluate, feature_pipeline_.Dim());
-      for (int32 i = 0; i < num_frames_evaluate; i++) {
-        int32 t = num_frames_consumed + i;
-        SubVector<BaseFloat> feat(feats, i);
-        feature_pipeline_.GetFrame(t, &feat);
-      }
+      std::vector<int32> frames(num_frames_evaluate);
+      for (int32 i = 0; i < num_frames_evaluate; i++)
+        frames[i] = num_frames_consumed + i;
+      feature_pipeline_.GetFrames(frames, &feats);
     }
     /****** End locking of feature pipeline mutex. ******/
     feature_pipeline_mutex_.unlock();
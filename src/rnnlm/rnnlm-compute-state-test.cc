@@ -0,0 +1,175 @@
+// rnnlm/rnnlm-compute-state-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//  http://www.apache.org/licenses/LICENSE-2.0
+
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <sstream>
+
+#include "base/kaldi-math.h"
+#include "nnet3/nnet-utils.h"
+#include "rnnlm/rnnlm-compute-state.h"
+
+namespace kaldi {
+namespace rnnlm {
+
+// Creates a small recurrent network with the same input and output dimension,
+// as used for RNNLMs, with recurrences at more than one time offset.
+static void GenerateRecurrentRnnlm(int32 embedding_dim, nnet3::Nnet *rnnlm) {
+  int32 hidden_dim = RandInt(5, 20);
+  std::ostringstream os;
+  os << "component name=affine1 type=AffineComponent input-dim="
+     << (embedding_dim + hidden_dim) << " output-dim=" << hidden_dim << "\n"
+     << "component name=tanh1 type=TanhComponent dim=" << hidden_dim << "\n"
+     << "component name=affine2 type=AffineComponent input-dim="
+     << (2 * hidden_dim) << " output-dim=" << embedding_dim << "\n"
+     << "input-node name=input dim=" << embedding_dim << "\n"
+     << "component-node name=affine1 component=affine1 "
+     << "input=Append(input, IfDefined(Offset(tanh1, -1)))\n"
+     << "component-node name=tanh1 component=tanh1 input=affine1\n"
+     << "component-node name=affine2 component=affine2 "
+     << "input=Append(tanh1, IfDefined(Offset(tanh1, -3)))\n"
+     << "output-node name=output input=affine2\n";
+  std::istringstream is(os.str());
+  rnnlm->ReadConfig(is);
+}
+
+// Checks that RnnlmBatchComputer gives the same log-probs as
+// RnnlmComputeState, for a tree of word sequences.
+static void UnitTestRnnlmBatchComputer() {
+  int32 embedding_dim = RandInt(4, 10), num_words = RandInt(5, 30);
+  nnet3::Nnet rnnlm;
+  GenerateRecurrentRnnlm(embedding_dim, &rnnlm);
+  CuMatrix<BaseFloat> word_embedding_mat(num_words, embedding_dim);
+  word_embedding_mat.SetRandn();
+
+  RnnlmComputeStateComputationOptions opts;
+  opts.bos_index = 1;
+  opts.eos_index = 2;
+  opts.normalize_probs = (RandInt(0, 1) == 0);
+  if (RandInt(0, 1) == 0) {
+    opts.normalize_shortlist_size = RandInt(0, num_words);
+    opts.normalize_num_classes = RandInt(1, 4);
+  }
+  RnnlmComputeStateInfo info(opts, rnnlm, word_embedding_mat);
+  RnnlmBatchComputer batch_computer(info, RandInt(1, 8));
+
+  std::vector<RnnlmComputeState*> states;
+  std::vector<RnnlmBatchState*> batch_states;
+  states.push_back(new RnnlmComputeState(info, opts.bos_index));
+  batch_states.push_back(batch_computer.GetInitialState());
+  for (int32 iter = 0; iter < 15; iter++) {
+    // Extend randomly chosen states (more than once each, sometimes), all
+    // in one call.  We need enough iterations to get to the loop of the
+    // looped computation.
+    int32 num_new = RandInt(1, 10), num_existing = batch_states.size();
+    std::vector<const RnnlmBatchState*> predecessors;
+    std::vector<int32> words;
+    for (int32 i = 0; i < num_new; i++) {
+      int32 s = RandInt(0, num_existing - 1),
+          word = RandInt(2, num_words - 1);
+      predecessors.push_back(batch_states[s]);
+      words.push_back(word);
+      states.push_back(states[s]->GetSuccessorState(word));
+    }
+    std::vector<RnnlmBatchState*> successors;
+    batch_computer.GetSuccessorStates(predecessors, words, &successors);
+    batch_states.insert(batch_states.end(), successors.begin(),
+                        successors.end());
+  }
+  for (size_t s = 0; s < states.size(); s++) {
+    for (int32 word = 1; word < num_words; word++) {
+      BaseFloat logprob = states[s]->LogProbOfWord(word),
+          batch_logprob = batch_computer.LogProbOfWord(*(batch_states[s]),
+                                                       word);
+      KALDI_ASSERT(ApproxEqual(logprob, batch_logprob, 0.001) ||
+                   std::abs(logprob - batch_logprob) < 1.0e-04);
+    }
+    delete states[s];
+    delete batch_states[s];
+  }
+  batch_computer.PrintStats();
+}
+
+// Checks RnnlmComputeStateInfo::ComputeLogNormalizers() with a shortlist: it
+// should be exact if each class has one word, and close if the embeddings of
+// the words in each class are close.
+static void UnitTestRnnlmShortlistNormalizer() {
+  int32 embedding_dim = RandInt(4, 10), num_words = RandInt(20, 100);
+  nnet3::Nnet rnnlm;
+  GenerateRecurrentRnnlm(embedding_dim, &rnnlm);
+  CuMatrix<BaseFloat> word_embedding_mat(num_words, embedding_dim);
+  word_embedding_mat.SetRandn();
+  CuMatrix<BaseFloat> predicted_embeddings(RandInt(1, 5), embedding_dim);
+  predicted_embeddings.SetRandn();
+
+  RnnlmComputeStateComputationOptions opts;
+  opts.bos_index = 1;
+  opts.eos_index = 2;
+  opts.normalize_probs = true;
+  CuVector<BaseFloat> exact(predicted_embeddings.NumRows()),
+      approx(predicted_embeddings.NumRows());
+  {
+    RnnlmComputeStateInfo info(opts, rnnlm, word_embedding_mat);
+    info.ComputeLogNormalizers(predicted_embeddings, &exact);
+  }
+  int32 shortlist_size = RandInt(0, num_words);
+  opts.normalize_shortlist_size = shortlist_size;
+  opts.normalize_num_classes = num_words;
+  {
+    RnnlmComputeStateInfo info(opts, rnnlm, word_embedding_mat);
+    info.ComputeLogNormalizers(predicted_embeddings, &approx);
+    AssertEqual(exact, approx);
+  }
+
+  // Make the words outside the shortlist come in contiguous groups of
+  // near-identical embeddings, one group per class.
+  int32 tail_begin = std::max(shortlist_size, 1),
+      num_tail_words = num_words - tail_begin,
+      num_classes = std::min(RandInt(1, 5), num_tail_words);
+  Matrix<BaseFloat> embeddings(word_embedding_mat);
+  for (int32 w = tail_begin; w < num_words; w++) {
+    int32 c = ((w - tail_begin) * num_classes) / num_tail_words;
+    embeddings.Row(w).CopyFromVec(embeddings.Row(tail_begin + c));
+    for (int32 d = 0; d < embedding_dim; d++)
+      embeddings(w, d) += 0.01 * RandGauss();
+  }
+  word_embedding_mat.CopyFromMat(embeddings);
+  opts.normalize_shortlist_size = -1;
+  {
+    RnnlmComputeStateInfo info(opts, rnnlm, word_embedding_mat);
+    info.ComputeLogNormalizers(predicted_embeddings, &exact);
+  }
+  opts.normalize_shortlist_size = shortlist_size;
+  opts.normalize_num_classes = num_classes;
+  {
+    RnnlmComputeStateInfo info(opts, rnnlm, word_embedding_mat);
+    info.ComputeLogNormalizers(predicted_embeddings, &approx);
+    AssertEqual<BaseFloat>(exact, approx, 0.01);
+  }
+}
+
+}  // namespace rnnlm
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::rnnlm;
+  for (int32 i = 0; i < 10; i++)
+    UnitTestRnnlmBatchComputer();
+  for (int32 i = 0; i < 10; i++)
+    UnitTestRnnlmShortlistNormalizer();
+  KALDI_LOG << "Tests succeeded.";
+  return 0;
+}
@@ -19,7 +19,10 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <sstream>
+
 #include "rnnlm/rnnlm-compute-state.h"
+#include "base/timer.h"
 #include "nnet3/nnet-utils.h"
 #include "nnet3/nnet-compile-looped.h"
 
@@ -30,7 +33,8 @@ RnnlmComputeStateInfo::RnnlmComputeStateInfo(
     const RnnlmComputeStateComputationOptions &opts,
     const kaldi::nnet3::Nnet &rnnlm,
     const CuMatrix<BaseFloat> &word_embedding_mat):
-    opts(opts), rnnlm(rnnlm), word_embedding_mat(word_embedding_mat) {
+    opts(opts), rnnlm(rnnlm), word_embedding_mat(word_embedding_mat),
+    shortlist_size_(word_embedding_mat.NumRows() - 1) {
   KALDI_ASSERT(IsSimpleNnet(rnnlm));
   int32 left_context, right_context;
   ComputeSimpleNnetContext(rnnlm, &left_context, &right_context);
@@ -51,6 +55,9 @@ RnnlmComputeStateInfo::RnnlmComputeStateInfo(
     KALDI_ERR << "--eos-symbol option isn't set correctly.";
   }
 
+  if (opts.normalize_probs && opts.normalize_shortlist_size >= 0)
+    InitNormalizerClasses();
+
   nnet3::ComputationRequest request1, request2, request3;
   CreateLoopedComputationRequestSimple(rnnlm,
                                        1, // num_frames
@@ -70,20 +77,144 @@ RnnlmComputeStateInfo::RnnlmComputeStateInfo(
   }
 }
 
+void RnnlmComputeStateInfo::InitNormalizerClasses() {
+  int32 num_words = word_embedding_mat.NumRows(),
+      embedding_dim = word_embedding_mat.NumCols();
+  shortlist_size_ = std::max(0, std::min(opts.normalize_shortlist_size - 1,
+                                         num_words - 1));
+  int32 tail_begin = 1 + shortlist_size_,
+      num_tail_words = num_words - tail_begin;
+  int32 num_classes = std::min(opts.normalize_num_classes, num_tail_words);
+  if (num_classes <= 0) {
+    if (num_tail_words > 0)
+      KALDI_ERR << "--normalize-num-classes must be positive.";
+    return;
+  }
+  CuSubMatrix<BaseFloat> tail_embeddings(
+      word_embedding_mat.RowRange(tail_begin, num_tail_words));
+  Matrix<BaseFloat> tail_embeddings_cpu(tail_embeddings);
+
+  // Initialize the means with words spread evenly over the tail (which is
+  // sorted by frequency, normally), and do a few iterations of k-means.
+  Matrix<BaseFloat> means(num_classes, embedding_dim);
+  for (int32 c = 0; c < num_classes; c++)
+    means.Row(c).CopyFromVec(tail_embeddings_cpu.Row(
+        (static_cast<int64>(c) * num_tail_words) / num_classes));
+  std::vector<int32> assignments;
+  int32 num_iters = 10;
+  for (int32 iter = 0; iter <= num_iters; iter++) {
+    // Assign each word to the closest mean, i.e. the one that maximizes
+    // 2 x . mean - mean . mean.
+    CuMatrix<BaseFloat> means_cuda(means);
+    CuVector<BaseFloat> mean_sqnorms(num_classes);
+    mean_sqnorms.AddDiagMat2(-1.0, means_cuda, kNoTrans, 0.0);
+    CuMatrix<BaseFloat> scores(num_tail_words, num_classes, kUndefined);
+    scores.CopyRowsFromVec(mean_sqnorms);
+    scores.AddMatMat(2.0, tail_embeddings, kNoTrans, means_cuda, kTrans, 1.0);
+    CuArray<int32> assignments_cuda(num_tail_words);
+    scores.FindRowMaxId(&assignments_cuda);
+    assignments_cuda.CopyToVec(&assignments);
+    if (iter == num_iters)
+      break;
+    // Update the means; empty classes keep their old means.
+    Matrix<BaseFloat> sums(num_classes, embedding_dim);
+    std::vector<int32> counts(num_classes, 0);
+    for (int32 w = 0; w < num_tail_words; w++) {
+      sums.Row(assignments[w]).AddVec(1.0, tail_embeddings_cpu.Row(w));
+      counts[assignments[w]]++;
+    }
+    for (int32 c = 0; c < num_classes; c++) {
+      if (counts[c] > 0) {
+        means.Row(c).CopyFromVec(sums.Row(c));
+        means.Row(c).Scale(1.0 / counts[c]);
+      }
+    }
+  }
+
+  // Compute the statistics of the classes; we leave out the empty ones.
+  Matrix<BaseFloat> sums(num_classes, embedding_dim),
+      sumsq(num_classes, embedding_dim);
+  std::vector<int32> counts(num_classes, 0);
+  for (int32 w = 0; w < num_tail_words; w++) {
+    int32 c = assignments[w];
+    sums.Row(c).AddVec(1.0, tail_embeddings_cpu.Row(w));
+    sumsq.Row(c).AddVec2(1.0, tail_embeddings_cpu.Row(w));
+    counts[c]++;
+  }
+  int32 num_nonempty = 0;
+  for (int32 c = 0; c < num_classes; c++)
+    if (counts[c] > 0)
+      num_nonempty++;
+  Matrix<BaseFloat> class_means(num_nonempty, embedding_dim),
+      class_half_variances(num_nonempty, embedding_dim);
+  Vector<BaseFloat> class_log_counts(num_nonempty);
+  for (int32 c = 0, i = 0; c < num_classes; c++) {
+    if (counts[c] == 0)
+      continue;
+    SubVector<BaseFloat> mean(class_means, i), half_var(class_half_variances, i);
+    mean.AddVec(1.0 / counts[c], sums.Row(c));
+    half_var.AddVec(1.0 / counts[c], sumsq.Row(c));
+    half_var.AddVec2(-1.0, mean);
+    half_var.ApplyFloor(0.0);
+    half_var.Scale(0.5);
+    class_log_counts(i) = Log(static_cast<BaseFloat>(counts[c]));
+    i++;
+  }
+  class_means_ = class_means;
+  class_half_variances_ = class_half_variances;
+  class_log_counts_ = class_log_counts;
+  KALDI_LOG << "Normalizing RNNLM probabilities with a shortlist of "
+            << shortlist_size_ << " words and " << num_nonempty
+            << " classes for the other " << num_tail_words << " words.";
+}
+
+void RnnlmComputeStateInfo::ComputeLogNormalizers(
+    const CuMatrixBase<BaseFloat> &predicted_embeddings,
+    CuVectorBase<BaseFloat> *log_normalizers) const {
+  int32 num_rows = predicted_embeddings.NumRows();
+  KALDI_ASSERT(log_normalizers->Dim() == num_rows);
+  log_normalizers->SetZero();
+  if (shortlist_size_ > 0) {
+    // We exclude the <eps> symbol.
+    CuMatrix<BaseFloat> probs(num_rows, shortlist_size_, kUndefined);
+    probs.AddMatMat(1.0, predicted_embeddings, kNoTrans,
+                    word_embedding_mat.RowRange(1, shortlist_size_), kTrans,
+                    0.0);
+    probs.ApplyExp();
+    log_normalizers->AddColSumMat(1.0, probs, 1.0);
+  }
+  int32 num_classes = class_means_.NumRows();
+  if (num_classes > 0) {
+    CuMatrix<BaseFloat> class_probs(num_rows, num_classes, kUndefined);
+    class_probs.CopyRowsFromVec(class_log_counts_);
+    class_probs.AddMatMat(1.0, predicted_embeddings, kNoTrans, class_means_,
+                          kTrans, 1.0);
+    CuMatrix<BaseFloat> embeddings_sq(predicted_embeddings);
+    embeddings_sq.ApplyPow(2.0);
+    class_probs.AddMatMat(1.0, embeddings_sq, kNoTrans, class_half_variances_,
+                          kTrans, 1.0);
+    class_probs.ApplyExp();
+    log_normalizers->AddColSumMat(1.0, class_probs, 1.0);
+  }
+  log_normalizers->ApplyLog();
+}
+
 RnnlmComputeState::RnnlmComputeState(const RnnlmComputeStateInfo &info,
                                      int32 bos_index) :
     info_(info),
     computer_(info_.opts.compute_config, info_.computation,
               info_.rnnlm, NULL),  // NULL is 'nnet_to_update'
     previous_word_(-1),
-    normalization_factor_(0.0) {
+    normalization_factor_(0.0),
+    normalization_factor_computed_(false) {
   AddWord(bos_index);
 }
 
 RnnlmComputeState::RnnlmComputeState(const RnnlmComputeState &other):
   info_(other.info_), computer_(other.computer_),
   previous_word_(other.previous_word_),
-  normalization_factor_(other.normalization_factor_)
+  normalization_factor_(other.normalization_factor_),
+  normalization_factor_computed_(other.normalization_factor_computed_)
 {}
 
 RnnlmComputeState* RnnlmComputeState::GetSuccessorState(int32 next_word) const {
@@ -96,18 +227,18 @@ void RnnlmComputeState::AddWord(int32 word_index) {
   KALDI_ASSERT(word_index > 0 && word_index < info_.word_embedding_mat.NumRows());
   previous_word_ = word_index;
   AdvanceChunk();
+  normalization_factor_computed_ = false;
+}
 
-  const CuMatrix<BaseFloat> &word_embedding_mat = info_.word_embedding_mat;
-  if (info_.opts.normalize_probs) {
-    CuVector<BaseFloat> log_probs(info_.word_embedding_mat.NumRows());
-
-    log_probs.AddMatVec(1.0, word_embedding_mat, kNoTrans,
-                        predicted_word_embedding_->Row(0), 0.0);
-    log_probs.ApplyExp();
-
-    // We excluding the <eps> symbol which is always 0.
-    normalization_factor_ = log(log_probs.Range(1, log_probs.Dim() - 1).Sum());
+BaseFloat RnnlmComputeState::NormalizationFactor() const {
+  if (!normalization_factor_computed_) {
+    CuVector<BaseFloat> log_normalizer(1);
+    info_.ComputeLogNormalizers(predicted_word_embedding_->RowRange(0, 1),
+                                &log_normalizer);
+    normalization_factor_ = log_normalizer(0);
+    normalization_factor_computed_ = true;
   }
+  return normalization_factor_;
 }
 
 BaseFloat RnnlmComputeState::LogProbOfWord(int32 word_index) const {
@@ -119,7 +250,7 @@ BaseFloat RnnlmComputeState::LogProbOfWord(int32 word_index) const {
   // Even without explicit normalization, the log-probs will be close to
   // correctly normalized due to the way the model was trained.
   if (info_.opts.normalize_probs) {
-    log_prob -= normalization_factor_;
+    log_prob -= NormalizationFactor();
   }
   return log_prob;
 }
@@ -128,14 +259,14 @@ void RnnlmComputeState::GetLogProbOfWords(CuMatrixBase<BaseFloat> *output) const
   const CuMatrix<BaseFloat> &word_embedding_mat = info_.word_embedding_mat;
 
   KALDI_ASSERT(output->NumRows() == 1
-                && output->NumCols() == word_embedding_mat.NumCols());
+                && output->NumCols() == word_embedding_mat.NumRows());
   output->Row(0).AddMatVec(1.0, word_embedding_mat, kNoTrans,
                    predicted_word_embedding_->Row(0), 0.0);
 
   // Even without explicit normalization, the log-probs will be close to
   // correctly normalized due to the way the model was trained.
   if (info_.opts.normalize_probs) {
-    output->Add(normalization_factor_);
+    output->Add(-NormalizationFactor());
   }
 
   // making sure <eps> has almost 0 prob
@@ -157,5 +288,387 @@ void RnnlmComputeState::AdvanceChunk() {
   }
 }
 
+// Sets 'cindexes' to the cindexes of the rows of matrix 'm' of 'computation'
+// that belong to the first sequence, in order.
+static void GetFirstSequenceCindexes(const nnet3::NnetComputation &computation,
+                                     int32 m,
+                                     std::vector<nnet3::Cindex> *cindexes) {
+  const std::vector<nnet3::Cindex> &all_cindexes =
+      computation.matrix_debug_info[m].cindexes;
+  cindexes->clear();
+  for (size_t r = 0; r < all_cindexes.size(); r++)
+    if (all_cindexes[r].second.n == 0)
+      cindexes->push_back(all_cindexes[r]);
+}
+
+RnnlmBatchComputer::BatchComputation::~BatchComputation() {
+  for (size_t c = 0; c < templates.size(); c++)
+    delete templates[c];
+}
+
+RnnlmBatchComputer::RnnlmBatchComputer(const RnnlmComputeStateInfo &info,
+                                       int32 batch_size):
+    info_(info), batch_size_(batch_size),
+    compute_config_(info.opts.compute_config), max_num_chunks_(-1),
+    num_states_computed_(0), num_sequences_computed_(0),
+    compute_time_(0.0) {
+  KALDI_ASSERT(batch_size > 0);
+  compute_config_.use_memory_arena = false;
+
+  // The computation with batch_size sequences defines the order of the
+  // matrices in RnnlmBatchState::matrix_rows.
+  BatchComputation *canonical = CreateComputation(batch_size);
+  max_num_chunks_ = canonical->templates.size() - 1;
+  for (int32 num_sequences = 1; num_sequences < batch_size;
+       num_sequences *= 2) {
+    BatchComputation *computation = CreateComputation(num_sequences);
+    if (SetStateMatrices(*canonical, computation)) {
+      computations_.push_back(computation);
+    } else {
+      KALDI_WARN << "The RNNLM computations with " << num_sequences
+                 << " and " << batch_size << " sequences have different "
+                 << "state matrices; not using the former.";
+      delete computation;
+    }
+  }
+  computations_.push_back(canonical);
+}
+
+RnnlmBatchComputer::BatchComputation*
+RnnlmBatchComputer::CreateComputation(int32 num_sequences) {
+  BatchComputation *ans = new BatchComputation();
+  ans->num_sequences = num_sequences;
+  nnet3::ComputationRequest requests[3];
+  CreateLoopedComputationRequestSimple(info_.rnnlm,
+                                       1, // num_frames
+                                       1, // frame_subsampling_factor
+                                       1, // ivector_period = 1
+                                       0, // extra_left_context_initial == 0
+                                       0, // extra_right_context == 0
+                                       num_sequences,
+                                       &(requests[0]), &(requests[1]),
+                                       &(requests[2]));
+  nnet3::NnetComputation &computation = ans->computation;
+  CompileLooped(info_.rnnlm, info_.opts.optimize_config, requests[0],
+                requests[1], requests[2], &computation);
+  computation.ComputeCudaIndexes();
+
+  // Work out the rows of the input and the output that belong to each
+  // sequence from the requests; they are the same for all the chunks.
+  for (int32 r = 0; r < 3; r++) {
+    const nnet3::ComputationRequest &request = requests[r];
+    int32 input_index = request.IndexForInput("input"),
+        output_index = request.IndexForOutput("output");
+    KALDI_ASSERT(input_index >= 0 && output_index >= 0);
+    const std::vector<nnet3::Index>
+        &input_indexes = request.inputs[input_index].indexes,
+        &output_indexes = request.outputs[output_index].indexes;
+    // There is one frame per sequence, as the RNNLM has no context.
+    if (static_cast<int32>(input_indexes.size()) != num_sequences ||
+        static_cast<int32>(output_indexes.size()) != num_sequences)
+      KALDI_ERR << "Expected one row of input and output per sequence.";
+    std::vector<int32> input_sequences(num_sequences),
+        output_rows(num_sequences, -1);
+    for (int32 i = 0; i < num_sequences; i++) {
+      int32 input_n = input_indexes[i].n, output_n = output_indexes[i].n;
+      KALDI_ASSERT(input_n >= 0 && input_n < num_sequences &&
+                   output_n >= 0 && output_n < num_sequences &&
+                   output_rows[output_n] == -1);
+      input_sequences[i] = input_n;
+      output_rows[output_n] = i;
+    }
+    if (r == 0) {
+      ans->input_sequences = input_sequences;
+      ans->output_rows = output_rows;
+    } else if (input_sequences != ans->input_sequences ||
+               output_rows != ans->output_rows) {
+      KALDI_ERR << "The order of the sequences differs between chunks.";
+    }
+  }
+
+  // For the other matrices we have to use the debug info.
+  int32 num_matrices = computation.matrices.size();
+  if (static_cast<int32>(computation.matrix_debug_info.size()) !=
+      num_matrices)
+    KALDI_ERR << "Computation has no debug info; cannot batch it.";
+  ans->rows_per_sequence.resize(num_matrices, -1);
+  ans->gather_indexes.resize(num_matrices);
+  ans->scatter_indexes.resize(num_matrices);
+  for (int32 m = 1; m < num_matrices; m++) {
+    const std::vector<nnet3::Cindex> &cindexes =
+        computation.matrix_debug_info[m].cindexes;
+    int32 num_rows = computation.matrices[m].num_rows;
+    if (static_cast<int32>(cindexes.size()) != num_rows)
+      continue;
+    std::vector<std::vector<int32> > rows(num_sequences);
+    bool ok = true;
+    for (int32 r = 0; r < num_rows; r++) {
+      int32 n = cindexes[r].second.n;
+      if (n < 0 || n >= num_sequences) {
+        ok = false;
+        break;
+      }
+      rows[n].push_back(r);
+    }
+    for (int32 n = 1; n < num_sequences; n++)
+      if (rows[n].size() != rows[0].size())
+        ok = false;
+    if (!ok)
+      continue;
+    std::vector<int32> gather, scatter(num_rows);
+    for (int32 n = 0; n < num_sequences; n++)
+      gather.insert(gather.end(), rows[n].begin(), rows[n].end());
+    for (int32 i = 0; i < num_rows; i++)
+      scatter[gather[i]] = i;
+    ans->rows_per_sequence[m] = rows[0].size();
+    ans->gather_indexes[m] = gather;
+    ans->scatter_indexes[m] = scatter;
+  }
+
+  int32 max_num_chunks = 1;
+  bool found_loop = false;
+  for (size_t c = 0; c < computation.commands.size(); c++) {
+    nnet3::CommandType command_type = computation.commands[c].command_type;
+    if (command_type == nnet3::kNoOperationLabel) {
+      found_loop = true;
+      break;
+    } else if (command_type == nnet3::kProvideOutput) {
+      max_num_chunks++;
+    }
+  }
+  if (!found_loop)
+    KALDI_ERR << "Expected a looped computation.";
+
+  // Run the chunks before the loop and the first one in it to get the
+  // template computers, and work out which matrices are allocated after each
+  // of them.
+  int32 embedding_dim = info_.word_embedding_mat.NumCols();
+  ans->templates.resize(max_num_chunks + 1);
+  ans->state_matrices.resize(max_num_chunks + 1);
+  ans->templates[0] = new nnet3::NnetComputer(compute_config_, computation,
+                                              info_.rnnlm, NULL);
+  for (int32 c = 1; c <= max_num_chunks; c++) {
+    ans->templates[c] = new nnet3::NnetComputer(*(ans->templates[c - 1]));
+    CuMatrix<BaseFloat> input(num_sequences, embedding_dim);
+    ans->templates[c]->AcceptInput("input", &input);
+    ans->templates[c]->Run();
+    ans->templates[c]->GetOutput("output");
+  }
+  for (int32 c = 0; c <= max_num_chunks; c++) {
+    for (int32 m = 1; m < num_matrices; m++) {
+      if (ans->templates[c]->GetComputationMatrix(m).NumRows() == 0)
+        continue;
+      if (ans->rows_per_sequence[m] < 0)
+        KALDI_ERR << "Cannot work out which rows of matrix " << m
+                  << " belong to which sequence.";
+      ans->state_matrices[c].push_back(m);
+    }
+  }
+  return ans;
+}
+
+bool RnnlmBatchComputer::SetStateMatrices(
+    const BatchComputation &canonical,
+    BatchComputation *computation) const {
+  if (computation->templates.size() != canonical.templates.size())
+    return false;
+  // We match up the matrices by the cindexes and dimension of the rows of a
+  // sequence.
+  std::vector<nnet3::Cindex> canonical_cindexes, cindexes;
+  for (size_t c = 0; c < canonical.state_matrices.size(); c++) {
+    const std::vector<int32> &canonical_matrices = canonical.state_matrices[c];
+    std::vector<int32> matrices = computation->state_matrices[c],
+        ordered_matrices;
+    if (matrices.size() != canonical_matrices.size())
+      return false;
+    for (size_t i = 0; i < canonical_matrices.size(); i++) {
+      int32 canonical_m = canonical_matrices[i];
+      GetFirstSequenceCindexes(canonical.computation, canonical_m,
+                               &canonical_cindexes);
+      size_t j = 0;
+      for (; j < matrices.size(); j++) {
+        int32 m = matrices[j];
+        if (m < 0 || computation->computation.matrices[m].num_cols !=
+            canonical.computation.matrices[canonical_m].num_cols)
+          continue;
+        GetFirstSequenceCindexes(computation->computation, m, &cindexes);
+        if (cindexes == canonical_cindexes)
+          break;
+      }
+      if (j == matrices.size())
+        return false;
+      ordered_matrices.push_back(matrices[j]);
+      matrices[j] = -1;
+    }
+    computation->state_matrices[c] = ordered_matrices;
+  }
+  return true;
+}
+
+RnnlmBatchComputer::~RnnlmBatchComputer() {
+  for (size_t i = 0; i < computations_.size(); i++)
+    delete computations_[i];
+}
+
+RnnlmBatchState *RnnlmBatchComputer::GetInitialState() {
+  std::vector<const RnnlmBatchState*> states(1, NULL);
+  std::vector<int32> words(1, info_.opts.bos_index);
+  RnnlmBatchState *ans;
+  ComputeBatch(states, words, &ans);
+  return ans;
+}
+
+void RnnlmBatchComputer::GetSuccessorStates(
+    const std::vector<const RnnlmBatchState*> &states,
+    const std::vector<int32> &words,
+    std::vector<RnnlmBatchState*> *successors) {
+  KALDI_ASSERT(states.size() == words.size());
+  successors->resize(states.size());
+  // States with different num_chunks need different parts of the looped
+  // computation, so we batch them separately.
+  for (int32 num_chunks = 1; num_chunks <= max_num_chunks_; num_chunks++) {
+    std::vector<int32> indexes;
+    for (size_t i = 0; i < states.size(); i++)
+      if (states[i]->num_chunks == num_chunks)
+        indexes.push_back(i);
+    for (size_t begin = 0; begin < indexes.size(); begin += batch_size_) {
+      size_t end = std::min<size_t>(begin + batch_size_, indexes.size());
+      std::vector<const RnnlmBatchState*> batch_states;
+      std::vector<int32> batch_words;
+      for (size_t i = begin; i < end; i++) {
+        batch_states.push_back(states[indexes[i]]);
+        batch_words.push_back(words[indexes[i]]);
+      }
+      std::vector<RnnlmBatchState*> batch_successors(end - begin);
+      ComputeBatch(batch_states, batch_words, &(batch_successors[0]));
+      for (size_t i = begin; i < end; i++)
+        (*successors)[indexes[i]] = batch_successors[i - begin];
+    }
+  }
+}
+
+void RnnlmBatchComputer::ComputeBatch(
+    const std::vector<const RnnlmBatchState*> &states,
+    const std::vector<int32> &words,
+    RnnlmBatchState **successors) {
+  Timer timer;
+  int32 num_states = words.size();
+  KALDI_ASSERT(num_states > 0 && num_states <= batch_size_);
+  // We use the smallest computation that has room for all the states.
+  size_t index = 0;
+  while (computations_[index]->num_sequences < num_states)
+    index++;
+  BatchComputation &batch = *(computations_[index]);
+  int32 num_sequences = batch.num_sequences,
+      num_chunks = (states[0] == NULL ? 0 : states[0]->num_chunks),
+      next_num_chunks = std::min(num_chunks + 1, max_num_chunks_);
+  nnet3::NnetComputer computer(*(batch.templates[num_chunks]));
+
+  // Copy the rows of the states into the sequences of the computation; the
+  // sequences we don't use are zeroed.
+  const std::vector<int32> &matrices = batch.state_matrices[num_chunks];
+  for (size_t i = 0; i < matrices.size(); i++) {
+    int32 m = matrices[i], k = batch.rows_per_sequence[m];
+    CuMatrix<BaseFloat> &mat = computer.GetComputationMatrix(m);
+    CuMatrix<BaseFloat> gathered(num_sequences * k, mat.NumCols());
+    for (int32 s = 0; s < num_states; s++) {
+      KALDI_ASSERT(states[s]->num_chunks == num_chunks);
+      gathered.RowRange(s * k, k).CopyFromMat(states[s]->matrix_rows[i]);
+    }
+    mat.CopyRows(gathered, batch.scatter_indexes[m]);
+  }
+
+  const CuMatrix<BaseFloat> &word_embedding_mat = info_.word_embedding_mat;
+  for (int32 s = 0; s < num_states; s++)
+    KALDI_ASSERT(words[s] > 0 && words[s] < word_embedding_mat.NumRows());
+  std::vector<int32> input_words(num_sequences, -1);
+  for (int32 r = 0; r < num_sequences; r++) {
+    int32 s = batch.input_sequences[r];
+    if (s < num_states)
+      input_words[r] = words[s];
+  }
+  CuArray<int32> input_words_cuda(input_words);
+  CuMatrix<BaseFloat> input_embeddings(num_sequences,
+                                       word_embedding_mat.NumCols(),
+                                       kUndefined);
+  input_embeddings.CopyRows(word_embedding_mat, input_words_cuda);
+  computer.AcceptInput("input", &input_embeddings);
+  computer.Run();
+  // As in AdvanceChunk(), we can't use GetOutputDestructive() here.
+  CuArray<int32> output_rows(std::vector<int32>(
+      batch.output_rows.begin(), batch.output_rows.begin() + num_states));
+  CuMatrix<BaseFloat> output(num_states, word_embedding_mat.NumCols(),
+                             kUndefined);
+  output.CopyRows(computer.GetOutput("output"), output_rows);
+
+  CuVector<BaseFloat> normalization_factors;
+  if (info_.opts.normalize_probs) {
+    normalization_factors.Resize(num_states, kUndefined);
+    info_.ComputeLogNormalizers(output, &normalization_factors);
+  }
+
+  const std::vector<int32> &next_matrices =
+      batch.state_matrices[next_num_chunks];
+  for (int32 s = 0; s < num_states; s++) {
+    successors[s] = new RnnlmBatchState();
+    successors[s]->num_chunks = next_num_chunks;
+    successors[s]->matrix_rows.resize(next_matrices.size());
+    successors[s]->predicted_word_embedding = output.Row(s);
+    successors[s]->normalization_factor =
+        (info_.opts.normalize_probs ? normalization_factors(s) : 0.0);
+  }
+  for (size_t i = 0; i < next_matrices.size(); i++) {
+    int32 m = next_matrices[i], k = batch.rows_per_sequence[m];
+    const CuMatrix<BaseFloat> &mat = computer.GetComputationMatrix(m);
+    CuMatrix<BaseFloat> gathered(num_sequences * k, mat.NumCols(),
+                                 kUndefined);
+    gathered.CopyRows(mat, batch.gather_indexes[m]);
+    for (int32 s = 0; s < num_states; s++)
+      successors[s]->matrix_rows[i] = gathered.RowRange(s * k, k);
+  }
+
+  batch.num_batches++;
+  num_states_computed_ += num_states;
+  num_sequences_computed_ += num_sequences;
+  compute_time_ += timer.Elapsed();
+}
+
+BaseFloat RnnlmBatchComputer::LogProbOfWord(const RnnlmBatchState &state,
+                                            int32 word_index) const {
+  BaseFloat log_prob = VecVec(state.predicted_word_embedding,
+                              info_.word_embedding_mat.Row(word_index));
+  if (info_.opts.normalize_probs)
+    log_prob -= state.normalization_factor;
+  return log_prob;
+}
+
+void RnnlmBatchComputer::PrintStats() const {
+  int64 num_batches = 0;
+  std::ostringstream os;
+  for (size_t i = 0; i < computations_.size(); i++) {
+    num_batches += computations_[i]->num_batches;
+    os << ' ' << computations_[i]->num_sequences << ':'
+       << computations_[i]->num_batches;
+  }
+  if (num_batches == 0) {
+    KALDI_LOG << "No RNNLM states were computed.";
+    return;
+  }
+  KALDI_LOG << "Computed " << num_states_computed_ << " RNNLM states in "
+            << num_batches << " minibatches, i.e. "
+            << (num_states_computed_ / static_cast<double>(num_batches))
+            << " states per minibatch on average (max " << batch_size_
+            << "); " << (100.0 * (num_sequences_computed_ -
+                                  num_states_computed_) /
+                         num_sequences_computed_)
+            << "% of the sequences computed were padding.";
+  KALDI_LOG << "Number of minibatches per computation size "
+            << "(num-sequences:count):" << os.str();
+  KALDI_LOG << "The RNNLM computation took " << compute_time_
+            << " seconds, i.e. "
+            << (num_states_computed_ / std::max(compute_time_, 1.0e-10))
+            << " states per second.";
+}
+
 } // namespace rnnlm
 } // namespace kaldi
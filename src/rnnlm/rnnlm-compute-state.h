@@ -35,6 +35,11 @@ namespace rnnlm {
 struct RnnlmComputeStateComputationOptions {
   bool debug_computation;
   bool normalize_probs;
+  // If >= 0, the normalizer is computed exactly only for the words with index
+  // less than this, and approximately for the rest; see
+  // RnnlmComputeStateInfo::ComputeLogNormalizers().
+  int32 normalize_shortlist_size;
+  int32 normalize_num_classes;
   // We need this when we initialize the RnnlmComputeState and pass the BOS history.
   int32 bos_index;
   // We need this to compute the Final() cost of a state.
@@ -46,6 +51,8 @@ struct RnnlmComputeStateComputationOptions {
   RnnlmComputeStateComputationOptions():
       debug_computation(false),
       normalize_probs(false),
+      normalize_shortlist_size(-1),
+      normalize_num_classes(256),
       bos_index(-1),
       eos_index(-1),
       brk_index(-1)
@@ -57,6 +64,18 @@ struct RnnlmComputeStateComputationOptions {
     opts->Register("normalize-probs", &normalize_probs, "If true, word "
        "probabilities will be correctly normalized (otherwise the sum-to-one "
        "normalization is approximate)");
+    opts->Register("normalize-shortlist-size", &normalize_shortlist_size,
+                   "If >= 0 (and --normalize-probs=true), only the words with "
+                   "index less than this are included exactly in the "
+                   "normalizer of the probabilities, and the others are "
+                   "approximated by --normalize-num-classes clusters of their "
+                   "embeddings, which makes the normalization much faster for "
+                   "large vocabularies.  Word lists created by "
+                   "prepare_rnnlm_dir.sh are sorted by decreasing frequency, "
+                   "so this is a shortlist of the most frequent words.");
+    opts->Register("normalize-num-classes", &normalize_num_classes,
+                   "Number of classes for the words outside the shortlist "
+                   "(see --normalize-shortlist-size).");
     opts->Register("bos-symbol", &bos_index, "Index in wordlist representing "
                    "the begin-of-sentence symbol");
     opts->Register("eos-symbol", &eos_index, "Index in wordlist representing "
@@ -87,12 +106,39 @@ class RnnlmComputeStateInfo  {
       const kaldi::nnet3::Nnet &rnnlm,
       const CuMatrix<BaseFloat> &word_embedding_mat);
 
+  /// Sets (*log_normalizers)(i) to the log of the sum over all words (except
+  /// <eps>) of the exp of the dot product of predicted_embeddings.Row(i) with
+  /// the embedding of the word, i.e. the normalizer of the log-probs.  If
+  /// opts.normalize_shortlist_size >= 0, this is exact only for the words in
+  /// the shortlist; each class of the other words contributes
+  ///   count * exp(h . mean + 0.5 * (h * h) . variance),
+  /// where h is the predicted embedding and the mean and variance are those
+  /// of the embeddings in the class (i.e. it treats them as Gaussian), so the
+  /// cost does not depend on the vocabulary size.
+  void ComputeLogNormalizers(
+      const CuMatrixBase<BaseFloat> &predicted_embeddings,
+      CuVectorBase<BaseFloat> *log_normalizers) const;
+
   const RnnlmComputeStateComputationOptions &opts;
   const kaldi::nnet3::Nnet &rnnlm;
   const CuMatrix<BaseFloat> &word_embedding_mat;
 
   // The compiled, 'looped' computation.
   nnet3::NnetComputation computation;
+
+ private:
+  // Clusters the embeddings of the words outside the shortlist with k-means,
+  // and sets up the class_* members.
+  void InitNormalizerClasses();
+
+  // The number of words with index >= 1 and less than
+  // opts.normalize_shortlist_size, or all words except <eps> if it is < 0.
+  int32 shortlist_size_;
+  // For each class: the mean, half the (diagonal) variance, and the log of
+  // the number of words.
+  CuMatrix<BaseFloat> class_means_;
+  CuMatrix<BaseFloat> class_half_variances_;
+  CuVector<BaseFloat> class_log_counts_;
 };
 
 /*
@@ -129,13 +175,19 @@ class RnnlmComputeState {
   /// This function does the computation for the next chunk.
   void AdvanceChunk();
 
+  /// Returns normalization_factor_, computing it if necessary.
+  BaseFloat NormalizationFactor() const;
+
   const RnnlmComputeStateInfo &info_;
   nnet3::NnetComputer computer_;
   int32 previous_word_;
 
   // This is the log of the sum of the exp'ed values in the output.
-  // Only used if config_.normalize_probs is set to be true.
-  BaseFloat normalization_factor_;
+  // Only used if config_.normalize_probs is set to be true; it is computed
+  // the first time it is needed for this history, since computing it is
+  // expensive compared with LogProbOfWord() for a few words.
+  mutable BaseFloat normalization_factor_;
+  mutable bool normalization_factor_computed_;
 
   // This points to the matrix returned by GetOutput() on the Nnet object.
   // This pointer is not owned by this class.
@@ -143,6 +195,153 @@ class RnnlmComputeState {
 };
 
 
+/*
+  This is the state of the RNNLM after a particular word sequence, as used by
+  RnnlmBatchComputer; it plays the same role as RnnlmComputeState, but it only
+  stores this sequence's rows of the looped computation's matrices rather than
+  a whole NnetComputer.  It can only be used with the RnnlmBatchComputer that
+  created it.
+*/
+struct RnnlmBatchState {
+  // The number of chunks of the looped computation (i.e. words, including
+  // the BOS symbol) that have been processed, capped at the number after
+  // which the computation repeats itself (see RnnlmBatchComputer).
+  int32 num_chunks;
+
+  // For each matrix in the RnnlmBatchComputer's list of matrices that are
+  // allocated after 'num_chunks' chunks, the rows of that matrix that belong
+  // to this sequence.
+  std::vector<CuMatrix<BaseFloat> > matrix_rows;
+
+  // The output of the RNNLM, i.e. the predicted embedding of the next word.
+  CuVector<BaseFloat> predicted_word_embedding;
+
+  // The log of the sum of the exp'ed values in the output; only set if
+  // normalize_probs is true.
+  BaseFloat normalization_factor;
+};
+
+
+/*
+  RnnlmBatchComputer advances many RNNLM histories by one word at a time in a
+  single minibatched computation, instead of one RnnlmComputeState (with a
+  computation of batch size one) at a time.  It compiles looped computations
+  with 1, 2, 4 ... sequences, up to 'batch_size'; to compute the successors of
+  a set of states, it copies the rows of each state into a different sequence
+  of the smallest computation that has room for them, runs it for one chunk,
+  and copies the rows of each sequence out again.  So a small set of states
+  does not cost as much as a full minibatch.  The rows of the input and output
+  that belong to each sequence are given by the indexes of the computation
+  request; for the other matrices that hold the state of the recurrence, they
+  are worked out from the debug info of the computation.
+*/
+class RnnlmBatchComputer {
+ public:
+  RnnlmBatchComputer(const RnnlmComputeStateInfo &info, int32 batch_size);
+
+  ~RnnlmBatchComputer();
+
+  /// Returns the state after the BOS symbol.  The pointer is owned by the
+  /// caller.
+  RnnlmBatchState *GetInitialState();
+
+  /// Sets (*successors)[i] to the state after the word sequence of states[i]
+  /// followed by words[i].  Any number of states may be given; they are
+  /// processed in minibatches of up to BatchSize().  The pointers are owned
+  /// by the caller.
+  void GetSuccessorStates(const std::vector<const RnnlmBatchState*> &states,
+                          const std::vector<int32> &words,
+                          std::vector<RnnlmBatchState*> *successors);
+
+  /// Returns the log-prob that the model predicts for the provided
+  /// word-index after the history of 'state'; the same as
+  /// RnnlmComputeState::LogProbOfWord().
+  BaseFloat LogProbOfWord(const RnnlmBatchState &state,
+                          int32 word_index) const;
+
+  int32 BatchSize() const { return batch_size_; }
+
+  const RnnlmComputeStateInfo &Info() const { return info_; }
+
+  /// Prints the number of states computed, the sizes of the minibatches, and
+  /// how long the computation took.
+  void PrintStats() const;
+
+ private:
+  // The looped computation for a particular number of sequences, with what
+  // we need to run it for one chunk at a time.
+  struct BatchComputation {
+    int32 num_sequences;
+    nnet3::NnetComputation computation;
+    // templates[c] is a computer that has processed c chunks (of arbitrary
+    // words), for c = 0 ... max_num_chunks_; we copy it to process the next
+    // chunk for states with num_chunks == c.
+    std::vector<nnet3::NnetComputer*> templates;
+    // state_matrices[c][i] is the matrix whose rows are stored in
+    // RnnlmBatchState::matrix_rows[i] for states with num_chunks == c; these
+    // are the matrices that are allocated in templates[c].  The order is the
+    // same in all the computations, so states can move between them.
+    std::vector<std::vector<int32> > state_matrices;
+    // For each matrix index m, the number of rows of matrix m that belong to
+    // each sequence (or -1 if the sequences have different numbers of rows);
+    // gather_indexes[m] lists its row indexes ordered by sequence, and
+    // scatter_indexes[m] is the inverse permutation.
+    std::vector<int32> rows_per_sequence;
+    std::vector<CuArray<int32> > gather_indexes;
+    std::vector<CuArray<int32> > scatter_indexes;
+    // For each row of the input, the sequence it belongs to.
+    std::vector<int32> input_sequences;
+    // For each sequence, its row of the output.
+    std::vector<int32> output_rows;
+    // The number of minibatches that used this computation.
+    int64 num_batches;
+
+    BatchComputation(): num_sequences(0), num_batches(0) { }
+    ~BatchComputation();
+  };
+
+  // Compiles the computation for 'num_sequences' sequences and sets up
+  // everything in it; 'state_matrices' are in order of matrix index, and
+  // SetStateMatrices() puts them in the order of another computation.
+  BatchComputation *CreateComputation(int32 num_sequences);
+
+  // Sets computation->state_matrices so that they are in the same order as
+  // those of 'canonical'.  Returns false if the state rows of the two
+  // computations cannot be matched up; this is not expected to happen.
+  bool SetStateMatrices(const BatchComputation &canonical,
+                        BatchComputation *computation) const;
+
+  // Computes the successors of up to batch_size_ states with the same
+  // num_chunks, or the initial state if states[0] is NULL.
+  void ComputeBatch(const std::vector<const RnnlmBatchState*> &states,
+                    const std::vector<int32> &words,
+                    RnnlmBatchState **successors);
+
+  const RnnlmComputeStateInfo &info_;
+  int32 batch_size_;
+  // A copy of info_.opts.compute_config without the memory arena, since we
+  // need to access all the matrices.  The computers keep a reference to it.
+  nnet3::NnetComputeOptions compute_config_;
+
+  // The looped computation has a different part for each chunk until it
+  // gets to the loop, which does one chunk per iteration; this is the number
+  // of chunks after which we are in the loop, i.e. the number of outputs
+  // before the loop plus one.  RnnlmBatchState::num_chunks is capped at this.
+  int32 max_num_chunks_;
+
+  // The computations, sorted by increasing num_sequences; the last one has
+  // batch_size_ sequences.
+  std::vector<BatchComputation*> computations_;
+
+  // Statistics for PrintStats().
+  int64 num_states_computed_;
+  int64 num_sequences_computed_;
+  double compute_time_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(RnnlmBatchComputer);
+};
+
+
 } // namespace rnnlm
 } // namespace kaldi
 
@@ -21,6 +21,7 @@
 #include "rnnlm/rnnlm-core-training.h"
 #include "rnnlm/rnnlm-example-utils.h"
 #include "nnet3/nnet-utils.h"
+#include "util/kaldi-thread.h"
 
 namespace kaldi {
 namespace rnnlm {
@@ -271,6 +272,146 @@ void RnnlmCoreTrainer::TrainBackstitch(
   }
 }
 
+// Calls RnnlmCoreTrainer::ComputeDerivatives() for minibatch thread_id_ of
+// RnnlmCoreTrainer::TrainParallel().
+class RnnlmCoreTrainerThread: public MultiThreadable {
+ public:
+  RnnlmCoreTrainerThread(
+      RnnlmCoreTrainer *trainer,
+      const std::vector<const RnnlmExample*> &minibatches,
+      const std::vector<const RnnlmExampleDerived*> &derived,
+      const std::vector<const CuMatrixBase<BaseFloat>*> &word_embeddings,
+      const std::vector<CuMatrixBase<BaseFloat>*> &word_embedding_derivs,
+      std::vector<BaseFloat> *stats):
+      trainer_(trainer), minibatches_(minibatches), derived_(derived),
+      word_embeddings_(word_embeddings),
+      word_embedding_derivs_(word_embedding_derivs), stats_(stats) { }
+
+  void operator () () {
+    int32 t = thread_id_;
+    KALDI_ASSERT(static_cast<size_t>(num_threads_) == minibatches_.size());
+    nnet3::CachingOptimizingCompiler *compiler =
+        (t == 0 ? &(trainer_->compiler_) : trainer_->thread_compilers_[t - 1]);
+    BaseFloat *stats = &((*stats_)[4 * t]);
+    trainer_->ComputeDerivatives(
+        *(minibatches_[t]), *(derived_[t]), *(word_embeddings_[t]), compiler,
+        trainer_->thread_delta_nnets_[t],
+        (word_embedding_derivs_.empty() ? NULL : word_embedding_derivs_[t]),
+        stats, stats + 1, stats + 2, stats + 3);
+  }
+
+ private:
+  RnnlmCoreTrainer *trainer_;
+  const std::vector<const RnnlmExample*> &minibatches_;
+  const std::vector<const RnnlmExampleDerived*> &derived_;
+  const std::vector<const CuMatrixBase<BaseFloat>*> &word_embeddings_;
+  const std::vector<CuMatrixBase<BaseFloat>*> &word_embedding_derivs_;
+  // For each minibatch, the weight, objf_num, objf_den and objf_den_exact.
+  std::vector<BaseFloat> *stats_;
+};
+
+void RnnlmCoreTrainer::TrainParallel(
+    const std::vector<const RnnlmExample*> &minibatches,
+    const std::vector<const RnnlmExampleDerived*> &derived,
+    const std::vector<const CuMatrixBase<BaseFloat>*> &word_embeddings,
+    const std::vector<CuMatrixBase<BaseFloat>*> &word_embedding_derivs) {
+  using namespace nnet3;
+  int32 num_minibatches = minibatches.size();
+  KALDI_ASSERT(num_minibatches > 0 && derived.size() == minibatches.size() &&
+               word_embeddings.size() == minibatches.size() &&
+               (word_embedding_derivs.empty() ||
+                word_embedding_derivs.size() == minibatches.size()));
+  while (thread_compilers_.size() + 1 < minibatches.size())
+    thread_compilers_.push_back(new CachingOptimizingCompiler(*nnet_));
+  while (thread_delta_nnets_.size() < minibatches.size()) {
+    Nnet *delta_nnet = nnet_->Copy();
+    ScaleNnet(0.0, delta_nnet);
+    thread_delta_nnets_.push_back(delta_nnet);
+  }
+
+  std::vector<BaseFloat> stats(4 * num_minibatches);
+  {
+    RnnlmCoreTrainerThread thread(this, minibatches, derived, word_embeddings,
+                                  word_embedding_derivs, &stats);
+    // The destructor of 'threader' waits for the threads to finish.
+    MultiThreader<RnnlmCoreTrainerThread> threader(num_minibatches, thread);
+  }
+
+  // Add up the derivatives, as if it was one larger minibatch.
+  int32 num_chunks = 0;
+  for (int32 i = 0; i < num_minibatches; i++) {
+    AddNnet(*(thread_delta_nnets_[i]), 1.0, delta_nnet_);
+    ScaleNnet(0.0, thread_delta_nnets_[i]);
+    num_chunks += minibatches[i]->num_chunks;
+    objf_info_.AddStats(stats[4 * i], stats[4 * i + 1], stats[4 * i + 2],
+                        stats[4 * i + 3]);
+  }
+  // If relevant, add in the part of the gradient that comes from L2
+  // regularization.
+  ApplyL2Regularization(*nnet_, num_chunks * config_.l2_regularize_factor,
+                        delta_nnet_);
+
+  bool success = UpdateNnetWithMaxChange(*delta_nnet_, config_.max_param_change,
+      1.0, 1.0 - config_.momentum, nnet_,
+      &num_max_change_per_component_applied_, &num_max_change_global_applied_);
+  if (success) ScaleNnet(config_.momentum, delta_nnet_);
+  else ScaleNnet(0.0, delta_nnet_);
+
+  num_minibatches_processed_++;
+}
+
+void RnnlmCoreTrainer::ComputeDerivatives(
+    const RnnlmExample &minibatch,
+    const RnnlmExampleDerived &derived,
+    const CuMatrixBase<BaseFloat> &word_embedding,
+    nnet3::CachingOptimizingCompiler *compiler,
+    nnet3::Nnet *delta_nnet,
+    CuMatrixBase<BaseFloat> *word_embedding_deriv,
+    BaseFloat *weight, BaseFloat *objf_num,
+    BaseFloat *objf_den, BaseFloat *objf_den_exact) {
+  using namespace nnet3;
+
+  bool need_model_derivative = true;
+  bool need_input_derivative = (word_embedding_deriv != NULL);
+  bool store_component_stats = true;
+
+  ComputationRequest request;
+  GetRnnlmComputationRequest(minibatch, need_model_derivative,
+                             need_input_derivative,
+                             store_component_stats,
+                             &request);
+
+  std::shared_ptr<const NnetComputation> computation =
+      compiler->Compile(request);
+
+  NnetComputeOptions compute_opts;
+
+  // The component stats go to 'delta_nnet', so 'nnet_' is only read here.
+  NnetComputer computer(compute_opts, *computation,
+                        *nnet_, delta_nnet);
+
+  ProvideInput(minibatch, derived, word_embedding, &computer);
+  computer.Run();  // This is the forward pass.
+
+  CuMatrix<BaseFloat> output, output_deriv;
+  computer.GetOutputDestructive("output", &output);
+  output_deriv.Resize(output.NumRows(), output.NumCols());
+  ProcessRnnlmOutput(objective_config_,
+                     minibatch, derived, word_embedding,
+                     output, word_embedding_deriv, &output_deriv,
+                     weight, objf_num, objf_den, objf_den_exact);
+  computer.AcceptInput("output", &output_deriv);
+
+  computer.Run();  // This is the backward pass.
+
+  if (word_embedding_deriv != NULL) {
+    CuMatrix<BaseFloat> input_deriv;
+    computer.GetOutputDestructive("input", &input_deriv);
+    word_embedding_deriv->AddSmatMat(1.0, derived.input_words_smat, kNoTrans,
+                                     input_deriv, 1.0);
+  }
+}
+
 void RnnlmCoreTrainer::ProvideInput(
     const RnnlmExample &minibatch,
     const RnnlmExampleDerived &derived,
@@ -346,10 +487,14 @@ void RnnlmCoreTrainer::ProcessOutput(
 void RnnlmCoreTrainer::ConsolidateMemory() {
   kaldi::nnet3::ConsolidateMemory(nnet_);
   kaldi::nnet3::ConsolidateMemory(delta_nnet_);
+  for (size_t i = 0; i < thread_delta_nnets_.size(); i++)
+    kaldi::nnet3::ConsolidateMemory(thread_delta_nnets_[i]);
 }
 
 RnnlmCoreTrainer::~RnnlmCoreTrainer() {
   PrintMaxChangeStats();
+  DeletePointers(&thread_compilers_);
+  DeletePointers(&thread_delta_nnets_);
   // Note: the objective-function stats are printed out in the destructor of the
   // ObjectiveTracker object.
 }
@@ -182,6 +182,21 @@ class RnnlmCoreTrainer {
                        const CuMatrixBase<BaseFloat> &word_embedding,
                        CuMatrixBase<BaseFloat> *word_embedding_deriv = NULL);
 
+  /* Trains on several minibatches at once, one per thread (this is for
+     multi-threaded training on CPU; see RnnlmTrainer).  The parameter changes
+     for the minibatches are computed in parallel, each thread with its own
+     copy of the derivatives, then they are summed and the model is updated
+     once (with max-change, momentum and l2 applied to the sum), as if they
+     were one larger minibatch.  The arguments are as for Train(), with one
+     element per minibatch; word_embedding_derivs should be empty if the
+     embedding derivatives are not needed.  Not compatible with backstitch.
+  */
+  void TrainParallel(
+      const std::vector<const RnnlmExample*> &minibatches,
+      const std::vector<const RnnlmExampleDerived*> &derived,
+      const std::vector<const CuMatrixBase<BaseFloat>*> &word_embeddings,
+      const std::vector<CuMatrixBase<BaseFloat>*> &word_embedding_derivs);
+
   // Prints out the final stats.
   void PrintTotalStats() const;
 
@@ -219,6 +234,23 @@ class RnnlmCoreTrainer {
                      nnet3::NnetComputer *computer,
                      CuMatrixBase<BaseFloat> *word_embedding_deriv = NULL);
 
+  /** Does the forward and backward computation for one minibatch in
+      TrainParallel(); it may be called from several threads at once, with
+      different 'compiler' and 'delta_nnet'.  The parameter derivative is
+      added to 'delta_nnet', and the objective function stats are output (see
+      ProcessRnnlmOutput()) rather than recorded in objf_info_.
+  */
+  void ComputeDerivatives(const RnnlmExample &minibatch,
+                          const RnnlmExampleDerived &derived,
+                          const CuMatrixBase<BaseFloat> &word_embedding,
+                          nnet3::CachingOptimizingCompiler *compiler,
+                          nnet3::Nnet *delta_nnet,
+                          CuMatrixBase<BaseFloat> *word_embedding_deriv,
+                          BaseFloat *weight, BaseFloat *objf_num,
+                          BaseFloat *objf_den, BaseFloat *objf_den_exact);
+
+  friend class RnnlmCoreTrainerThread;
+
   // Applies per-component max-change and global max-change to all updatable
   // components in *delta_nnet_, and use *delta_nnet_ to update parameters
   // in *nnet_.
@@ -232,6 +264,12 @@ class RnnlmCoreTrainer {
                              // weighted average).
   nnet3::CachingOptimizingCompiler compiler_;
 
+  // For TrainParallel(): the compilers for threads 1, 2, ... (thread 0 uses
+  // compiler_), and the parameter derivatives for each thread (delta_nnet_
+  // holds the momentum); they are created when needed.
+  std::vector<nnet3::CachingOptimizingCompiler*> thread_compilers_;
+  std::vector<nnet3::Nnet*> thread_delta_nnets_;
+
   int32 num_minibatches_processed_;
 
   // stats for max-change.
@@ -22,6 +22,7 @@
 #include "rnnlm/rnnlm-test-utils.h"
 #include "rnnlm/rnnlm-example-utils.h"
 #include "rnnlm/rnnlm-training.h"
+#include "nnet3/nnet-utils.h"
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "cudamatrix/cu-device.h"
@@ -73,6 +74,129 @@ void TestRnnlmTraining(const std::string &archive_rxfilename,
   delete rnnlm;
 }
 
+// Checks that training on N minibatches with num_threads == N, which trains
+// on them in parallel (see RnnlmCoreTrainer::TrainParallel()), changes the
+// parameters and the embedding by the sum of the changes from training on
+// each of them on its own, starting from the same model.  We use plain SGD
+// (no natural gradient, max-change or momentum), so that the change is
+// proportional to the derivative.  With sampled egs this checks the merging
+// of the embedding derivatives over the different active words of the
+// minibatches.
+void TestRnnlmTrainParallel(const RnnlmEgsConfig &egs_config_in,
+                            const SamplingLm &arpa,
+                            const std::vector<std::vector<int32> > &sentences) {
+  // We need several minibatches, so we make them small.
+  RnnlmEgsConfig egs_config(egs_config_in);
+  egs_config.num_chunks_per_minibatch = 4;
+  egs_config.chunk_length = 16;
+  egs_config.num_samples = 16;
+  bool sampling = (RandInt(0, 1) == 0);
+  {
+    RnnlmExampleWriter writer("ark:tmp2.ark");
+    RnnlmExampleSampler sampler(egs_config, arpa);
+    TaskSequencerConfig sequencer_config;
+    RnnlmExampleCreator *creator = NULL;
+    if (sampling)
+      creator = new RnnlmExampleCreator(egs_config, sequencer_config, sampler,
+                                        &writer);
+    else
+      creator = new RnnlmExampleCreator(egs_config, &writer);
+    for (size_t i = 0; i < sentences.size(); i++)
+      creator->AcceptSequence(1.0, sentences[i]);
+    delete creator;
+  }
+
+  std::vector<RnnlmExample> minibatches;
+  int32 num_minibatches = RandInt(2, 4);
+  {
+    SequentialRnnlmExampleReader reader("ark:tmp2.ark");
+    for (; !reader.Done() &&
+             static_cast<int32>(minibatches.size()) < num_minibatches;
+         reader.Next())
+      minibatches.push_back(reader.Value());
+  }
+  unlink("tmp2.ark");
+  KALDI_ASSERT(static_cast<int32>(minibatches.size()) == num_minibatches &&
+               minibatches[0].sampled_words.empty() == !sampling);
+
+  int32 vocab_size = egs_config.vocab_size;
+  int32 embedding_dim = RandInt(10, 30);
+  std::ostringstream config_os;
+  config_os << "input-node name=input dim=" << embedding_dim << std::endl;
+  config_os << "component name=affine1 type=AffineComponent input-dim="
+            << embedding_dim << " output-dim=" << embedding_dim
+            << " learning-rate=0.01" << std::endl;
+  config_os << "component-node input=input name=affine1 component=affine1\n";
+  config_os << "output-node input=affine1 name=output\n";
+  std::istringstream config_is(config_os.str());
+  nnet3::Nnet rnnlm;
+  rnnlm.ReadConfig(config_is);
+  CuMatrix<BaseFloat> embedding_mat(vocab_size, embedding_dim);
+  embedding_mat.SetRandn();
+  embedding_mat.Scale(0.1);
+
+  RnnlmCoreTrainerOptions core_config;
+  core_config.max_param_change = 1.0e+10;
+  RnnlmEmbeddingTrainerOptions embedding_config;
+  embedding_config.max_param_change = 1.0e+10;
+  embedding_config.use_natural_gradient = false;
+  embedding_config.learning_rate = 0.01;
+  RnnlmObjectiveOptions objective_config;
+
+  int32 num_params = nnet3::NumParameters(rnnlm);
+  Vector<BaseFloat> params(num_params);
+  nnet3::VectorizeNnet(rnnlm, &params);
+
+  // The sum of the changes from training on each minibatch on its own.
+  Vector<BaseFloat> summed_param_change(num_params);
+  CuMatrix<BaseFloat> summed_embedding_change(vocab_size, embedding_dim);
+  for (int32 i = 0; i < num_minibatches; i++) {
+    nnet3::Nnet rnnlm_copy(rnnlm);
+    CuMatrix<BaseFloat> embedding_copy(embedding_mat);
+    RnnlmExample minibatch(minibatches[i]);
+    {
+      RnnlmTrainer trainer(true, core_config, embedding_config,
+                           objective_config, NULL, &embedding_copy,
+                           &rnnlm_copy);
+      trainer.Train(&minibatch);
+    }
+    Vector<BaseFloat> new_params(num_params);
+    nnet3::VectorizeNnet(rnnlm_copy, &new_params);
+    summed_param_change.AddVec(1.0, new_params);
+    summed_param_change.AddVec(-1.0, params);
+    summed_embedding_change.AddMat(1.0, embedding_copy);
+    summed_embedding_change.AddMat(-1.0, embedding_mat);
+  }
+
+  nnet3::Nnet parallel_rnnlm(rnnlm);
+  CuMatrix<BaseFloat> parallel_embedding(embedding_mat);
+  {
+    RnnlmTrainer trainer(true, core_config, embedding_config,
+                         objective_config, NULL, &parallel_embedding,
+                         &parallel_rnnlm, num_minibatches);
+    for (int32 i = 0; i < num_minibatches; i++) {
+      RnnlmExample minibatch(minibatches[i]);
+      trainer.Train(&minibatch);
+    }
+  }
+  Vector<BaseFloat> param_change(num_params);
+  nnet3::VectorizeNnet(parallel_rnnlm, &param_change);
+  param_change.AddVec(-1.0, params);
+  CuMatrix<BaseFloat> embedding_change(parallel_embedding);
+  embedding_change.AddMat(-1.0, embedding_mat);
+
+  KALDI_LOG << "For " << num_minibatches << " minibatches (sampling = "
+            << std::boolalpha << sampling << "), parameter change is "
+            << param_change.Norm(2.0) << " in parallel vs. "
+            << summed_param_change.Norm(2.0) << " summed; embedding change "
+            << "is " << embedding_change.FrobeniusNorm() << " vs. "
+            << summed_embedding_change.FrobeniusNorm();
+  KALDI_ASSERT(summed_param_change.Norm(2.0) > 0.0 &&
+               summed_embedding_change.FrobeniusNorm() > 0.0);
+  KALDI_ASSERT(param_change.ApproxEqual(summed_param_change, 0.01));
+  KALDI_ASSERT(embedding_change.ApproxEqual(summed_embedding_change, 0.01));
+}
+
 void TestRnnlmOutput(const std::string &archive_rxfilename) {
   SequentialRnnlmExampleReader reader(archive_rxfilename);
   int32 num_test = 10;
@@ -267,6 +391,7 @@ void TestRnnlmExample() {
 
   TestRnnlmOutput("ark:tmp.ark");
   TestRnnlmTraining("ark:tmp.ark", egs_config.vocab_size);
+  TestRnnlmTrainParallel(egs_config, arpa, int_sentences_train);
 
 }
 
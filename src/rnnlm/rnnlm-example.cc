@@ -152,14 +152,16 @@ void RnnlmExampleSampler::SampleForMinibatch(RnnlmExample *minibatch) const {
   minibatch->sampled_words.resize(num_groups * num_samples);
   minibatch->sample_inv_probs.Resize(num_groups * num_samples);
 
+  DistributionAccumulator higher_order_probs(VocabSize());
   for (int32 g = 0; g < num_groups; g++) {
-    SampleForGroup(g, minibatch);
+    SampleForGroup(g, &higher_order_probs, minibatch);
   }
 }
 
 
-void RnnlmExampleSampler::SampleForGroup(int32 g,
-                                         RnnlmExample *minibatch) const {
+void RnnlmExampleSampler::SampleForGroup(
+    int32 g, DistributionAccumulator *higher_order_probs,
+    RnnlmExample *minibatch) const {
   // All words that appear on the output are required to appear in the sample.  we
   // need to figure what this set of words is.
   int32 num_chunks_per_minibatch = config_.num_chunks_per_minibatch;
@@ -184,10 +186,10 @@ void RnnlmExampleSampler::SampleForGroup(int32 g,
   // distributions that the language model predicts given the history states
   // present in 'hist_weights'.
   // We represent the distribution in this way, instead of just as a vector,
-  // so that it is efficient even when the vocabulary size is very large.
-  std::vector<std::pair<int32, BaseFloat> > higher_order_probs;
+  // so that it is efficient even when the vocabulary size is very large
+  // (class DistributionAccumulator only visits the words that were added).
   BaseFloat unigram_weight = arpa_sampling_.GetDistribution(hist_weights,
-                                                            &higher_order_probs);
+                                                            higher_order_probs);
 
   // 'sample' will be a list of pairs (integer word-id, inclusion probability).
   std::vector<std::pair<int32, BaseFloat> > sample;
@@ -197,7 +199,7 @@ void RnnlmExampleSampler::SampleForGroup(int32 g,
   // additional-weight) pairs.
   int32 num_samples = config_.num_samples;
   sampler_->SampleWords(num_samples, unigram_weight,
-                        higher_order_probs, words_we_must_sample,
+                        words_we_must_sample, higher_order_probs,
                         &sample);
   KALDI_ASSERT(sample.size() == static_cast<size_t>(num_samples));
   std::sort(sample.begin(), sample.end());
@@ -324,7 +324,10 @@ class RnnlmExampleSampler {
   // same as the position 0 <= t < chunk_length in the sequence if
   // config_.sample_group_size == 1, and otherwise, each group
   // encompasses several successive 't' values.
-  void SampleForGroup(int32 g, RnnlmExample *minibatch) const;
+  // 'higher_order_probs' is temporary storage that is shared by all the
+  // groups of the minibatch, to save the cost of allocating it.
+  void SampleForGroup(int32 g, DistributionAccumulator *higher_order_probs,
+                      RnnlmExample *minibatch) const;
 
 
   // This function gets the combination of histories to be sampled from for the g'th
@@ -116,5 +116,103 @@ bool KaldiRnnlmDeterministicFst::GetArc(StateId s, Label ilabel,
   return true;
 }
 
+KaldiRnnlmBatchedDeterministicFst::KaldiRnnlmBatchedDeterministicFst(
+    int32 max_ngram_order, RnnlmBatchComputer *computer):
+    computer_(computer), start_state_(0), max_ngram_order_(max_ngram_order) {
+  const RnnlmComputeStateComputationOptions &opts =
+      computer->Info().opts;
+  eos_index_ = opts.eos_index;
+
+  std::vector<Label> bos_seq;
+  bos_seq.push_back(opts.bos_index);
+  state_to_wseq_.push_back(bos_seq);
+  wseq_to_state_[bos_seq] = 0;
+  state_to_rnnlm_state_.push_back(computer_->GetInitialState());
+  state_to_predecessor_.push_back(std::pair<StateId, Label>(-1, -1));
+}
+
+KaldiRnnlmBatchedDeterministicFst::~KaldiRnnlmBatchedDeterministicFst() {
+  for (size_t i = 0; i < state_to_rnnlm_state_.size(); i++)
+    delete state_to_rnnlm_state_[i];
+}
+
+void KaldiRnnlmBatchedDeterministicFst::Clear() {
+  // We retain the 0-th entries, which correspond to the <bos> state.
+  for (size_t i = 1; i < state_to_rnnlm_state_.size(); i++)
+    delete state_to_rnnlm_state_[i];
+  state_to_rnnlm_state_.resize(1);
+  state_to_wseq_.resize(1);
+  state_to_predecessor_.resize(1);
+  pending_states_.clear();
+  wseq_to_state_.clear();
+  wseq_to_state_[state_to_wseq_[0]] = 0;
+}
+
+void KaldiRnnlmBatchedDeterministicFst::ComputePendingStates() {
+  std::vector<const RnnlmBatchState*> predecessors;
+  std::vector<int32> words;
+  predecessors.reserve(pending_states_.size());
+  words.reserve(pending_states_.size());
+  for (size_t i = 0; i < pending_states_.size(); i++) {
+    const std::pair<StateId, Label> &predecessor =
+        state_to_predecessor_[pending_states_[i]];
+    // A state is only created by GetArc() on a state that has been computed.
+    KALDI_ASSERT(state_to_rnnlm_state_[predecessor.first] != NULL);
+    predecessors.push_back(state_to_rnnlm_state_[predecessor.first]);
+    words.push_back(predecessor.second);
+  }
+  std::vector<RnnlmBatchState*> successors;
+  computer_->GetSuccessorStates(predecessors, words, &successors);
+  for (size_t i = 0; i < pending_states_.size(); i++)
+    state_to_rnnlm_state_[pending_states_[i]] = successors[i];
+  pending_states_.clear();
+}
+
+fst::StdArc::Weight KaldiRnnlmBatchedDeterministicFst::Final(StateId s) {
+  KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
+  if (state_to_rnnlm_state_[s] == NULL)
+    ComputePendingStates();
+  return Weight(-computer_->LogProbOfWord(*(state_to_rnnlm_state_[s]),
+                                          eos_index_));
+}
+
+bool KaldiRnnlmBatchedDeterministicFst::GetArc(StateId s, Label ilabel,
+                                               fst::StdArc *oarc) {
+  KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
+  if (state_to_rnnlm_state_[s] == NULL)
+    ComputePendingStates();
+
+  BaseFloat logprob = computer_->LogProbOfWord(*(state_to_rnnlm_state_[s]),
+                                               ilabel);
+
+  std::vector<Label> word_seq = state_to_wseq_[s];
+  word_seq.push_back(ilabel);
+  if (max_ngram_order_ > 0) {
+    while (word_seq.size() >= max_ngram_order_) {
+      /// History state has at most <max_ngram_order_> - 1 words in the state.
+      word_seq.erase(word_seq.begin(), word_seq.begin() + 1);
+    }
+  }
+
+  std::pair<const std::vector<Label>, StateId> wseq_state_pair(
+      word_seq, static_cast<Label>(state_to_wseq_.size()));
+  typedef MapType::iterator IterType;
+  std::pair<IterType, bool> result = wseq_to_state_.insert(wseq_state_pair);
+
+  // If the state is new, we just record how to compute it.
+  if (result.second == true) {
+    pending_states_.push_back(state_to_wseq_.size());
+    state_to_wseq_.push_back(word_seq);
+    state_to_rnnlm_state_.push_back(NULL);
+    state_to_predecessor_.push_back(std::pair<StateId, Label>(s, ilabel));
+  }
+
+  oarc->ilabel = ilabel;
+  oarc->olabel = ilabel;
+  oarc->nextstate = result.first->second;
+  oarc->weight = Weight(-logprob);
+  return true;
+}
+
 }  // namespace rnnlm
 }  // namespace kaldi
@@ -76,6 +76,71 @@ class KaldiRnnlmDeterministicFst
 
 };
 
+/**
+   This is like KaldiRnnlmDeterministicFst, but the RNNLM computation for a new
+   state is not done when the state is created (in GetArc()); it is deferred
+   until the first GetArc() or Final() call on the state, and then done for
+   all the states that are pending at that time, in minibatches (see
+   RnnlmBatchComputer).  When this is used in ComposeCompactLatticePruned(),
+   the pending states are those of the composed states on the frontier of the
+   composition that have not been expanded yet, so the frontier is evaluated
+   in batches.  The scores are the same as with KaldiRnnlmDeterministicFst, so
+   the composition makes the same pruning decisions (up to roundoff); it just
+   computes some states that it then never expands.  The frontier may be
+   much smaller than the batch size, in which case RnnlmBatchComputer uses a
+   computation with fewer sequences; see RnnlmBatchComputer::PrintStats() for
+   the sizes of the minibatches that were actually computed.
+ */
+class KaldiRnnlmBatchedDeterministicFst
+    : public fst::DeterministicOnDemandFst<fst::StdArc> {
+ public:
+  typedef fst::StdArc::Weight Weight;
+  typedef fst::StdArc::StateId StateId;
+  typedef fst::StdArc::Label Label;
+
+  // Does not take ownership of 'computer'.
+  KaldiRnnlmBatchedDeterministicFst(int32 max_ngram_order,
+                                    RnnlmBatchComputer *computer);
+  ~KaldiRnnlmBatchedDeterministicFst();
+
+  // Removes all the states except the start state; call this between
+  // lattices to save memory.
+  void Clear();
+
+  virtual StateId Start() { return start_state_; }
+
+  virtual Weight Final(StateId s);
+
+  virtual bool GetArc(StateId s, Label ilabel, fst::StdArc* oarc);
+
+ private:
+  // Computes the RNNLM states of all the states in pending_states_.
+  void ComputePendingStates();
+
+  typedef unordered_map
+      <std::vector<Label>, StateId, VectorHasher<Label> > MapType;
+  RnnlmBatchComputer *computer_;
+  StateId start_state_;
+  int32 max_ngram_order_;
+  int32 eos_index_;
+
+  MapType wseq_to_state_;
+
+  // Mapping from state-id to history sequence.
+  std::vector<std::vector<Label> > state_to_wseq_;
+
+  // Mapping from state-id to RNNLM states, which are NULL for the states
+  // that are pending.  The pointers are owned in this class.
+  std::vector<RnnlmBatchState*> state_to_rnnlm_state_;
+
+  // Mapping from state-id to the state and word it was created from, which
+  // we need to compute it.
+  std::vector<std::pair<StateId, Label> > state_to_predecessor_;
+
+  // The states whose RNNLM states have not been computed yet.
+  std::vector<StateId> pending_states_;
+};
+
 }  // namespace rnnlm
 }  // namespace kaldi
 
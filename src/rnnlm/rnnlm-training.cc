@@ -19,6 +19,7 @@
 
 #include "rnnlm/rnnlm-training.h"
 #include "nnet3/nnet-utils.h"
+#include "cudamatrix/cu-device.h"
 
 namespace kaldi {
 namespace rnnlm {
@@ -31,7 +32,8 @@ RnnlmTrainer::RnnlmTrainer(bool train_embedding,
                            const RnnlmObjectiveOptions &objective_config,
                            const CuSparseMatrix<BaseFloat> *word_feature_mat,
                            CuMatrix<BaseFloat> *embedding_mat,
-                           nnet3::Nnet *rnnlm):
+                           nnet3::Nnet *rnnlm,
+                           int32 num_threads):
     train_embedding_(train_embedding),
     core_config_(core_config),
     embedding_config_(embedding_config),
@@ -42,7 +44,8 @@ RnnlmTrainer::RnnlmTrainer(bool train_embedding,
     embedding_trainer_(NULL),
     word_feature_mat_(word_feature_mat),
     num_minibatches_processed_(0),
-    srand_seed_(RandInt(0, 100000)) {
+    srand_seed_(RandInt(0, 100000)),
+    num_threads_(num_threads) {
 
 
   int32 rnnlm_input_dim = rnnlm_->InputDim("input"),
@@ -72,6 +75,25 @@ RnnlmTrainer::RnnlmTrainer(bool train_embedding,
                 << embedding_mat_->NumRows() << " (mismatch).";
     }
   }
+
+  KALDI_ASSERT(num_threads >= 1);
+  if (num_threads > 1) {
+#if HAVE_CUDA == 1
+    if (CuDevice::Instantiate().Enabled())
+      KALDI_ERR << "Multi-threaded RNNLM training is only supported on CPU.";
+#endif
+    if (core_config.backstitch_training_scale > 0.0)
+      KALDI_ERR << "Backstitch training is not supported with more than one "
+                << "thread.";
+    // The threads share the model, and random components (like dropout)
+    // change their random generators when they are used.
+    for (int32 c = 0; c < rnnlm_->NumComponents(); c++)
+      if (dynamic_cast<const nnet3::RandomComponent*>(
+              rnnlm_->GetComponent(c)) != NULL)
+        KALDI_ERR << "Multi-threaded training is not supported for RNNLMs "
+                  << "with random components such as dropout (component "
+                  << rnnlm_->GetComponentName(c) << ").";
+  }
 }
 
 
@@ -82,27 +104,27 @@ void RnnlmTrainer::Train(RnnlmExample *minibatch) {
                 << VocabSize() << ", got "
                 << minibatch->vocab_size;
 
-  current_minibatch_.Swap(minibatch);
   num_minibatches_processed_++;
+  if (num_threads_ > 1) {
+    PreparedMinibatch *prepared = new PreparedMinibatch();
+    prepared->minibatch.Swap(minibatch);
+    PrepareMinibatch(&(prepared->minibatch), &(prepared->derived),
+                     &(prepared->active_words),
+                     &(prepared->active_word_features),
+                     &(prepared->active_word_features_trans));
+    pending_minibatches_.push_back(prepared);
+    if (pending_minibatches_.size() == static_cast<size_t>(num_threads_))
+      TrainParallelInternal();
+    return;
+  }
+
+  current_minibatch_.Swap(minibatch);
   RnnlmExampleDerived derived;
   CuArray<int32> active_words_cuda;
   CuSparseMatrix<BaseFloat> active_word_features;
   CuSparseMatrix<BaseFloat> active_word_features_trans;
-
-  if (!current_minibatch_.sampled_words.empty()) {
-    std::vector<int32> active_words;
-    RenumberRnnlmExample(&current_minibatch_, &active_words);
-    active_words_cuda.CopyFromVec(active_words);
-
-    if (word_feature_mat_ != NULL) {
-      active_word_features.SelectRows(active_words_cuda,
-                                      *word_feature_mat_);
-      active_word_features_trans.CopyFromSmat(active_word_features,
-                                              kTrans);
-    }
-  }
-  GetRnnlmExampleDerived(current_minibatch_, train_embedding_,
-                         &derived);
+  PrepareMinibatch(&current_minibatch_, &derived, &active_words_cuda,
+                   &active_word_features, &active_word_features_trans);
 
   derived_.Swap(&derived);
   active_words_.Swap(&active_words_cuda);
@@ -116,15 +138,40 @@ void RnnlmTrainer::Train(RnnlmExample *minibatch) {
 }
 
 
-void RnnlmTrainer::GetWordEmbedding(CuMatrix<BaseFloat> *word_embedding_storage,
-                                    CuMatrix<BaseFloat> **word_embedding) {
-  RnnlmExample &minibatch = current_minibatch_;
+void RnnlmTrainer::PrepareMinibatch(
+    RnnlmExample *minibatch,
+    RnnlmExampleDerived *derived,
+    CuArray<int32> *active_words,
+    CuSparseMatrix<BaseFloat> *active_word_features,
+    CuSparseMatrix<BaseFloat> *active_word_features_trans) {
+  if (!minibatch->sampled_words.empty()) {
+    std::vector<int32> active_words_cpu;
+    RenumberRnnlmExample(minibatch, &active_words_cpu);
+    active_words->CopyFromVec(active_words_cpu);
+
+    if (word_feature_mat_ != NULL) {
+      active_word_features->SelectRows(*active_words,
+                                       *word_feature_mat_);
+      active_word_features_trans->CopyFromSmat(*active_word_features,
+                                               kTrans);
+    }
+  }
+  GetRnnlmExampleDerived(*minibatch, train_embedding_, derived);
+}
+
+
+void RnnlmTrainer::GetWordEmbedding(
+    const RnnlmExample &minibatch,
+    const CuArray<int32> &active_words,
+    const CuSparseMatrix<BaseFloat> &active_word_features,
+    CuMatrix<BaseFloat> *word_embedding_storage,
+    CuMatrix<BaseFloat> **word_embedding) {
   bool sampling = !minibatch.sampled_words.empty();
 
   if (word_feature_mat_ == NULL) {
     // There is no sparse word-feature matrix.
     if (!sampling) {
-      KALDI_ASSERT(active_words_.Dim() == 0);
+      KALDI_ASSERT(active_words.Dim() == 0);
       // There is no sparse word-feature matrix, so the embedding matrix is just
       // embedding_mat_ (the embedding matrix for all words).
       *word_embedding = embedding_mat_;
@@ -132,18 +179,18 @@ void RnnlmTrainer::GetWordEmbedding(CuMatrix<BaseFloat> *word_embedding_storage,
     } else {
       // There is sampling-- we're using a subset of the words so the user wants
       // an embedding matrix for just those rows.
-      KALDI_ASSERT(active_words_.Dim() != 0);
-      word_embedding_storage->Resize(active_words_.Dim(),
+      KALDI_ASSERT(active_words.Dim() != 0);
+      word_embedding_storage->Resize(active_words.Dim(),
                                      embedding_mat_->NumCols(),
                                      kUndefined);
-      word_embedding_storage->CopyRows(*embedding_mat_, active_words_);
+      word_embedding_storage->CopyRows(*embedding_mat_, active_words);
       *word_embedding = word_embedding_storage;
     }
   } else {
     // There is a sparse word-feature matrix, so we need to multiply it by the
     // feature-embedding matrix in order to get the word-embedding matrix.
     const CuSparseMatrix<BaseFloat> &word_feature_mat =
-        sampling ? active_word_features_ : *word_feature_mat_;
+        sampling ? active_word_features : *word_feature_mat_;
     word_embedding_storage->Resize(word_feature_mat.NumRows(),
                                    embedding_mat_->NumCols());
     word_embedding_storage->AddSmatMat(1.0, word_feature_mat, kNoTrans,
@@ -232,10 +279,113 @@ void RnnlmTrainer::TrainBackstitchWordEmbedding(
 }
 
 
+void RnnlmTrainer::TrainWordEmbeddingParallel(
+    std::vector<CuMatrix<BaseFloat> > *word_embedding_derivs) {
+  int32 num_minibatches = pending_minibatches_.size(),
+      embedding_dim = embedding_mat_->NumCols();
+  KALDI_ASSERT(word_embedding_derivs->size() == pending_minibatches_.size());
+  // All the minibatches come from the same egs, so they all use sampling or
+  // none of them does.
+  bool sampling = !pending_minibatches_[0]->minibatch.sampled_words.empty();
+
+  if (word_feature_mat_ == NULL) {
+    // There is no sparse word-feature matrix.
+    if (!sampling) {
+      CuMatrix<BaseFloat> &embedding_deriv = (*word_embedding_derivs)[0];
+      for (int32 i = 1; i < num_minibatches; i++)
+        embedding_deriv.AddMat(1.0, (*word_embedding_derivs)[i]);
+      embedding_trainer_->Train(&embedding_deriv);
+    } else {
+      // Each derivative is for the active words of its minibatch; we add them
+      // up in a matrix for the union of the active words.
+      std::vector<std::vector<int32> > active_words(num_minibatches);
+      std::vector<int32> all_active_words;
+      for (int32 i = 0; i < num_minibatches; i++) {
+        pending_minibatches_[i]->active_words.CopyToVec(&(active_words[i]));
+        all_active_words.insert(all_active_words.end(),
+                                active_words[i].begin(),
+                                active_words[i].end());
+      }
+      SortAndUniq(&all_active_words);
+      CuMatrix<BaseFloat> embedding_deriv(all_active_words.size(),
+                                          embedding_dim);
+      for (int32 i = 0; i < num_minibatches; i++) {
+        std::vector<int32> indexes(active_words[i].size());
+        for (size_t j = 0; j < active_words[i].size(); j++)
+          indexes[j] = std::lower_bound(all_active_words.begin(),
+                                        all_active_words.end(),
+                                        active_words[i][j]) -
+              all_active_words.begin();
+        CuArray<int32> indexes_cuda(indexes);
+        (*word_embedding_derivs)[i].AddToRows(1.0, indexes_cuda,
+                                              &embedding_deriv);
+      }
+      CuArray<int32> all_active_words_cuda(all_active_words);
+      embedding_trainer_->Train(all_active_words_cuda, &embedding_deriv);
+    }
+  } else {
+    // There is a sparse word-feature matrix, so we need to multiply by it
+    // to get the derivative w.r.t. the feature-embedding matrix.
+    if (!sampling && word_feature_mat_transpose_.NumRows() == 0)
+      word_feature_mat_transpose_.CopyFromSmat(*word_feature_mat_, kTrans);
+
+    CuMatrix<BaseFloat> feature_embedding_deriv(embedding_mat_->NumRows(),
+                                                embedding_dim);
+    for (int32 i = 0; i < num_minibatches; i++) {
+      const CuSparseMatrix<BaseFloat> &word_features_trans =
+          (sampling ? pending_minibatches_[i]->active_word_features_trans :
+           word_feature_mat_transpose_);
+      feature_embedding_deriv.AddSmatMat(1.0, word_features_trans, kNoTrans,
+                                         (*word_embedding_derivs)[i], 1.0);
+    }
+    embedding_trainer_->Train(&feature_embedding_deriv);
+  }
+}
+
+
+void RnnlmTrainer::TrainParallelInternal() {
+  int32 num_minibatches = pending_minibatches_.size();
+  KALDI_ASSERT(num_minibatches > 0);
+  std::vector<CuMatrix<BaseFloat> > word_embedding_storage(num_minibatches),
+      word_embedding_derivs(train_embedding_ ? num_minibatches : 0);
+  std::vector<const RnnlmExample*> minibatches(num_minibatches);
+  std::vector<const RnnlmExampleDerived*> derived(num_minibatches);
+  std::vector<const CuMatrixBase<BaseFloat>*> word_embeddings(num_minibatches);
+  std::vector<CuMatrixBase<BaseFloat>*> word_embedding_deriv_ptrs;
+  for (int32 i = 0; i < num_minibatches; i++) {
+    PreparedMinibatch *prepared = pending_minibatches_[i];
+    CuMatrix<BaseFloat> *word_embedding;
+    GetWordEmbedding(prepared->minibatch, prepared->active_words,
+                     prepared->active_word_features,
+                     &(word_embedding_storage[i]), &word_embedding);
+    minibatches[i] = &(prepared->minibatch);
+    derived[i] = &(prepared->derived);
+    word_embeddings[i] = word_embedding;
+    if (train_embedding_) {
+      word_embedding_derivs[i].Resize(word_embedding->NumRows(),
+                                      word_embedding->NumCols());
+      word_embedding_deriv_ptrs.push_back(&(word_embedding_derivs[i]));
+    }
+  }
+
+  core_trainer_->TrainParallel(minibatches, derived, word_embeddings,
+                               word_embedding_deriv_ptrs);
+  if (train_embedding_)
+    TrainWordEmbeddingParallel(&word_embedding_derivs);
+
+  bool first_time = (num_minibatches_processed_ == num_minibatches);
+  DeletePointers(&pending_minibatches_);
+  pending_minibatches_.clear();
+  if (first_time)
+    core_trainer_->ConsolidateMemory();
+}
+
+
 void RnnlmTrainer::TrainInternal() {
   CuMatrix<BaseFloat> word_embedding_storage;
   CuMatrix<BaseFloat> *word_embedding;
-  GetWordEmbedding(&word_embedding_storage, &word_embedding);
+  GetWordEmbedding(current_minibatch_, active_words_, active_word_features_,
+                   &word_embedding_storage, &word_embedding);
 
   CuMatrix<BaseFloat> word_embedding_deriv;
   if (train_embedding_)
@@ -274,6 +424,8 @@ int32 RnnlmTrainer::VocabSize() {
 }
 
 RnnlmTrainer::~RnnlmTrainer() {
+  if (!pending_minibatches_.empty())
+    TrainParallelInternal();
   // Note: the following delete statements may cause some diagnostics to be
   // issued, from the destructors of those classes.
   if (core_trainer_)
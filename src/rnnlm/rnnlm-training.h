@@ -66,6 +66,13 @@ class RnnlmTrainer {
                              word_feature_mat to get the word embedding matrix.
       @param [in,out] rnnlm  The RNNLM to be trained.  The class will retain
                              this pointer and modify the neural net in-place.
+      @param [in] num_threads  If >1, we train on this many minibatches at a
+                             time in parallel (CPU only), one per thread, and
+                             update the parameters once with the sum of their
+                             derivatives, as if they were one larger
+                             minibatch; the derivatives w.r.t. the embedding
+                             matrix, which are sparse if we use sampling, are
+                             merged before the embedding is updated.
   */
   RnnlmTrainer(bool train_embedding,
                const RnnlmCoreTrainerOptions &core_config,
@@ -73,16 +80,19 @@ class RnnlmTrainer {
                const RnnlmObjectiveOptions &objective_config,
                const CuSparseMatrix<BaseFloat> *word_feature_mat,
                CuMatrix<BaseFloat> *embedding_mat,
-               nnet3::Nnet *rnnlm);
+               nnet3::Nnet *rnnlm,
+               int32 num_threads = 1);
 
 
 
   // Train on one example.  The example is provided as a pointer because we
-  // acquire it destructively, via Swap().
+  // acquire it destructively, via Swap().  If num_threads > 1, the training
+  // is done once we have num_threads examples (or in the destructor).
   void Train(RnnlmExample *minibatch);
 
 
-  // The destructor writes out any files that we need to write out.
+  // The destructor trains on any examples we have not trained on yet, and
+  // writes out any files that we need to write out.
   ~RnnlmTrainer();
 
   int32 NumMinibatchesProcessed() { return num_minibatches_processed_; }
@@ -95,16 +105,35 @@ class RnnlmTrainer {
   /// it trains on minibatch_previous_.
   void TrainInternal();
 
-  /// This function works out the word-embedding matrix for the minibatch we're
-  /// training on (previous_minibatch_).  The word-embedding matrix for this
-  /// minibatch is a matrix of dimension current_minibatch_.vocab_size by
+  /// This is the version of TrainInternal() for num_threads_ > 1; it trains
+  /// on the minibatches in pending_minibatches_ and then deletes them.
+  void TrainParallelInternal();
+
+  /// If 'minibatch' uses sampling, this function renumbers its words (see
+  /// RenumberRnnlmExample()) and outputs 'active_words' and, if we have
+  /// sparse word features, 'active_word_features' and
+  /// 'active_word_features_trans' (see the members of the same names);
+  /// and it outputs 'derived' (see GetRnnlmExampleDerived()).
+  void PrepareMinibatch(RnnlmExample *minibatch,
+                        RnnlmExampleDerived *derived,
+                        CuArray<int32> *active_words,
+                        CuSparseMatrix<BaseFloat> *active_word_features,
+                        CuSparseMatrix<BaseFloat> *active_word_features_trans);
+
+  /// This function works out the word-embedding matrix for the minibatch
+  /// 'minibatch' (with 'active_words' and 'active_word_features' as output by
+  /// PrepareMinibatch()).  The word-embedding matrix for this
+  /// minibatch is a matrix of dimension minibatch.vocab_size by
   /// embedding_mat_.NumRows().  This function sets '*word_embedding' to be a
   /// pointer to the embedding matrix, which will either be '&embedding_mat_'
   /// (in the case where there is no sampling and no sparse feature
   /// representation), or 'word_embedding_storage' otherwise.  In the latter
   /// case, 'word_embedding_storage' will be resized and written to
   /// appropriately.
-  void GetWordEmbedding(CuMatrix<BaseFloat> *word_embedding_storage,
+  void GetWordEmbedding(const RnnlmExample &minibatch,
+                        const CuArray<int32> &active_words,
+                        const CuSparseMatrix<BaseFloat> &active_word_features,
+                        CuMatrix<BaseFloat> *word_embedding_storage,
                         CuMatrix<BaseFloat> **word_embedding);
 
 
@@ -125,6 +154,14 @@ class RnnlmTrainer {
       bool is_backstitch_step1,
       CuMatrixBase<BaseFloat> *word_embedding_deriv);
 
+  /// The version of TrainWordEmbedding() for TrainParallelInternal():
+  /// 'word_embedding_derivs' are the derivatives for the minibatches in
+  /// pending_minibatches_, which are merged (for the union of their active
+  /// words, if we use sampling) so that the embedding is updated once.  The
+  /// derivatives are consumed destructively.
+  void TrainWordEmbeddingParallel(
+      std::vector<CuMatrix<BaseFloat> > *word_embedding_derivs);
+
   bool train_embedding_;  // true if we are training the embedding.
   const RnnlmCoreTrainerOptions &core_config_;
   const RnnlmEmbeddingTrainerOptions &embedding_config_;
@@ -185,6 +222,21 @@ class RnnlmTrainer {
   // when the class is initialized.
   int32 srand_seed_;
 
+  // The number of minibatches we train on in parallel (see the constructor).
+  int32 num_threads_;
+
+  // A minibatch with the quantities derived from it by PrepareMinibatch().
+  struct PreparedMinibatch {
+    RnnlmExample minibatch;
+    RnnlmExampleDerived derived;
+    CuArray<int32> active_words;
+    CuSparseMatrix<BaseFloat> active_word_features;
+    CuSparseMatrix<BaseFloat> active_word_features_trans;
+  };
+  // If num_threads_ > 1, the minibatches that we have been given but have
+  // not trained on yet (fewer than num_threads_ of them).
+  std::vector<PreparedMinibatch*> pending_minibatches_;
+
   KALDI_DISALLOW_COPY_AND_ASSIGN(RnnlmTrainer);
 };
 
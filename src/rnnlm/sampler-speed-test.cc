@@ -0,0 +1,167 @@
+// rnnlm/sampler-speed-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <map>
+#include "rnnlm/sampler.h"
+#include "rnnlm/sampling-lm.h"
+#include "rnnlm/sampling-lm-estimate.h"
+#include "base/timer.h"
+
+namespace kaldi {
+namespace rnnlm {
+
+static void CsvResult(std::string test, int dim, BaseFloat measure,
+                      std::string units) {
+  std::cout << test << "," << dim << "," << measure << "," << units << "\n";
+}
+
+// Generates sentences over words 4 ... vocab_size - 1 with a Zipfian unigram
+// distribution and some bigram structure, so that the estimated LM has
+// history-states with large numbers of words, as real LMs do.
+static void GetTestSentences(int32 vocab_size, int32 num_sentences,
+                             std::vector<std::vector<int32> > *sentences) {
+  int32 num_words = vocab_size - 4;
+  std::vector<double> cdf(num_words);
+  double sum = 0.0;
+  for (int32 i = 0; i < num_words; i++) {
+    sum += 1.0 / (i + 1);
+    cdf[i] = sum;
+  }
+  sentences->resize(num_sentences);
+  for (int32 n = 0; n < num_sentences; n++) {
+    int32 length = RandInt(5, 30), prev_word = 0;
+    for (int32 t = 0; t < length; t++) {
+      int32 word = std::upper_bound(cdf.begin(), cdf.end(),
+                                    RandUniform() * sum) - cdf.begin();
+      word = std::min(word, num_words - 1);
+      if (RandInt(0, 1) == 0)
+        word = (7 * word + 13 * prev_word) % num_words;
+      prev_word = word;
+      (*sentences)[n].push_back(word + 4);
+    }
+  }
+}
+
+// Gets the distribution for each group of histories and samples from it, as
+// done in RnnlmExampleSampler::SampleForGroup(), using a hash table and sorted
+// vectors if 'accumulator' is NULL, or else 'accumulator'.  Returns the number
+// of words sampled.
+static int64 SampleGroups(
+    const SamplingLm &lm, const Sampler &sampler, int32 num_samples,
+    const std::vector<SamplingLm::WeightedHistType> &histories,
+    const std::vector<std::vector<int32> > &words_we_must_sample,
+    DistributionAccumulator *accumulator) {
+  int64 num_sampled = 0;
+  for (size_t g = 0; g < histories.size(); g++) {
+    std::vector<std::pair<int32, BaseFloat> > sample;
+    if (accumulator == NULL) {
+      std::vector<std::pair<int32, BaseFloat> > higher_order_probs;
+      BaseFloat unigram_weight = lm.GetDistribution(histories[g],
+                                                    &higher_order_probs);
+      sampler.SampleWords(num_samples, unigram_weight, higher_order_probs,
+                          words_we_must_sample[g], &sample);
+    } else {
+      BaseFloat unigram_weight = lm.GetDistribution(histories[g],
+                                                    accumulator);
+      sampler.SampleWords(num_samples, unigram_weight,
+                          words_we_must_sample[g], accumulator, &sample);
+    }
+    num_sampled += sample.size();
+  }
+  return num_sampled;
+}
+
+// Compares the speed of the two ways of sampling in SampleGroups().
+static void UnitTestSamplerSpeed(int32 vocab_size) {
+  int32 num_sentences = 50000, num_groups = 200,
+      num_histories_per_group = 256, num_samples = 512;
+  std::vector<std::vector<int32> > sentences;
+  GetTestSentences(vocab_size, num_sentences, &sentences);
+
+  SamplingLmEstimatorOptions lm_opts;
+  lm_opts.vocab_size = vocab_size;
+  lm_opts.brk_symbol = 3;
+  SamplingLmEstimator estimator(lm_opts);
+  for (int32 n = 0; n < num_sentences; n++)
+    estimator.ProcessLine(1.0, sentences[n]);
+  estimator.Estimate(false);
+  SamplingLm lm(estimator);
+
+  std::vector<BaseFloat> unigram_probs(lm.GetUnigramDistribution());
+  double total = 0.0;
+  for (int32 i = 0; i < vocab_size; i++) {
+    unigram_probs[i] += 1.0e-06;
+    total += unigram_probs[i];
+  }
+  for (int32 i = 0; i < vocab_size; i++)
+    unigram_probs[i] /= total;
+  Sampler sampler(unigram_probs);
+
+  // Each group has the trigram histories and the words that follow them, at
+  // random positions in the sentences.
+  std::vector<SamplingLm::WeightedHistType> histories(num_groups);
+  std::vector<std::vector<int32> > words_we_must_sample(num_groups);
+  for (int32 g = 0; g < num_groups; g++) {
+    std::map<std::vector<int32>, BaseFloat> hist_to_weight;
+    for (int32 h = 0; h < num_histories_per_group; h++) {
+      const std::vector<int32> &sentence =
+          sentences[RandInt(0, num_sentences - 1)];
+      int32 t = RandInt(2, sentence.size() - 1);
+      std::vector<int32> history(sentence.begin() + t - 2,
+                                 sentence.begin() + t);
+      hist_to_weight[history] += 1.0;
+      words_we_must_sample[g].push_back(sentence[t]);
+    }
+    histories[g].assign(hist_to_weight.begin(), hist_to_weight.end());
+    SortAndUniq(&(words_we_must_sample[g]));
+  }
+
+  DistributionAccumulator accumulator(vocab_size);
+  // The first pass over the groups is a warm-up, so that neither version
+  // pays for the cold caches.
+  SampleGroups(lm, sampler, num_samples, histories, words_we_must_sample,
+               NULL);
+  Timer timer;
+  int64 num_sampled = SampleGroups(lm, sampler, num_samples, histories,
+                                   words_we_must_sample, NULL);
+  double hash_time = timer.Elapsed();
+  timer.Reset();
+  num_sampled -= SampleGroups(lm, sampler, num_samples, histories,
+                              words_we_must_sample, &accumulator);
+  double accumulator_time = timer.Elapsed();
+  KALDI_ASSERT(num_sampled == 0);
+
+  int64 num_samples_total = static_cast<int64>(num_groups) * num_samples;
+  CsvResult("sample-words-hash", vocab_size, num_samples_total / hash_time,
+            "samples/s");
+  CsvResult("sample-words-accumulator", vocab_size,
+            num_samples_total / accumulator_time, "samples/s");
+}
+
+
+}  // namespace rnnlm
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::rnnlm;
+  for (int32 vocab_size = 10000; vocab_size <= 160000; vocab_size *= 4)
+    UnitTestSamplerSpeed(vocab_size);
+  KALDI_LOG << "Sampler speed tests finished.";
+  return 0;
+}
@@ -246,15 +246,33 @@ void UnitTestSampleWords() {
                    &full_distribution);
 
     Sampler sampler(unigram_probs);
+    // if true, test the version of SampleWords() that takes a
+    // DistributionAccumulator.
+    bool use_accumulator = (RandInt(0, 1) == 0);
+    DistributionAccumulator accumulator(vocab_size);
     std::vector<double> sample_total(vocab_size);
     size_t l = 0;
     while (true) {
       // this will loop forever if the normalized samples don't approach
       // 'full_distribution' closely enough.
       std::vector<std::pair<int32, BaseFloat> > sample;
-      sampler.SampleWords(num_words_to_sample, unigram_weight,
-                          higher_order_probs, words_we_must_sample,
-                          &sample);
+      if (use_accumulator) {
+        // add the sparse probabilities in two pieces, to test the summing.
+        for (int32 i = 0; i < num_sparse; i++) {
+          accumulator.Add(higher_order_probs[i].first,
+                          0.25 * higher_order_probs[i].second);
+          accumulator.Add(higher_order_probs[i].first,
+                          0.75 * higher_order_probs[i].second);
+        }
+        sampler.SampleWords(num_words_to_sample, unigram_weight,
+                            words_we_must_sample, &accumulator,
+                            &sample);
+        KALDI_ASSERT(accumulator.Total() == 0.0);
+      } else {
+        sampler.SampleWords(num_words_to_sample, unigram_weight,
+                            higher_order_probs, words_we_must_sample,
+                            &sample);
+      }
 
       KALDI_ASSERT(sample.size() == size_t(num_words_to_sample));
       std::sort(sample.begin(), sample.end());
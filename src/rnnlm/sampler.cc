@@ -194,6 +194,56 @@ void MergeDistributions(const Distribution &d1,
 }
 
 
+void DistributionAccumulator::Output(Distribution *d) {
+  std::sort(elements_.begin(), elements_.end());
+  d->clear();
+  d->reserve(elements_.size());
+  std::vector<int32>::const_iterator iter = elements_.begin(),
+      end = elements_.end();
+  for (; iter != end; ++iter) {
+    int32 i = *iter;
+    if (probs_[i] != 0.0)
+      d->push_back(std::pair<int32, BaseFloat>(i, probs_[i]));
+    probs_[i] = 0.0;
+    seen_[i] = false;
+  }
+  elements_.clear();
+  total_ = 0.0;
+}
+
+
+void Sampler::SampleWords(
+    int32 num_words_to_sample,
+    BaseFloat unigram_weight,
+    const std::vector<int32> &words_we_must_sample,
+    DistributionAccumulator *higher_order_probs,
+    std::vector<std::pair<int32, BaseFloat> > *sample) const {
+  int32 vocab_size = unigram_cdf_.size() - 1;
+  KALDI_ASSERT(higher_order_probs->Dim() == vocab_size &&
+               IsSortedAndUniq(words_we_must_sample) &&
+               num_words_to_sample > 0 && num_words_to_sample < vocab_size);
+  int32 num_words_we_must_sample = words_we_must_sample.size();
+  if (num_words_we_must_sample > 0) {
+    KALDI_ASSERT(num_words_we_must_sample < num_words_to_sample);
+    KALDI_ASSERT(words_we_must_sample.front() >= 0 &&
+                 words_we_must_sample.back() < vocab_size);
+  }
+  // See the other version of SampleWords() for an explanation of 'p'.
+  BaseFloat total_existing_weight = unigram_weight +
+      higher_order_probs->Total();
+  BaseFloat p = 1.1 * total_existing_weight /
+      (num_words_to_sample - num_words_we_must_sample);
+  for (int32 i = 0 ; i < num_words_we_must_sample; i++)
+    higher_order_probs->Add(words_we_must_sample[i], p);
+
+  std::vector<std::pair<int32, BaseFloat> > merged_distribution;
+  higher_order_probs->Output(&merged_distribution);
+  SampleWords(num_words_to_sample, unigram_weight,
+              merged_distribution,
+              sample);
+}
+
+
 void Sampler::SampleWords(
     int32 num_words_to_sample,
     BaseFloat unigram_weight,
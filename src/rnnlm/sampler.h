@@ -77,6 +77,9 @@ const double* SampleFromCdf(const double *cdf_start,
                             const double *cdf_end);
 
 
+class DistributionAccumulator;
+
+
 /**
    This class allows us to sample a set of words from a distribution over
    words, where the distribution (which ultimately comes from an ARPA-style
@@ -152,6 +155,19 @@ class Sampler {
                    const std::vector<int32> &words_we_must_sample,
                    std::vector<std::pair<int32, BaseFloat> > *sample) const;
 
+  /// This version of SampleWords() is as the one above, except that the
+  /// higher-order part of the distribution is supplied as the contents of
+  /// 'higher_order_probs' (whose dimension must equal unigram_probs.size()),
+  /// to which we add the words we must sample directly.  At exit,
+  /// 'higher_order_probs' will have been cleared so it can be reused.  This
+  /// avoids the cost of merging sorted vectors, which is significant for large
+  /// vocabularies.
+  void SampleWords(int32 num_words_to_sample,
+                   BaseFloat unigram_weight,
+                   const std::vector<int32> &words_we_must_sample,
+                   DistributionAccumulator *higher_order_probs,
+                   std::vector<std::pair<int32, BaseFloat> > *sample) const;
+
 
  private:
 
@@ -267,6 +283,52 @@ void MergeDistributions(const Distribution &d1,
                         Distribution *d);
 
 
+/**
+   This class accumulates a Distribution that is a weighted sum of many sparse
+   distributions (e.g. the distributions of the history-states of an n-gram
+   model), in a dense vector indexed by word.  Accumulating this way is much
+   faster than using a hash table or merging sorted vectors when the sum has
+   a large support.  The dense vector is cleared by Output(), so an object of
+   this type can be reused cheaply, e.g. for all the sampling groups of a
+   minibatch.
+ */
+class DistributionAccumulator {
+ public:
+  /// 'dim' is the dimension of the space, e.g. the vocabulary size; all
+  /// indexes supplied to Add() must be in the range [0, dim).
+  explicit DistributionAccumulator(int32 dim):
+      probs_(dim, 0.0), seen_(dim, false), total_(0.0) { }
+
+  /// Adds 'prob' to the probability of element 'i'.
+  inline void Add(int32 i, BaseFloat prob) {
+    KALDI_PARANOID_ASSERT(static_cast<size_t>(i) < probs_.size());
+    if (!seen_[i]) {
+      seen_[i] = true;
+      elements_.push_back(i);
+    }
+    probs_[i] += prob;
+    total_ += prob;
+  }
+
+  /// Returns the sum of the probabilities added so far.
+  double Total() const { return total_; }
+
+  int32 Dim() const { return probs_.size(); }
+
+  /// Outputs the accumulated distribution to 'd', sorted on the int32 and
+  /// without zero elements (like MergeDistributions()), and clears this
+  /// object.
+  void Output(Distribution *d);
+
+ private:
+  std::vector<BaseFloat> probs_;
+  std::vector<bool> seen_;
+  // The elements that have had something added to them.
+  std::vector<int32> elements_;
+  double total_;
+};
+
+
 
 
 
@@ -120,6 +120,22 @@ void SamplingLmTest::TestGetDistribution(const WeightedHistType &histories) {
   // assert unigram weight plus total non_unigram probs equals
   // the total input histories' weights
   KALDI_ASSERT(ApproxEqual(unigram_weight + non_unigram_probsum, total_weights));
+
+  // Check that the version of GetDistribution() that uses a
+  // DistributionAccumulator gives the same distribution.  We call it twice to
+  // check that the accumulator is cleared properly.
+  DistributionAccumulator accumulator(arpa_->VocabSize());
+  for (int32 i = 0; i < 2; i++) {
+    std::vector<std::pair<int32, BaseFloat> > pdf2;
+    BaseFloat unigram_weight2 = arpa_->GetDistribution(histories,
+                                                       &accumulator);
+    accumulator.Output(&pdf2);
+    KALDI_ASSERT(ApproxEqual(unigram_weight, unigram_weight2) &&
+                 pdf2.size() == pdf.size());
+    for (size_t j = 0; j < pdf.size(); j++)
+      KALDI_ASSERT(pdf2[j].first == pdf[j].first &&
+                   ApproxEqual(pdf2[j].second, pdf[j].second));
+  }
 }
 
 }  // namespace rnnlm
@@ -291,6 +291,50 @@ BaseFloat SamplingLm::GetDistribution(
   return total_unigram_weight;
 }
 
+BaseFloat SamplingLm::GetDistribution(
+    const WeightedHistType &histories,
+    DistributionAccumulator *non_unigram_probs) const {
+  KALDI_ASSERT(non_unigram_probs->Dim() == VocabSize());
+  WeightedHistType histories_closure;
+  BaseFloat total_weight, total_unigram_weight;
+  AddBackoffToHistoryStates(histories, &histories_closure,
+                            &total_weight, &total_unigram_weight);
+  double initial_total = non_unigram_probs->Total();
+  WeightedHistType::const_iterator iter = histories_closure.begin(),
+      end = histories_closure.end();
+  for (; iter != end; ++iter) {
+    const HistType &history = iter->first;
+    BaseFloat hist_weight = iter->second;
+    int32 order = history.size() + 1;
+    KALDI_ASSERT(order > 1);  // unigram history is not included at this point.
+    std::unordered_map<HistType, HistoryState,
+        VectorHasher<int32> >::const_iterator it_hist =
+           higher_order_probs_[order - 2].find(history);
+    KALDI_ASSERT(it_hist != higher_order_probs_[order - 2].end());
+    std::vector<std::pair<int32, BaseFloat> >::const_iterator
+        word_iter = it_hist->second.words_and_probs.begin(),
+        word_end = it_hist->second.words_and_probs.end();
+    for (; word_iter != word_end; ++word_iter)
+      non_unigram_probs->Add(word_iter->first,
+                             word_iter->second * hist_weight);
+  }
+  // See the other version of GetDistribution() for an explanation of this
+  // check.
+  double total_weight_check = total_unigram_weight +
+      non_unigram_probs->Total() - initial_total;
+  if (fabs(total_weight - total_weight_check) >
+      0.01 * total_weight) {
+    static int32 num_times_warned = 0;
+    if (num_times_warned < 10) {
+      KALDI_WARN << "Total weight does not have expected value (problem in "
+          "your ARPA file, or this code).  Won't warn >10 times.";
+      num_times_warned++;
+    }
+  }
+  KALDI_ASSERT(total_unigram_weight > 0.0);
+  return total_unigram_weight;
+}
+
 SamplingLm::SamplingLm(const SamplingLmEstimator &estimator):
     ArpaFileParser(ArpaParseOptions(), NULL),
     unigram_probs_(estimator.unigram_probs_),
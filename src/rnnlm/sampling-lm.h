@@ -25,6 +25,7 @@
 #include "util/common-utils.h"
 #include "lm/arpa-file-parser.h"
 #include "rnnlm/sampling-lm-estimate.h"
+#include "rnnlm/sampler.h"
 
 namespace kaldi {
 namespace rnnlm {
@@ -111,6 +112,14 @@ class SamplingLm : public ArpaFileParser {
   BaseFloat GetDistribution(const WeightedHistType &histories,
             std::vector<std::pair<int32, BaseFloat> > *non_unigram_probs) const;
 
+  // This is a faster interface to GetDistribution() which adds the
+  // higher-than-unigram probabilities to 'non_unigram_probs', whose dimension
+  // must be VocabSize().  Use this when you need to get distributions
+  // repeatedly, e.g. for all the sampling groups of a minibatch, reusing the
+  // same accumulator; see Sampler::SampleWords() for how to sample from it.
+  BaseFloat GetDistribution(const WeightedHistType &histories,
+                            DistributionAccumulator *non_unigram_probs) const;
+
   // Return the n-gram order, e.g. 1 for a unigram LM, 2 for a bigram.
   int32 Order() const { return higher_order_probs_.size() + 1; }
 
@@ -63,6 +63,7 @@ int main(int argc, char *argv[]) {
 
 
     std::string use_gpu = "yes";
+    int32 num_threads = 1;
 
     ParseOptions po(usage);
     po.Register("use-gpu", &use_gpu,
@@ -90,6 +91,12 @@ int main(int argc, char *argv[]) {
                 "will be interpreted as a feature-embedding matrix.");
     po.Register("binary", &binary,
                 "If true, write outputs in binary form.");
+    po.Register("num-threads", &num_threads,
+                "Number of threads for training on CPU; each thread processes "
+                "a different minibatch and their parameter changes are "
+                "summed, so the effective minibatch size is multiplied by "
+                "this.  Requires --use-gpu=no, and is not compatible with "
+                "backstitch training or dropout.");
 
 
     objective_config.Register(&po);
@@ -163,7 +170,7 @@ int main(int argc, char *argv[]) {
       RnnlmTrainer trainer(
           train_embedding, core_config, embedding_config, objective_config,
           (word_features_rxfilename != "" ? &word_feature_mat : NULL),
-          &embedding_mat, &rnnlm);
+          &embedding_mat, &rnnlm, num_threads);
 
       SequentialRnnlmExampleReader example_reader(examples_rspecifier);
 